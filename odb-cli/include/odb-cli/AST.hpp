@@ -11,14 +11,17 @@ struct ast;
 int initAST(void);
 void deinitAST(void);
 
+bool setLexer(const std::vector<std::string>& args);
 bool parse_dba(const std::vector<std::string>& args);
 bool run_semantic_checks(const std::vector<std::string>& args);
+bool print_semantic_passes(const std::vector<std::string>& args);
 bool dump_ast_pre_semantic(const std::vector<std::string>& args);
 bool dump_ast_post_semantic(const std::vector<std::string>& args);
 
-struct ast* getAST();
-const char* getSourceFilepath();
-const char* getSource();
+int         getTUCount();
+struct ast* getAST(int tu_id = 0);
+const char* getSourceFilepath(int tu_id = 0);
+const char* getSource(int tu_id = 0);
 
 ActionHandler parseDBPro(const std::vector<std::string>& args);
 ActionHandler autoDetectInput(const std::vector<std::string>& args);
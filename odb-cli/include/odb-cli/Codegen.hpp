@@ -13,6 +13,7 @@ bool output(const std::vector<std::string>& args);
 bool dumpIR(const std::vector<std::string>& args);
 bool exec_output(const std::vector<std::string>& args);
 bool set_optimization_level(const std::vector<std::string>& args);
+bool set_time_passes(const std::vector<std::string>& args);
 
 enum target_arch getTargetArch(void);
 enum target_platform getTargetPlatform(void);
@@ -7,11 +7,13 @@ extern "C" {
 #include "odb-compiler/parser/db_parser.h"
 #include "odb-compiler/semantic/post.h"
 #include "odb-compiler/semantic/semantic.h"
+#include "odb-compiler/semantic/session.h"
 #include "odb-compiler/semantic/symbol_table.h"
 #include "odb-util/log.h"
 #include "odb-util/mem.h"
 #include "odb-util/mutex.h"
 #include "odb-util/thread.h"
+#include "odb-util/time.h"
 #include "odb-util/utf8.h"
 }
 
@@ -27,22 +29,38 @@ VEC_DEFINE_API(ast_mutexes, struct mutex*, 32)
 
 struct ctx
 {
-    struct filenames*    filenames;
-    struct sources*      sources;
-    struct tus*          tus;
-    struct ast_mutexes*  ast_mutexes;
-    struct symbol_table* symbol_table;
+    struct filenames*        filenames;
+    struct sources*          sources;
+    struct tus*              tus;
+    struct ast_mutexes*      ast_mutexes;
+    struct symbol_table*     symbol_table;
+    struct semantic_session* session;
+    /* Set while semantic checks run on TUs as they are parsed. The ASTs are
+     * owned by the semantic check threads until it's finished */
+    struct semantic_sched*   sched;
 };
 
 struct worker
 {
-    struct thread* thread;
-    struct mutex*  mutex;
-    struct ctx*    ctx;
-    int            id;
+    struct thread*       thread;
+    struct ctx*          ctx;
+    /* Declarations of the TUs parsed by this worker. Merged into the shared
+     * symbol table once all workers are done, so they don't contend on it */
+    struct symbol_table* symbol_table;
+    int                  id;
+    int                  count;
 };
 
-static struct ctx ctx;
+static struct ctx            ctx;
+static enum db_lexer_backend lexer_backend = DB_LEXER_FLEX;
+
+/* Dumping the AST before semantic checks means the checks can't start until
+ * all TUs are parsed */
+static bool                     dump_pre_semantic = false;
+static std::vector<std::string> dump_pre_semantic_args;
+
+static bool
+dump_ast(const std::vector<std::string>& args);
 
 static void
 close_tus(struct ctx* ctx)
@@ -214,13 +232,14 @@ static void*
 parse_worker(void* arg)
 {
     int               tu_id, parse_result;
+    uint64_t          start_us;
     struct db_parser  parser;
     struct db_source* source;
     struct worker*    worker = (struct worker*)arg;
 
     if (mem_init() != 0)
         goto init_mem_failed;
-    if (db_parser_init(&parser) != 0)
+    if (db_parser_init(&parser, lexer_backend) != 0)
         goto init_parser_failed;
 
     vec_enumerate(worker->ctx->sources, tu_id, source)
@@ -228,12 +247,13 @@ parse_worker(void* arg)
         struct utf8* filename = vec_get(worker->ctx->filenames, tu_id);
         struct ast** astp = vec_get(worker->ctx->tus, tu_id);
 
-        if (tu_id % sources_count(worker->ctx->sources) != worker->id)
+        if (tu_id % worker->count != worker->id)
             continue;
 
         log_parser_info(
             "Parsing source file: {emph:%s}\n",
             filename->len ? utf8_cstr(*filename) : "<stdin>");
+        start_us = time_get_us();
         mem_acquire_ast(*astp);
         parse_result = db_parse(
             &parser,
@@ -243,25 +263,55 @@ parse_worker(void* arg)
             getCommandList());
         mem_release_ast(*astp);
         if (parse_result != 0)
+        {
+            if (worker->ctx->sched != NULL)
+                semantic_sched_tu_failed(worker->ctx->sched, tu_id);
             goto parse_failed;
+        }
+
+        log_parser_info(
+            "Scanned %d tokens, %d command probes ({emph:%.2f} per token)\n",
+            parser.stats.tokens,
+            parser.stats.cmd_probes,
+            parser.stats.tokens
+                ? (double)parser.stats.cmd_probes / parser.stats.tokens
+                : 0.0);
+        log_parser_info(
+            "Took %d trie transitions for %d bytes ({emph:%.2f} per byte)\n",
+            parser.stats.transitions,
+            parser.stats.bytes,
+            parser.stats.bytes
+                ? (double)parser.stats.transitions / parser.stats.bytes
+                : 0.0);
+
+        /* The scheduler adds the declarations to the session itself */
+        if (worker->ctx->sched == NULL)
+            symbol_table_add_declarations_from_ast(
+                &worker->symbol_table,
+                worker->ctx->tus->data,
+                tu_id,
+                worker->ctx->sources->data);
 
-        mutex_lock(worker->mutex);
-        mem_acquire_symbol_table(worker->ctx->symbol_table);
-        symbol_table_add_declarations_from_ast(
-            &worker->ctx->symbol_table,
-            worker->ctx->tus->data,
-            tu_id,
-            worker->ctx->sources->data);
-        mem_release_symbol_table(worker->ctx->symbol_table);
-        mutex_unlock(worker->mutex);
+        log_parser_info(
+            "Parsed {emph:%s} in %.3f ms\n",
+            filename->len ? utf8_cstr(*filename) : "<stdin>",
+            (double)(time_get_us() - start_us) / 1000.0);
+
+        /* Checks can start on this TU right away. The ones that look up
+         * symbols wait for the TUs that declare them */
+        if (worker->ctx->sched != NULL)
+            semantic_sched_tu_ready(worker->ctx->sched, tu_id);
     }
 
+    /* The table is handed over to the main thread */
+    mem_release_symbol_table(worker->symbol_table);
     db_parser_deinit(&parser);
     mem_deinit();
 
     return NULL;
 
 parse_failed:
+    mem_release_symbol_table(worker->symbol_table);
     db_parser_deinit(&parser);
 init_parser_failed:
     mem_deinit();
@@ -269,53 +319,6 @@ init_mem_failed:
     return (void*)1;
 }
 
-static void*
-semantic_worker(void* arg)
-{
-    int               tu_id, result;
-    struct db_source* source;
-    struct worker*    worker = (struct worker*)arg;
-
-    if (mem_init() != 0)
-        goto init_mem_failed;
-
-    vec_enumerate(worker->ctx->sources, tu_id, source)
-    {
-        struct utf8* filename = vec_get(worker->ctx->filenames, tu_id);
-        struct ast** astp = vec_get(worker->ctx->tus, tu_id);
-
-        if (tu_id % sources_count(worker->ctx->sources) != worker->id)
-            continue;
-
-        log_parser_info(
-            "Running semantic checks: {emph:%s}\n",
-            filename->len ? utf8_cstr(*filename) : "<stdin>");
-        mem_acquire_ast(*astp);
-        result = semantic_run_essential_checks(
-            worker->ctx->tus->data,
-            sources_count(worker->ctx->sources),
-            tu_id,
-            worker->ctx->ast_mutexes->data,
-            worker->ctx->filenames->data,
-            worker->ctx->sources->data,
-            getPluginList(),
-            getCommandList(),
-            worker->ctx->symbol_table);
-        mem_release_ast(*astp);
-
-        if (result != 0)
-            goto check_failed;
-    }
-
-    mem_deinit();
-    return NULL;
-
-check_failed:
-    mem_deinit();
-init_mem_failed:
-    return (void*)1;
-}
-
 // Public ---------------------------------------------------------------------
 int
 initAST(void)
@@ -325,12 +328,29 @@ initAST(void)
     tus_init(&ctx.tus);
     ast_mutexes_init(&ctx.ast_mutexes);
     symbol_table_init(&ctx.symbol_table);
+    ctx.session = semantic_session_create();
+    if (ctx.session == NULL)
+        return -1;
+    ctx.sched = NULL;
 
     return 0;
 }
 void
 deinitAST(void)
 {
+    struct ast** astp;
+
+    if (ctx.sched != NULL)
+    {
+        semantic_sched_finish(ctx.sched);
+        ctx.sched = NULL;
+        vec_for_each(ctx.tus, astp)
+        {
+            mem_acquire_ast(*astp);
+        }
+    }
+
+    semantic_session_destroy(ctx.session);
     symbol_table_deinit(ctx.symbol_table);
     close_tus(&ctx);
     ast_mutexes_deinit(ctx.ast_mutexes);
@@ -339,6 +359,26 @@ deinitAST(void)
     filenames_deinit(ctx.filenames);
 }
 
+static int
+merge_symbol_tables(std::vector<worker>* workers)
+{
+    int result = 0;
+    for (int i = 0; i != (int)workers->size(); ++i)
+    {
+        struct worker& worker = workers->at(i);
+        mem_acquire_symbol_table(worker.symbol_table);
+        if (result == 0
+            && symbol_table_merge(&ctx.symbol_table, worker.symbol_table) != 0)
+        {
+            result = -1;
+        }
+        symbol_table_deinit(worker.symbol_table);
+        symbol_table_init(&worker.symbol_table);
+    }
+
+    return result;
+}
+
 static int
 execute_parse_workers(std::vector<worker>* workers)
 {
@@ -349,7 +389,6 @@ execute_parse_workers(std::vector<worker>* workers)
     {
         mem_release_ast(*astp);
     }
-    mem_release_symbol_table(ctx.symbol_table);
 
     for (worker_id = 0; worker_id != (int)workers->size(); ++worker_id)
     {
@@ -365,13 +404,13 @@ execute_parse_workers(std::vector<worker>* workers)
             goto parse_thread_failed;
     }
 
-    vec_for_each(ctx.tus, astp)
-    {
-        mem_acquire_ast(*astp);
-    }
-    mem_acquire_symbol_table(ctx.symbol_table);
+    if (ctx.sched == NULL)
+        vec_for_each(ctx.tus, astp)
+        {
+            mem_acquire_ast(*astp);
+        }
 
-    return 0;
+    return merge_symbol_tables(workers);
 
 parse_thread_failed:
     --worker_id;
@@ -381,59 +420,81 @@ start_parse_thread_failed:
         struct worker& worker = workers->at(worker_id);
         thread_join(worker.thread);
     }
-    vec_for_each(ctx.tus, astp)
-    {
-        mem_acquire_ast(*astp);
-    }
-    mem_acquire_symbol_table(ctx.symbol_table);
+    if (ctx.sched == NULL)
+        vec_for_each(ctx.tus, astp)
+        {
+            mem_acquire_ast(*astp);
+        }
+    merge_symbol_tables(workers);
     return -1;
 }
 
 static int
-execute_semantic_workers(std::vector<worker>* workers)
+execute_semantic_checks(void)
 {
-    int          worker_id;
+    int          tu_id, result;
     struct ast** astp;
 
-    vec_for_each(ctx.tus, astp)
+    /* The checks were started while parsing */
+    if (ctx.sched != NULL)
     {
-        mem_release_ast(*astp);
+        result = semantic_sched_finish(ctx.sched);
+        ctx.sched = NULL;
+        vec_for_each(ctx.tus, astp)
+        {
+            mem_acquire_ast(*astp);
+        }
+        return result;
     }
 
-    for (worker_id = 0; worker_id != (int)workers->size(); ++worker_id)
+    vec_for_each(ctx.tus, astp)
     {
-        struct worker& worker = workers->at(worker_id);
-        worker.thread = thread_start(semantic_worker, &worker);
-        if (worker.thread == NULL)
-            goto start_semantic_thread_failed;
+        mem_release_ast(*astp);
     }
-    for (--worker_id; worker_id >= 0; --worker_id)
+
+    for (tu_id = 0; tu_id != sources_count(ctx.sources); ++tu_id)
     {
-        struct worker& worker = workers->at(worker_id);
-        if (thread_join(worker.thread) != NULL)
-            goto semantic_thread_failed;
+        struct utf8* filename = vec_get(ctx.filenames, tu_id);
+        log_parser_info(
+            "Running semantic checks: {emph:%s}\n",
+            filename->len ? utf8_cstr(*filename) : "<stdin>");
     }
 
+    /* Checks of all TUs are scheduled together, so that checks that don't
+     * depend on each other can run at the same time */
+    result = semantic_run_essential_checks_parallel(
+        ctx.tus->data,
+        sources_count(ctx.sources),
+        ctx.ast_mutexes->data,
+        ctx.filenames->data,
+        ctx.sources->data,
+        getPluginList(),
+        getCommandList(),
+        ctx.symbol_table,
+        ctx.session);
+
     vec_for_each(ctx.tus, astp)
     {
         mem_acquire_ast(*astp);
     }
 
-    return 0;
+    return result;
+}
 
-semantic_thread_failed:
-    --worker_id;
-start_semantic_thread_failed:
-    while (worker_id-- > 0)
-    {
-        struct worker& worker = workers->at(worker_id);
-        thread_join(worker.thread);
-    }
-    vec_for_each(ctx.tus, astp)
+bool
+setLexer(const std::vector<std::string>& args)
+{
+    if (args[0] == "flex")
+        lexer_backend = DB_LEXER_FLEX;
+    else if (args[0] == "fast")
+        lexer_backend = DB_LEXER_FAST;
+    else
     {
-        mem_acquire_ast(*astp);
+        log_parser_err("Unknown lexer {quote:%s}\n", args[0].c_str());
+        return false;
     }
-    return -1;
+
+    return true;
 }
 
 bool
@@ -442,12 +503,8 @@ parse_dba(const std::vector<std::string>& args)
     const int           max_workers = 32;
     std::vector<worker> workers;
     int                 worker_id;
+    uint64_t            start_us = time_get_us();
     struct ast**        astp;
-    struct mutex*       mutex;
-
-    mutex = mutex_create();
-    if (mutex == NULL)
-        goto create_mutex_failed;
 
     /* If there are no source files, we default to reading stdin */
     if (args.size() == 0)
@@ -465,70 +522,90 @@ parse_dba(const std::vector<std::string>& args)
     {
         struct worker& worker = workers[i];
         worker.id = i;
+        worker.count = (int)workers.size();
         worker.ctx = &ctx;
-        worker.mutex = mutex;
+        symbol_table_init(&worker.symbol_table);
+    }
+
+    /* Semantic checks run on each TU as soon as it's parsed. They are finished
+     * by run_semantic_checks() */
+    if (!dump_pre_semantic)
+    {
+        ctx.sched = semantic_sched_start_essential_checks(
+            ctx.tus->data,
+            sources_count(ctx.sources),
+            ctx.ast_mutexes->data,
+            ctx.filenames->data,
+            ctx.sources->data,
+            getPluginList(),
+            getCommandList(),
+            ctx.session);
+        if (ctx.sched == NULL)
+            goto start_semantic_failed;
     }
 
     if (execute_parse_workers(&workers) != 0)
         goto parse_failed;
 
-    /* The reason for joining/splitting here is because we need to build a
-     * symbol table from all of the ASTs before it's possible to run semantic
-     * checks. The symbol table is populated in each parser worker thread */
+    log_parser_info(
+        "Parsed %d source files in {emph:%.3f} ms\n",
+        sources_count(ctx.sources),
+        (double)(time_get_us() - start_us) / 1000.0);
 
-    mutex_destroy(mutex);
+    if (ctx.sched == NULL && dump_ast(dump_pre_semantic_args) == false)
+        goto parse_failed;
 
     return true;
 
 parse_failed:
+    if (ctx.sched != NULL)
+    {
+        semantic_sched_finish(ctx.sched);
+        ctx.sched = NULL;
+        vec_for_each(ctx.tus, astp)
+        {
+            mem_acquire_ast(*astp);
+        }
+    }
+start_semantic_failed:
     close_tus(&ctx);
 open_sources_failed:
-    mutex_destroy(mutex);
-create_mutex_failed:
     return false;
 }
 
 bool
 run_semantic_checks(const std::vector<std::string>& args)
 {
-    const int           max_workers = 32;
-    std::vector<worker> workers;
-    int                 worker_id;
-    struct ast**        astp;
-    struct mutex*       mutex;
-
-    mutex = mutex_create();
-    if (mutex == NULL)
-        goto create_mutex_failed;
-
-    workers.resize(
-        sources_count(ctx.sources) < max_workers ? sources_count(ctx.sources)
-                                                 : max_workers);
-    for (int i = 0; i != (int)workers.size(); ++i)
-    {
-        struct worker& worker = workers[i];
-        worker.id = i;
-        worker.ctx = &ctx;
-        worker.mutex = mutex;
-    }
-
-    if (execute_semantic_workers(&workers) != 0)
+    if (execute_semantic_checks() != 0)
         goto semantic_failed;
 
-    mutex_destroy(mutex);
-
+    /* If the checks were started while parsing, the declarations were added to
+     * the session instead of the parser workers' tables */
     post_delete_polymorphic_functions(ctx.tus->data, tus_count(ctx.tus));
+    if (post_gc(
+            ctx.tus->data,
+            tus_count(ctx.tus),
+            dump_pre_semantic ? ctx.symbol_table
+                              : semantic_session_symbols(ctx.session))
+        != 0)
+    {
+        goto post_gc_failed;
+    }
 
     return true;
 
+post_gc_failed:
 semantic_failed:
     close_tus(&ctx);
-open_sources_failed:
-    mutex_destroy(mutex);
-create_mutex_failed:
     return false;
 }
 
+bool
+print_semantic_passes(const std::vector<std::string>& args)
+{
+    return semantic_log_essential_passes() == 0;
+}
+
 // ----------------------------------------------------------------------------
 ActionHandler
 parseDBPro(const ArgList& args)
@@ -580,7 +657,10 @@ dump_ast(const std::vector<std::string>& args)
 bool
 dump_ast_pre_semantic(const std::vector<std::string>& args)
 {
-    return dump_ast(args);
+    /* Parsing hasn't started yet. The AST is dumped by parse_dba() */
+    dump_pre_semantic = true;
+    dump_pre_semantic_args = args;
+    return true;
 }
 bool
 dump_ast_post_semantic(const std::vector<std::string>& args)
@@ -625,18 +705,23 @@ dumpASTJSON(const std::vector<std::string>& args)
 }
 
 // ----------------------------------------------------------------------------
+int
+getTUCount()
+{
+    return tus_count(ctx.tus);
+}
 struct ast*
-getAST()
+getAST(int tu_id)
 {
-    return *vec_get(ctx.tus, 0);
+    return *vec_get(ctx.tus, tu_id);
 }
 const char*
-getSourceFilepath()
+getSourceFilepath(int tu_id)
 {
-    return utf8_cstr(*vec_get(ctx.filenames, 0));
+    return utf8_cstr(*vec_get(ctx.filenames, tu_id));
 }
 const char*
-getSource()
+getSource(int tu_id)
 {
-    return vec_get(ctx.sources, 0)->text.data;
+    return vec_get(ctx.sources, tu_id)->text.data;
 }
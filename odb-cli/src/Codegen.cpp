@@ -3,15 +3,24 @@
 #include "odb-cli/Commands.hpp"
 #include "odb-cli/SDK.hpp"
 
+#include <atomic>
+#include <cctype>
+#include <set>
+#include <thread>
+
 extern "C" {
 #include "odb-compiler/codegen/ir.h"
+#include "odb-compiler/codegen/obj_cache.h"
 #include "odb-compiler/codegen/target.h"
 #include "odb-compiler/link/link.h"
 #include "odb-compiler/sdk/used_cmds.h"
 #include "odb-util/fs.h"
 #include "odb-util/log.h"
+#include "odb-util/mem.h"
+#include "odb-util/mutex.h"
 #include "odb-util/process.h"
 #include "odb-util/thread.h"
+#include "odb-util/time.h"
 }
 
 static std::string      outputExe_;
@@ -22,7 +31,10 @@ static enum target_platform platform_ = TARGET_LINUX;
 #else
 static enum target_platform platform_ = TARGET_WINDOWS;
 #endif
-static bool optimize_ = false;
+static enum ir_opt_level optLevel_ = IR_O0;
+static bool              timePasses_ = false;
+/* Objects are shared by all projects built into the same directory */
+static const int maxCachedObjects_ = 256;
 
 // ----------------------------------------------------------------------------
 bool
@@ -78,6 +90,239 @@ set_path_to_arch_platform_dir(struct ospath* path)
     return 0;
 }
 
+/* Every TU and the harness are lowered into a module of their own and
+ * compiled to an object file. A module has its own LLVMContext, so the
+ * modules can be generated in parallel */
+struct codegen_job
+{
+    std::string   module_name;
+    struct ospath objfile;
+    /* -1 for the harness */
+    int tu_id;
+    int result;
+};
+
+struct codegen_ctx
+{
+    std::vector<codegen_job>* jobs;
+    const struct cmd_ids*     used_cmds;
+    const char*               main_dba_name;
+    struct ir_session*        session;
+    /* Objects of modules that didn't change since they were last compiled */
+    struct ospath    cache_dir;
+    std::atomic<int> cache_hits;
+    std::atomic<int> cache_misses;
+    /* Keeps the IR of different modules from interleaving */
+    struct mutex*    dump_mutex;
+    std::atomic<int> next_job;
+};
+
+static int
+compile_module(
+    struct codegen_ctx* ctx, struct codegen_job* job, struct ir_module* ir)
+{
+    /* The harness only consists of glue code */
+    if (job->tu_id >= 0 && ir_optimize(ir, ctx->session, timePasses_) != 0)
+        return -1;
+
+    if (dumpIR_)
+    {
+        mutex_lock(ctx->dump_mutex);
+        ir_dump(ir);
+        mutex_unlock(ctx->dump_mutex);
+    }
+
+    return ir_compile(ir, ctx->session, ospath_cstr(job->objfile));
+}
+
+static int
+generate_module(struct codegen_ctx* ctx, struct codegen_job* job)
+{
+    int               result;
+    int               cached = 0;
+    uint64_t          start_us = time_get_us();
+    struct ir_module* ir = ir_alloc(job->module_name.c_str());
+
+    if (job->tu_id < 0)
+        result = ir_create_harness(
+            ir,
+            getPluginList(),
+            getCommandList(),
+            ctx->used_cmds,
+            ctx->main_dba_name,
+            getSDKType(),
+            arch_,
+            platform_);
+    else
+        result = ir_translate_ast(
+            ir,
+            getAST(job->tu_id),
+            getSDKType(),
+            getTargetArch(),
+            getTargetPlatform(),
+            getCommandList(),
+            getSourceFilepath(job->tu_id),
+            getSource(job->tu_id));
+
+    /* Generating the IR is cheap compared to optimizing and compiling it, so
+     * it is always generated to find out whether the module changed. The
+     * cache is bypassed if the IR is dumped, because dumping happens after
+     * optimizing */
+    if (result == 0 && !dumpIR_)
+    {
+        hash64 key = ir_hash(ir, ctx->session);
+        cached = obj_cache_load(
+            ospathc(ctx->cache_dir), key, ospathc(job->objfile));
+        if (cached > 0)
+        {
+            ctx->cache_hits++;
+            /* Otherwise, modules would silently be missing from the timings */
+            if (timePasses_)
+                log_info(
+                    "[codegen] ",
+                    "Pass timings for {emph:%s}: Skipped, object was cached\n",
+                    job->module_name.c_str());
+        }
+        else
+        {
+            ctx->cache_misses++;
+            result = compile_module(ctx, job, ir);
+            if (result == 0)
+                obj_cache_store(
+                    ospathc(ctx->cache_dir), key, ospathc(job->objfile));
+        }
+    }
+    else if (result == 0)
+        result = compile_module(ctx, job, ir);
+    ir_free(ir);
+
+    log_dbg(
+        "[codegen] ",
+        "%s {emph:%s} in %.3f ms\n",
+        cached > 0 ? "Reused" : "Compiled",
+        job->module_name.c_str(),
+        (double)(time_get_us() - start_us) / 1000.0);
+
+    return result;
+}
+
+static void*
+codegen_worker(void* arg)
+{
+    struct codegen_ctx* ctx = (struct codegen_ctx*)arg;
+    int                 job_id;
+
+    if (mem_init() != 0)
+        return (void*)-1;
+
+    while ((job_id = ctx->next_job++) < (int)ctx->jobs->size())
+    {
+        struct codegen_job* job = &ctx->jobs->at(job_id);
+        job->result = generate_module(ctx, job);
+    }
+
+    mem_deinit();
+    return NULL;
+}
+
+static int
+execute_codegen_workers(struct codegen_ctx* ctx)
+{
+    std::vector<struct thread*> workers;
+    int                         result = 0;
+    int                         worker_count
+        = (int)std::thread::hardware_concurrency();
+    uint64_t                    start_us = time_get_us();
+
+    if (worker_count > (int)ctx->jobs->size())
+        worker_count = (int)ctx->jobs->size();
+    if (worker_count < 1)
+        worker_count = 1;
+
+    ctx->dump_mutex = mutex_create();
+    if (ctx->dump_mutex == NULL)
+        return -1;
+
+    ctx->next_job = 0;
+    ctx->cache_hits = 0;
+    ctx->cache_misses = 0;
+    for (int i = 0; i != worker_count; ++i)
+    {
+        struct thread* worker = thread_start(codegen_worker, ctx);
+        if (worker == NULL)
+            break;
+        workers.push_back(worker);
+    }
+    if (workers.empty())
+    {
+        log_codegen_err("Failed to start code generator threads\n");
+        result = -1;
+    }
+    for (struct thread* worker : workers)
+        if (thread_join(worker) != NULL)
+            result = -1;
+
+    mutex_destroy(ctx->dump_mutex);
+
+    for (const struct codegen_job& job : *ctx->jobs)
+        if (job.result != 0)
+        {
+            log_codegen_err(
+                "Failed to generate {quote:%s}\n", job.module_name.c_str());
+            result = -1;
+        }
+
+    log_info(
+        "[codegen] ",
+        "Generated %d modules with %d threads in {emph:%.3f} ms\n",
+        (int)ctx->jobs->size(),
+        (int)workers.size(),
+        (double)(time_get_us() - start_us) / 1000.0);
+    log_info(
+        "[codegen] ",
+        "Object cache: %d hits, %d misses\n",
+        ctx->cache_hits.load(),
+        ctx->cache_misses.load());
+
+    return result;
+}
+
+static std::string
+module_name_from_filepath(const char* filepath)
+{
+    struct ospath name = empty_ospath();
+    ospath_set_cstr(&name, filepath);
+    ospath_filename(&name);
+    ospath_remove_ext(&name);
+    std::string module_name(ospath_cstr(name));
+    ospath_deinit(name);
+    return module_name;
+}
+
+/* Module names become part of symbol names and object file names, so files
+ * with the same name in different directories need different module names.
+ * Names are compared case-insensitively, because the object files may be
+ * written to a case-insensitive file system */
+static std::string
+unique_module_name(
+    std::set<std::string>* taken, const char* filepath, int tu_id)
+{
+    std::string name = module_name_from_filepath(filepath);
+    std::string unique = name;
+    for (int i = 0;; ++i)
+    {
+        std::string key = unique;
+        for (char& c : key)
+            c = (char)tolower((unsigned char)c);
+        if (taken->insert(key).second)
+            return unique;
+
+        unique = name + "_" + std::to_string(tu_id);
+        if (i > 0)
+            unique += "_" + std::to_string(i);
+    }
+}
+
 bool
 output(const std::vector<std::string>& args)
 {
@@ -118,65 +363,63 @@ output(const std::vector<std::string>& args)
     { /* TODO */
     }
 
-    /* Create a list of commands that were actually used, which get loaded by
-     * the harness */
+    /* Create a list of commands that were actually used in any of the TUs,
+     * which get loaded by the harness */
     struct used_cmds* used_cmds;
     used_cmds_init(&used_cmds);
-    used_cmds_append(&used_cmds, getAST());
+    for (int tu_id = 0; tu_id != getTUCount(); ++tu_id)
+        used_cmds_append(&used_cmds, getAST(tu_id));
     struct cmd_ids* used_cmds_list = used_cmds_finalize(used_cmds);
 
+    /* One object file per TU, followed by the harness */
+    std::vector<codegen_job> jobs(getTUCount() + 1);
+    std::set<std::string>    module_names = {"odbharness"};
+    for (int tu_id = 0; tu_id != getTUCount(); ++tu_id)
+    {
+        struct codegen_job& job = jobs[tu_id];
+        job.module_name = unique_module_name(
+            &module_names, getSourceFilepath(tu_id), tu_id);
+        job.objfile = empty_ospath();
+        ospath_set(&job.objfile, ospathc(tmpdir));
+        ospath_join_cstr(&job.objfile, job.module_name.c_str());
+        utf8_append_cstr(&job.objfile.str, ".o");
+        job.tu_id = tu_id;
+        job.result = 0;
+    }
+
     /* Harness needs to know the module name of the main DBA */
-    struct ospath maindbaname = empty_ospath();
-    ospath_set_cstr(&maindbaname, getSourceFilepath());
-    ospath_filename(&maindbaname);
-    ospath_remove_ext(&maindbaname);
-    log_dbg(
-        "[codegen] ", "maindbaname: {quote:%s}\n", ospath_cstr(maindbaname));
-
-    log_info("[codegen] ", "Generating harness\n");
-    struct ospath harnessobj = empty_ospath();
-    ospath_set(&harnessobj, ospathc(tmpdir));
-    ospath_join_cstr(&harnessobj, "odbharness.o");
-    struct ir_module* ir = ir_alloc("odbharness");
-    ir_create_harness(
-        ir,
-        getPluginList(),
-        getCommandList(),
-        used_cmds_list,
-        ospath_cstr(maindbaname),
-        getSDKType(),
-        arch_,
-        platform_);
-    ir_compile(ir, ospath_cstr(harnessobj), arch_, platform_);
-    if (dumpIR_)
-        ir_dump(ir);
-    ir_free(ir);
+    std::string maindbaname = jobs[0].module_name;
+    log_dbg("[codegen] ", "maindbaname: {quote:%s}\n", maindbaname.c_str());
+
+    struct codegen_job& harness = jobs.back();
+    harness.module_name = "odbharness";
+    harness.objfile = empty_ospath();
+    ospath_set(&harness.objfile, ospathc(tmpdir));
+    ospath_join_cstr(&harness.objfile, "odbharness.o");
+    harness.tu_id = -1;
+    harness.result = 0;
+
+    log_info("[codegen] ", "Generating harness and %d modules\n", getTUCount());
+    struct codegen_ctx codegen_ctx;
+    codegen_ctx.jobs = &jobs;
+    codegen_ctx.used_cmds = used_cmds_list;
+    codegen_ctx.main_dba_name = maindbaname.c_str();
+    codegen_ctx.session = ir_session_create(arch_, platform_, optLevel_);
+    codegen_ctx.cache_dir = empty_ospath();
+    ospath_set(&codegen_ctx.cache_dir, ospathc(tmpdir));
+    ospath_join_cstr(&codegen_ctx.cache_dir, "objcache");
+    fs_make_dir(ospathc(codegen_ctx.cache_dir));
+    int codegen_result = -1;
+    if (codegen_ctx.session != NULL)
+    {
+        codegen_result = execute_codegen_workers(&codegen_ctx);
+        ir_session_destroy(codegen_ctx.session);
+    }
+    obj_cache_evict(ospathc(codegen_ctx.cache_dir), maxCachedObjects_);
+    ospath_deinit(codegen_ctx.cache_dir);
 
     cmd_ids_deinit(used_cmds_list);
 
-    struct ospath  objfilepath = empty_ospath();
-    struct ospathc srcfilename = cstr_ospathc(getSourceFilepath());
-    ospathc_filename(&srcfilename);
-    ospath_set(&objfilepath, ospathc(tmpdir));
-    ospath_join(&objfilepath, srcfilename);
-    utf8_append_cstr(&objfilepath.str, ".o");
-    ir = ir_alloc(ospath_cstr(maindbaname));
-    ir_translate_ast(
-        ir,
-        getAST(),
-        getSDKType(),
-        getTargetArch(),
-        getTargetPlatform(),
-        getCommandList(),
-        getSourceFilepath(),
-        getSource());
-    if (optimize_)
-        ir_optimize(ir);
-    if (dumpIR_)
-        ir_dump(ir);
-    ir_compile(ir, ospath_cstr(objfilepath), arch_, platform_);
-    ir_free(ir);
-
     struct ospath rtlib = empty_ospath();
     switch (getSDKType())
     {
@@ -225,18 +468,19 @@ output(const std::vector<std::string>& args)
     }
 
     log_info("[link] ", "Linking {emph:%s}\n", outputExe_.c_str());
-    const char* objfiles[] = {
-        ospath_cstr(objfilepath),
-        ospath_cstr(harnessobj),
-        ospath_cstr(rtlib),
-        ospath_cstr(kernel32),
-    };
-    odb_link(
-        objfiles,
-        platform_ == TARGET_WINDOWS ? 4 : 3,
-        outputExe_.c_str(),
-        arch_,
-        platform_);
+    std::vector<const char*> objfiles;
+    for (const struct codegen_job& job : jobs)
+        objfiles.push_back(ospath_cstr(job.objfile));
+    objfiles.push_back(ospath_cstr(rtlib));
+    if (platform_ == TARGET_WINDOWS)
+        objfiles.push_back(ospath_cstr(kernel32));
+    if (codegen_result == 0)
+        odb_link(
+            objfiles.data(),
+            (int)objfiles.size(),
+            outputExe_.c_str(),
+            arch_,
+            platform_);
 
     switch (getSDKType())
     {
@@ -306,14 +550,13 @@ output(const std::vector<std::string>& args)
 
     ospath_deinit(kernel32);
     ospath_deinit(rtlib);
-    ospath_deinit(objfilepath);
-    ospath_deinit(harnessobj);
-    ospath_deinit(maindbaname);
+    for (struct codegen_job& job : jobs)
+        ospath_deinit(job.objfile);
     ospath_deinit(outdir);
     ospath_deinit(tmpdir);
     ospath_deinit(apdir);
 
-    return true;
+    return codegen_result == 0;
 }
 
 // ----------------------------------------------------------------------------
@@ -414,7 +657,31 @@ set_working_dir_failed:
 bool
 set_optimization_level(const std::vector<std::string>& args)
 {
-    optimize_ = true;
+    if (args[0] == "0")
+        optLevel_ = IR_O0;
+    else if (args[0] == "1")
+        optLevel_ = IR_O1;
+    else if (args[0] == "2")
+        optLevel_ = IR_O2;
+    else if (args[0] == "3")
+        optLevel_ = IR_O3;
+    else if (args[0] == "s")
+        optLevel_ = IR_Os;
+    else
+    {
+        log_codegen_err(
+            "Unknown optimization level {quote:%s}\n", args[0].c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+bool
+set_time_passes(const std::vector<std::string>& args)
+{
+    timePasses_ = true;
     return true;
 }
 
@@ -168,16 +168,12 @@ dumpCommandNames(const std::vector<std::string>& args)
         printf("%s ", type_to_db_name(ret_type));
         printf("%s", utf8_list_cstr(commands.db_cmd_names, i));
         printf("%s", ret_type == TYPE_VOID ? " " : "(");
-        const struct cmd_param_types_list* param_types
-            = commands.param_types->data[i];
-        struct utf8_list*       param_names = commands.db_param_names->data[i];
-        const struct cmd_param* param;
-        int                     n;
-        vec_enumerate(param_types, n, param)
+        for (int n = 0; n != cmd_param_count(&commands, i); ++n)
         {
+            const struct cmd_param* param = cmd_param(&commands, i, n);
             if (n)
                 printf(", ");
-            printf("%s", utf8_list_cstr(param_names, n));
+            printf("%s", cmd_param_name_cstr(&commands, i, n));
             if (param->direction == CMD_PARAM_OUT)
                 printf("*");
             printf(" AS %s", type_to_db_name(param->type));
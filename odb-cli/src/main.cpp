@@ -18,11 +18,13 @@ main(int argc, char** argv)
 
     initSDK();
     initCommands();
-    initAST();
+    if (initAST() != 0)
+        goto init_ast_failed;
 
     success = parseCommandLine(argc, argv);
 
     deinitAST();
+init_ast_failed:
     deinitCommands();
     deinitSDK();
 
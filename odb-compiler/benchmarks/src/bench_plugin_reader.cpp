@@ -0,0 +1,155 @@
+/* Compares the time it takes to extract the command strings from every plugin
+ * in a directory using LIEF and using plugin_reader. Both paths are expected
+ * to find the same number of strings.
+ *
+ * Usage: odb-bench-plugin-reader <plugin directory> [iterations]
+ */
+
+#include "LIEF/ELF.hpp"
+#include "LIEF/PE.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "odb-compiler/sdk/plugin_reader.h"
+}
+
+using Clock = std::chrono::steady_clock;
+
+/* Returns the number of strings found, or -1 if the file could not be read */
+static int
+read_with_lief(const std::string& filename)
+{
+    auto elf = LIEF::ELF::Parser::parse(filename);
+    if (elf != nullptr)
+    {
+        const LIEF::Section* odbres = elf->get_section(".odbres");
+        if (odbres == nullptr)
+            return 0;
+        auto content = odbres->content();
+        int  count = content.size() ? 1 : 0;
+        for (size_t i = 0; i + 1 < content.size(); ++i)
+            if (content[i] == '\n')
+                count++;
+        return count;
+    }
+
+    auto pe = LIEF::PE::Parser::parse(
+        filename,
+        LIEF::PE::ParserConfig{
+            false, ///< Parse PE Authenticode signature
+            true,  ///< Parse PE Exports Directory
+            false, ///< Parse PE Import Directory
+            true,  ///< Parse PE resources tree
+            false, ///< Parse PE relocations
+        });
+    if (pe == nullptr)
+        return -1;
+
+    int count = 0;
+    if (auto resmgr = pe->resources_manager())
+        for (const auto& entry : resmgr.value().string_table())
+            if (entry.name().length() > 0)
+                count++;
+    return count;
+}
+
+static int
+read_with_plugin_reader(const std::string& filename)
+{
+    struct plugin_reader reader;
+    int                  count = 0;
+    if (plugin_reader_open(&reader, cstr_ospathc(filename.c_str())) != 0)
+        return -1;
+
+    if (reader.format == PLUGIN_FORMAT_ELF)
+    {
+        struct utf8_span odbres;
+        if (plugin_reader_elf_section(&reader, ".odbres", &odbres) == 0)
+        {
+            const char* data = plugin_reader_data(&reader) + odbres.off;
+            count = odbres.len ? 1 : 0;
+            for (utf8_idx i = 0; i + 1 < odbres.len; ++i)
+                if (data[i] == '\n')
+                    count++;
+        }
+    }
+    else
+    {
+        struct pe_string_iter it;
+        struct utf16_view     str;
+        if (plugin_reader_pe_strings(&reader, &it) == 0)
+            while (pe_string_iter_next(&it, &str) == 1)
+                count++;
+    }
+
+    plugin_reader_close(&reader);
+    return count;
+}
+
+int
+main(int argc, char** argv)
+{
+    std::vector<std::string> files;
+    int                      iterations = argc > 2 ? atoi(argv[2]) : 10;
+    int                      mismatches = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <plugin directory> [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (const auto& entry :
+         std::filesystem::recursive_directory_iterator(argv[1]))
+    {
+        if (entry.is_regular_file())
+            files.push_back(entry.path().string());
+    }
+
+    for (const auto& filename : files)
+    {
+        int lief_count = read_with_lief(filename);
+        int reader_count = read_with_plugin_reader(filename);
+        if (lief_count != reader_count)
+        {
+            fprintf(
+                stderr,
+                "%s: LIEF found %d strings, plugin_reader found %d\n",
+                filename.c_str(),
+                lief_count,
+                reader_count);
+            mismatches++;
+        }
+    }
+
+    auto start = Clock::now();
+    for (int i = 0; i != iterations; ++i)
+        for (const auto& filename : files)
+            read_with_lief(filename);
+    auto lief_time = Clock::now() - start;
+
+    start = Clock::now();
+    for (int i = 0; i != iterations; ++i)
+        for (const auto& filename : files)
+            read_with_plugin_reader(filename);
+    auto reader_time = Clock::now() - start;
+
+    double lief_ms
+        = std::chrono::duration<double, std::milli>(lief_time).count();
+    double reader_ms
+        = std::chrono::duration<double, std::milli>(reader_time).count();
+    printf("%d files, %d iterations\n", (int)files.size(), iterations);
+    printf("LIEF:          %10.3f ms\n", lief_ms);
+    printf(
+        "plugin_reader: %10.3f ms (%.1fx)\n",
+        reader_ms,
+        reader_ms > 0.0 ? lief_ms / reader_ms : 0.0);
+
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -122,11 +122,15 @@ enum ast_type
 
 /* clang-format off */
 
+/*
+ * Nodes only hold the data needed to traverse and analyze the tree. Source
+ * locations are only needed for error messages and are stored separately in
+ * "struct ast_loc_info", so more nodes fit into a cache line.
+ */
 union ast_node
 {
     struct info
     {
-        struct utf8_span location;
         int32_t scope_id;
         enum ast_type node_type : 6;
         enum type type_info : 4;
@@ -155,7 +159,6 @@ union ast_node
         struct info info;
         ast_id expr;
         ast_id next;
-        struct utf8_span combined_location;
     } arglist;
 
     struct 
@@ -163,7 +166,6 @@ union ast_node
         struct info info;
         ast_id identifier;
         ast_id next;
-        struct utf8_span combined_location;
     } paramlist;
 
     struct 
@@ -179,7 +181,6 @@ union ast_node
         struct info info;
         ast_id lvalue;
         ast_id expr;
-        struct utf8_span op_location;
     } assignment;
 
     struct 
@@ -187,8 +188,6 @@ union ast_node
         struct info info;
         ast_id _pad1, _pad2;
         struct utf8_span name;
-        struct utf8_span explicit_type_location;
-        struct utf8_span scope_location;
         enum type_annotation annotation : 7;
         enum scope scope : 1;
         enum type explicit_type : 4;
@@ -199,7 +198,6 @@ union ast_node
         struct info info;
         ast_id left;
         ast_id right;
-        struct utf8_span op_location;
         enum binop_type op : 5;
     } binop;
 
@@ -284,7 +282,6 @@ union ast_node
         struct info info;
         ast_id decl;
         ast_id def;
-        struct utf8_span endfunction_location;
     } func;
 
     struct {
@@ -380,10 +377,32 @@ union ast_node
     } scope;
 };
 
+/* The largest nodes are loops, which store two names */
+ODBUTIL_STATIC_ASSERT(sizeof(union ast_node) == 32);
+
+/* Source locations of a node. Index aligns with node ID */
+struct ast_loc_info
+{
+    struct utf8_span location;
+    /* Only used by identifiers */
+    struct utf8_span explicit_type_location;
+    struct utf8_span scope_location;
+    /* Only used by arglists and paramlists. Spans all of the list's entries */
+    struct utf8_span combined_location;
+    /* Only used by assignments and binops */
+    struct utf8_span op_location;
+    /* Only used by functions */
+    struct utf8_span endfunction_location;
+};
+
 struct ast
 {
     ast_id count, capacity;
     ast_id root;
+    /* Optional index of each node's parent, or NULL if the index was not
+     * built. See ast_parents_build() */
+    ast_id* parents;
+    struct ast_loc_info* locs;
     union ast_node nodes[1];
 };
 
@@ -406,6 +425,24 @@ mem_release_ast(struct ast* ast);
 #define mem_release_ast(ast)
 #endif
 
+/*!
+ * @brief Builds an index of each node's parent, so @see ast_find_parent() no
+ * longer has to search the whole tree. Once built, all functions in ast.h and
+ * ast_ops.h keep the index up to date. Code that changes the children of a
+ * node directly must call @see ast_set_parent() for every child it links or
+ * unlinks.
+ * @return Returns 0 on success, negative if out of memory.
+ */
+ODBCOMPILER_PUBLIC_API int
+ast_parents_build(struct ast* ast);
+
+static inline void
+ast_set_parent(struct ast* ast, ast_id child, ast_id parent)
+{
+    if (ast->parents && child > -1)
+        ast->parents[child] = parent;
+}
+
 static inline void
 ast_set_root(struct ast* ast, ast_id n)
 {
@@ -427,7 +464,7 @@ ast_type_info(const struct ast* ast, ast_id n)
     { return ast->nodes[n].info.type_info; }
 static inline struct utf8_span
 ast_loc(const struct ast* ast, ast_id n)
-    { return ast->nodes[n].info.location; }
+    { return ast->locs[n].location; }
 
 ast_id ast_dup_node(struct ast** astp, ast_id n);
 
@@ -1,6 +1,7 @@
 #pragma once
 
-struct ast;
+#include "odb-compiler/ast/ast.h"
+
 struct cmd_list;
 
 void
@@ -31,9 +32,17 @@ ast_delete_tree(struct ast* ast, int node);
  * changing during modification. To get around this, when
  * @see ast_delete_node() is called, the node is marked with a special value
  * AST_ID (@see ast_type) and must be cleaned up later with this function.
+ *
+ * The remaining nodes are renumbered in depth-first order starting at the
+ * root, so traversals walk memory front to back, and the AST is reallocated
+ * to fit. Every ast_id held outside of the AST must be updated afterwards.
+ * @param[out] remap_out Optional. Set to an array mapping each old node ID to
+ * its new ID, or -1 if the node was removed. Must be freed with mem_free().
+ * @return Returns 0 on success, negative if out of memory. On error, the AST
+ * is left unchanged.
  */
-void
-ast_gc(struct ast* ast);
+int
+ast_gc(struct ast** astp, ast_id** remap_out);
 
 int
 ast_find_parent(const struct ast* ast, int node);
@@ -3,11 +3,41 @@
 #include "odb-compiler/codegen/target.h"
 #include "odb-compiler/config.h"
 #include "odb-compiler/sdk/sdk_type.h"
+#include "odb-util/hash.h"
+
+/* Map to the default pipelines of LLVM's pass builder */
+enum ir_opt_level
+{
+    IR_O0,
+    IR_O1,
+    IR_O2,
+    IR_O3,
+    IR_Os
+};
 
 struct ast;
 struct cmd_ids;
 struct cmd_list;
 struct ir_module;
+struct ir_session;
+struct mstream;
+
+/*!
+ * @brief Creates a session for compiling modules to the given target. Only the
+ * LLVM backend of the target is initialized, and only the first time a session
+ * for it is created. The session can be shared by multiple threads, each of
+ * which gets its own TargetMachine the first time it optimizes or compiles a
+ * module.
+ * @return Returns NULL if the target is not supported.
+ */
+ODBCOMPILER_PUBLIC_API struct ir_session*
+ir_session_create(
+    enum target_arch     arch,
+    enum target_platform platform,
+    enum ir_opt_level    level);
+
+ODBCOMPILER_PUBLIC_API void
+ir_session_destroy(struct ir_session* session);
 
 ODBCOMPILER_PUBLIC_API struct ir_module*
 ir_alloc(const char* module_name);
@@ -37,15 +67,35 @@ ir_create_harness(
     enum target_arch          arch,
     enum target_platform      platform);
 
+/*!
+ * @brief Runs the default optimization pipeline of the session's level on the
+ * module. Nothing is done for IR_O0.
+ * @param[in] time_passes If non-zero, logs how long each pass took.
+ */
 ODBCOMPILER_PUBLIC_API int
-ir_optimize(struct ir_module* ir);
+ir_optimize(struct ir_module* ir, struct ir_session* session, int time_passes);
 
 ODBCOMPILER_PUBLIC_API int
 ir_dump(const struct ir_module* ir);
 
+/*!
+ * @brief Hashes everything the object code of the unoptimized module depends
+ * on: Its bitcode, the session's target triple and optimization level, and the
+ * LLVM version.
+ */
+ODBCOMPILER_PUBLIC_API hash64
+ir_hash(const struct ir_module* ir, const struct ir_session* session);
+
 ODBCOMPILER_PUBLIC_API int
 ir_compile(
-    struct ir_module*    mod,
-    const char*          output_filepath,
-    enum target_arch     arch,
-    enum target_platform platform);
+    struct ir_module*  mod,
+    struct ir_session* session,
+    const char*        output_filepath);
+
+/*!
+ * @brief Same as ir_compile(), but appends the object code to a writable
+ * memory stream instead of writing it to a file.
+ */
+ODBCOMPILER_PUBLIC_API int
+ir_compile_to_memory(
+    struct ir_module* mod, struct ir_session* session, struct mstream* ms);
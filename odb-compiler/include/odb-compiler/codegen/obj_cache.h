@@ -0,0 +1,37 @@
+#pragma once
+
+#include "odb-compiler/config.h"
+#include "odb-util/hash.h"
+#include "odb-util/ospath.h"
+
+/*
+ * Object files are cached in a directory, where each object is named after a
+ * hash of everything it was generated from, see ir_hash(). A module whose hash
+ * did not change since it was last compiled does not have to be optimized or
+ * compiled again.
+ */
+
+/*!
+ * @brief Copies the cached object with the given key to "objfile", and marks
+ * it as recently used.
+ * @return Returns 1 if the object was found, 0 if there is no object with this
+ * key, and negative if it could not be copied.
+ */
+ODBCOMPILER_PUBLIC_API int
+obj_cache_load(struct ospathc cache_dir, hash64 key, struct ospathc objfile);
+
+/*!
+ * @brief Stores a copy of "objfile" under the given key.
+ * @return Returns 0 on success, negative on error.
+ */
+ODBCOMPILER_PUBLIC_API int
+obj_cache_store(struct ospathc cache_dir, hash64 key, struct ospathc objfile);
+
+/*!
+ * @brief Removes the least recently used objects until at most "max_objects"
+ * are left.
+ * @return Returns the number of objects that were removed, or negative on
+ * error.
+ */
+ODBCOMPILER_PUBLIC_API int
+obj_cache_evict(struct ospathc cache_dir, int max_objects);
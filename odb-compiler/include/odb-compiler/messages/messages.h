@@ -61,7 +61,9 @@ int
 err_func_call_incompatible_types(
     const struct ast* ast,
     ast_id            arg,
-    ast_id            param,
+    enum type         param_type,
+    struct utf8_span  param_type_location,
+    const char*       param_source,
     int               arg_num,
     const char*       filename,
     const char*       source);
@@ -201,7 +203,9 @@ void
 warn_func_call_implicit_conversion(
     const struct ast* ast,
     ast_id            arg,
-    ast_id            param,
+    enum type         param_type,
+    struct utf8_span  param_type_location,
+    const char*       param_source,
     int               arg_num,
     const char*       filename,
     const char*       source);
@@ -209,7 +213,9 @@ void
 warn_func_call_truncation(
     const struct ast* ast,
     ast_id            arg,
-    ast_id            param,
+    enum type         param_type,
+    struct utf8_span  param_type_location,
+    const char*       param_source,
     int               arg_num,
     const char*       filename,
     const char*       source);
@@ -3,5 +3,14 @@
 #include "odb-compiler/parser/db_parser.y.h"
 #include "odb-util/utf8.h"
 
-dbtoken_kind_t
-db_keyword_lookup(const char* data, struct utf8_span ref);
+/*!
+ * @brief Calls "on_keyword" once for every builtin keyword. The parser adds
+ * them to its command trie, so keywords and commands are matched in the same
+ * walk over the source text.
+ * @return Returns 0, or the first non-zero value returned by "on_keyword", in
+ * which case iteration stops.
+ */
+int
+db_keyword_for_each(
+    int (*on_keyword)(const char* name, dbtoken_kind_t token, void* user),
+    void* user);
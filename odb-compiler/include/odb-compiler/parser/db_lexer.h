@@ -0,0 +1,51 @@
+#pragma once
+
+#include "odb-compiler/config.h"
+#include "odb-compiler/parser/db_parser.y.h"
+#include "odb-compiler/parser/db_source.h"
+
+/*!
+ * @brief Selects which lexer the parser uses to tokenize the source text.
+ */
+enum db_lexer_backend
+{
+    /* The reentrant FLEX scanner generated from db_scanner.lex */
+    DB_LEXER_FLEX,
+    /* The hand-written lexer in db_lexer.c. It produces exactly the same
+     * tokens, values and locations as the FLEX scanner, but scans runs of
+     * identifier, whitespace and comment bytes with a lookup table instead of
+     * going through FLEX's state machine and buffer management */
+    DB_LEXER_FAST
+};
+
+struct db_lexer
+{
+    const char* text;
+    utf8_idx    len;
+    utf8_idx    pos;
+    int         state;
+};
+
+/*!
+ * @brief Points the lexer at the start of the source text.
+ */
+ODBCOMPILER_PUBLIC_API void
+db_lexer_init(struct db_lexer* lexer, struct db_source source);
+
+/*!
+ * @brief Scans the next token. Works the same way as dblex(): The location
+ * must be preserved across calls, as the next location is derived from the
+ * previous one.
+ * @return Returns the token kind, or TOK_EOF (0) at the end of the source.
+ */
+ODBCOMPILER_PUBLIC_API int
+db_lexer_next(struct db_lexer* lexer, DBSTYPE* value, DBLTYPE* location);
+
+/*!
+ * @brief Runs both lexer backends over the source and compares the token
+ * streams. The first difference is logged.
+ * @return Returns 0 if both backends produced the same tokens, values and
+ * locations, or negative if they differ or if there was an error.
+ */
+ODBCOMPILER_PUBLIC_API int
+db_lexer_diff(struct db_source source, const char* filename);
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "odb-compiler/config.h"
+#include "odb-compiler/parser/db_lexer.h"
 #include "odb-compiler/parser/db_source.h"
+#include "odb-compiler/sdk/cmd_trie.h"
 
 typedef void*           dbscan_t;
 typedef struct dbpstate dbpstate;
@@ -9,14 +11,46 @@ typedef struct dbpstate dbpstate;
 struct ast;
 struct cmd_list;
 
+/* Counters for the most recent call to db_parse() */
+struct db_parser_stats
+{
+    /* Number of tokens returned by the scanner */
+    int32_t tokens;
+    /* Number of times a token's text was matched against the command trie,
+     * either as the start of a command or as the continuation of one */
+    int32_t cmd_probes;
+    /* Number of transitions taken in the command and keyword trie. Each
+     * transition consumes one byte of source text */
+    int32_t transitions;
+    /* Length of the source, in bytes */
+    int32_t bytes;
+};
+
 struct db_parser
 {
     dbscan_t  scanner;
     dbpstate* parser;
+
+    enum db_lexer_backend lexer_backend;
+    struct db_lexer       lexer;
+
+    /* Built lazily from the command list passed to db_parse(), and rebuilt if
+     * a different command list is passed in or if its size changes */
+    struct cmd_trie*       cmd_trie;
+    const struct cmd_list* cmd_trie_cmds;
+    cmd_id                 cmd_trie_cmd_count;
+
+    struct db_parser_stats stats;
 };
 
+/*!
+ * @brief Initializes the parser.
+ * @param[in] lexer_backend Selects the lexer used to tokenize sources. Both
+ * backends produce the same tokens.
+ * @return Returns 0 on success, negative on error.
+ */
 ODBCOMPILER_PUBLIC_API int
-db_parser_init(struct db_parser* parser);
+db_parser_init(struct db_parser* parser, enum db_lexer_backend lexer_backend);
 
 ODBCOMPILER_PUBLIC_API void
 db_parser_deinit(struct db_parser* parser);
@@ -19,7 +19,10 @@
  *
  * This abstraction is required to hide some parser details.
  *   1) FLEX requires an "EOB" marker at the end of its buffers. This is
- *      appended when using the various open() functions below.
+ *      appended when using the various open() functions below. Files are
+ *      mapped directly, and the marker is placed into the zero-filled remainder
+ *      of the file's last page. If it doesn't fit, the source is streamed into
+ *      the scanner instead.
  *   2) Throughout the compilation process, any text extracted from the parsing
  *      stage is referenced through @see utf8_span, which is an offset/length
  *      into the source text. Thus, it's necessary to keep the file around for
@@ -28,6 +31,8 @@
 struct db_source
 {
     struct utf8 text;
+    /* Set if the text is followed by FLEX's "EOB" marker */
+    char has_eob;
 };
 
 /*!
@@ -4,22 +4,37 @@
 #include "odb-compiler/sdk/cmd_list.h"
 #include "odb-compiler/sdk/plugin_list.h"
 #include "odb-compiler/sdk/sdk_type.h"
+#include "odb-util/hash.h"
+#include "odb-util/vec.h"
+
+/* Bumped whenever the format of the cache changes. Also part of the key of
+ * cached object files, see obj_cache.h */
+#define CMD_CACHE_VERSION 2
 
 struct plugin_ids;
-struct plugin_list;
 
+/* Index aligns with plugin ID, see plugin_reader_command_hash() */
+VEC_DECLARE_API(ODBCOMPILER_PUBLIC_API, plugin_hashes, hash64, 16)
+
+/*!
+ * @brief Loads the commands of all plugins that have the same hash as when the
+ * cache was saved. The IDs of these plugins are added to "cached_plugins".
+ * Plugins with a hash of 0 are never loaded from the cache.
+ * @return Returns 0 on success, negative if the cache does not exist or could
+ * not be loaded. On error, no plugins are added to "cached_plugins".
+ */
 int
 cmd_cache_load(
-    struct plugin_ids**       cached_plugins,
-    const struct plugin_list* plugins,
-    struct cmd_list*          cmds,
-    enum sdk_type             sdk_type,
-    enum target_arch          arch,
-    enum target_platform      platform);
+    struct plugin_ids**         cached_plugins,
+    const struct plugin_hashes* plugin_hashes,
+    struct cmd_list*            cmds,
+    enum sdk_type               sdk_type,
+    enum target_arch            arch,
+    enum target_platform        platform);
 int
 cmd_cache_save(
-    const struct plugin_list* plugins,
-    const struct cmd_list*    cmds,
-    enum sdk_type             sdk_type,
-    enum target_arch          arch,
-    enum target_platform      platform);
+    const struct plugin_hashes* plugin_hashes,
+    const struct cmd_list*      cmds,
+    enum sdk_type               sdk_type,
+    enum target_arch            arch,
+    enum target_platform        platform);
@@ -24,25 +24,39 @@ struct cmd_param
     // struct utf8_span         doc;
 };
 
+/* Location of a command's parameters in the list's parameter arrays */
+struct cmd_param_range
+{
+    int32_t first;
+    int32_t count;
+};
+
 /* clang-format off */
 ODBUTIL_STATIC_ASSERT(sizeof(plugin_id) == 2);
 VEC_DECLARE_API(ODBCOMPILER_PUBLIC_API, plugin_ids, plugin_id, 16)
 VEC_DECLARE_API(ODBCOMPILER_PUBLIC_API, return_types_list, enum type, 32)
-VEC_DECLARE_API(ODBCOMPILER_PUBLIC_API, cmd_param_types_list, struct cmd_param, 8)
-VEC_DECLARE_API(ODBCOMPILER_PUBLIC_API, cmd_param_types_lists, struct cmd_param_types_list*, 32)
-VEC_DECLARE_API(ODBCOMPILER_PUBLIC_API, db_param_names, struct utf8_list*, 32)
+VEC_DECLARE_API(ODBCOMPILER_PUBLIC_API, cmd_param_list, struct cmd_param, 32)
+VEC_DECLARE_API(ODBCOMPILER_PUBLIC_API, cmd_param_ranges, struct cmd_param_range, 32)
 /* clang-format on */
 
 struct cmd_list
 {
     /* All vectors have the same size -- index aligns with command ID */
-    struct utf8_list*             db_cmd_names;
-    struct utf8_list*             c_symbols;
-    struct plugin_ids*            plugin_ids;
-    struct return_types_list*     return_types;
-    struct cmd_param_types_lists* param_types;
-    struct db_param_names*        db_param_names;
-    char                          longest_command;
+    struct utf8_list*         db_cmd_names;
+    struct utf8_list*         c_symbols;
+    struct plugin_ids*        plugin_ids;
+    struct return_types_list* return_types;
+    struct cmd_param_ranges*  param_ranges;
+    /* The parameters of all commands are packed into these two arrays, so the
+     * whole list only consists of a handful of allocations. The parameters of
+     * a command are stored next to each other -- see "param_ranges". Index
+     * aligns with parameter ID */
+    struct cmd_param_list* params;
+    struct utf8_list*      db_param_names;
+    /* Commands from this index onwards were added with cmd_list_append() and
+     * are not sorted yet */
+    cmd_id sorted_count;
+    char   longest_command;
 };
 
 ODBCOMPILER_PUBLIC_API void
@@ -59,6 +73,54 @@ cmd_list_add(
     struct utf8_view db_cmd_name,
     struct utf8_view c_symbol);
 
+/*!
+ * @brief Appends a command to the end of the list without keeping the list
+ * sorted. This avoids shifting every array in the list for each command, which
+ * matters when loading thousands of commands from plugins. Once all commands
+ * are appended, @see cmd_list_sort() must be called before the list is used.
+ * @return Returns the index of the command until the list is sorted, or
+ * negative on error.
+ */
+ODBCOMPILER_PUBLIC_API cmd_id
+cmd_list_append(
+    struct cmd_list* cmds,
+    plugin_id        plugin_id,
+    enum type        return_type,
+    struct utf8_view db_cmd_name,
+    struct utf8_view c_symbol);
+
+/*!
+ * @brief Sorts all commands added with @see cmd_list_append() into the list.
+ * The result is the same as if every command had been added with
+ * @see cmd_list_add() in the same order, i.e. overloads with the same name
+ * end up in the same order.
+ * @return Returns 0 on success, negative on error. On error, the list is left
+ * unchanged.
+ */
+ODBCOMPILER_PUBLIC_API int
+cmd_list_sort(struct cmd_list* cmds);
+
+/*!
+ * @brief Appends all commands in "other" to the end of the list, in the same
+ * order, including their parameters. Like @see cmd_list_append(), the list
+ * must be sorted with @see cmd_list_sort() afterwards.
+ * @return Returns 0 on success, negative on error.
+ */
+ODBCOMPILER_PUBLIC_API int
+cmd_list_append_list(struct cmd_list* cmds, const struct cmd_list* other);
+
+/*!
+ * @brief Changes the plugin ID of every command to the ID "plugin_map" holds
+ * at the index of its current plugin ID. Commands whose plugin maps to -1 are
+ * removed. The remaining commands keep their order, so a sorted list stays
+ * sorted.
+ * @return Returns 0 on success, negative on error. On error, the list is left
+ * unchanged.
+ */
+ODBCOMPILER_PUBLIC_API int
+cmd_list_remap_plugins(
+    struct cmd_list* cmds, const struct plugin_ids* plugin_map);
+
 cmd_id
 cmd_list_insert(
     struct cmd_list* cmds,
@@ -90,8 +152,44 @@ cmd_list_load_from_plugins(
 ODBCOMPILER_PUBLIC_API cmd_id
 cmd_list_find(const struct cmd_list* cmds, struct utf8_view name);
 
+#if defined(ODBUTIL_MEM_DEBUGGING)
+ODBCOMPILER_PUBLIC_API void
+mem_acquire_cmd_list(struct cmd_list* cmds);
+ODBCOMPILER_PUBLIC_API void
+mem_release_cmd_list(struct cmd_list* cmds);
+#else
+#define mem_acquire_cmd_list(cmds)
+#define mem_release_cmd_list(cmds)
+#endif
+
 static inline cmd_id
 cmd_list_count(const struct cmd_list* cmds)
 {
     return utf8_list_count((cmds)->db_cmd_names);
 }
+
+static inline int
+cmd_param_count(const struct cmd_list* cmds, cmd_id cmd)
+{
+    return cmds->param_ranges->data[cmd].count;
+}
+
+static inline const struct cmd_param*
+cmd_param(const struct cmd_list* cmds, cmd_id cmd, int param)
+{
+    return &cmds->params->data[cmds->param_ranges->data[cmd].first + param];
+}
+
+static inline struct utf8_view
+cmd_param_name(const struct cmd_list* cmds, cmd_id cmd, int param)
+{
+    return utf8_list_view(
+        cmds->db_param_names, cmds->param_ranges->data[cmd].first + param);
+}
+
+static inline const char*
+cmd_param_name_cstr(const struct cmd_list* cmds, cmd_id cmd, int param)
+{
+    return utf8_list_cstr(
+        cmds->db_param_names, cmds->param_ranges->data[cmd].first + param);
+}
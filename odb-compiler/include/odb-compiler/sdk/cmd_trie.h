@@ -0,0 +1,114 @@
+#pragma once
+
+#include "odb-compiler/config.h"
+#include "odb-compiler/sdk/cmd_list.h"
+#include <ctype.h>
+
+#define CMD_TRIE_ROOT 0
+
+/*!
+ * @brief One node in the command trie. Siblings are stored in ascending byte
+ * order so a lookup can stop as soon as it passes the byte it is looking for.
+ *
+ * Besides commands, the trie can also hold the parser's builtin keywords, so
+ * a single walk over the source text finds both.
+ */
+struct cmd_trie_node
+{
+    int32_t first_child;
+    int32_t next_sibling;
+    /* Command ID of the first overload whose name ends at this node, or -1 */
+    cmd_id cmd;
+    /* Token kind of the keyword that ends at this node, or -1 */
+    int16_t keyword;
+    char    c;
+};
+
+VEC_DECLARE_API(ODBCOMPILER_PUBLIC_API, cmd_trie, struct cmd_trie_node, 32)
+
+/*!
+ * @brief Builds a trie over all command names in the command list. Any
+ * existing nodes in the trie are cleared.
+ *
+ * Commands are stored in the command list in upper case by convention, so
+ * the trie does the same. Lookups fold the source text to upper case on the
+ * fly, which means the parser never has to copy a candidate string.
+ * @return Returns 0 on success, negative on error.
+ */
+ODBCOMPILER_PUBLIC_API int
+cmd_trie_build(struct cmd_trie** trie, const struct cmd_list* cmds);
+
+/*!
+ * @brief Adds a keyword to the trie. Like commands, keywords can consist of
+ * several words, and are matched case-insensitively. Keywords have to be added
+ * after @see cmd_trie_build(), because building clears the trie.
+ * @param[in] keyword The parser's token kind for this keyword. Must fit into
+ * 16 bits.
+ * @return Returns 0 on success, negative on error.
+ */
+ODBCOMPILER_PUBLIC_API int
+cmd_trie_add_keyword(struct cmd_trie** trie, const char* name, int keyword);
+
+/*!
+ * @brief Follows the edge labelled with the upper case version of "c".
+ * @return Returns the child node, or -1 if no command continues with "c".
+ */
+static inline int32_t
+cmd_trie_next(const struct cmd_trie* trie, int32_t node, char c)
+{
+    int32_t child;
+    c = (char)toupper((unsigned char)c);
+    for (child = trie->data[node].first_child; child > -1;
+         child = trie->data[child].next_sibling)
+    {
+        if (trie->data[child].c == c)
+            return child;
+        if ((unsigned char)trie->data[child].c > (unsigned char)c)
+            break;
+    }
+    return -1;
+}
+
+/*!
+ * @brief Follows all bytes in the span starting at "node".
+ * @return Returns the node reached, or -1 as soon as no command can match.
+ */
+static inline int32_t
+cmd_trie_walk(
+    const struct cmd_trie* trie,
+    int32_t                node,
+    const char*            data,
+    struct utf8_span       span)
+{
+    for (; span.len && node > -1; span.off++, span.len--)
+        node = cmd_trie_next(trie, node, data[span.off]);
+    return node;
+}
+
+/*!
+ * @brief Returns true if at least one command or keyword is longer than the
+ * string that was walked to reach this node.
+ */
+static inline int
+cmd_trie_has_children(const struct cmd_trie* trie, int32_t node)
+{
+    return trie->data[node].first_child > -1;
+}
+
+/*!
+ * @brief Returns the ID of the command whose name ends at this node, or -1.
+ */
+static inline cmd_id
+cmd_trie_cmd(const struct cmd_trie* trie, int32_t node)
+{
+    return trie->data[node].cmd;
+}
+
+/*!
+ * @brief Returns the token kind of the keyword that ends at this node, or -1.
+ */
+static inline int
+cmd_trie_keyword(const struct cmd_trie* trie, int32_t node)
+{
+    return trie->data[node].keyword;
+}
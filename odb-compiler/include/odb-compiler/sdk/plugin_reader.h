@@ -0,0 +1,104 @@
+#pragma once
+
+#include "odb-compiler/config.h"
+#include "odb-util/hash.h"
+#include "odb-util/mfile.h"
+#include "odb-util/ospath.h"
+#include "odb-util/utf8.h"
+
+enum plugin_format
+{
+    PLUGIN_FORMAT_UNKNOWN,
+    PLUGIN_FORMAT_ELF,
+    PLUGIN_FORMAT_PE
+};
+
+/*!
+ * @brief A memory-mapped plugin binary. Only the few headers required to find
+ * the command strings are ever read. Everything returned points directly into
+ * the mapped file, so the reader must stay open for as long as the results are
+ * used.
+ */
+struct plugin_reader
+{
+    struct mfile       mf;
+    enum plugin_format format;
+    /* PE only: File offset and number of entries of the section table, used to
+     * translate RVAs into file offsets */
+    uint32_t pe_sections;
+    int      pe_section_count;
+};
+
+/*!
+ * @brief Iterates over all strings in a PE file's RT_STRING resources, in the
+ * order they appear in the resource tree.
+ */
+struct pe_string_iter
+{
+    const struct plugin_reader* reader;
+    uint32_t                    rsrc;    /* Offset of the resource directory */
+    uint32_t                    bundles; /* Offset of current level 2 dir */
+    int                         bundle, bundle_count;
+    uint32_t                    langs; /* Offset of current level 3 dir */
+    int                         lang, lang_count;
+    uint32_t                    pos, end; /* Current string block */
+};
+
+/*!
+ * @brief Maps the file into memory and detects whether it is an ELF or a PE
+ * file.
+ * @return Returns 0 on success, negative if the file could not be mapped or if
+ * it is neither a valid ELF nor a valid PE file.
+ */
+ODBCOMPILER_PUBLIC_API int
+plugin_reader_open(struct plugin_reader* reader, struct ospathc filepath);
+
+ODBCOMPILER_PUBLIC_API void
+plugin_reader_close(struct plugin_reader* reader);
+
+static inline const char*
+plugin_reader_data(const struct plugin_reader* reader)
+{
+    return (const char*)reader->mf.address;
+}
+
+/*!
+ * @brief Finds an ELF section by name.
+ * @param[out] section Set to the section's contents as an offset and length
+ * into @see plugin_reader_data().
+ * @return Returns 0 if the section was found, 1 if it does not exist, and
+ * negative if the file is malformed.
+ */
+ODBCOMPILER_PUBLIC_API int
+plugin_reader_elf_section(
+    const struct plugin_reader* reader,
+    const char*                 name,
+    struct utf8_span*           section);
+
+/*!
+ * @brief Prepares an iterator over the PE file's string table resources.
+ * @return Returns 0 on success, 1 if the file has no string table, and
+ * negative if the file is malformed.
+ */
+ODBCOMPILER_PUBLIC_API int
+plugin_reader_pe_strings(
+    const struct plugin_reader* reader, struct pe_string_iter* it);
+
+/*!
+ * @brief Gets the next non-empty string from the string table. Strings are
+ * UTF-16 encoded and point directly into the mapped file.
+ * @return Returns 1 if a string was returned, 0 if there are no more strings,
+ * and negative if the file is malformed.
+ */
+ODBCOMPILER_PUBLIC_API int
+pe_string_iter_next(struct pe_string_iter* it, struct utf16_view* str);
+
+/*!
+ * @brief Hashes the data the plugin's commands are parsed from, i.e. the
+ * .odbres section of an ELF file or the string table of a PE file. Plugins
+ * with the same hash provide the same commands, no matter when or where the
+ * files were written.
+ * @return Returns 0 on success, negative if the file is malformed.
+ */
+ODBCOMPILER_PUBLIC_API int
+plugin_reader_command_hash(const struct plugin_reader* reader, hash64* hash);
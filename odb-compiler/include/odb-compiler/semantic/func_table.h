@@ -0,0 +1,171 @@
+#pragma once
+
+#include "odb-compiler/ast/ast.h"
+#include "odb-compiler/config.h"
+#include "odb-compiler/semantic/type.h"
+#include "odb-util/utf8.h"
+
+/*!
+ * @brief Shared by the type checks of all TUs, see @see
+ * semantic_session_funcs(). Every function is claimed by the type check that
+ * checks it first, and its signature is published here once it is known. Calls
+ * from other TUs are resolved from the published signatures without having to
+ * lock the TU the function is defined in.
+ *
+ * A type check is identified by the TU it was started for (the "owner"). Note
+ * that a type check may claim functions in other TUs when it has to check a
+ * function it calls.
+ *
+ * The functions are spread over a number of shards, each with its own lock,
+ * so that type checks publishing and looking up functions rarely contend. The
+ * table refers to AST nodes, so it can't be used anymore once the ASTs are
+ * renumbered by @see ast_gc().
+ */
+struct func_table;
+
+struct func_param
+{
+    enum type type;
+    /* Location of the parameter's type in the source of the TU the function is
+     * defined in. Used for error messages */
+    struct utf8_span type_location;
+};
+
+enum func_state
+{
+    /* No type check has claimed the function yet */
+    FUNC_UNCLAIMED,
+    /* The function is claimed by the type check that is asking */
+    FUNC_OWNED,
+    /* Another type check is currently checking the function */
+    FUNC_BUSY,
+    /* The function was checked and its signature is available */
+    FUNC_CHECKED,
+    /* Type checking the function failed. The error was already reported */
+    FUNC_FAILED
+};
+
+ODBCOMPILER_PUBLIC_API struct func_table*
+func_table_create(void);
+
+ODBCOMPILER_PUBLIC_API void
+func_table_destroy(struct func_table* table);
+
+/*!
+ * @brief Claims a function for a type check, unless it is already claimed.
+ * @return Returns @see FUNC_OWNED if the function was claimed. Otherwise, the
+ * current state of the function is returned. Returns @see FUNC_FAILED if out
+ * of memory.
+ */
+ODBCOMPILER_PUBLIC_API enum func_state
+func_table_claim(struct func_table* table, int tu_id, ast_id func, int owner);
+
+/*!
+ * @brief Gets the state of a function, and its signature if it was checked.
+ * @param[out] ret_type Receives the return type. Can be NULL if only the state
+ * is of interest, in which case the other out parameters are ignored too.
+ * @param[out] params Receives up to @p max_params parameters.
+ * @param[out] param_count Set to the number of parameters of the function,
+ * which can be larger than @p max_params.
+ */
+ODBCOMPILER_PUBLIC_API enum func_state
+func_table_find(
+    struct func_table* table,
+    int                tu_id,
+    ast_id             func,
+    int                owner,
+    enum type*         ret_type,
+    struct func_param* params,
+    int                max_params,
+    int*               param_count);
+
+/*!
+ * @brief Publishes the signature of a function claimed by @see
+ * func_table_claim(). Other type checks waiting on the function can continue.
+ * @return Returns 0 on success, negative if out of memory.
+ */
+ODBCOMPILER_PUBLIC_API int
+func_table_publish(
+    struct func_table*       table,
+    int                      tu_id,
+    ast_id                   func,
+    enum type                ret_type,
+    const struct func_param* params,
+    int                      param_count);
+
+/*!
+ * @brief Marks all functions still claimed by a failed type check as failed,
+ * so that no other type check waits on them forever.
+ */
+ODBCOMPILER_PUBLIC_API void
+func_table_fail(struct func_table* table, int owner);
+
+/*!
+ * @brief Records that a type check is waiting for another type check to finish
+ * checking a function, and checks if this would deadlock. The type check then
+ * has to release its TU, and block in @see func_table_wait_finish().
+ * @return Returns 0 if waiting is fine, or if the function is no longer busy.
+ * Returns -1 if the other type check is (indirectly) waiting on a function
+ * claimed by @p owner.
+ */
+ODBCOMPILER_PUBLIC_API int
+func_table_wait(struct func_table* table, int owner, int tu_id, ast_id func);
+
+/*!
+ * @brief Blocks until the function passed to @see func_table_wait() was
+ * published or failed, and stops waiting on it.
+ */
+ODBCOMPILER_PUBLIC_API void
+func_table_wait_finish(struct func_table* table, int owner);
+
+/*!
+ * @brief Finds the instantiation of a polymorphic function that was created
+ * for the given argument types.
+ * @return Returns the AST_FUNC node, or -1 if it doesn't exist yet.
+ */
+ODBCOMPILER_PUBLIC_API ast_id
+func_table_find_instance(
+    struct func_table* table,
+    int                tu_id,
+    ast_id             func_poly,
+    const enum type*   arg_types,
+    int                arg_count);
+
+ODBCOMPILER_PUBLIC_API int
+func_table_add_instance(
+    struct func_table* table,
+    int                tu_id,
+    ast_id             func_poly,
+    ast_id             func,
+    const enum type*   arg_types,
+    int                arg_count);
+
+/*!
+ * @brief A type check holds the mutex of its TU for as long as it runs, except
+ * while it checks functions in other TUs. Type checks that have to check or
+ * instantiate a function in a TU held by someone else call this before
+ * blocking on the TU's mutex, and @see func_table_got_tu() once they locked it.
+ * @return Returns 0 on success, negative if out of memory. In that case, @see
+ * func_table_got_tu() must not be called.
+ */
+ODBCOMPILER_PUBLIC_API int
+func_table_want_tu(struct func_table* table, int tu_id);
+
+ODBCOMPILER_PUBLIC_API void
+func_table_got_tu(struct func_table* table, int tu_id);
+
+/*!
+ * @brief Checks if other type checks are blocked on a TU. The type check
+ * holding the TU calls this whenever it finished a function. If the TU is
+ * wanted, it unlocks the TU and calls @see func_table_hand_over_tu() before
+ * locking it again.
+ */
+ODBCOMPILER_PUBLIC_API int
+func_table_tu_wanted(struct func_table* table, int tu_id);
+
+/*!
+ * @brief Blocks until all type checks that were blocked on a TU got to lock
+ * it. Called with the TU unlocked.
+ */
+ODBCOMPILER_PUBLIC_API void
+func_table_hand_over_tu(struct func_table* table, int tu_id);
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "odb-compiler/config.h"
+#include "odb-compiler/sdk/cmd_list.h"
+#include "odb-compiler/semantic/type.h"
+
+/*!
+ * @brief Remembers which overload of a command was chosen for a set of
+ * argument types, and how many overloads a command has. Owned by the semantic
+ * session, see @see semantic_session_overloads(), and shared by the overload
+ * resolution of all TUs. Only successful resolutions are stored -- errors are
+ * always reported by the full resolution.
+ *
+ * Commands are identified by their first overload, which is the ID the parser
+ * assigns to the AST node. The command list must not change while the cache
+ * is in use, because the command IDs would no longer be valid.
+ */
+struct overload_cache;
+
+ODBCOMPILER_PUBLIC_API struct overload_cache*
+overload_cache_create(void);
+
+ODBCOMPILER_PUBLIC_API void
+overload_cache_destroy(struct overload_cache* cache);
+
+/*!
+ * @brief Looks up how many overloads a command has. The overloads of a command
+ * are next to each other in the command list, starting at the first overload.
+ * @return Returns the number of overloads, or 0 if they were not counted yet.
+ */
+ODBCOMPILER_PUBLIC_API int
+overload_cache_overload_count(
+    struct overload_cache* cache, cmd_id first_overload);
+
+/*!
+ * @brief Stores how many overloads a command has.
+ * @return Returns 0 on success, negative if out of memory.
+ */
+ODBCOMPILER_PUBLIC_API int
+overload_cache_set_overload_count(
+    struct overload_cache* cache, cmd_id first_overload, int overload_count);
+
+/*!
+ * @brief Looks up the overload that was chosen for the given argument types.
+ * @return Returns the command ID of the overload, or -1 if the command was not
+ * resolved with these argument types yet.
+ */
+ODBCOMPILER_PUBLIC_API cmd_id
+overload_cache_find(
+    struct overload_cache* cache,
+    cmd_id                 first_overload,
+    const enum type*       arg_types,
+    int                    arg_count);
+
+/*!
+ * @brief Stores the overload that was chosen for the given argument types.
+ * @return Returns 0 on success, negative if out of memory.
+ */
+ODBCOMPILER_PUBLIC_API int
+overload_cache_add(
+    struct overload_cache* cache,
+    cmd_id                 first_overload,
+    const enum type*       arg_types,
+    int                    arg_count,
+    cmd_id                 overload);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "odb-compiler/config.h"
+#include "odb-compiler/semantic/semantic.h"
+#include "odb-util/vec.h"
+
+/* Any more visitors than this are split over multiple traversals */
+#define SEMANTIC_PASS_MAX_CHECKS 8
+
+/*!
+ * @brief Either a single check, or a group of visitors that share a single
+ * traversal of the AST.
+ */
+struct semantic_pass
+{
+    const struct semantic_check* checks[SEMANTIC_PASS_MAX_CHECKS];
+    int                          count;
+    enum semantic_visit_order    order;
+};
+
+VEC_DECLARE_API(
+    ODBCOMPILER_PUBLIC_API, semantic_passes, struct semantic_pass, 16)
+
+/*!
+ * @brief Orders a check and everything it depends on into passes. Every check
+ * runs after its dependencies. A visitor joins the earliest pass it doesn't
+ * conflict with, which may be earlier than the position a depth-first run of
+ * the dependencies would give it.
+ * @param[in] already_run Checks that already ran, including everything they
+ * depend on. These are left out. May be NULL.
+ */
+ODBCOMPILER_PUBLIC_API int
+semantic_passes_build(
+    struct semantic_passes**      passes,
+    const struct semantic_check*  check,
+    const struct semantic_check** already_run);
+
+/*!
+ * @return Returns the index of the pass the check is in, or -1.
+ */
+ODBCOMPILER_PUBLIC_API int
+semantic_passes_find(
+    const struct semantic_passes* passes, const struct semantic_check* check);
+
+/*!
+ * @brief Runs all checks of the pass on a single TU.
+ * @return Returns 0 if all checks succeeded. Otherwise, returns a bitmask of
+ * the checks that failed, by their index in the pass. Checks that depend on a
+ * failed check of the same pass are not run any further and count as failed.
+ */
+ODBCOMPILER_PUBLIC_API int
+semantic_pass_run(
+    const struct semantic_pass* pass,
+    struct ast**                tus,
+    int                         tu_count,
+    int                         tu_id,
+    struct mutex**              tu_mutexes,
+    const struct utf8*          filenames,
+    const struct db_source*     sources,
+    const struct plugin_list*   plugins,
+    const struct cmd_list*      cmds,
+    const struct symbol_table*  symbols,
+    struct semantic_session*    session);
@@ -3,7 +3,16 @@
 #include "odb-compiler/config.h"
 
 struct ast;
+struct symbol_table;
 
 ODBCOMPILER_PUBLIC_API void
 post_delete_polymorphic_functions(struct ast** tus, int tu_count);
 
+/*!
+ * @brief Removes the nodes deleted during semantic analysis from every TU in
+ * which they make up a large enough part of the AST, and updates the symbol
+ * table to the new node IDs. See @see ast_gc().
+ * @return Returns 0 on success, negative if out of memory.
+ */
+ODBCOMPILER_PUBLIC_API int
+post_gc(struct ast** tus, int tu_count, struct symbol_table* symbols);
@@ -1,14 +1,16 @@
 #pragma once
 
+#include "odb-compiler/ast/ast.h"
 #include "odb-compiler/config.h"
 #include "odb-util/utf8.h"
 #include <stdint.h>
 
-struct ast;
 struct cmd_list;
 struct db_source;
 struct mutex;
 struct plugin_list;
+struct semantic_sched;
+struct semantic_session;
 struct symbol_table;
 
 typedef int (*semantic_check_func)(
@@ -20,15 +22,103 @@ typedef int (*semantic_check_func)(
     const struct db_source*    sources,
     const struct plugin_list*  plugins,
     const struct cmd_list*     cmds,
-    const struct symbol_table* symbols);
+    const struct symbol_table* symbols,
+    struct semantic_session*   session);
+
+enum semantic_check_flags
+{
+    /*!
+     * The check may modify TUs other than the one it is run on, and locks
+     * them itself. If there is more than one TU, the check starts once its
+     * dependencies have finished on its own TU, and waits for them to finish
+     * on any other TU it looks into, see semantic_session_wait_for_tu().
+     * Checks depending on it only run once it has finished on all TUs. The
+     * calling thread must not own the memory of any AST. See mem_acquire_ast()
+     */
+    SEMANTIC_CHECK_CROSS_TU = 0x01
+};
+
+/*!
+ * Called for a single node of the AST. The visitor may modify the node and the
+ * nodes below it, but nothing else. The AST may be reallocated.
+ */
+typedef int (*semantic_visit_func)(
+    struct ast** astp, ast_id n, const char* filename, const char* source);
+
+enum semantic_visit_order
+{
+    /*!
+     * The visitor relies on its dependencies having visited every node of the
+     * AST. It can only share a traversal with checks it doesn't depend on.
+     */
+    SEMANTIC_VISIT_ANY_ORDER,
+    /*!
+     * The visitor only relies on its dependencies having visited the nodes
+     * below the node it is called for. It can share a post-order traversal
+     * with them.
+     */
+    SEMANTIC_VISIT_CHILDREN_FIRST,
+    /*!
+     * The visitor only relies on its dependencies having visited the parents
+     * of the node it is called for. It can share a pre-order traversal with
+     * them.
+     */
+    SEMANTIC_VISIT_PARENTS_FIRST
+};
+
+#define SEMANTIC_VISIT_NODE(type) ((uint64_t)1 << (type))
+
+struct semantic_visitor
+{
+    semantic_visit_func       visit;
+    /* Bitmask of the node types to call the visitor for. See
+     * SEMANTIC_VISIT_NODE() */
+    uint64_t                  node_types;
+    enum semantic_visit_order order;
+};
 
 struct semantic_check
 {
-    semantic_check_func           execute;
-    const struct semantic_check** depends_on;
-    const char*                   name;
+    semantic_check_func            execute;
+    const struct semantic_check**  depends_on;
+    const char*                    name;
+    int                            flags;
+    /* If not NULL, the check only looks at individual nodes and can be fused
+     * with other checks into a single traversal of the AST. See
+     * semantic_visit() */
+    const struct semantic_visitor* visitor;
 };
 
+/*!
+ * @brief Traverses the AST once and calls the visitors of all checks on each
+ * node, in the order the checks are listed. All checks must have a visitor.
+ * Once a visitor fails, neither it nor the visitors of the checks depending on
+ * it are called again, but the other visitors finish the traversal.
+ * @return Returns 0 if all visitors succeeded, -1 otherwise.
+ */
+ODBCOMPILER_PUBLIC_API int
+semantic_visit(
+    const struct semantic_check* const* checks,
+    int                                 check_count,
+    enum semantic_visit_order           order,
+    struct ast**                        astp,
+    const char*                         filename,
+    const char*                         source);
+
+/*!
+ * @brief Logs the passes that are run for a check and everything it depends
+ * on, and which checks are fused into a single traversal of the AST.
+ */
+ODBCOMPILER_PUBLIC_API int
+semantic_log_passes(const struct semantic_check* check);
+
+/*!
+ * @brief Logs the passes of the essential checks. See @see
+ * semantic_log_passes().
+ */
+ODBCOMPILER_PUBLIC_API int
+semantic_log_essential_passes(void);
+
 ODBCOMPILER_PUBLIC_API int
 semantic_check_run(
     const struct semantic_check* check,
@@ -40,8 +130,155 @@ semantic_check_run(
     const struct db_source*      sources,
     const struct plugin_list*    plugins,
     const struct cmd_list*       cmds,
-    const struct symbol_table*   symbols);
+    const struct symbol_table*   symbols,
+    struct semantic_session*     session);
+
+/*!
+ * @brief Runs a check and everything it depends on, on all TUs. Every
+ * (check, TU) pair is a task, and the tasks are run on a pool of worker threads
+ * as soon as the tasks they depend on have finished. Checks that don't depend
+ * on each other can overlap, and a cross-TU check only waits for the TUs it
+ * looks into. See @see SEMANTIC_CHECK_CROSS_TU.
+ *
+ * Tasks on the same TU never run at the same time, because most checks modify
+ * the AST. If a check fails on a TU, the checks depending on it are skipped,
+ * but the other tasks still run so that as many errors as possible are
+ * reported.
+ *
+ * The checks of all TUs share the state in @p session, see @see
+ * semantic_session_create().
+ *
+ * The calling thread must not own the memory of any AST. See mem_acquire_ast()
+ */
+ODBCOMPILER_PUBLIC_API int
+semantic_check_run_parallel(
+    const struct semantic_check* check,
+    struct ast**                 tus,
+    int                          tu_count,
+    struct mutex**               tu_mutexes,
+    const struct utf8*           filenames,
+    const struct db_source*      sources,
+    const struct plugin_list*    plugins,
+    const struct cmd_list*       cmds,
+    const struct symbol_table*   symbols,
+    struct semantic_session*     session);
+
+/*!
+ * @brief Same as @see semantic_check_run_parallel(), but the checks can start
+ * while the TUs are still being parsed.
+ *
+ * The passes of a TU wait until @see semantic_sched_tu_ready() is called for
+ * it, which also adds the declarations of the TU to @p session. All passes are
+ * called with a NULL symbol table. Passes that look up symbols (see @see
+ * SEMANTIC_CHECK_CROSS_TU) look them up in @p session instead, and wait for
+ * the TUs that declare them. See @see semantic_session_find_symbol().
+ *
+ * @return Returns NULL on failure.
+ */
+ODBCOMPILER_PUBLIC_API struct semantic_sched*
+semantic_sched_start(
+    const struct semantic_check* check,
+    struct ast**                 tus,
+    int                          tu_count,
+    struct mutex**               tu_mutexes,
+    const struct utf8*           filenames,
+    const struct db_source*      sources,
+    const struct plugin_list*    plugins,
+    const struct cmd_list*       cmds,
+    struct semantic_session*     session);
+
+/*!
+ * @brief Call once a TU was parsed. The calling thread must not own the memory
+ * of the AST. See mem_acquire_ast()
+ */
+ODBCOMPILER_PUBLIC_API void
+semantic_sched_tu_ready(struct semantic_sched* sched, int tu_id);
+
+/*!
+ * @brief Call if a TU failed to parse. None of its passes run, nor anything
+ * that depends on them.
+ */
+ODBCOMPILER_PUBLIC_API void
+semantic_sched_tu_failed(struct semantic_sched* sched, int tu_id);
 
+/*!
+ * @brief Waits for all passes to finish and frees the scheduler. TUs that were
+ * never made ready count as failures. Afterwards, the declarations of all TUs
+ * are in @see semantic_session_symbols().
+ * @return Returns 0 if all passes of all TUs succeeded, -1 otherwise.
+ */
+ODBCOMPILER_PUBLIC_API int
+semantic_sched_finish(struct semantic_sched* sched);
+
+/*!
+ * @brief Runs the essential checks on all TUs. See @see
+ * semantic_check_run_parallel().
+ */
+ODBCOMPILER_PUBLIC_API int
+semantic_run_essential_checks_parallel(
+    struct ast**               tus,
+    int                        tu_count,
+    struct mutex**             tu_mutexes,
+    const struct utf8*         filenames,
+    const struct db_source*    sources,
+    const struct plugin_list*  plugins,
+    const struct cmd_list*     cmds,
+    const struct symbol_table* symbols,
+    struct semantic_session*   session);
+
+/*!
+ * @brief Starts the essential checks on TUs that are still being parsed. See
+ * @see semantic_sched_start().
+ */
+ODBCOMPILER_PUBLIC_API struct semantic_sched*
+semantic_sched_start_essential_checks(
+    struct ast**              tus,
+    int                       tu_count,
+    struct mutex**            tu_mutexes,
+    const struct utf8*        filenames,
+    const struct db_source*   sources,
+    const struct plugin_list* plugins,
+    const struct cmd_list*    cmds,
+    struct semantic_session*  session);
+
+/*!
+ * @brief The essential checks are split into steps so that multiple TUs can be
+ * checked in parallel. Type checking a TU may type check the functions it calls
+ * in other TUs, so all TUs must have finished @see SEMANTIC_STEP_PREPARE before
+ * any TU starts @see SEMANTIC_STEP_TYPE_CHECK, and all TUs must have finished
+ * type checking before any TU starts @see SEMANTIC_STEP_FINISH. The scheduler
+ * doesn't need these barriers, see @see semantic_check_run_parallel().
+ */
+enum semantic_step
+{
+    /* Runs the checks the type check depends on */
+    SEMANTIC_STEP_PREPARE,
+    /* If there is more than one TU, the ASTs are handed between threads during
+     * this step. The calling thread must not own the memory of any AST. See
+     * mem_acquire_ast() */
+    SEMANTIC_STEP_TYPE_CHECK,
+    /* Runs the remaining essential checks */
+    SEMANTIC_STEP_FINISH
+};
+
+ODBCOMPILER_PUBLIC_API int
+semantic_run_essential_step(
+    enum semantic_step         step,
+    struct ast**               tus,
+    int                        tu_count,
+    int                        tu_id,
+    struct mutex**             tu_mutexes,
+    const struct utf8*         filenames,
+    const struct db_source*    sources,
+    const struct plugin_list*  plugins,
+    const struct cmd_list*     cmds,
+    const struct symbol_table* symbols,
+    struct semantic_session*   session);
+
+/*!
+ * @brief Runs all steps of the essential checks on a TU. Only use this if the
+ * TUs are checked one after another.
+ */
 ODBCOMPILER_PUBLIC_API int
 semantic_run_essential_checks(
     struct ast**               tus,
@@ -52,7 +289,8 @@ semantic_run_essential_checks(
     const struct db_source*    sources,
     const struct plugin_list*  plugins,
     const struct cmd_list*     cmds,
-    const struct symbol_table* symbols);
+    const struct symbol_table* symbols,
+    struct semantic_session*   session);
 
 /*!
  * Analyzes all expression trees and ensures that the types of the operands are
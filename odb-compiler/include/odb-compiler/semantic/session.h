@@ -0,0 +1,119 @@
+#pragma once
+
+#include "odb-compiler/config.h"
+#include "odb-util/utf8.h"
+
+struct ast;
+struct db_source;
+struct func_table;
+struct overload_cache;
+struct symbol_table;
+struct symbol_table_entry;
+
+/*!
+ * @brief State that the semantic checks of all TUs share while they run. A
+ * session is created before the checks of a program are run, and destroyed
+ * once they are done. Checks that only look at their own TU don't need it.
+ * The command list must not change while the session is in use.
+ */
+struct semantic_session;
+
+ODBCOMPILER_PUBLIC_API struct semantic_session*
+semantic_session_create(void);
+
+ODBCOMPILER_PUBLIC_API void
+semantic_session_destroy(struct semantic_session* session);
+
+/*!
+ * @brief Gets the table in which the type checks of all TUs share the
+ * signatures of their functions. See @see func_table.h.
+ */
+ODBCOMPILER_PUBLIC_API struct func_table*
+semantic_session_funcs(struct semantic_session* session);
+
+/*!
+ * @brief Gets the overloads the overload resolution of all TUs chose for the
+ * commands. See @see overload_cache.h.
+ */
+ODBCOMPILER_PUBLIC_API struct overload_cache*
+semantic_session_overloads(struct semantic_session* session);
+
+/*!
+ * @brief Starts tracking which TUs are prepared, i.e. which TUs the checks that
+ * look into other TUs can use, see @see semantic_session_wait_for_tu(). Called
+ * by the scheduler before any checks run. Also forgets the declarations added
+ * by an earlier run.
+ * @return Returns 0 on success, negative if out of memory.
+ */
+ODBCOMPILER_PUBLIC_API int
+semantic_session_begin(struct semantic_session* session, int tu_count);
+
+/*!
+ * @brief All checks that the cross-TU checks depend on finished on the TU. If
+ * @p failed is set, one of them failed or was skipped.
+ */
+ODBCOMPILER_PUBLIC_API void
+semantic_session_tu_prepared(
+    struct semantic_session* session, int tu_id, int failed);
+
+/*!
+ * @brief Blocks until the TU is prepared. TUs that aren't tracked by a
+ * scheduler are assumed to be prepared.
+ * @return Returns 0 if the TU can be used, -1 if the checks on it failed.
+ */
+ODBCOMPILER_PUBLIC_API int
+semantic_session_wait_for_tu(struct semantic_session* session, int tu_id);
+
+/*!
+ * @brief Adds the declarations of a TU as soon as it was parsed, so the checks
+ * of other TUs can look them up while the remaining TUs are still being
+ * parsed. Symbols declared by more than one TU are reported, see
+ * @see symbol_table_merge().
+ * @return Returns 0 on success, negative on error.
+ */
+ODBCOMPILER_PUBLIC_API int
+semantic_session_add_declarations(
+    struct semantic_session* session,
+    struct ast**             tus,
+    int                      tu_id,
+    const struct db_source*  sources);
+
+/*!
+ * @brief No more declarations are added. Lookups of symbols that don't exist
+ * stop waiting for them.
+ */
+ODBCOMPILER_PUBLIC_API void
+semantic_session_symbols_complete(struct semantic_session* session);
+
+/*!
+ * @brief Looks up a symbol while declarations are still being added.
+ * @param[out] entry Set if the symbol was found.
+ * @param[out] generation If the symbol was not found, set to the number of
+ * times declarations were added so far. See
+ * @see semantic_session_wait_for_symbols().
+ * @return Returns 1 if the symbol was found, 0 if it may still be declared,
+ * and -1 if all declarations were added. In the latter case, the symbols can
+ * be looked up in @see semantic_session_symbols() without locking.
+ */
+ODBCOMPILER_PUBLIC_API int
+semantic_session_find_symbol(
+    struct semantic_session*   session,
+    struct utf8_view           key,
+    struct symbol_table_entry* entry,
+    int*                       generation);
+
+/*!
+ * @brief Blocks until more declarations were added since @p generation, or
+ * until all declarations were added.
+ */
+ODBCOMPILER_PUBLIC_API void
+semantic_session_wait_for_symbols(
+    struct semantic_session* session, int generation);
+
+/*!
+ * @brief Gets the declarations added with
+ * @see semantic_session_add_declarations(). Must only be used once all
+ * declarations were added.
+ */
+ODBCOMPILER_PUBLIC_API struct symbol_table*
+semantic_session_symbols(struct semantic_session* session);
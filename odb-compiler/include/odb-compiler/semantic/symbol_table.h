@@ -34,9 +34,35 @@ symbol_table_add_declarations_from_ast(
     int                     tu_id,
     const struct db_source* sources);
 
+/*!
+ * @brief Adds all symbols of @p other to @p table. Parser threads each
+ * register the declarations of their TUs in a table of their own, which are
+ * merged once all threads are done. Merging a symbol that already exists in
+ * @p table with the same definition does nothing. If the definitions differ,
+ * an error is logged. @p other is left unchanged and still has to be
+ * deinitialized.
+ * @return Returns 0 on success, -1 if a symbol is declared more than once or
+ * if memory could not be allocated.
+ */
+ODBCOMPILER_PUBLIC_API int
+symbol_table_merge(
+    struct symbol_table** table, const struct symbol_table* other);
+
+/*!
+ * @brief Looks up a symbol. The table is only read, so once all declarations
+ * were added, any number of threads can look up symbols without locking.
+ */
 ODBCOMPILER_PUBLIC_API const struct symbol_table_entry*
 symbol_table_find(const struct symbol_table* table, struct utf8_view key);
 
+/*!
+ * @brief Updates the node of every symbol defined in a TU after its AST was
+ * renumbered by @see ast_gc(). Symbols whose node was removed are set to -1.
+ */
+ODBCOMPILER_PUBLIC_API void
+symbol_table_remap_tu(
+    struct symbol_table* table, int tu_id, const ast_id* remap);
+
 ODBCOMPILER_PUBLIC_API void
 mem_acquire_symbol_table(struct symbol_table* table);
 
@@ -13,16 +13,43 @@ ast_grow(struct ast** astp)
     struct ast* ast = *astp;
     if (ast == NULL || ast->count == ast->capacity)
     {
-        ast_id   new_capacity = ast ? ast->capacity * 2 : 128;
-        mem_size header_size = offsetof(struct ast, nodes);
-        mem_size nodes_size = sizeof(union ast_node) * new_capacity;
-
-        struct ast* new_ast = mem_realloc(ast, header_size + nodes_size);
+        ast_id               new_capacity = ast ? ast->capacity * 2 : 128;
+        mem_size             header_size = offsetof(struct ast, nodes);
+        mem_size             nodes_size = sizeof(union ast_node) * new_capacity;
+        mem_size             locs_size
+            = sizeof(struct ast_loc_info) * new_capacity;
+        struct ast_loc_info* new_locs;
+        struct ast*          new_ast;
+
+        if (ast && ast->parents)
+        {
+            mem_size parents_size = sizeof(ast_id) * new_capacity;
+            ast_id*  new_parents = mem_realloc(ast->parents, parents_size);
+            if (new_parents == NULL)
+                return log_oom(parents_size, "new_node()");
+            ast->parents = new_parents;
+        }
+
+        new_locs = mem_realloc(ast ? ast->locs : NULL, locs_size);
+        if (new_locs == NULL)
+            return log_oom(locs_size, "new_node()");
+        if (ast)
+            ast->locs = new_locs;
+
+        new_ast = mem_realloc(ast, header_size + nodes_size);
         if (new_ast == NULL)
+        {
+            if (ast == NULL)
+                mem_free(new_locs);
             return log_oom(header_size + nodes_size, "new_node()");
+        }
 
         if (ast == NULL)
+        {
             new_ast->count = 0;
+            new_ast->parents = NULL;
+            new_ast->locs = new_locs;
+        }
         new_ast->capacity = new_capacity;
         ast = new_ast;
         *astp = new_ast;
@@ -40,21 +67,59 @@ new_node(struct ast** astp, enum ast_type type, struct utf8_span location)
         return -1;
     ast = *astp;
 
-    ast->nodes[n].info.location = location;
+    ast->locs[n].location = location;
+    ast->locs[n].explicit_type_location = empty_utf8_span();
+    ast->locs[n].scope_location = empty_utf8_span();
+    ast->locs[n].combined_location = empty_utf8_span();
+    ast->locs[n].op_location = empty_utf8_span();
+    ast->locs[n].endfunction_location = empty_utf8_span();
     ast->nodes[n].info.scope_id = 0;
     ast->nodes[n].info.node_type = type;
     ast->nodes[n].info.type_info = TYPE_INVALID;
     ast->nodes[n].base.left = -1;
     ast->nodes[n].base.right = -1;
+    ast_set_parent(ast, n, -1);
 
     return n;
 }
 
+/* Updates the parent index after the children of "n" were set */
+static void
+link_children(struct ast* ast, ast_id n)
+{
+    ast_set_parent(ast, ast->nodes[n].base.left, n);
+    ast_set_parent(ast, ast->nodes[n].base.right, n);
+}
+
 void
 ast_deinit(struct ast* ast)
 {
     if (ast)
+    {
+        if (ast->parents)
+            mem_free(ast->parents);
+        mem_free(ast->locs);
         mem_free(ast);
+    }
+}
+
+int
+ast_parents_build(struct ast* ast)
+{
+    ast_id n;
+    if (ast == NULL || ast->parents)
+        return 0;
+
+    ast->parents = mem_alloc(sizeof(ast_id) * ast->capacity);
+    if (ast->parents == NULL)
+        return log_oom(sizeof(ast_id) * ast->capacity, "ast_parents_build()");
+
+    for (n = 0; n != ast_count_unsafe(ast); ++n)
+        ast->parents[n] = -1;
+    for (n = 0; n != ast_count_unsafe(ast); ++n)
+        link_children(ast, n);
+
+    return 0;
 }
 
 #if defined(ODBUTIL_MEM_DEBUGGING)
@@ -68,10 +133,19 @@ mem_acquire_ast(struct ast* ast)
     header = offsetof(struct ast, nodes);
     nodes = sizeof(union ast_node) * ast->capacity;
     mem_acquire(ast, header + nodes);
+    mem_acquire(ast->locs, sizeof(struct ast_loc_info) * ast->capacity);
+    if (ast->parents)
+        mem_acquire(ast->parents, sizeof(ast_id) * ast->capacity);
 }
 void
 mem_release_ast(struct ast* ast)
 {
+    if (ast == NULL)
+        return;
+
+    if (ast->parents)
+        mem_release(ast->parents);
+    mem_release(ast->locs);
     mem_release(ast);
 }
 #endif
@@ -83,7 +157,9 @@ ast_dup_node(struct ast** astp, ast_id n)
     if (dup < 0)
         return -1;
 
-    memcpy(&(*astp)->nodes[dup], &(*astp)->nodes[n], sizeof(union ast_node));
+    (*astp)->nodes[dup] = (*astp)->nodes[n];
+    (*astp)->locs[dup] = (*astp)->locs[n];
+    ast_set_parent(*astp, dup, -1);
     return dup;
 }
 
@@ -97,6 +173,7 @@ ast_block(struct ast** astp, ast_id stmt, struct utf8_span location)
 
     ODBUTIL_DEBUG_ASSERT(stmt > -1, log_parser_err("stmt: %d\n", stmt));
     ast->nodes[n].block.stmt = stmt;
+    ast_set_parent(ast, stmt, n);
 
     return n;
 }
@@ -118,6 +195,7 @@ ast_block_append(struct ast* ast, ast_id block, ast_id append_block)
         block = ast->nodes[block].block.next;
 
     ast->nodes[block].block.next = append_block;
+    ast_set_parent(ast, append_block, block);
 }
 ast_id
 ast_block_append_stmt(
@@ -130,6 +208,7 @@ ast_block_append_stmt(
 
     ast_block_append(ast, block, n);
     ast->nodes[n].block.stmt = stmt;
+    ast_set_parent(ast, stmt, n);
 
     return n;
 }
@@ -150,7 +229,8 @@ ast_arglist(struct ast** astp, ast_id expr, struct utf8_span location)
 
     ODBUTIL_DEBUG_ASSERT(expr > -1, log_parser_err("expr: %d\n", expr));
     ast->nodes[n].arglist.expr = expr;
-    ast->nodes[n].arglist.combined_location = location;
+    ast->locs[n].combined_location = location;
+    ast_set_parent(ast, expr, n);
 
     return n;
 }
@@ -173,17 +253,19 @@ ast_arglist_append(
         log_parser_err("type: %d\n", ast->nodes[arglist].info.node_type));
 
     combined_location
-        = utf8_span_union(ast->nodes[arglist].info.location, location);
+        = utf8_span_union(ast->locs[arglist].location, location);
     while (ast->nodes[arglist].arglist.next != -1)
     {
-        ast->nodes[arglist].arglist.combined_location = combined_location;
+        ast->locs[arglist].combined_location = combined_location;
         arglist = ast->nodes[arglist].arglist.next;
     }
 
-    ast->nodes[arglist].arglist.combined_location = combined_location;
+    ast->locs[arglist].combined_location = combined_location;
     ast->nodes[arglist].arglist.next = n;
     ast->nodes[n].arglist.expr = expr;
-    ast->nodes[n].arglist.combined_location = combined_location;
+    ast->locs[n].combined_location = combined_location;
+    ast_set_parent(ast, n, arglist);
+    ast_set_parent(ast, expr, n);
 
     return n;
 }
@@ -203,7 +285,8 @@ ast_paramlist(struct ast** astp, ast_id identifier, struct utf8_span location)
         log_parser_err("type: %d\n", ast->nodes[identifier].info.node_type));
 
     ast->nodes[n].paramlist.identifier = identifier;
-    ast->nodes[n].paramlist.combined_location = location;
+    ast->locs[n].combined_location = location;
+    ast_set_parent(ast, identifier, n);
 
     return n;
 }
@@ -234,17 +317,19 @@ ast_paramlist_append(
         log_parser_err("type: %d\n", ast->nodes[identifier].info.node_type));
 
     combined_location
-        = utf8_span_union(ast->nodes[paramlist].info.location, location);
+        = utf8_span_union(ast->locs[paramlist].location, location);
     while (ast->nodes[paramlist].paramlist.next != -1)
     {
-        ast->nodes[paramlist].paramlist.combined_location = combined_location;
+        ast->locs[paramlist].combined_location = combined_location;
         paramlist = ast->nodes[paramlist].paramlist.next;
     }
 
-    ast->nodes[paramlist].paramlist.combined_location = combined_location;
+    ast->locs[paramlist].combined_location = combined_location;
     ast->nodes[paramlist].paramlist.next = n;
     ast->nodes[n].paramlist.identifier = identifier;
-    ast->nodes[n].paramlist.combined_location = combined_location;
+    ast->locs[n].combined_location = combined_location;
+    ast_set_parent(ast, n, paramlist);
+    ast_set_parent(ast, identifier, n);
 
     return n;
 }
@@ -265,6 +350,7 @@ ast_command(
 
     ast->nodes[n].cmd.id = cmd_id;
     ast->nodes[n].cmd.arglist = arglist;
+    ast_set_parent(ast, arglist, n);
 
     return n;
 }
@@ -291,7 +377,8 @@ ast_assign(
 
     ast->nodes[n].assignment.lvalue = identifier;
     ast->nodes[n].assignment.expr = expr;
-    ast->nodes[n].assignment.op_location = op_location;
+    ast->locs[n].op_location = op_location;
+    link_children(ast, n);
 
     return n;
 }
@@ -312,8 +399,6 @@ ast_identifier(
     ast->nodes[n].identifier.annotation = annotation;
     ast->nodes[n].identifier.explicit_type = TYPE_INVALID;
     ast->nodes[n].identifier.scope = SCOPE_LOCAL;
-    ast->nodes[n].identifier.explicit_type_location = empty_utf8_span();
-    ast->nodes[n].identifier.scope_location = empty_utf8_span();
 
     return n;
 }
@@ -331,7 +416,7 @@ ast_identifier_set_explicit_type(
         log_parser_err("type: %d\n", ast->nodes[identifier].info.node_type));
 
     ast->nodes[identifier].identifier.explicit_type = explicit_type;
-    ast->nodes[identifier].identifier.explicit_type_location = location;
+    ast->locs[identifier].explicit_type_location = location;
 }
 
 void
@@ -347,7 +432,7 @@ ast_identifier_set_scope(
         log_parser_err("type: %d\n", ast->nodes[identifier].info.node_type));
 
     ast->nodes[identifier].identifier.scope = scope;
-    ast->nodes[identifier].identifier.scope_location = location;
+    ast->locs[identifier].scope_location = location;
 }
 
 ast_id
@@ -369,8 +454,9 @@ ast_binop(
 
     ast->nodes[n].binop.left = left;
     ast->nodes[n].binop.right = right;
-    ast->nodes[n].binop.op_location = op_location;
+    ast->locs[n].op_location = op_location;
     ast->nodes[n].binop.op = op;
+    link_children(ast, n);
 
     return n;
 }
@@ -391,6 +477,7 @@ ast_unop(
 
     ast->nodes[n].unop.expr = expr;
     ast->nodes[n].unop.op = op;
+    ast_set_parent(ast, expr, n);
 
     return n;
 }
@@ -449,6 +536,7 @@ ast_cond(
 
     ast->nodes[n].cond.expr = expr;
     ast->nodes[n].cond.cond_branches = cond_branches;
+    link_children(ast, n);
     return n;
 }
 
@@ -470,6 +558,7 @@ ast_cond_branches(
 
     ast->nodes[n].cond_branches.yes = yes;
     ast->nodes[n].cond_branches.no = no;
+    link_children(ast, n);
 
     return n;
 }
@@ -489,10 +578,12 @@ ast_loop(
         return -1;
 
     ast->nodes[loop_body].loop_body.body = body;
+    ast_set_parent(ast, body, loop_body);
 
     ast->nodes[n].loop.loop_body = loop_body;
     ast->nodes[n].loop.name = name;
     ast->nodes[n].loop.implicit_name = implicit_name;
+    ast_set_parent(ast, loop_body, n);
 
     return n;
 }
@@ -574,14 +665,18 @@ ast_loop_for(
 
     ast->nodes[loop_for3].loop_for3.step = step;
     ast->nodes[loop_for3].loop_for3.next = next;
+    link_children(ast, loop_for3);
 
     ast->nodes[loop_for2].loop_for2.loop_for3 = loop_for3;
     ast->nodes[loop_for2].loop_for2.end = end;
+    link_children(ast, loop_for2);
 
     ast->nodes[loop_for1].loop_for1.loop_for2 = loop_for2;
     ast->nodes[loop_for1].loop_for1.init = init;
+    link_children(ast, loop_for1);
 
     ast->nodes[loop].loop.loop_for1 = loop_for1;
+    ast_set_parent(ast, loop_for1, loop);
 
     return loop;
 }
@@ -600,6 +695,7 @@ ast_loop_cont(
 
     ast->nodes[n].cont.name = name;
     ast->nodes[n].cont.step = step;
+    ast_set_parent(ast, step, n);
 
     return n;
 }
@@ -673,12 +769,12 @@ ast_func(
         log_parser_err("type: %d\n", ast->nodes[paramlist].info.node_type));
     ast->nodes[decl].func_decl.paramlist = paramlist;
 
-    ast->nodes[decl].func_decl.info.location
+    ast->locs[decl].location
         = paramlist > -1
               ? utf8_span_union(
-                    ast->nodes[identifier].info.location,
-                    ast->nodes[paramlist].paramlist.combined_location)
-              : ast->nodes[identifier].info.location;
+                    ast->locs[identifier].location,
+                    ast->locs[paramlist].combined_location)
+              : ast->locs[identifier].location;
 
     ODBUTIL_DEBUG_ASSERT(
         body == -1 || ast->nodes[body].info.node_type == AST_BLOCK,
@@ -688,7 +784,10 @@ ast_func(
 
     ast->nodes[func].func.decl = decl;
     ast->nodes[func].func.def = def;
-    ast->nodes[func].func.endfunction_location = endfunction_location;
+    ast->locs[func].endfunction_location = endfunction_location;
+    link_children(ast, decl);
+    link_children(ast, def);
+    link_children(ast, func);
 
     if (ast_func_is_polymorphic(ast, func))
         ast->nodes[func].info.node_type = AST_FUNC_POLY;
@@ -705,6 +804,7 @@ ast_func_exit(struct ast** astp, ast_id retval, struct utf8_span location)
         return -1;
 
     ast->nodes[n].func_exit.retval = retval;
+    ast_set_parent(ast, retval, n);
 
     return n;
 }
@@ -732,6 +832,7 @@ ast_func_or_container_ref(
 
     ast->nodes[n].func_or_container_ref.identifier = identifier;
     ast->nodes[n].func_or_container_ref.arglist = arglist;
+    link_children(ast, n);
 
     return n;
 }
@@ -887,6 +988,7 @@ ast_cast(
 
     ast->nodes[n].cast.expr = expr;
     ast->nodes[n].cast.explicit_type = target_type;
+    ast_set_parent(ast, expr, n);
 
     return n;
 }
@@ -902,6 +1004,7 @@ ast_scope(struct ast** astp, ast_id child, struct utf8_span location)
     ODBUTIL_DEBUG_ASSERT(child > -1, log_parser_err("expr: %d\n", child));
 
     ast->nodes[n].scope.child = child;
+    ast_set_parent(ast, child, n);
 
     return n;
 }
@@ -89,32 +89,110 @@ report_unconnected_nodes(const struct ast* ast)
     ast_id n;
     for (n = 0; n != ast_count(ast); ++n)
     {
-        ast_id parent = ast_find_parent(ast, n);
+        ast_id parent;
+        if (ast_node_type(ast, n) == AST_GC)
+            continue;
+
+        parent = ast_find_parent(ast, n);
         if (parent == -1 && n != ast->root)
             print_subtree(ast, n, 0);
     }
 }
 
+static int
+verify_parents(const struct ast* ast)
+{
+    ast_id n;
+    int    error = 0;
+    for (n = 0; n != ast_count(ast); ++n)
+    {
+        ast_id parent = ast->parents[n];
+        ast_id left = ast->nodes[n].base.left;
+        ast_id right = ast->nodes[n].base.right;
+        if (ast_node_type(ast, n) == AST_GC)
+            continue;
+
+        if (left > -1 && ast->parents[left] != n)
+        {
+            log_err(
+                "[ast] ",
+                "Parent index of node %d is %d, but node %d refers to it\n",
+                left,
+                ast->parents[left],
+                n);
+            error = -1;
+        }
+        if (right > -1 && ast->parents[right] != n)
+        {
+            log_err(
+                "[ast] ",
+                "Parent index of node %d is %d, but node %d refers to it\n",
+                right,
+                ast->parents[right],
+                n);
+            error = -1;
+        }
+
+        if (parent > -1 && ast->nodes[parent].base.left != n
+            && ast->nodes[parent].base.right != n)
+        {
+            log_err(
+                "[ast] ",
+                "Parent index of node %d is %d, but %d has no such child\n",
+                n,
+                parent,
+                parent);
+            error = -1;
+        }
+    }
+
+    if (ast->root > -1 && ast->parents[ast->root] != -1)
+    {
+        log_err(
+            "[ast] ",
+            "Root node %d has parent %d in the parent index\n",
+            ast->root,
+            ast->parents[ast->root]);
+        error = -1;
+    }
+
+    return error;
+}
+
+static ast_id
+count_live_nodes(const struct ast* ast)
+{
+    ast_id n, count = 0;
+    for (n = 0; n != ast_count(ast); ++n)
+        if (ast_node_type(ast, n) != AST_GC)
+            count++;
+    return count;
+}
+
 int
 ast_verify_connectivity(const struct ast* ast)
 {
     ast_id count = count_nodes_recurse(ast, ast->root, 0);
+    ast_id live = count_live_nodes(ast);
     if (count < 0)
     {
         log_err("[ast] ", "AST recursion depth exceeds node count\n");
         return -1;
     }
-    else if (count != ast_count(ast))
+    else if (count != live)
     {
         log_err(
             "[ast] ",
             "%d out of %d nodes reachable from root. Did you forget to call "
-            "ast_gc()?\n",
+            "ast_delete_tree()?\n",
             count,
-            ast_count(ast));
+            live);
         report_unconnected_nodes(ast);
         return -1;
     }
 
+    if (ast->parents && verify_parents(ast) != 0)
+        return -1;
+
     return 0;
 }
@@ -2,13 +2,71 @@
 #include "odb-compiler/ast/ast_ops.h"
 #include "odb-util/config.h"
 #include "odb-util/log.h"
+#include "odb-util/mem.h"
 #include <assert.h>
 
+static ast_id
+swap_id(ast_id n, ast_id n1, ast_id n2)
+{
+    return n == n1 ? n2 : n == n2 ? n1 : n;
+}
+
+static void
+swap_child_ids(struct ast* ast, ast_id parent, ast_id n1, ast_id n2)
+{
+    union ast_node* node = &ast->nodes[parent];
+    node->base.left = swap_id(node->base.left, n1, n2);
+    node->base.right = swap_id(node->base.right, n1, n2);
+}
+
+static void
+link_children(struct ast* ast, ast_id n)
+{
+    ast_set_parent(ast, ast->nodes[n].base.left, n);
+    ast_set_parent(ast, ast->nodes[n].base.right, n);
+}
+
+static void
+swap_nodes(struct ast* ast, ast_id n1, ast_id n2)
+{
+    union ast_node      tmp = ast->nodes[n1];
+    struct ast_loc_info tmp_loc = ast->locs[n1];
+    ast->nodes[n1] = ast->nodes[n2];
+    ast->nodes[n2] = tmp;
+    ast->locs[n1] = ast->locs[n2];
+    ast->locs[n2] = tmp_loc;
+}
+
+static void
+swap_node_idxs_indexed(struct ast* ast, ast_id n1, ast_id n2)
+{
+    ast_id p1 = ast->parents[n1];
+    ast_id p2 = ast->parents[n2];
+
+    /* Only the parents of the two nodes refer to them */
+    if (p1 > -1)
+        swap_child_ids(ast, p1, n1, n2);
+    if (p2 > -1 && p2 != p1)
+        swap_child_ids(ast, p2, n1, n2);
+
+    swap_nodes(ast, n1, n2);
+
+    ast->parents[n1] = swap_id(p2, n1, n2);
+    ast->parents[n2] = swap_id(p1, n1, n2);
+    link_children(ast, n1);
+    link_children(ast, n2);
+}
+
 void
 ast_swap_node_idxs(struct ast* ast, ast_id n1, ast_id n2)
 {
-    ast_id         n;
-    union ast_node tmp;
+    ast_id n;
+
+    if (ast->parents)
+    {
+        swap_node_idxs_indexed(ast, n1, n2);
+        return;
+    }
 
     for (n = 0; n != ast_count_unsafe(ast); ++n)
     {
@@ -32,9 +90,7 @@ ast_swap_node_idxs(struct ast* ast, ast_id n1, ast_id n2)
             ast->nodes[n].base.right = n2;
     }
 
-    tmp = ast->nodes[n1];
-    ast->nodes[n1] = ast->nodes[n2];
-    ast->nodes[n2] = tmp;
+    swap_nodes(ast, n1, n2);
 }
 
 void
@@ -46,9 +102,7 @@ ast_swap_node_values(struct ast* ast, ast_id n1, ast_id n2)
     ast_id n2_left = ast->nodes[n2].base.left;
     ast_id n2_right = ast->nodes[n2].base.right;
 
-    union ast_node tmp = ast->nodes[n1];
-    ast->nodes[n1] = ast->nodes[n2];
-    ast->nodes[n2] = tmp;
+    swap_nodes(ast, n1, n2);
 
     ast->nodes[n1].base.left = n1_left;
     ast->nodes[n1].base.right = n1_right;
@@ -77,9 +131,16 @@ int
 ast_find_parent(const struct ast* ast, ast_id n)
 {
     ast_id p;
+    if (ast->parents)
+        return ast->parents[n];
+
     for (p = 0; p != ast_count_unsafe(ast); ++p)
+    {
+        if (ast->nodes[p].info.node_type == AST_GC)
+            continue;
         if (ast->nodes[p].base.left == n || ast->nodes[p].base.right == n)
             return p;
+    }
     return -1;
 }
 
@@ -98,6 +159,7 @@ ast_dup_subtree(struct ast** astp, int n)
 
     (*astp)->nodes[dup].base.left = lhs;
     (*astp)->nodes[dup].base.right = rhs;
+    link_children(*astp, dup);
 
     return dup;
 }
@@ -133,23 +195,141 @@ ast_delete_tree(struct ast* ast, ast_id n)
     delete_tree_recurse(ast, n);
 }
 
-void
-ast_gc(struct ast* ast)
+/* Visits all nodes of the subtree "n" in depth-first order and assigns each of
+ * them its new ID. Deleted nodes are skipped */
+static void
+number_subtree(
+    const struct ast* ast,
+    ast_id            n,
+    ast_id*           remap,
+    ast_id*           order,
+    ast_id*           live,
+    ast_id*           stack)
 {
-    ast_id n, p;
-    for (n = 0; n < ast_count(ast); ++n)
-        if (ast->nodes[n].info.node_type == AST_GC)
+    int top = 0;
+
+    remap[n] = -2;
+    stack[top++] = n;
+    while (top > 0)
+    {
+        ast_id left, right;
+        n = stack[--top];
+        left = ast->nodes[n].base.left;
+        right = ast->nodes[n].base.right;
+
+        remap[n] = *live;
+        order[(*live)++] = n;
+
+        /* Push right first, so the left subtree is visited first */
+        if (right > -1 && remap[right] == -1
+            && ast->nodes[right].info.node_type != AST_GC)
+        {
+            remap[right] = -2;
+            stack[top++] = right;
+        }
+        if (left > -1 && remap[left] == -1
+            && ast->nodes[left].info.node_type != AST_GC)
         {
-            ast_id last = --ast->count;
-            for (p = 0; p != ast_count_unsafe(ast); ++p)
-            {
-                if (ast->nodes[p].base.left == last)
-                    ast->nodes[p].base.left = n;
-                if (ast->nodes[p].base.right == last)
-                    ast->nodes[p].base.right = n;
-            }
-            ast->nodes[n] = ast->nodes[last];
+            remap[left] = -2;
+            stack[top++] = left;
         }
+    }
+}
+
+static ast_id
+remap_id(const ast_id* remap, ast_id n)
+{
+    return n > -1 ? remap[n] : -1;
+}
+
+int
+ast_gc(struct ast** astp, ast_id** remap_out)
+{
+    struct ast*          ast = *astp;
+    struct ast*          new_ast;
+    struct ast_loc_info* new_locs;
+    ast_id*              remap;
+    ast_id*              order;
+    ast_id               n, live, capacity;
+    mem_size             header_size = offsetof(struct ast, nodes);
+
+    if (remap_out)
+        *remap_out = NULL;
+    if (ast_count(ast) == 0)
+        return 0;
+
+    remap = mem_alloc(sizeof(ast_id) * ast->count);
+    if (remap == NULL)
+        goto alloc_remap_failed;
+    /* The second half is used as the stack when visiting the tree */
+    order = mem_alloc(sizeof(ast_id) * ast->count * 2);
+    if (order == NULL)
+        goto alloc_order_failed;
+
+    for (n = 0; n != ast->count; ++n)
+        remap[n] = -1;
+
+    /* Number the nodes reachable from the root first. Live nodes that are not
+     * connected to the root are kept, but go after them */
+    live = 0;
+    if (ast->root > -1)
+        number_subtree(
+            ast, ast->root, remap, order, &live, order + ast->count);
+    for (n = 0; n != ast->count; ++n)
+        if (remap[n] == -1 && ast->nodes[n].info.node_type != AST_GC)
+            number_subtree(ast, n, remap, order, &live, order + ast->count);
+
+    /* Use the same growth steps as when the AST is built, but don't keep
+     * more memory around than is required */
+    capacity = 128;
+    while (capacity < live)
+        capacity *= 2;
+
+    new_ast = mem_alloc(header_size + sizeof(union ast_node) * capacity);
+    if (new_ast == NULL)
+        goto alloc_ast_failed;
+    new_locs = mem_alloc(sizeof(struct ast_loc_info) * capacity);
+    if (new_locs == NULL)
+        goto alloc_locs_failed;
+
+    new_ast->count = live;
+    new_ast->capacity = capacity;
+    new_ast->root = remap_id(remap, ast->root);
+    new_ast->parents = NULL;
+    new_ast->locs = new_locs;
+    for (n = 0; n != live; ++n)
+    {
+        new_ast->nodes[n] = ast->nodes[order[n]];
+        new_ast->locs[n] = ast->locs[order[n]];
+        new_ast->nodes[n].base.left
+            = remap_id(remap, new_ast->nodes[n].base.left);
+        new_ast->nodes[n].base.right
+            = remap_id(remap, new_ast->nodes[n].base.right);
+    }
+
+    if (ast->parents && ast_parents_build(new_ast) != 0)
+        goto build_parents_failed;
+
+    ast_deinit(ast);
+    *astp = new_ast;
+    mem_free(order);
+    if (remap_out)
+        *remap_out = remap;
+    else
+        mem_free(remap);
+
+    return 0;
+
+build_parents_failed:
+    mem_free(new_locs);
+alloc_locs_failed:
+    mem_free(new_ast);
+alloc_ast_failed:
+    mem_free(order);
+alloc_order_failed:
+    mem_free(remap);
+alloc_remap_failed:
+    return log_oom(sizeof(ast_id) * ast->count, "ast_gc()");
 }
 
 ast_id
@@ -248,12 +248,10 @@ get_command_function_signature(
     cmd_id cmd_id = ast->nodes[cmd].cmd.id;
 
     /* Get command arguments from command list and convert each one to LLVM */
-    const struct cmd_param_types_list* odb_param_types
-        = cmds->param_types->data[cmd_id];
     llvm::SmallVector<llvm::Type*, 8> llvm_param_types;
-    const struct cmd_param*           odb_param;
-    vec_for_each(odb_param_types, odb_param)
+    for (int i = 0; i != cmd_param_count(cmds, cmd_id); ++i)
     {
+        const struct cmd_param* odb_param = cmd_param(cmds, cmd_id, i);
         if (sdk_type == SDK_DBPRO && odb_param->type == TYPE_F32)
             llvm_param_types.push_back(llvm::Type::getInt32Ty(ir->ctx));
         else
@@ -432,6 +430,52 @@ create_db_function_table(
     return 0;
 }
 
+/* Calls to functions defined in other TUs can't be found in the table. They
+ * are declared using the types of the call, which the type check made match
+ * the function's signature, and are resolved when the TUs are linked */
+static int
+declare_external_db_functions(
+    struct ir_module*                 ir,
+    llvm::StringMap<llvm::Function*>* db_func_table,
+    const struct ast*                 ast,
+    const char*                       source)
+{
+    llvm::SmallString<128> func_name;
+    for (ast_id n = 0; n != ast_count(ast); ++n)
+    {
+        if (ast_node_type(ast, n) != AST_FUNC_CALL)
+            continue;
+
+        ast_id ast_identifier = ast->nodes[n].func_call.identifier;
+        ast_id ast_arglist = ast->nodes[n].func_call.arglist;
+        func_name_from_arglist(
+            func_name, ast, ast_identifier, ast_arglist, source);
+        if (db_func_table->find(func_name) != db_func_table->end())
+            continue;
+
+        llvm::SmallVector<llvm::Type*, 8> param_types;
+        for (; ast_arglist > -1;
+             ast_arglist = ast->nodes[ast_arglist].arglist.next)
+        {
+            ast_id    ast_arg = ast->nodes[ast_arglist].arglist.expr;
+            enum type arg_type = ast_type_info(ast, ast_arg);
+            param_types.push_back(type_to_llvm(arg_type, &ir->ctx));
+        }
+
+        llvm::Function* F = llvm::Function::Create(
+            llvm::FunctionType::get(
+                type_to_llvm(ast_type_info(ast, n), &ir->ctx),
+                param_types,
+                /* isVarArg */ false),
+            llvm::Function::ExternalLinkage,
+            func_name,
+            &ir->mod);
+        db_func_table->insert({func_name, F});
+    }
+
+    return 0;
+}
+
 static llvm::Value*
 gen_expr(
     struct ir_module*                             ir,
@@ -1621,6 +1665,7 @@ ir_translate_ast(
 
     llvm::StringMap<llvm::Function*> db_func_table;
     create_db_function_table(ir, &db_func_table, ast, source);
+    declare_external_db_functions(ir, &db_func_table, ast, source);
 
     llvm::SmallVector<loop_stack_entry, 8> loop_exit_stack;
 
@@ -1,69 +1,48 @@
 #include "./ir_internal.hpp"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/IR/LegacyPassManager.h"
-#include "llvm/MC/TargetRegistry.h"
-#include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/FileSystem.h"
-#include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/raw_ostream.h"
-#include "llvm/Target/TargetMachine.h"
-#include "llvm/Target/TargetOptions.h"
-#include "llvm/TargetParser/Host.h"
 
 extern "C" {
 #include "odb-compiler/codegen/ir.h"
 #include "odb-util/log.h"
+#include "odb-util/mstream.h"
 }
 
-int
-ir_compile(
-    struct ir_module*    ir,
-    const char*          filepath,
-    enum target_arch     arch,
-    enum target_platform platform)
+static int
+emit_object(
+    struct ir_module*        ir,
+    struct ir_session*       session,
+    llvm::raw_pwrite_stream& dest)
 {
-    /* clang-format off */
-    static const char* target_triples[3][3] = {
-        {"i386-pc-windows-msvc", "x86_64-pc-windows-msvc", ""},
-        {"i386-",                "x86_64-", ""},
-        {"i386-linux-gnu",       "x86_64-linux-gnu", ""},
-    };
-    /* clang-format on */
-
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargets();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllAsmPrinters();
+    llvm::TargetMachine* TargetMachine = ir_session_target_machine(session);
+    if (TargetMachine == nullptr)
+        return -1;
 
-    std::string Error;
-    auto TargetTriple = target_triples[platform][arch];
-    auto Target = llvm::TargetRegistry::lookupTarget(TargetTriple, Error);
+    ir->mod.setDataLayout(TargetMachine->createDataLayout());
+    ir->mod.setTargetTriple(session->triple);
 
-    // Print an error and exit if we couldn't find the requested target.
-    // This generally occurs if we've forgotten to initialise the
-    // TargetRegistry or we have a bogus target triple.
-    if (!Target)
+    /* Code generation has not been ported to the new pass manager */
+    llvm::legacy::PassManager pass;
+    auto                      FileType = llvm::CodeGenFileType::ObjectFile;
+    if (TargetMachine->addPassesToEmitFile(pass, dest, nullptr, FileType))
     {
-        llvm::errs() << Error;
+        llvm::errs() << "TargetMachine can't emit a file of this type\n";
         return -1;
     }
 
-    auto                CPU = "generic";
-    auto                Features = "";
-    llvm::TargetOptions opt;
-    auto                TargetMachine = Target->createTargetMachine(
-        TargetTriple,
-        CPU,
-        Features,
-        opt,
-        /* https://discourse.llvm.org/t/llvm-emitting-wrong-machine-code-for-x64-msvc/81226/1 */
-        platform == TARGET_WINDOWS ? llvm::Reloc::PIC_ : llvm::Reloc::Static);
-
-    log_dbg("[codegen] ", "triple: %s, CPU: %s, features: %s\n", target_triples[platform][arch], CPU, Features);
+    pass.run(ir->mod);
 
-    ir->mod.setDataLayout(TargetMachine->createDataLayout());
-    ir->mod.setTargetTriple(TargetTriple);
+    return 0;
+}
 
+int
+ir_compile(
+    struct ir_module* ir, struct ir_session* session, const char* filepath)
+{
     std::error_code      EC;
     llvm::raw_fd_ostream dest(filepath, EC, llvm::sys::fs::OF_None);
     if (EC)
@@ -72,16 +51,39 @@ ir_compile(
         return -1;
     }
 
-    llvm::legacy::PassManager pass;
-    auto                      FileType = llvm::CodeGenFileType::ObjectFile;
-    if (TargetMachine->addPassesToEmitFile(pass, dest, nullptr, FileType))
-    {
-        llvm::errs() << "TargetMachine can't emit a file of this type\n";
+    if (emit_object(ir, session, dest) != 0)
         return -1;
-    }
-
-    pass.run(ir->mod);
     dest.flush();
 
     return 0;
 }
+
+int
+ir_compile_to_memory(
+    struct ir_module* ir, struct ir_session* session, struct mstream* ms)
+{
+    llvm::SmallVector<char, 0> buffer;
+    llvm::raw_svector_ostream  dest(buffer);
+    if (emit_object(ir, session, dest) != 0)
+        return -1;
+
+    return mstream_write(ms, buffer.data(), (int)buffer.size());
+}
+
+hash64
+ir_hash(const struct ir_module* ir, const struct ir_session* session)
+{
+    llvm::SmallVector<char, 0> bitcode;
+    llvm::raw_svector_ostream  os(bitcode);
+    llvm::WriteBitcodeToFile(ir->mod, os);
+
+    int32_t opt_level = session->opt_level;
+    hash64  h = hash64_murmur64a(bitcode.data(), (int)bitcode.size(), 0);
+    h = hash64_murmur64a(
+        session->triple.data(), (int)session->triple.size(), h);
+    h = hash64_murmur64a(&opt_level, sizeof(opt_level), h);
+    h = hash64_murmur64a(
+        LLVM_VERSION_STRING, (int)sizeof(LLVM_VERSION_STRING), h);
+
+    return h;
+}
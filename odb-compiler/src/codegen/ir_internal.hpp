@@ -1,5 +1,12 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Target/TargetMachine.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
 
 extern "C" {
 #include "odb-compiler/codegen/ir.h"
@@ -11,3 +18,22 @@ struct ir_module
     llvm::LLVMContext ctx;
     llvm::Module      mod;
 };
+
+struct ir_session
+{
+    const llvm::Target*  target;
+    std::string          triple;
+    enum target_platform platform;
+    enum ir_opt_level    opt_level;
+
+    /* Each thread creates its own TargetMachine on first use. They live until
+     * the session is destroyed */
+    std::mutex mutex;
+    std::unordered_map<std::thread::id, std::unique_ptr<llvm::TargetMachine>>
+        machines;
+};
+
+/* Returns the TargetMachine of the calling thread, creating it if necessary.
+ * Returns NULL on failure */
+llvm::TargetMachine*
+ir_session_target_machine(struct ir_session* session);
@@ -1,53 +1,153 @@
 #include "./ir_internal.hpp"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/Analysis/InlineCost.h"
 #include "llvm/Analysis/LoopAnalysisManager.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/StandardInstrumentations.h"
-#include "llvm/Transforms/InstCombine/InstCombine.h"
-#include "llvm/Transforms/Scalar/GVN.h"
-#include "llvm/Transforms/Scalar/Reassociate.h"
-#include "llvm/Transforms/Scalar/SimplifyCFG.h"
-#include "llvm/Transforms/Utils/Mem2Reg.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "odb-util/log.h"
+#include "odb-util/time.h"
+}
+
+/* Measures the time spent in each pass, excluding the time spent in the passes
+ * it runs, e.g. a module-to-function adaptor only accounts for itself */
+struct pass_timings
+{
+    struct running_pass
+    {
+        uint64_t start_us;
+        uint64_t nested_us;
+    };
+
+    void
+    register_callbacks(llvm::PassInstrumentationCallbacks* PIC)
+    {
+        PIC->registerBeforeNonSkippedPassCallback(
+            [this](llvm::StringRef, llvm::Any) { begin(); });
+        PIC->registerAfterPassCallback(
+            [this](
+                llvm::StringRef pass, llvm::Any, const llvm::PreservedAnalyses&)
+            { end(pass); });
+        PIC->registerAfterPassInvalidatedCallback(
+            [this](llvm::StringRef pass, const llvm::PreservedAnalyses&)
+            { end(pass); });
+    }
+
+    void
+    begin()
+    {
+        running.push_back({time_get_us(), 0});
+    }
+
+    void
+    end(llvm::StringRef pass)
+    {
+        running_pass p = running.pop_back_val();
+        uint64_t     total_us = time_get_us() - p.start_us;
+        if (!running.empty())
+            running.back().nested_us += total_us;
+        self_us[pass] += total_us - p.nested_us;
+    }
+
+    void
+    log(const llvm::Module& mod) const
+    {
+        std::vector<std::pair<llvm::StringRef, uint64_t>> sorted;
+        for (const auto& entry : self_us)
+            sorted.emplace_back(entry.getKey(), entry.getValue());
+        std::sort(
+            sorted.begin(),
+            sorted.end(),
+            [](const auto& a, const auto& b) { return a.second > b.second; });
+
+        /* Modules are optimized on multiple threads. Log everything at once so
+         * the tables don't interleave */
+        std::string table;
+        char        line[32];
+        for (const auto& [pass, us] : sorted)
+        {
+            snprintf(line, sizeof(line), "  %10.3f ms  ", (double)us / 1000.0);
+            table += line;
+            table += pass;
+            table += "\n";
+        }
+        log_info(
+            "[codegen] ",
+            "Pass timings for {emph:%s}:\n%s",
+            mod.getModuleIdentifier().c_str(),
+            table.c_str());
+    }
+
+    llvm::SmallVector<running_pass, 8> running;
+    llvm::StringMap<uint64_t>          self_us;
+};
 
 int
-ir_optimize(struct ir_module* ir)
+ir_optimize(struct ir_module* ir, struct ir_session* session, int time_passes)
 {
+    llvm::OptimizationLevel opt_level;
+    switch (session->opt_level)
+    {
+        case IR_O0: return 0;
+        case IR_O1: opt_level = llvm::OptimizationLevel::O1; break;
+        case IR_O2: opt_level = llvm::OptimizationLevel::O2; break;
+        case IR_O3: opt_level = llvm::OptimizationLevel::O3; break;
+        case IR_Os: opt_level = llvm::OptimizationLevel::Os; break;
+    }
+
+    /* The optimizations need to know about the target, e.g. the vectorizers
+     * query the width of its vector registers */
+    llvm::TargetMachine* TM = ir_session_target_machine(session);
+    if (TM == nullptr)
+        return -1;
+    ir->mod.setDataLayout(TM->createDataLayout());
+    ir->mod.setTargetTriple(session->triple);
+
     // Create the analysis managers.
     // These must be declared in this order so that they are destroyed in the
     // correct order due to inter-analysis-manager references.
-    llvm::LoopAnalysisManager LAM;
-    llvm::FunctionPassManager FPM;
+    llvm::LoopAnalysisManager     LAM;
     llvm::FunctionAnalysisManager FAM;
-    llvm::CGSCCAnalysisManager CGAM;
-    llvm::ModuleAnalysisManager MAM;
-    llvm::ModulePassManager MPM;
+    llvm::CGSCCAnalysisManager    CGAM;
+    llvm::ModuleAnalysisManager   MAM;
 
     llvm::PassInstrumentationCallbacks PIC;
-    llvm::StandardInstrumentations SI(ir->ctx, /*DebugLogging*/ true);
+    llvm::StandardInstrumentations     SI(ir->ctx, /*DebugLogging*/ false);
     SI.registerCallbacks(PIC, &MAM);
 
-    // Add transform passes.
-    // Promote allocas to registers.
-    FPM.addPass(llvm::PromotePass());
-    // Do simple "peephole" optimizations and bit-twiddling optzns.
-    FPM.addPass(llvm::InstCombinePass());
-    // Reassociate expressions.
-    FPM.addPass(llvm::ReassociatePass());
-    // Eliminate Common SubExpressions.
-    FPM.addPass(llvm::GVNPass());
-    // Simplify the control flow graph (deleting unreachable blocks, etc).
-    FPM.addPass(llvm::SimplifyCFGPass());
+    pass_timings timings;
+    if (time_passes)
+        timings.register_callbacks(&PIC);
+
+    llvm::PipelineTuningOptions PTO;
+    PTO.LoopUnrolling = true;
+    PTO.LoopInterleaving = true;
+    PTO.LoopVectorization = true;
+    PTO.SLPVectorization = true;
+    PTO.InlinerThreshold
+        = llvm::getInlineParams(
+              opt_level.getSpeedupLevel(), opt_level.getSizeLevel())
+              .DefaultThreshold;
 
     // Register all the basic analyses with the managers.
-    llvm::PassBuilder PB;
+    llvm::PassBuilder PB(TM, PTO, std::nullopt, &PIC);
     PB.registerModuleAnalyses(MAM);
     PB.registerCGSCCAnalyses(CGAM);
     PB.registerFunctionAnalyses(FAM);
     PB.registerLoopAnalyses(LAM);
     PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
 
-    MPM.addPass(llvm::createModuleToFunctionPassAdaptor(std::move(FPM)));
+    llvm::ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(opt_level);
     MPM.run(ir->mod, MAM);
 
+    if (time_passes)
+        timings.log(ir->mod);
+
     return 0;
 }
@@ -0,0 +1,145 @@
+#include "./ir_internal.hpp"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetOptions.h"
+#include <cstring>
+
+extern "C" {
+#include "odb-util/log.h"
+#include "odb-util/mem.h"
+}
+
+/* Registers the LLVM backend that compiles for the given architecture. The
+ * backends of all other architectures are left alone, and each backend is only
+ * registered once, no matter how many sessions are created. i386 and x86_64
+ * share the same backend */
+static void
+init_llvm_target(enum target_arch arch)
+{
+    enum llvm_backend
+    {
+        BACKEND_X86,
+        BACKEND_AArch64,
+        BACKEND_COUNT
+    };
+    static const char* backend_names[BACKEND_COUNT] = {"X86", "AArch64"};
+    static std::once_flag init_flags[BACKEND_COUNT];
+
+    enum llvm_backend id
+        = arch == TARGET_AArch64 ? BACKEND_AArch64 : BACKEND_X86;
+    std::call_once(
+        init_flags[id],
+        [id]
+        {
+            const char* backend = backend_names[id];
+#define LLVM_TARGET(name)                                                      \
+    if (strcmp(#name, backend) == 0)                                           \
+    {                                                                          \
+        LLVMInitialize##name##TargetInfo();                                    \
+        LLVMInitialize##name##Target();                                        \
+        LLVMInitialize##name##TargetMC();                                      \
+    }
+#include "llvm/Config/Targets.def"
+#define LLVM_ASM_PRINTER(name)                                                 \
+    if (strcmp(#name, backend) == 0)                                           \
+        LLVMInitialize##name##AsmPrinter();
+#include "llvm/Config/AsmPrinters.def"
+        });
+}
+
+struct ir_session*
+ir_session_create(
+    enum target_arch     arch,
+    enum target_platform platform,
+    enum ir_opt_level    level)
+{
+    /* clang-format off */
+    static const char* target_triples[3][3] = {
+        {"i386-pc-windows-msvc", "x86_64-pc-windows-msvc", ""},
+        {"i386-",                "x86_64-", ""},
+        {"i386-linux-gnu",       "x86_64-linux-gnu", ""},
+    };
+    /* clang-format on */
+
+    init_llvm_target(arch);
+
+    std::string         error;
+    const char*         triple = target_triples[platform][arch];
+    const llvm::Target* target
+        = llvm::TargetRegistry::lookupTarget(triple, error);
+
+    // This generally occurs if the backend wasn't built into LLVM or we have
+    // a bogus target triple.
+    if (target == nullptr)
+    {
+        log_codegen_err(
+            "Unsupported target {quote:%s}: %s\n", triple, error.c_str());
+        return NULL;
+    }
+
+    struct ir_session* session = new ir_session;
+    mem_track_allocation(session);
+    session->target = target;
+    session->triple = triple;
+    session->platform = platform;
+    session->opt_level = level;
+
+    return session;
+}
+
+void
+ir_session_destroy(struct ir_session* session)
+{
+    mem_track_deallocation(session);
+    delete session;
+}
+
+llvm::TargetMachine*
+ir_session_target_machine(struct ir_session* session)
+{
+    std::lock_guard<std::mutex> guard(session->mutex);
+
+    std::unique_ptr<llvm::TargetMachine>& machine
+        = session->machines[std::this_thread::get_id()];
+    if (machine)
+        return machine.get();
+
+    llvm::CodeGenOptLevel opt_level = llvm::CodeGenOptLevel::None;
+    switch (session->opt_level)
+    {
+        case IR_O0: opt_level = llvm::CodeGenOptLevel::None; break;
+        case IR_O1: opt_level = llvm::CodeGenOptLevel::Less; break;
+        case IR_O2:
+        case IR_Os: opt_level = llvm::CodeGenOptLevel::Default; break;
+        case IR_O3: opt_level = llvm::CodeGenOptLevel::Aggressive; break;
+    }
+
+    auto                CPU = "generic";
+    auto                Features = "";
+    llvm::TargetOptions opt;
+    machine.reset(session->target->createTargetMachine(
+        session->triple,
+        CPU,
+        Features,
+        opt,
+        /* https://discourse.llvm.org/t/llvm-emitting-wrong-machine-code-for-x64-msvc/81226/1 */
+        session->platform == TARGET_WINDOWS ? llvm::Reloc::PIC_
+                                            : llvm::Reloc::Static,
+        std::nullopt,
+        opt_level));
+    if (!machine)
+    {
+        log_codegen_err(
+            "Failed to create target machine for {quote:%s}\n",
+            session->triple.c_str());
+        return nullptr;
+    }
+
+    log_dbg(
+        "[codegen] ",
+        "triple: %s, CPU: %s, features: %s\n",
+        session->triple.c_str(),
+        CPU,
+        Features);
+
+    return machine.get();
+}
@@ -0,0 +1,204 @@
+#include "odb-compiler/codegen/obj_cache.h"
+#include "odb-compiler/sdk/cmd_cache.h"
+#include "odb-util/fs.h"
+#include "odb-util/log.h"
+#include "odb-util/vec.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Bumped whenever the way objects are stored changes */
+#define VERSION 1
+
+/* "0123456789abcdef.o" */
+#define NAME_LEN 18
+
+struct entry
+{
+    uint64_t mtime;
+    char     name[NAME_LEN + 1];
+};
+
+VEC_DECLARE_API(static, entries, struct entry, 32)
+VEC_DEFINE_API(entries, struct entry, 32)
+
+static int
+make_object_path(struct ospath* path, struct ospathc cache_dir, hash64 key)
+{
+    /* The commands are compiled into the harness, so how they are loaded
+     * affects the object code as well */
+    const int32_t versions[2] = {VERSION, CMD_CACHE_VERSION};
+    char          name[NAME_LEN + 1];
+
+    key = hash64_murmur64a(versions, sizeof(versions), key);
+    snprintf(name, sizeof(name), "%016" PRIx64 ".o", key);
+
+    if (ospath_set(path, cache_dir) != 0)
+        return -1;
+    return ospath_join_cstr(path, name);
+}
+
+int
+obj_cache_load(struct ospathc cache_dir, hash64 key, struct ospathc objfile)
+{
+    struct ospath path = empty_ospath();
+    if (make_object_path(&path, cache_dir, key) != 0)
+        goto fail;
+
+    if (!fs_file_exists(ospathc(path)))
+    {
+        ospath_deinit(path);
+        return 0;
+    }
+
+    if (fs_copy_file(ospathc(path), objfile) != 0)
+        goto fail;
+    /* Eviction removes the objects with the oldest modification time first */
+    fs_touch(ospathc(path));
+
+    ospath_deinit(path);
+    return 1;
+
+fail:
+    ospath_deinit(path);
+    return -1;
+}
+
+int
+obj_cache_store(struct ospathc cache_dir, hash64 key, struct ospathc objfile)
+{
+    char          suffix[sizeof(".0123456789abcdef.tmp")];
+    struct ospath path = empty_ospath();
+    struct ospath tmp = empty_ospath();
+    if (make_object_path(&path, cache_dir, key) != 0)
+        goto fail;
+
+    /* The object is copied to a temporary file first and then renamed into
+     * place, so loading the same key never sees a partially written object.
+     * The temporary name depends on the object file being stored, so
+     * concurrent stores of the same key don't write to the same file */
+    snprintf(
+        suffix,
+        sizeof(suffix),
+        ".%016" PRIx64 ".tmp",
+        hash64_murmur64a(ospathc_cstr(objfile), objfile.len, 0));
+    if (ospath_set(&tmp, ospathc(path)) != 0
+        || utf8_append_cstr(&tmp.str, suffix) != 0)
+    {
+        goto fail;
+    }
+
+    if (fs_copy_file(objfile, ospathc(tmp)) != 0)
+        goto fail;
+    if (fs_rename_file(ospathc(tmp), ospathc(path)) != 0)
+    {
+        fs_remove_file(ospathc(tmp));
+        goto fail;
+    }
+
+    ospath_deinit(tmp);
+    ospath_deinit(path);
+    return 0;
+
+fail:
+    ospath_deinit(tmp);
+    ospath_deinit(path);
+    return -1;
+}
+
+struct list_ctx
+{
+    struct entries** entries;
+    struct ospath    path;
+    struct ospathc   cache_dir;
+};
+
+static int
+on_cache_entry(const char* name, void* user)
+{
+    struct list_ctx* ctx = (struct list_ctx*)user;
+    struct entry*    entry;
+    int              len = (int)strlen(name);
+
+    /* Leave any files that weren't created by the cache alone */
+    if (len != NAME_LEN || strcmp(name + NAME_LEN - 2, ".o") != 0)
+        return 0;
+
+    if (ospath_set(&ctx->path, ctx->cache_dir) != 0
+        || ospath_join_cstr(&ctx->path, name) != 0)
+    {
+        return -1;
+    }
+
+    entry = entries_emplace(ctx->entries);
+    if (entry == NULL)
+        return -1;
+    entry->mtime = fs_mtime_ms(ospathc(ctx->path));
+    memcpy(entry->name, name, NAME_LEN + 1);
+
+    return 0;
+}
+
+static int
+cmp_entry_mtime(const void* a, const void* b)
+{
+    const struct entry* e1 = (const struct entry*)a;
+    const struct entry* e2 = (const struct entry*)b;
+    return e1->mtime < e2->mtime ? -1 : e1->mtime > e2->mtime ? 1 : 0;
+}
+
+int
+obj_cache_evict(struct ospathc cache_dir, int max_objects)
+{
+    struct list_ctx ctx;
+    struct entries* entries;
+    int             i, evict_count;
+
+    entries_init(&entries);
+    ctx.entries = &entries;
+    ctx.path = empty_ospath();
+    ctx.cache_dir = cache_dir;
+    if (fs_list(cache_dir, on_cache_entry, &ctx) != 0)
+        goto fail;
+
+    evict_count = entries_count(entries) - max_objects;
+    if (evict_count <= 0)
+    {
+        ospath_deinit(ctx.path);
+        entries_deinit(entries);
+        return 0;
+    }
+
+    /* Oldest first */
+    qsort(
+        vec_first(entries),
+        entries_count(entries),
+        sizeof(struct entry),
+        cmp_entry_mtime);
+
+    for (i = 0; i != evict_count; ++i)
+    {
+        if (ospath_set(&ctx.path, cache_dir) != 0
+            || ospath_join_cstr(&ctx.path, vec_get(entries, i)->name) != 0)
+        {
+            goto fail;
+        }
+        fs_remove_file(ospathc(ctx.path));
+    }
+
+    log_dbg(
+        "[codegen] ",
+        "Evicted %d objects from {quote:%s}\n",
+        evict_count,
+        ospathc_cstr(cache_dir));
+
+    ospath_deinit(ctx.path);
+    entries_deinit(entries);
+    return evict_count;
+
+fail:
+    ospath_deinit(ctx.path);
+    entries_deinit(entries);
+    return -1;
+}
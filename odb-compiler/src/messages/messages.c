@@ -53,7 +53,7 @@ err_assignment_incompatible_types(
     gutter = log_excerpt_binop(
         source,
         ast_loc(ast, lhs),
-        ast->nodes[ass].assignment.op_location,
+        ast->locs[ass].op_location,
         ast_loc(ast, rhs),
         type_to_db_name(ast_type_info(ast, lhs)),
         type_to_db_name(ast_type_info(ast, rhs)));
@@ -97,7 +97,7 @@ err_binop_incompatible_types(
     log_excerpt_binop(
         source,
         ast_loc(ast, lhs),
-        ast->nodes[op].binop.op_location,
+        ast->locs[op].op_location,
         ast_loc(ast, rhs),
         type_to_db_name(lhs == source_node ? source_type : target_type),
         type_to_db_name(lhs == source_node ? target_type : source_type));
@@ -134,7 +134,7 @@ err_binop_pow_incompatible_base_type(
     gutter = log_excerpt_2(
         source,
         ast_loc(ast, base),
-        ast->nodes[op].binop.op_location,
+        ast->locs[op].op_location,
         type_to_db_name(base_type),
         "",
         0,
@@ -172,7 +172,7 @@ err_binop_pow_incompatible_exponent_type(
     gutter = log_excerpt_binop(
         source,
         ast_loc(ast, base),
-        ast->nodes[op].binop.op_location,
+        ast->locs[op].op_location,
         ast_loc(ast, exp),
         "",
         type_to_db_name(exp_type));
@@ -246,7 +246,9 @@ int
 err_func_call_incompatible_types(
     const struct ast* ast,
     ast_id            arg,
-    ast_id            param,
+    enum type         param_type,
+    struct utf8_span  param_type_location,
+    const char*       param_source,
     int               arg_num,
     const char*       filename,
     const char*       source)
@@ -254,10 +256,6 @@ err_func_call_incompatible_types(
     int gutter;
 
     ODBUTIL_DEBUG_ASSERT(arg > -1, (void)0);
-    ODBUTIL_DEBUG_ASSERT(param > -1, (void)0);
-    ODBUTIL_DEBUG_ASSERT(
-        ast_node_type(ast, param) == AST_IDENTIFIER,
-        log_err("", "type: %d\n", ast_node_type(ast, param)));
 
     log_flc_err(
         filename,
@@ -271,12 +269,11 @@ err_func_call_incompatible_types(
         : arg_num == 3 ? "rd"
                        : "th",
         type_to_db_name(ast_type_info(ast, arg)),
-        type_to_db_name(ast_type_info(ast, param)));
+        type_to_db_name(param_type));
     gutter = log_excerpt_1(
         source, ast_loc(ast, arg), type_to_db_name(ast_type_info(ast, arg)), 1);
     log_excerpt_note(gutter, "Function return type was declared here:\n");
-    log_excerpt_1(
-        source, ast->nodes[param].identifier.explicit_type_location, "", 0);
+    log_excerpt_1(param_source, param_type_location, "", 0);
 
     return -1;
 }
@@ -316,7 +313,7 @@ err_func_return_incompatible_types(
     log_excerpt_note(gutter, "Function return type was declared here:\n");
     log_excerpt_1(
         source,
-        ast->nodes[func_ident].identifier.explicit_type_location,
+        ast->locs[func_ident].explicit_type_location,
         "",
         1);
 
@@ -346,7 +343,7 @@ err_func_missing_return_value(
     log_excerpt_note(gutter, "Function return type was declared here:\n");
     log_excerpt_1(
         source,
-        ast->nodes[func_ident].identifier.explicit_type_location,
+        ast->locs[func_ident].explicit_type_location,
         "",
         0);
 
@@ -370,7 +367,7 @@ err_initialization_incompatible_types(
     log_excerpt_binop(
         source,
         ast_loc(ast, lhs),
-        ast->nodes[ass].assignment.op_location,
+        ast->locs[ass].op_location,
         ast_loc(ast, rhs),
         type_to_db_name(ast_type_info(ast, lhs)),
         type_to_db_name(ast_type_info(ast, rhs)));
@@ -537,7 +534,7 @@ warn_assignment_implicit_conversion(
     gutter = log_excerpt_binop(
         source,
         ast_loc(ast, lhs),
-        ast->nodes[ass].assignment.op_location,
+        ast->locs[ass].op_location,
         ast_loc(ast, rhs),
         type_to_db_name(ast_type_info(ast, lhs)),
         type_to_db_name(ast_type_info(ast, rhs)));
@@ -581,7 +578,7 @@ warn_assignment_truncation(
     gutter = log_excerpt_binop(
         source,
         ast_loc(ast, lhs),
-        ast->nodes[ass].assignment.op_location,
+        ast->locs[ass].op_location,
         ast_loc(ast, rhs),
         type_to_db_name(ast_type_info(ast, lhs)),
         type_to_db_name(ast_type_info(ast, rhs)));
@@ -625,7 +622,7 @@ warn_binop_implicit_conversion(
     gutter = log_excerpt_binop(
         source,
         ast_loc(ast, lhs),
-        ast->nodes[op].binop.op_location,
+        ast->locs[op].op_location,
         ast_loc(ast, rhs),
         type_to_db_name(lhs == source_node ? source_type : target_type),
         type_to_db_name(lhs == source_node ? target_type : source_type));
@@ -658,7 +655,7 @@ warn_binop_truncation(
     log_excerpt_binop(
         source,
         ast_loc(ast, lhs),
-        ast->nodes[op].binop.op_location,
+        ast->locs[op].op_location,
         ast_loc(ast, rhs),
         type_to_db_name(lhs == source_node ? source_type : target_type),
         type_to_db_name(lhs == source_node ? target_type : source_type));
@@ -686,7 +683,7 @@ warn_binop_pow_base_implicit_conversion(
     gutter = log_excerpt_2(
         source,
         ast_loc(ast, base),
-        ast->nodes[op].binop.op_location,
+        ast->locs[op].op_location,
         type_to_db_name(base_type),
         "",
         0,
@@ -723,7 +720,7 @@ warn_binop_pow_base_truncation(
     gutter = log_excerpt_binop(
         source,
         ast_loc(ast, base),
-        ast->nodes[op].binop.op_location,
+        ast->locs[op].op_location,
         ast_loc(ast, exp),
         type_to_db_name(base_type),
         type_to_db_name(ast_type_info(ast, exp)));
@@ -757,7 +754,7 @@ warn_binop_pow_exponent_implicit_conversion(
     gutter = log_excerpt_binop(
         source,
         ast_loc(ast, base),
-        ast->nodes[op].binop.op_location,
+        ast->locs[op].op_location,
         ast_loc(ast, exp),
         "",
         type_to_db_name(exp_type));
@@ -802,7 +799,7 @@ warn_binop_pow_exponent_truncation(
     gutter = log_excerpt_binop(
         source,
         ast_loc(ast, base),
-        ast->nodes[op].binop.op_location,
+        ast->locs[op].op_location,
         ast_loc(ast, exp),
         target_type == TYPE_F32 ? type_to_db_name(TYPE_F32) : "",
         type_to_db_name(exp_type));
@@ -944,7 +941,9 @@ void
 warn_func_call_implicit_conversion(
     const struct ast* ast,
     ast_id            arg,
-    ast_id            param,
+    enum type         param_type,
+    struct utf8_span  param_type_location,
+    const char*       param_source,
     int               arg_num,
     const char*       filename,
     const char*       source)
@@ -952,10 +951,6 @@ warn_func_call_implicit_conversion(
     int gutter;
 
     ODBUTIL_DEBUG_ASSERT(arg > -1, (void)0);
-    ODBUTIL_DEBUG_ASSERT(param > -1, (void)0);
-    ODBUTIL_DEBUG_ASSERT(
-        ast_node_type(ast, param) == AST_IDENTIFIER,
-        log_err("", "type: %d\n", ast_node_type(ast, param)));
 
     log_flc_warn(
         filename,
@@ -969,21 +964,21 @@ warn_func_call_implicit_conversion(
         : arg_num == 3 ? "rd"
                        : "th",
         type_to_db_name(ast_type_info(ast, arg)),
-        type_to_db_name(ast_type_info(ast, param)));
+        type_to_db_name(param_type));
     gutter = log_excerpt_1(
         source, ast_loc(ast, arg), type_to_db_name(ast_type_info(ast, arg)), 1);
     log_excerpt_note(gutter, "Function parameter type is declared here:\n");
-    log_excerpt_1(
-        source, ast->nodes[param].identifier.explicit_type_location, "", 0);
-    help_insert_explicit_cast(
-        source, gutter, ast_loc(ast, arg), ast_type_info(ast, param));
+    log_excerpt_1(param_source, param_type_location, "", 0);
+    help_insert_explicit_cast(source, gutter, ast_loc(ast, arg), param_type);
 }
 
 void
 warn_func_call_truncation(
     const struct ast* ast,
     ast_id            arg,
-    ast_id            param,
+    enum type         param_type,
+    struct utf8_span  param_type_location,
+    const char*       param_source,
     int               arg_num,
     const char*       filename,
     const char*       source)
@@ -991,10 +986,6 @@ warn_func_call_truncation(
     int gutter;
 
     ODBUTIL_DEBUG_ASSERT(arg > -1, (void)0);
-    ODBUTIL_DEBUG_ASSERT(param > -1, (void)0);
-    ODBUTIL_DEBUG_ASSERT(
-        ast_node_type(ast, param) == AST_IDENTIFIER,
-        log_err("", "type: %d\n", ast_node_type(ast, param)));
 
     log_flc_warn(
         filename,
@@ -1007,13 +998,12 @@ warn_func_call_truncation(
         : arg_num == 2 ? "nd"
         : arg_num == 3 ? "rd"
                        : "th",
-        type_to_db_name(ast_type_info(ast, param)),
+        type_to_db_name(param_type),
         type_to_db_name(ast_type_info(ast, arg)));
     gutter = log_excerpt_1(
         source, ast_loc(ast, arg), type_to_db_name(ast_type_info(ast, arg)), 1);
     log_excerpt_note(gutter, "Function return type was declared here:\n");
-    log_excerpt_1(
-        source, ast->nodes[param].identifier.explicit_type_location, "", 0);
+    log_excerpt_1(param_source, param_type_location, "", 0);
 }
 
 void
@@ -1051,7 +1041,7 @@ warn_func_return_implicit_conversion(
     log_excerpt_note(gutter, "Function return type was declared here:\n");
     log_excerpt_1(
         source,
-        ast->nodes[func_ident].identifier.explicit_type_location,
+        ast->locs[func_ident].explicit_type_location,
         "",
         1);
     help_insert_explicit_cast(
@@ -1093,7 +1083,7 @@ warn_func_return_truncation(
     log_excerpt_note(gutter, "Function return type was declared here:\n");
     log_excerpt_1(
         source,
-        ast->nodes[func_ident].identifier.explicit_type_location,
+        ast->locs[func_ident].explicit_type_location,
         "",
         1);
     help_insert_explicit_cast(
@@ -1239,7 +1229,7 @@ warn_initialization_implicit_conversion(
     gutter = log_excerpt_binop(
         source,
         ast_loc(ast, lhs),
-        ast->nodes[ass].assignment.op_location,
+        ast->locs[ass].op_location,
         ast_loc(ast, rhs),
         type_to_db_name(ast_type_info(ast, lhs)),
         type_to_db_name(ast_type_info(ast, rhs)));
@@ -1293,7 +1283,7 @@ warn_initialization_truncation(
     gutter = log_excerpt_binop(
         source,
         ast_loc(ast, lhs),
-        ast->nodes[ass].assignment.op_location,
+        ast->locs[ass].op_location,
         ast_loc(ast, rhs),
         type_to_db_name(ast_type_info(ast, lhs)),
         type_to_db_name(ast_type_info(ast, rhs)));
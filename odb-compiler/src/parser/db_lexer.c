@@ -0,0 +1,560 @@
+#include "odb-compiler/parser/db_lexer.h"
+#include "odb-compiler/parser/db_scanner.lex.h"
+#include "odb-util/log.h"
+#include "odb-util/mem.h"
+#include <stdlib.h>
+#include <string.h>
+
+enum lexer_state
+{
+    STATE_INITIAL,
+    STATE_SINGLE_COMMENT,
+    STATE_MULTI_COMMENT,
+    STATE_MULTI_COMMENT_C
+};
+
+#define CC_WS          0x01 /* [ \t\r] */
+#define CC_IDENT_START 0x02 /* [a-zA-Z_] */
+#define CC_IDENT       0x04 /* [a-zA-Z0-9_] */
+#define CC_DIGIT       0x08 /* [0-9] */
+#define CC_HEX         0x10 /* [0-9a-fA-F] */
+#define CC_SUFFIX      0x20 /* [?%&#!$], the type suffixes of identifiers */
+
+#define W CC_WS
+#define S CC_SUFFIX
+#define D (CC_IDENT | CC_DIGIT | CC_HEX)
+#define L (CC_IDENT_START | CC_IDENT)
+#define H (CC_IDENT_START | CC_IDENT | CC_HEX)
+static const unsigned char char_class[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, W, 0, 0, 0, W, 0, 0, /* 0x00 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x10 */
+    W, S, 0, S, S, S, S, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x20 */
+    D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, S, /* 0x30 */
+    0, H, H, H, H, H, H, L, L, L, L, L, L, L, L, L, /* 0x40 */
+    L, L, L, L, L, L, L, L, L, L, L, 0, 0, 0, 0, L, /* 0x50 */
+    0, H, H, H, H, H, H, L, L, L, L, L, L, L, L, L, /* 0x60 */
+    L, L, L, L, L, L, L, L, L, L, L, 0, 0, 0, 0, 0, /* 0x70 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x80 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x90 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xA0 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xB0 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xC0 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xD0 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xE0 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xF0 */
+};
+#undef W
+#undef S
+#undef D
+#undef L
+#undef H
+
+void
+db_lexer_init(struct db_lexer* lexer, struct db_source source)
+{
+    lexer->text = source.text.data;
+    lexer->len = source.text.len;
+    lexer->pos = 0;
+    lexer->state = STATE_INITIAL;
+}
+
+/* Returns the byte at "offset" from the read position, or '\0' past the end */
+static char
+peek(const struct db_lexer* l, utf8_idx offset)
+{
+    return l->pos + offset < l->len ? l->text[l->pos + offset] : '\0';
+}
+
+/* Counts the bytes starting at "pos" that belong to the character class */
+static utf8_idx
+count_class(const struct db_lexer* l, utf8_idx pos, unsigned char cls)
+{
+    utf8_idx start = pos;
+    while (pos < l->len && (char_class[(unsigned char)l->text[pos]] & cls))
+        pos++;
+    return pos - start;
+}
+
+/* Compares against a lower case ASCII string. Only letters can fold onto
+ * letters, so this is safe to use on arbitrary bytes */
+static int
+equals_nocase(const char* text, const char* lower, utf8_idx len)
+{
+    utf8_idx i;
+    for (i = 0; i != len; ++i)
+        if ((text[i] | 0x20) != lower[i])
+            return 0;
+    return 1;
+}
+
+/*
+ * FLEX updates the location for every rule it matches, including rules that
+ * don't return a token such as whitespace and comment bytes. The new location
+ * starts where the previous match ended, and its length is the strlen() of the
+ * matched text. Everything below goes through match() or skip_bytes() so the
+ * locations end up being identical.
+ */
+static void
+match(struct db_lexer* l, DBLTYPE* loc, utf8_idx len)
+{
+    const char* nul = memchr(l->text + l->pos, '\0', (size_t)len);
+    loc->off += loc->len;
+    loc->len = nul ? (utf8_idx)(nul - (l->text + l->pos)) : len;
+    l->pos += len;
+}
+
+static int
+emit(struct db_lexer* l, DBLTYPE* loc, utf8_idx len, int kind)
+{
+    match(l, loc, len);
+    return kind;
+}
+
+/* Skips bytes that FLEX matches one rule at a time */
+static void
+skip_bytes(struct db_lexer* l, DBLTYPE* loc, utf8_idx count)
+{
+    for (; count; count--, l->pos++)
+    {
+        loc->off += loc->len;
+        loc->len = l->text[l->pos] != '\0';
+    }
+}
+
+/* Same as strtoll() on a string containing only valid digits, including
+ * clamping to INT64_MAX on overflow */
+static int64_t
+parse_integer(const char* text, utf8_idx len, int base)
+{
+    int64_t value = 0;
+    for (; len; text++, len--)
+    {
+        int digit = *text <= '9' ? *text - '0' : (*text | 0x20) - 'a' + 10;
+        if (value > (INT64_MAX - digit) / base)
+            return INT64_MAX;
+        value = value * base + digit;
+    }
+    return value;
+}
+
+/* atof() needs a NULL terminated string, but the source text can't be
+ * modified and may not be NULL terminated */
+static double
+parse_double(const char* text, utf8_idx len)
+{
+    char   buf[64];
+    char*  str = buf;
+    double value;
+
+    if ((size_t)len >= sizeof(buf))
+    {
+        str = mem_alloc((mem_size)len + 1);
+        if (str == NULL)
+        {
+            log_oom((size_t)len + 1, "parse_double()");
+            return 0.0;
+        }
+    }
+
+    memcpy(str, text, (size_t)len);
+    str[len] = '\0';
+    value = atof(str);
+
+    if (str != buf)
+        mem_free(str);
+    return value;
+}
+
+static utf8_idx
+exponent_len(const struct db_lexer* l, utf8_idx pos)
+{
+    utf8_idx sign = 0, digits;
+    if (pos >= l->len || (l->text[pos] != 'e' && l->text[pos] != 'E'))
+        return 0;
+    if (pos + 1 < l->len
+        && (l->text[pos + 1] == '+' || l->text[pos + 1] == '-'))
+        sign = 1;
+    digits = count_class(l, pos + 1 + sign, CC_DIGIT);
+    return digits ? 1 + sign + digits : 0;
+}
+
+/* Handles the FLOAT, DOUBLE, INTEGER_BASE16 and INTEGER rules. The token
+ * either starts with a digit, or with a '.' followed by a digit */
+static int
+scan_number(struct db_lexer* l, DBSTYPE* value, DBLTYPE* loc)
+{
+    const char* text = l->text + l->pos;
+    utf8_idx    digits = count_class(l, l->pos, CC_DIGIT);
+    utf8_idx    dbl = 0, hex = 0, end;
+    char        c;
+
+    if (digits == 0 || peek(l, digits) == '.')
+    {
+        end = l->pos + digits + 1;
+        end += count_class(l, end, CC_DIGIT);
+        dbl = end - l->pos + exponent_len(l, end);
+    }
+    else
+    {
+        utf8_idx exp = exponent_len(l, l->pos + digits);
+        if (exp)
+            dbl = digits + exp;
+    }
+
+    /* {DOUBLE}[fF]|{INTEGER}[fF] */
+    c = peek(l, dbl ? dbl : digits);
+    if (c == 'f' || c == 'F')
+    {
+        utf8_idx len = (dbl ? dbl : digits) + 1;
+        value->float_value = (float)parse_double(text, len);
+        match(l, loc, len);
+        return TOK_FLOAT_LITERAL;
+    }
+    if (dbl)
+    {
+        value->double_value = parse_double(text, dbl);
+        match(l, loc, dbl);
+        return TOK_DOUBLE_LITERAL;
+    }
+
+    if (text[0] == '0' && (peek(l, 1) == 'x' || peek(l, 1) == 'X'))
+        hex = count_class(l, l->pos + 2, CC_HEX);
+    if (hex)
+    {
+        value->integer_value = parse_integer(text + 2, hex, 16);
+        match(l, loc, hex + 2);
+        return TOK_INTEGER_LITERAL;
+    }
+
+    value->integer_value = parse_integer(text, digits, 10);
+    match(l, loc, digits);
+    return TOK_INTEGER_LITERAL;
+}
+
+static int
+scan_identifier(struct db_lexer* l, DBSTYPE* value, DBLTYPE* loc)
+{
+    const char* text = l->text + l->pos;
+    utf8_idx    len = count_class(l, l->pos, CC_IDENT);
+    char        suffix = peek(l, len);
+
+    if (char_class[(unsigned char)suffix] & CC_SUFFIX)
+    {
+        match(l, loc, len + 1);
+        value->string_value = *loc;
+        switch (suffix)
+        {
+            case '?': return TOK_IDENTIFIER_BOOLEAN;
+            case '%': return TOK_IDENTIFIER_WORD;
+            case '&': return TOK_IDENTIFIER_DOUBLE_INTEGER;
+            case '#': return TOK_IDENTIFIER_FLOAT;
+            case '!': return TOK_IDENTIFIER_DOUBLE;
+            default: return TOK_IDENTIFIER_STRING;
+        }
+    }
+
+    /* FLEX prefers the earlier rule if two rules match the same length, which
+     * is why these beat {IDENTIFIER} */
+    switch (len)
+    {
+        case 3:
+            if (!equals_nocase(text, "rem", 3))
+                break;
+            match(l, loc, len);
+            l->state = STATE_SINGLE_COMMENT;
+            return TOK_REMSTART;
+        case 4:
+            if (!equals_nocase(text, "true", 4))
+                break;
+            match(l, loc, len);
+            value->boolean_value = 1;
+            return TOK_BOOLEAN_LITERAL;
+        case 5:
+            if (!equals_nocase(text, "false", 5))
+                break;
+            match(l, loc, len);
+            value->boolean_value = 0;
+            return TOK_BOOLEAN_LITERAL;
+        case 8:
+            if (!equals_nocase(text, "remstart", 8))
+                break;
+            match(l, loc, len);
+            l->state = STATE_MULTI_COMMENT;
+            return TOK_REMSTART;
+    }
+
+    match(l, loc, len);
+    value->string_value = *loc;
+    return TOK_IDENTIFIER;
+}
+
+static int
+scan_other(struct db_lexer* l, DBSTYPE* value, DBLTYPE* loc)
+{
+    const char* text = l->text + l->pos;
+    char        next = peek(l, 1);
+
+    switch (text[0])
+    {
+        case '.':
+            if (char_class[(unsigned char)next] & CC_DIGIT)
+                return scan_number(l, value, loc);
+            if (next == '.')
+                return emit(l, loc, 2, TOK_BNOT);
+            break;
+
+        case '%': {
+            utf8_idx len = 1;
+            while (l->pos + len < l->len
+                   && (text[len] == '0' || text[len] == '1'))
+                len++;
+            if (len == 1)
+                break;
+            value->integer_value = parse_integer(text + 1, len - 1, 2);
+            match(l, loc, len);
+            return TOK_INTEGER_LITERAL;
+        }
+
+        case '#':
+            if (l->len - l->pos >= 9 && memcmp(text, "#constant", 9) == 0)
+                return emit(l, loc, 9, TOK_CONSTANT);
+            break;
+
+        case '"': {
+            const char* end
+                = memchr(text + 1, '"', (size_t)(l->len - l->pos - 1));
+            if (end == NULL)
+                break;
+            match(l, loc, (utf8_idx)(end - text) + 1);
+            value->string_value.off = loc->off + 1;
+            value->string_value.len = loc->len - 2;
+            return TOK_STRING_LITERAL;
+        }
+
+        case '`':
+            match(l, loc, 1);
+            l->state = STATE_SINGLE_COMMENT;
+            return TOK_REMSTART;
+        case '/':
+            if (next == '/')
+                l->state = STATE_SINGLE_COMMENT;
+            else if (next == '*')
+                l->state = STATE_MULTI_COMMENT_C;
+            else
+                break;
+            match(l, loc, 2);
+            return TOK_REMSTART;
+
+        case '<':
+            if (next == '>')
+                return emit(l, loc, 2, TOK_NE);
+            if (next == '=')
+                return emit(l, loc, 2, TOK_LE);
+            if (next == '<')
+                return emit(l, loc, 2, TOK_BSHL);
+            break;
+        case '>':
+            if (next == '=')
+                return emit(l, loc, 2, TOK_GE);
+            if (next == '>')
+                return emit(l, loc, 2, TOK_BSHR);
+            break;
+        case '|':
+            if (next == '|')
+                return emit(l, loc, 2, TOK_BOR);
+            break;
+        case '&':
+            if (next == '&')
+                return emit(l, loc, 2, TOK_BAND);
+            break;
+        case '~':
+            if (next == '~')
+                return emit(l, loc, 2, TOK_BXOR);
+            break;
+    }
+
+    /* Every remaining single character is returned as-is, same as FLEX's "."
+     * rule. Note that this returns TOK_EOF for a NULL byte */
+    match(l, loc, 1);
+    return text[0];
+}
+
+static int
+scan_single_comment(struct db_lexer* l, DBLTYPE* loc)
+{
+    const char* end
+        = memchr(l->text + l->pos, '\n', (size_t)(l->len - l->pos));
+    if (end == NULL)
+    {
+        skip_bytes(l, loc, l->len - l->pos);
+        return TOK_EOF;
+    }
+
+    skip_bytes(l, loc, (utf8_idx)(end - (l->text + l->pos)));
+    match(l, loc, 1);
+    l->state = STATE_INITIAL;
+    return TOK_REMEND;
+}
+
+static int
+scan_multi_comment(struct db_lexer* l, DBLTYPE* loc)
+{
+    utf8_idx pos;
+    for (pos = l->pos; pos + 6 <= l->len; ++pos)
+        if (equals_nocase(l->text + pos, "remend", 6))
+        {
+            skip_bytes(l, loc, pos - l->pos);
+            match(l, loc, 6);
+            l->state = STATE_INITIAL;
+            return TOK_REMEND;
+        }
+
+    skip_bytes(l, loc, l->len - l->pos);
+    return TOK_EOF;
+}
+
+static int
+scan_multi_comment_c(struct db_lexer* l, DBLTYPE* loc)
+{
+    const char* text = l->text + l->pos;
+    const char* end = text + (l->len - l->pos);
+    const char* star = text;
+
+    while ((star = memchr(star, '*', (size_t)(end - star))) != NULL)
+    {
+        if (star + 1 < end && star[1] == '/')
+        {
+            skip_bytes(l, loc, (utf8_idx)(star - text));
+            match(l, loc, 2);
+            l->state = STATE_INITIAL;
+            return TOK_REMEND;
+        }
+        star++;
+    }
+
+    skip_bytes(l, loc, l->len - l->pos);
+    return TOK_EOF;
+}
+
+int
+db_lexer_next(struct db_lexer* l, DBSTYPE* value, DBLTYPE* loc)
+{
+    while (l->pos < l->len)
+    {
+        unsigned char cls;
+
+        switch (l->state)
+        {
+            case STATE_SINGLE_COMMENT: return scan_single_comment(l, loc);
+            case STATE_MULTI_COMMENT: return scan_multi_comment(l, loc);
+            case STATE_MULTI_COMMENT_C: return scan_multi_comment_c(l, loc);
+        }
+
+        cls = char_class[(unsigned char)l->text[l->pos]];
+        if (cls & CC_WS)
+        {
+            skip_bytes(l, loc, count_class(l, l->pos, CC_WS));
+            continue;
+        }
+        if (cls & CC_IDENT_START)
+            return scan_identifier(l, value, loc);
+        if (cls & CC_DIGIT)
+            return scan_number(l, value, loc);
+        return scan_other(l, value, loc);
+    }
+
+    return TOK_EOF;
+}
+
+static int
+values_equal(int kind, const DBSTYPE* a, const DBSTYPE* b)
+{
+    switch (kind)
+    {
+        case TOK_BOOLEAN_LITERAL: return a->boolean_value == b->boolean_value;
+        case TOK_INTEGER_LITERAL: return a->integer_value == b->integer_value;
+        case TOK_FLOAT_LITERAL: return a->float_value == b->float_value;
+        case TOK_DOUBLE_LITERAL: return a->double_value == b->double_value;
+        case TOK_STRING_LITERAL:
+        case TOK_IDENTIFIER:
+        case TOK_IDENTIFIER_BOOLEAN:
+        case TOK_IDENTIFIER_WORD:
+        case TOK_IDENTIFIER_DOUBLE_INTEGER:
+        case TOK_IDENTIFIER_FLOAT:
+        case TOK_IDENTIFIER_DOUBLE:
+        case TOK_IDENTIFIER_STRING:
+            return a->string_value.off == b->string_value.off
+                   && a->string_value.len == b->string_value.len;
+    }
+    return 1;
+}
+
+int
+db_lexer_diff(struct db_source source, const char* filename)
+{
+    dbscan_t         scanner;
+    YY_BUFFER_STATE  buffer_state;
+    struct db_lexer  lexer;
+    struct utf8_view input = utf8_view(source.text);
+    DBLTYPE          flex_loc = empty_utf8_span();
+    DBLTYPE          fast_loc = empty_utf8_span();
+    int              result = -1;
+
+    if (dblex_init(&scanner) != 0)
+        goto init_scanner_failed;
+
+    if (source.has_eob)
+        buffer_state
+            = db_scan_buffer(source.text.data, source.text.len + 2, scanner);
+    else
+    {
+        buffer_state = db_create_buffer(NULL, YY_BUF_SIZE, scanner);
+        if (buffer_state != NULL)
+            db_switch_to_buffer(buffer_state, scanner);
+    }
+    if (buffer_state == NULL)
+    {
+        log_parser_err("Failed to set up scan buffer\n");
+        goto init_buffer_failed;
+    }
+
+    dbset_extra(&input, scanner);
+    db_lexer_init(&lexer, source);
+
+    while (1)
+    {
+        DBSTYPE flex_value, fast_value;
+        int     flex_kind = dblex(&flex_value, &flex_loc, scanner);
+        int     fast_kind = db_lexer_next(&lexer, &fast_value, &fast_loc);
+
+        if (flex_kind != fast_kind || flex_loc.off != fast_loc.off
+            || flex_loc.len != fast_loc.len
+            || !values_equal(flex_kind, &flex_value, &fast_value))
+        {
+            log_parser_err(
+                "{emph:%s}: Lexers disagree: FLEX returned token %d at "
+                "{%d, %d}, but the fast lexer returned token %d at {%d, %d}\n",
+                filename,
+                flex_kind,
+                flex_loc.off,
+                flex_loc.len,
+                fast_kind,
+                fast_loc.off,
+                fast_loc.len);
+            break;
+        }
+
+        if (flex_kind == TOK_EOF)
+        {
+            result = 0;
+            break;
+        }
+    }
+
+    dbset_extra(NULL, scanner);
+    db_delete_buffer(buffer_state, scanner);
+init_buffer_failed:
+    dblex_destroy(scanner);
+init_scanner_failed:
+    return result;
+}
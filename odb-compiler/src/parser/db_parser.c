@@ -5,6 +5,7 @@
 #include "odb-compiler/parser/db_parser.y.h"
 #include "odb-compiler/parser/db_scanner.lex.h"
 #include "odb-compiler/sdk/cmd_list.h"
+#include "odb-compiler/sdk/cmd_trie.h"
 #include "odb-util/config.h"
 #include "odb-util/log.h"
 #include "odb-util/rb.h"
@@ -15,18 +16,25 @@
 extern int dbdebug;
 #endif
 
+#define CMD_NODE_UNPROBED -2
+
 struct token
 {
     DBLTYPE        pushed_location;
     dbtoken_kind_t pushed_char;
     DBSTYPE        pushed_value;
+    /* The node in the command trie reached by matching this token's text from
+     * the root, or -1 if no command can start with this token. This is cached
+     * so a token is probed at most once as the start of a command, no matter
+     * how long it sits in the queue. */
+    int32_t cmd_node;
 };
 
 RB_DECLARE_API(static, token_queue, struct token, 8)
 RB_DEFINE_API(token_queue, struct token, 8)
 
 int
-db_parser_init(struct db_parser* parser)
+db_parser_init(struct db_parser* parser, enum db_lexer_backend lexer_backend)
 {
     if (dblex_init(&parser->scanner) != 0)
         goto init_scanner_failed;
@@ -35,6 +43,15 @@ db_parser_init(struct db_parser* parser)
     if (parser->parser == NULL)
         goto init_parser_failed;
 
+    parser->lexer_backend = lexer_backend;
+    cmd_trie_init(&parser->cmd_trie);
+    parser->cmd_trie_cmds = NULL;
+    parser->cmd_trie_cmd_count = -1;
+    parser->stats.tokens = 0;
+    parser->stats.cmd_probes = 0;
+    parser->stats.transitions = 0;
+    parser->stats.bytes = 0;
+
     return 0;
 
 init_parser_failed:
@@ -46,22 +63,83 @@ init_scanner_failed:
 void
 db_parser_deinit(struct db_parser* parser)
 {
+    cmd_trie_deinit(parser->cmd_trie);
     dbpstate_delete(parser->parser);
     dblex_destroy(parser->scanner);
 }
 
+static void
+scan_token(
+    struct db_parser* parser, struct token* token, DBLTYPE* scanner_location)
+{
+    if (parser->lexer_backend == DB_LEXER_FAST)
+        token->pushed_char = db_lexer_next(
+            &parser->lexer, &token->pushed_value, scanner_location);
+    else
+        token->pushed_char
+            = dblex(&token->pushed_value, scanner_location, parser->scanner);
+    token->pushed_location = *scanner_location;
+    token->cmd_node = CMD_NODE_UNPROBED;
+    parser->stats.tokens++;
+}
+
+static int32_t
+walk_cmd_trie(
+    struct db_parser* parser,
+    int32_t           node,
+    const char*       source_text,
+    struct utf8_span  span)
+{
+    for (; span.len && node > -1; span.off++, span.len--)
+    {
+        node = cmd_trie_next(parser->cmd_trie, node, source_text[span.off]);
+        parser->stats.transitions++;
+    }
+    return node;
+}
+
+static int32_t
+probe_cmd_trie(
+    struct db_parser* parser,
+    int32_t           node,
+    const char*       source_text,
+    struct utf8_span  span)
+{
+    parser->stats.cmd_probes++;
+    return walk_cmd_trie(parser, node, source_text, span);
+}
+
+static int
+add_keyword(const char* name, dbtoken_kind_t token, void* user)
+{
+    struct cmd_trie** trie = user;
+    return cmd_trie_add_keyword(trie, name, token);
+}
+
+/* Builds the trie used to recognize both commands and keywords */
+static int
+build_cmd_trie(struct db_parser* parser, const struct cmd_list* commands)
+{
+    if (cmd_trie_build(&parser->cmd_trie, commands) != 0)
+        return -1;
+    if (db_keyword_for_each(add_keyword, &parser->cmd_trie) != 0)
+        return -1;
+
+    parser->cmd_trie_cmds = commands;
+    parser->cmd_trie_cmd_count = cmd_list_count(commands);
+    return 0;
+}
+
 static struct token*
 get_next_assembled_token(
-    struct token_queue**   tokens,
-    struct utf8*           cmd_buf,
-    const struct cmd_list* commands,
-    const char*            source_text,
-    dbscan_t               scanner,
-    DBLTYPE*               scanner_location)
+    struct token_queue** tokens,
+    struct db_parser*    parser,
+    const char*          source_text,
+    DBLTYPE*             scanner_location)
 {
     struct token* token;
 
-    /* Only scan the next token with FLEX if we've run out */
+    /* Only scan the next token if we've run out */
     if (token_queue_is_empty(*tokens))
     {
         token = token_queue_emplace(*tokens);
@@ -69,9 +147,7 @@ get_next_assembled_token(
         ODBUTIL_DEBUG_ASSERT(
             token != NULL,
             log_parser_err("token->pushed_char: %d\n", token->pushed_char));
-        token->pushed_char
-            = dblex(&token->pushed_value, scanner_location, scanner);
-        token->pushed_location = *scanner_location;
+        scan_token(parser, token, scanner_location);
     }
     else
     {
@@ -95,11 +171,9 @@ get_next_assembled_token(
      * matching a command will be combined into a single TOK_COMMAND token
      * before being pushed to the parser.
      *
-     * If we fail to identify a valid command, then the next step is to
-     * determine if this TOK_IDENTIFIER is a builtin keyword. This is
-     * accomplished by looking up the string associated with each TOK_IDENTIFIER
-     * in a hash table (generated using gperf). If this succeeds, then the token
-     * is promoted to the appropriate TOK_xxx keyword.
+     * Keywords are stored in the same trie as commands, so the same walk also
+     * finds out if the TOK_IDENTIFIER is a builtin keyword. If no command
+     * matched, the token is promoted to the appropriate TOK_xxx keyword.
      *
      * If neither of these steps succeed, then we leave it as a TOK_IDENTIFIER.
      */
@@ -107,34 +181,51 @@ get_next_assembled_token(
         || token->pushed_char == TOK_INTEGER_LITERAL) /* Commands can start with
                                                          an integer literal */
     {
-        cmd_id           longest_match_cmd_idx;
-        int              i, longest_match_token_idx = -1;
-        struct utf8_span candidate = token->pushed_location;
-        for (i = 0; candidate.len <= commands->longest_command; ++i)
+        cmd_id         longest_match_cmd_idx;
+        dbtoken_kind_t longest_match_keyword;
+        int            i, longest_match_token_idx = -1;
+        int            longest_keyword_token_idx = -1;
+        int            merge_count;
+        int            is_identifier = token->pushed_char == TOK_IDENTIFIER;
+        int32_t        node;
+
+        if (token->cmd_node == CMD_NODE_UNPROBED)
+            token->cmd_node = probe_cmd_trie(
+                parser, CMD_TRIE_ROOT, source_text, token->pushed_location);
+        node = token->cmd_node;
+
+        /* Commands are stored in the command list in upper case by convention.
+         * The trie folds each byte of the source text to upper case as it
+         * walks, so there is no need to copy the candidate string. Walking
+         * stops as soon as no command or keyword can continue with the next
+         * byte, which also means no further tokens are scanned ahead. */
+        for (i = 0; node > -1; ++i)
         {
-            /* Commands are stored in the command list in upper case by
-             * convention. For performance reasons we do the conversion to
-             * upper here */
-            if (utf8_set(cmd_buf, utf8_span_view(source_text, candidate)) != 0)
-                return NULL;
-            utf8_toupper(*cmd_buf);
-
-            cmd_id cmd = cmd_list_find(commands, utf8_view(*cmd_buf));
+            struct utf8_span gap;
+            cmd_id           cmd = cmd_trie_cmd(parser->cmd_trie, node);
+            int              keyword = cmd_trie_keyword(parser->cmd_trie, node);
             if (cmd > -1)
             {
                 longest_match_cmd_idx = cmd;
                 longest_match_token_idx = i;
             }
+            if (keyword > -1 && is_identifier)
+            {
+                longest_match_keyword = (dbtoken_kind_t)keyword;
+                longest_keyword_token_idx = i;
+            }
+
+            if (!cmd_trie_has_children(parser->cmd_trie, node))
+                break;
 
             /* Get or scan next token */
+            gap.off = token->pushed_location.off + token->pushed_location.len;
             if (i + 1 >= token_queue_count(*tokens))
             {
                 token = token_queue_emplace_realloc(tokens);
                 if (token == NULL)
                     return NULL;
-                token->pushed_char
-                    = dblex(&token->pushed_value, scanner_location, scanner);
-                token->pushed_location = *scanner_location;
+                scan_token(parser, token, scanner_location);
             }
             else
             {
@@ -147,14 +238,22 @@ get_next_assembled_token(
             if (token->pushed_char < 0)
                 return NULL;
 
-            candidate.len = (utf8_idx)(token->pushed_location.off
-                                       - token_queue_peek_read(*tokens)
-                                             ->pushed_location.off
-                                       + token->pushed_location.len);
+            /* Commands can span multiple tokens, e.g. "make object". The
+             * whitespace between tokens is part of the command name. */
+            gap.len = (utf8_idx)(token->pushed_location.off - gap.off);
+            node = walk_cmd_trie(parser, node, source_text, gap);
+            if (node > -1)
+                node = probe_cmd_trie(
+                    parser, node, source_text, token->pushed_location);
         }
 
-        /* Merge tokens that matched the longest command */
-        for (i = 0; i < longest_match_token_idx; ++i)
+        /* Commands take precedence over keywords, because plugins can define
+         * commands that are also keywords */
+        merge_count = longest_match_token_idx > -1 ? longest_match_token_idx
+                                                   : longest_keyword_token_idx;
+
+        /* Merge tokens that matched the longest command or keyword */
+        for (i = 0; i < merge_count; ++i)
         {
             struct token* t1 = token_queue_take(*tokens);
             struct token* t2 = token_queue_peek_read(*tokens);
@@ -163,23 +262,17 @@ get_next_assembled_token(
             t2->pushed_location.off = t1->pushed_location.off;
         }
 
-        /* Promote token to a command */
+        /* Promote token to a command or keyword */
+        token = token_queue_peek_read(*tokens);
         if (longest_match_token_idx > -1)
         {
-            token = token_queue_peek_read(*tokens);
             token->pushed_char = TOK_COMMAND;
             token->pushed_value.cmd_value = longest_match_cmd_idx;
         }
-    }
-
-    /* This identifier could be a keyword */
-    token = token_queue_peek_read(*tokens);
-    if (token->pushed_char == TOK_IDENTIFIER)
-    {
-        dbtoken_kind_t keyword
-            = db_keyword_lookup(source_text, token->pushed_location);
-        if (keyword != TOK_EOF)
-            token->pushed_char = keyword;
+        else if (longest_keyword_token_idx > -1)
+        {
+            token->pushed_char = longest_match_keyword;
+        }
     }
 
     return token_queue_take(*tokens);
@@ -187,27 +280,25 @@ get_next_assembled_token(
 
 static struct token*
 get_next_token_ignoring_comments(
-    struct token_queue**   tokens,
-    struct utf8*           cmd_buf,
-    const struct cmd_list* commands,
-    const char*            filename,
-    const char*            source,
-    dbscan_t               scanner,
-    DBLTYPE*               scanner_location)
+    struct token_queue** tokens,
+    struct db_parser*    parser,
+    const char*          filename,
+    const char*          source,
+    DBLTYPE*             scanner_location)
 {
     struct token* expect_remend;
 
     while (1)
     {
         struct token* token = get_next_assembled_token(
-            tokens, cmd_buf, commands, source, scanner, scanner_location);
+            tokens, parser, source, scanner_location);
         if (token == NULL)
             return NULL;
         if (token->pushed_char != TOK_REMSTART)
             return token;
 
         expect_remend = get_next_assembled_token(
-            tokens, cmd_buf, commands, source, scanner, scanner_location);
+            tokens, parser, source, scanner_location);
         if (expect_remend->pushed_char == TOK_REMEND)
             continue;
 
@@ -228,8 +319,13 @@ db_parse(
     YY_BUFFER_STATE     buffer_state;
     int                 parse_result = -1;
     struct utf8_span    scanner_location = empty_utf8_span();
-    struct utf8         cmd_buf = empty_utf8();
     struct parse_param  parse_param = {astp, filename, source.text.data};
+    struct utf8_view    input = utf8_view(source.text);
+
+    parser->stats.tokens = 0;
+    parser->stats.cmd_probes = 0;
+    parser->stats.transitions = 0;
+    parser->stats.bytes = source.text.len;
 
     if (source.text.len == 0)
     {
@@ -237,9 +333,29 @@ db_parse(
         return 0;
     }
 
-    buffer_state = db_scan_buffer(
-        source.text.data, source.text.len + 2, parser->scanner);
-    if (buffer_state == NULL)
+    if (parser->cmd_trie_cmds != commands
+        || parser->cmd_trie_cmd_count != cmd_list_count(commands))
+    {
+        if (build_cmd_trie(parser, commands) != 0)
+            return -1;
+    }
+
+    /* The fast lexer works directly on the source text. Otherwise, if the
+     * source could not be loaded with FLEX's EOB marker, then it is streamed
+     * into the scanner through YY_INPUT instead */
+    buffer_state = NULL;
+    if (parser->lexer_backend == DB_LEXER_FAST)
+        db_lexer_init(&parser->lexer, source);
+    else if (source.has_eob)
+        buffer_state = db_scan_buffer(
+            source.text.data, source.text.len + 2, parser->scanner);
+    else
+    {
+        buffer_state = db_create_buffer(NULL, YY_BUF_SIZE, parser->scanner);
+        if (buffer_state != NULL)
+            db_switch_to_buffer(buffer_state, parser->scanner);
+    }
+    if (buffer_state == NULL && parser->lexer_backend != DB_LEXER_FAST)
     {
         log_parser_err(
             "Failed to set up scan buffer. Either we ran out of memory, or the "
@@ -256,18 +372,12 @@ db_parse(
     dbdebug = 1;
 #endif
 
-    dbset_extra(source.text.data, parser->scanner);
+    dbset_extra(&input, parser->scanner);
 
     do
     {
         struct token* token = get_next_token_ignoring_comments(
-            &tokens,
-            &cmd_buf,
-            commands,
-            filename,
-            source.text.data,
-            parser->scanner,
-            &scanner_location);
+            &tokens, parser, filename, source.text.data, &scanner_location);
         if (token == NULL)
             goto parse_failed;
 
@@ -292,8 +402,8 @@ parse_failed:
     dbset_extra(NULL, parser->scanner);
     token_queue_deinit(tokens);
 init_token_queue_failed:
-    db_delete_buffer(buffer_state, parser->scanner);
+    if (buffer_state != NULL)
+        db_delete_buffer(buffer_state, parser->scanner);
 init_buffer_failed:
-    utf8_deinit(cmd_buf);
     return parse_result == 0 ? 0 : -1;
 }
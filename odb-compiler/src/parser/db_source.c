@@ -6,31 +6,23 @@
 int
 db_source_open_file(struct db_source* s, struct ospathc filepath)
 {
-    struct mfile mf_orig;
-    struct mfile mf_flex;
+    struct mfile mf;
 
     /* FLEX expects to find an "EOB marker" at the end of its buffer, which is a
-     * sequence of two NULL bytes. */
-    if (mfile_map_read(&mf_orig, filepath, 1) != 0)
-        goto map_file_failed;
-    if (mfile_map_mem(&mf_flex, mf_orig.size + 2) != 0)
-        goto map_flex_failed;
-
-    memcpy(mf_flex.address, mf_orig.address, mf_orig.size);
-    ((char*)mf_flex.address)[mf_flex.size - 1] = '\0';
-    ((char*)mf_flex.address)[mf_flex.size - 2] = '\0';
+     * sequence of two NULL bytes. In most cases these fit into the remainder of
+     * the file's last page, which the OS fills with zeros, so the file can be
+     * scanned in-place without copying it. */
+    switch (mfile_map_cow_padded(&mf, filepath, 2, 1))
+    {
+        case 0: s->has_eob = 1; break;
+        case 1: s->has_eob = 0; break;
+        default: return -1;
+    }
 
-    s->text.data = (char*)mf_flex.address;
-    s->text.len = mf_flex.size - 2; /* two EOB bytes -- also function as a null
-                                       terminator */
+    s->text.data = (char*)mf.address;
+    s->text.len = mf.size;
 
-    mfile_unmap(&mf_orig);
     return 0;
-
-map_flex_failed:
-    mfile_unmap(&mf_orig);
-map_file_failed:
-    return -1;
 }
 
 int
@@ -47,6 +39,7 @@ db_source_open_string(struct db_source* s, struct utf8_view str)
     s->text.data = (char*)mf.address;
     s->text.len = mf.size - 2; /* two EOB bytes -- also function as a null
                                   terminator */
+    s->has_eob = 1;
     return 0;
 }
 
@@ -61,6 +54,7 @@ db_source_ref_string(struct db_source* s, struct utf8* str)
 
     s->text.data = str->data;
     s->text.len = str->len - 2;
+    s->has_eob = 1;
 
     return 0;
 }
@@ -68,6 +62,7 @@ db_source_ref_string(struct db_source* s, struct utf8* str)
 void
 db_source_close(struct db_source* s)
 {
-    struct mfile mf = {(void*)s->text.data, s->text.len + 2};
+    struct mfile mf
+        = {(void*)s->text.data, s->text.len + (s->has_eob ? 2 : 0)};
     mfile_unmap(&mf);
 }
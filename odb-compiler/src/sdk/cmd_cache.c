@@ -1,35 +1,85 @@
 #include "odb-compiler/sdk/cmd_cache.h"
 #include "odb-util/fs.h"
 #include "odb-util/log.h"
+#include "odb-util/mem.h"
 #include "odb-util/mfile.h"
 #include "odb-util/mstream.h"
 #include "odb-util/utf8.h"
-
-#define VERSION 0
-
-int
-cmd_cache_load(
-    struct plugin_ids**       cached_plugins,
-    const struct plugin_list* plugins,
-    struct cmd_list*          cmds,
-    enum sdk_type             sdk_type,
-    enum target_arch          arch,
-    enum target_platform      platform)
+#include <stddef.h>
+
+VEC_DEFINE_API(plugin_hashes, hash64, 16)
+
+/*
+ * The cache stores an image of each container in the command list, so that
+ * when no plugin changed, the list can be restored with one memcpy() per
+ * container instead of being rebuilt one command at a time:
+ *
+ *   header, plugin hashes, command names, C symbols, plugin IDs, return types,
+ *   parameter ranges, parameters, parameter names
+ *
+ * Plugins are identified by a hash of the data their commands are parsed
+ * from, see plugin_reader_command_hash(). A hash of 0 means the plugin could
+ * not be hashed, and never matches.
+ *
+ * The three string sections are utf8_list images: The string blob followed by
+ * its table of offsets. Commands are stored in sorted order, so the name list
+ * is also the lookup index used by cmd_list_find(). Every section starts on an
+ * 8 byte boundary so the images can be read in-place from the mapped file.
+ *
+ * The cache is only ever read on the machine that wrote it, so everything is
+ * stored in native byte order. The header records the size of each record to
+ * catch layout changes that don't bump the version.
+ */
+enum section
 {
-    plugin_id          cached_plugin_id;
-    plugin_id          cached_plugin_count;
-    cmd_id             cached_cmd;
-    cmd_id             cached_cmd_count;
-    struct mfile       mf;
-    struct mstream     ms;
-    struct plugin_ids* cached_plugin_map;
-    struct utf8        fname = empty_utf8();
-    struct ospath      path = empty_ospath();
+    SECTION_PLUGINS,
+    SECTION_CMD_NAMES,
+    SECTION_C_SYMBOLS,
+    SECTION_PLUGIN_IDS,
+    SECTION_RETURN_TYPES,
+    SECTION_PARAM_RANGES,
+    SECTION_PARAMS,
+    SECTION_PARAM_NAMES,
+
+    SECTION_COUNT
+};
+
+struct section_range
+{
+    int32_t off;
+    int32_t size;
+};
 
-    plugin_ids_init(&cached_plugin_map);
+struct header
+{
+    /* Must stay the first byte, so older caches are rejected */
+    uint8_t version;
+    uint8_t longest_command;
+    uint8_t sizeof_type;
+    uint8_t sizeof_param;
+    uint8_t sizeof_param_range;
+    uint8_t sizeof_utf8_list;
+    int32_t plugin_count;
+    int32_t cmd_count;
+    int32_t param_count;
+
+    struct section_range sections[SECTION_COUNT];
+};
+
+#define UTF8_LIST_HEADER_SIZE ((int32_t)offsetof(struct utf8_list, data))
+#define SECTION_ALIGNMENT     8
+
+static int
+get_cache_path(
+    struct ospath*       path,
+    enum sdk_type        sdk_type,
+    enum target_arch     arch,
+    enum target_platform platform)
+{
+    struct utf8 fname = empty_utf8();
 
-    if (fs_get_appdata_dir(&path) != 0)
-        goto open_mfile_failed;
+    if (fs_get_appdata_dir(path) != 0)
+        goto fail;
 
     if (utf8_fmt(
             &fname,
@@ -39,202 +89,501 @@ cmd_cache_load(
             target_platform_to_name(platform))
         != 0)
     {
-        goto open_mfile_failed;
+        goto fail;
     }
 
-    if (ospath_join_cstr(&path, "cmd-cache") != 0)
-        goto open_mfile_failed;
-    if (fs_make_path(path) != 0)
-        goto open_mfile_failed;
-    if (ospath_join(&path, utf8_ospathc(fname)) != 0)
-        goto open_mfile_failed;
+    if (ospath_join_cstr(path, "cmd-cache") != 0)
+        goto fail;
+    if (fs_make_path(*path) != 0)
+        goto fail;
+    if (ospath_join(path, utf8_ospathc(fname)) != 0)
+        goto fail;
 
+    utf8_deinit(fname);
+    return 0;
+
+fail:
+    utf8_deinit(fname);
+    return -1;
+}
+
+/* Load functions ----------------------------------------------------------- */
+
+static const char*
+section_data(const struct mfile* mf, const struct header* header, int section)
+{
+    return (const char*)mf->address + header->sections[section].off;
+}
+
+/* Checks that a utf8_list image can be used in-place, and that it contains the
+ * expected number of strings */
+static int
+check_utf8_list(const char* image, int32_t size, int32_t expected_count)
+{
+    struct utf8_list        list;
+    const struct utf8_span* table;
+    utf8_idx                i;
+
+    if (size == 0)
+        return expected_count == 0 ? 0 : -1;
+    if (size < UTF8_LIST_HEADER_SIZE)
+        return -1;
+
+    memcpy(&list, image, UTF8_LIST_HEADER_SIZE);
+    if (list.count != expected_count || list.count <= 0 || list.str_used < 0
+        || list.capacity != size - UTF8_LIST_HEADER_SIZE
+        || list.capacity % sizeof(struct utf8_span) != 0
+        || (list.capacity - list.str_used) / (int32_t)sizeof(struct utf8_span)
+               < list.count)
+    {
+        return -1;
+    }
+
+    table = UTF8_LIST_TABLE_PTR((const struct utf8_list*)image);
+    for (i = 0; i != list.count; ++i)
+    {
+        struct utf8_span span = table[-i];
+        if (span.off < 0 || span.len < 0
+            || span.len > list.str_used - UTF8_APPEND_PADDING
+            || span.off > list.str_used - UTF8_APPEND_PADDING - span.len)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+check_header(const struct mfile* mf, const struct header* header)
+{
+    int                           i;
+    const struct cmd_param_range* ranges;
+    const plugin_id*              plugin_ids;
+
+    if (header->version != CMD_CACHE_VERSION
+        || header->sizeof_type != sizeof(enum type)
+        || header->sizeof_param != sizeof(struct cmd_param)
+        || header->sizeof_param_range != sizeof(struct cmd_param_range)
+        || header->sizeof_utf8_list != UTF8_LIST_HEADER_SIZE)
+    {
+        return -1;
+    }
+
+    /* The plugin ID vector has a 16-bit count */
+    if (header->plugin_count < 0 || header->plugin_count > INT16_MAX
+        || header->cmd_count < 0 || header->cmd_count > INT16_MAX
+        || header->param_count < 0)
+    {
+        return -1;
+    }
+
+    for (i = 0; i != SECTION_COUNT; ++i)
+    {
+        struct section_range s = header->sections[i];
+        if (s.off < (int32_t)sizeof(*header) || s.off % SECTION_ALIGNMENT != 0
+            || s.size < 0 || s.size > mf->size - s.off)
+        {
+            return -1;
+        }
+    }
+
+    if (header->sections[SECTION_PLUGINS].size
+            != header->plugin_count * (int32_t)sizeof(hash64)
+        || header->sections[SECTION_PLUGIN_IDS].size
+               != header->cmd_count * (int32_t)sizeof(plugin_id)
+        || header->sections[SECTION_RETURN_TYPES].size
+               != header->cmd_count * (int32_t)sizeof(enum type)
+        || header->sections[SECTION_PARAM_RANGES].size
+               != header->cmd_count * (int32_t)sizeof(struct cmd_param_range)
+        || (int64_t)header->sections[SECTION_PARAMS].size
+               != (int64_t)header->param_count * sizeof(struct cmd_param))
+    {
+        return -1;
+    }
+
+    if (check_utf8_list(
+            section_data(mf, header, SECTION_CMD_NAMES),
+            header->sections[SECTION_CMD_NAMES].size,
+            header->cmd_count)
+            != 0
+        || check_utf8_list(
+               section_data(mf, header, SECTION_C_SYMBOLS),
+               header->sections[SECTION_C_SYMBOLS].size,
+               header->cmd_count)
+               != 0
+        || check_utf8_list(
+               section_data(mf, header, SECTION_PARAM_NAMES),
+               header->sections[SECTION_PARAM_NAMES].size,
+               header->param_count)
+               != 0)
+    {
+        return -1;
+    }
+
+    plugin_ids
+        = (const plugin_id*)section_data(mf, header, SECTION_PLUGIN_IDS);
+    ranges = (const struct cmd_param_range*)section_data(
+        mf, header, SECTION_PARAM_RANGES);
+    for (i = 0; i != header->cmd_count; ++i)
+    {
+        if (plugin_ids[i] < 0 || plugin_ids[i] >= header->plugin_count)
+            return -1;
+        if (ranges[i].first < 0 || ranges[i].count < 0
+            || ranges[i].count > header->param_count
+            || ranges[i].first > header->param_count - ranges[i].count)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+copy_utf8_list(struct utf8_list** l, const char* image, int32_t size)
+{
+    if (size == 0)
+        return 0;
+
+    *l = mem_alloc(size);
+    if (*l == NULL)
+        return log_oom(size, "cmd_cache_load()");
+    memcpy(*l, image, size);
+    return 0;
+}
+
+/* Restores the cached list with one allocation per container */
+static int
+copy_cmd_list(
+    struct cmd_list*     cmds,
+    const struct mfile*  mf,
+    const struct header* header)
+{
+    cmd_list_deinit(cmds);
+    cmd_list_init(cmds);
+
+    if (copy_utf8_list(
+            &cmds->db_cmd_names,
+            section_data(mf, header, SECTION_CMD_NAMES),
+            header->sections[SECTION_CMD_NAMES].size)
+        != 0)
+        goto fail;
+    if (copy_utf8_list(
+            &cmds->c_symbols,
+            section_data(mf, header, SECTION_C_SYMBOLS),
+            header->sections[SECTION_C_SYMBOLS].size)
+        != 0)
+        goto fail;
+    if (copy_utf8_list(
+            &cmds->db_param_names,
+            section_data(mf, header, SECTION_PARAM_NAMES),
+            header->sections[SECTION_PARAM_NAMES].size)
+        != 0)
+        goto fail;
+
+    if (header->cmd_count > 0)
+    {
+        if (plugin_ids_resize(&cmds->plugin_ids, header->cmd_count) != 0)
+            goto fail;
+        if (return_types_list_resize(&cmds->return_types, header->cmd_count)
+            != 0)
+            goto fail;
+        if (cmd_param_ranges_resize(&cmds->param_ranges, header->cmd_count)
+            != 0)
+            goto fail;
+        memcpy(
+            cmds->plugin_ids->data,
+            section_data(mf, header, SECTION_PLUGIN_IDS),
+            header->sections[SECTION_PLUGIN_IDS].size);
+        memcpy(
+            cmds->return_types->data,
+            section_data(mf, header, SECTION_RETURN_TYPES),
+            header->sections[SECTION_RETURN_TYPES].size);
+        memcpy(
+            cmds->param_ranges->data,
+            section_data(mf, header, SECTION_PARAM_RANGES),
+            header->sections[SECTION_PARAM_RANGES].size);
+    }
+    if (header->param_count > 0)
+    {
+        if (cmd_param_list_resize(&cmds->params, header->param_count) != 0)
+            goto fail;
+        memcpy(
+            cmds->params->data,
+            section_data(mf, header, SECTION_PARAMS),
+            header->sections[SECTION_PARAMS].size);
+    }
+
+    cmds->sorted_count = header->cmd_count;
+    cmds->longest_command = (char)header->longest_command;
+    return 0;
+
+fail:
+    cmd_list_deinit(cmds);
+    cmd_list_init(cmds);
+    return -1;
+}
+
+static int
+contains_plugin(const struct plugin_ids* ids, plugin_id id)
+{
+    const plugin_id* other;
+    vec_for_each(ids, other)
+    {
+        if (*other == id)
+            return 1;
+    }
+    return 0;
+}
+
+int
+cmd_cache_load(
+    struct plugin_ids**         cached_plugins,
+    const struct plugin_hashes* plugin_hashes,
+    struct cmd_list*            cmds,
+    enum sdk_type               sdk_type,
+    enum target_arch            arch,
+    enum target_platform        platform)
+{
+    plugin_id          cached_plugin_id;
+    struct header      header;
+    struct mfile       mf;
+    const hash64*      cached_hashes;
+    struct plugin_ids* cached_plugin_map;
+    struct cmd_list    loaded;
+    int                unchanged;
+    struct ospath      path = empty_ospath();
+
+    plugin_ids_init(&cached_plugin_map);
+
+    if (get_cache_path(&path, sdk_type, arch, platform) != 0)
+        goto open_mfile_failed;
     if (mfile_map_read(&mf, ospathc(path), 0) != 0)
         goto open_mfile_failed;
-    ms = mstream_from_mfile(&mf);
 
-    /* Version */
-    if (mstream_read_u8(&ms) != VERSION)
+    if (mf.size < (int)sizeof(header))
+        goto parse_failed;
+    memcpy(&header, mf.address, sizeof(header));
+    if (check_header(&mf, &header) != 0)
         goto parse_failed;
 
-    /* Load list of plugins. If a plugin is outdated, we don't add it to the
-     * returned list and we don't load its commands */
-    cached_plugin_count = mstream_read_li16(&ms);
-    if (plugin_ids_resize(&cached_plugin_map, cached_plugin_count) != 0)
+    /* Each cached plugin is matched to a plugin with the same hash. Paths and
+     * timestamps don't matter, so e.g. a fresh checkout of the SDK can still
+     * use the cache. Plugins without a match are parsed again, and we don't
+     * load the commands of cached plugins without a match */
+    if (plugin_ids_resize(&cached_plugin_map, header.plugin_count) != 0)
         goto parse_failed;
-    for (cached_plugin_id = 0; cached_plugin_id != cached_plugin_count;
+    unchanged = 1;
+    cached_hashes = (const hash64*)section_data(&mf, &header, SECTION_PLUGINS);
+    for (cached_plugin_id = 0; cached_plugin_id != header.plugin_count;
          ++cached_plugin_id)
     {
-        int                       i;
-        const struct plugin_info* plugin;
-
-        uint64_t       cached_stamp = mstream_read_lu64(&ms);
-        struct ospathc cached_path = mstream_read_ospath(&ms);
-        uint64_t       stamp = fs_mtime_ms(cached_path);
+        int           i;
+        const hash64* hash;
 
         /* Map to invalid plugin by default. Don't forget this, resize() does
          * NOT initialize values in the vector! */
         cached_plugin_map->data[cached_plugin_id] = -1;
 
-        if (stamp != cached_stamp)
-            continue;
-
-        vec_enumerate(plugins, i, plugin)
-        {
-            if (ospathc_equal(ospathc(plugin->filepath), cached_path))
-            {
-                plugin_ids_push(cached_plugins, i);
-                cached_plugin_map->data[cached_plugin_id] = i;
-                break;
-            }
-        }
-    }
-
-    /* Command list */
-    cached_cmd_count = mstream_read_li32(&ms);
-    for (cached_cmd = 0; cached_cmd != cached_cmd_count; ++cached_cmd)
-    {
-        int              i;
-        cmd_id           cmd;
-        struct utf8_view db_cmd_name = mstream_read_utf8(&ms);
-        struct utf8_view c_symbol = mstream_read_utf8(&ms);
-        plugin_id        cached_plugin_id = mstream_read_li16(&ms);
-        enum type        return_type = mstream_read_u8(&ms);
-        int              param_count = mstream_read_u8(&ms);
-
-        if (cached_plugin_id < 0
-            || cached_plugin_id >= plugin_ids_count(cached_plugin_map)
-            || cached_plugin_map->data[cached_plugin_id] == -1)
+        vec_enumerate(plugin_hashes, i, hash)
         {
-            for (i = 0; i != param_count; ++i)
+            if (*hash == 0 || *hash != cached_hashes[cached_plugin_id]
+                || contains_plugin(*cached_plugins, i))
             {
-                mstream_read_u8(&ms);
-                mstream_read_utf8(&ms);
+                continue;
             }
-            continue;
-        }
 
-        ODBUTIL_DEBUG_ASSERT(
-            cached_plugin_id >= 0
-                && cached_plugin_id < plugin_ids_count(cached_plugin_map),
-            log_cmd_err("plugin_id: %d\n", cached_plugin_id));
-        cmd = cmd_list_add(
-            cmds,
-            cached_plugin_map->data[cached_plugin_id],
-            return_type,
-            db_cmd_name,
-            c_symbol);
-        if (cmd < 0)
-            goto parse_failed;
-
-        for (i = 0; i != param_count; ++i)
-        {
-            uint8_t                  data = mstream_read_u8(&ms);
-            struct utf8_view         param_name = mstream_read_utf8(&ms);
-            enum cmd_param_direction direction
-                = (data & 0x80) ? CMD_PARAM_OUT : CMD_PARAM_IN;
-            enum type param_type = (data & 0x7F);
-
-            if (cmd_add_param(cmds, cmd, param_type, direction, param_name)
-                != 0)
+            if (plugin_ids_push(cached_plugins, i) != 0)
                 goto parse_failed;
+            cached_plugin_map->data[cached_plugin_id] = i;
+            break;
         }
+
+        if (cached_plugin_map->data[cached_plugin_id] != cached_plugin_id)
+            unchanged = 0;
+    }
+
+    /* Command list. The cached list is restored as a whole, then the commands
+     * of plugins that changed are removed from it in a single pass */
+    cmd_list_init(&loaded);
+    if (copy_cmd_list(&loaded, &mf, &header) != 0)
+        goto parse_failed;
+    if (!unchanged && cmd_list_remap_plugins(&loaded, cached_plugin_map) != 0)
+        goto merge_failed;
+    if (cmd_list_count(cmds) == 0)
+    {
+        cmd_list_deinit(cmds);
+        *cmds = loaded;
+    }
+    else
+    {
+        if (cmd_list_append_list(cmds, &loaded) != 0)
+            goto merge_failed;
+        cmd_list_deinit(&loaded);
     }
 
     mfile_unmap(&mf);
     plugin_ids_deinit(cached_plugin_map);
-    utf8_deinit(fname);
     ospath_deinit(path);
     return 0;
 
+merge_failed:
+    cmd_list_deinit(&loaded);
 parse_failed:
+    plugin_ids_clear(*cached_plugins);
     mfile_unmap(&mf);
 open_mfile_failed:
     plugin_ids_deinit(cached_plugin_map);
-    utf8_deinit(fname);
     ospath_deinit(path);
     return -1;
 }
 
-int
-cmd_cache_save(
-    const struct plugin_list* plugins,
-    const struct cmd_list*    cmds,
-    enum sdk_type             sdk_type,
-    enum target_arch          arch,
-    enum target_platform      platform)
-{
-    cmd_id                    cmd;
-    struct mfile              mf;
-    const struct plugin_info* plugin;
-    struct utf8               fname = empty_utf8();
-    struct ospath             path = empty_ospath();
-    struct mstream            ms = mstream_init_writable();
-
-    if (fs_get_appdata_dir(&path) != 0)
-        goto error;
+/* Save functions ----------------------------------------------------------- */
 
-    if (utf8_fmt(
-            &fname,
-            "%s-%s-%s.dat",
-            sdk_type_to_name(sdk_type),
-            target_arch_to_name(arch),
-            target_platform_to_name(platform))
-        != 0)
-    {
-        goto error;
-    }
+static void
+begin_section(struct mstream* ms, struct header* header, int section)
+{
+    static const char zeros[SECTION_ALIGNMENT] = {0};
+    mstream_write(
+        ms,
+        zeros,
+        (SECTION_ALIGNMENT - ms->ptr % SECTION_ALIGNMENT) % SECTION_ALIGNMENT);
+    header->sections[section].off = ms->ptr;
+}
 
-    if (ospath_join_cstr(&path, "cmd-cache") != 0)
-        goto error;
-    if (fs_make_path(path) != 0)
-        goto error;
-    if (ospath_join(&path, utf8_ospathc(fname)) != 0)
-        goto error;
+static void
+end_section(struct mstream* ms, struct header* header, int section)
+{
+    header->sections[section].size = ms->ptr - header->sections[section].off;
+}
 
-    /* Version */
-    mstream_write_u8(&ms, VERSION);
+static void
+write_array(
+    struct mstream* ms,
+    struct header*  header,
+    int             section,
+    const void*     data,
+    int             size)
+{
+    begin_section(ms, header, section);
+    if (size > 0)
+        mstream_write(ms, data, size);
+    end_section(ms, header, section);
+}
 
-    /* List of plugins */
-    mstream_write_li16(&ms, plugin_list_count(plugins));
-    vec_for_each(plugins, plugin)
+/* Writes a copy of the list without any unused capacity */
+static void
+write_utf8_list(
+    struct mstream*         ms,
+    struct header*          header,
+    int                     section,
+    const struct utf8_list* l)
+{
+    static const char zeros[sizeof(struct utf8_span)] = {0};
+    struct utf8_list  image;
+    utf8_idx          count = utf8_list_count(l);
+    utf8_idx          table_size = count * (utf8_idx)sizeof(struct utf8_span);
+    utf8_idx          padding;
+
+    begin_section(ms, header, section);
+    if (count > 0)
     {
-        /* Timestamps of plugins, so next time we know if the plugin has to be
-         * parsed again or not */
-        uint64_t stamp = fs_mtime_ms(ospathc(plugin->filepath));
-
-        mstream_write_lu64(&ms, stamp);
-        mstream_write_ospath(&ms, plugin->filepath);
+        padding = (sizeof(struct utf8_span)
+                   - l->str_used % sizeof(struct utf8_span))
+                  % sizeof(struct utf8_span);
+        image.count = count;
+        image.str_used = l->str_used;
+        image.capacity = l->str_used + padding + table_size;
+
+        mstream_write(ms, &image, UTF8_LIST_HEADER_SIZE);
+        mstream_write(ms, l->data, l->str_used);
+        mstream_write(ms, zeros, padding);
+        mstream_write(ms, UTF8_LIST_TABLE_PTR(l) - (count - 1), table_size);
     }
+    end_section(ms, header, section);
+}
+
+int
+cmd_cache_save(
+    const struct plugin_hashes* plugin_hashes,
+    const struct cmd_list*      cmds,
+    enum sdk_type               sdk_type,
+    enum target_arch            arch,
+    enum target_platform        platform)
+{
+    struct header  header;
+    struct mfile   mf;
+    struct ospath  path = empty_ospath();
+    struct mstream ms = mstream_init_writable();
+    cmd_id         cmd_count = cmd_list_count(cmds);
+    int            plugin_count = plugin_hashes_count(plugin_hashes);
+    int            param_count = cmd_param_list_count(cmds->params);
+
+    /* The name list is saved as the lookup index */
+    ODBUTIL_DEBUG_ASSERT(
+        cmds->sorted_count == cmd_count,
+        log_cmd_err("sorted_count: %d\n", cmds->sorted_count));
+
+    if (get_cache_path(&path, sdk_type, arch, platform) != 0)
+        goto error;
+
+    memset(&header, 0, sizeof(header));
+    header.version = CMD_CACHE_VERSION;
+    header.longest_command = (uint8_t)cmds->longest_command;
+    header.sizeof_type = sizeof(enum type);
+    header.sizeof_param = sizeof(struct cmd_param);
+    header.sizeof_param_range = sizeof(struct cmd_param_range);
+    header.sizeof_utf8_list = UTF8_LIST_HEADER_SIZE;
+    header.plugin_count = plugin_count;
+    header.cmd_count = cmd_count;
+    header.param_count = param_count;
+
+    /* Placeholder, the header is written again once the sections are known */
+    mstream_write(&ms, &header, sizeof(header));
+
+    /* Hashes of plugins, so next time we know if the plugin has to be parsed
+     * again or not */
+    write_array(
+        &ms,
+        &header,
+        SECTION_PLUGINS,
+        plugin_count ? plugin_hashes->data : NULL,
+        plugin_count * (int)sizeof(hash64));
 
     /* Command list */
-    mstream_write_li32(&ms, cmd_list_count(cmds));
-    for (cmd = 0; cmd != cmd_list_count(cmds); ++cmd)
-    {
-        int i;
-        mstream_write_utf8(&ms, utf8_list_view(cmds->db_cmd_names, cmd));
-        mstream_write_utf8(&ms, utf8_list_view(cmds->c_symbols, cmd));
-        mstream_write_li16(&ms, cmds->plugin_ids->data[cmd]);
-        mstream_write_u8(&ms, cmds->return_types->data[cmd]);
-        mstream_write_u8(
-            &ms, cmd_param_types_list_count(cmds->param_types->data[cmd]));
-        for (i = 0;
-             i != cmd_param_types_list_count(cmds->param_types->data[cmd]);
-             i++)
-        {
-            const struct cmd_param* param_type
-                = &cmds->param_types->data[cmd]->data[i];
-            struct utf8_view param_name
-                = utf8_list_view(cmds->db_param_names->data[cmd], i);
-            mstream_write_u8(
-                &ms, (param_type->type & 0x7F) | (param_type->direction << 7));
-            mstream_write_utf8(&ms, param_name);
-        }
-    }
+    write_utf8_list(&ms, &header, SECTION_CMD_NAMES, cmds->db_cmd_names);
+    write_utf8_list(&ms, &header, SECTION_C_SYMBOLS, cmds->c_symbols);
+    write_array(
+        &ms,
+        &header,
+        SECTION_PLUGIN_IDS,
+        cmd_count ? cmds->plugin_ids->data : NULL,
+        cmd_count * (int)sizeof(plugin_id));
+    write_array(
+        &ms,
+        &header,
+        SECTION_RETURN_TYPES,
+        cmd_count ? cmds->return_types->data : NULL,
+        cmd_count * (int)sizeof(enum type));
+    write_array(
+        &ms,
+        &header,
+        SECTION_PARAM_RANGES,
+        cmd_count ? cmds->param_ranges->data : NULL,
+        cmd_count * (int)sizeof(struct cmd_param_range));
+    write_array(
+        &ms,
+        &header,
+        SECTION_PARAMS,
+        param_count ? cmds->params->data : NULL,
+        param_count * (int)sizeof(struct cmd_param));
+    write_utf8_list(&ms, &header, SECTION_PARAM_NAMES, cmds->db_param_names);
 
     /* If at any point a write failed, the error flag is set */
     if (ms.error)
         goto error;
+    memcpy(ms.data, &header, sizeof(header));
 
     /* Write to file */
     if (mfile_map_overwrite(&mf, ms.ptr, ospathc(path)) != 0)
@@ -244,12 +593,10 @@ cmd_cache_save(
     mfile_unmap(&mf);
     mstream_free_writable(&ms);
     ospath_deinit(path);
-    utf8_deinit(fname);
     return 0;
 
 error:
     mstream_free_writable(&ms);
     ospath_deinit(path);
-    utf8_deinit(fname);
     return -1;
 }
@@ -1,12 +1,15 @@
 #include "odb-compiler/sdk/cmd_list.h"
+#include "odb-util/log.h"
+#include "odb-util/mem.h"
 #include "odb-util/utf8.h"
 #include "odb-util/utf8_list.h"
+#include <stdlib.h>
+#include <string.h>
 
 VEC_DEFINE_API(plugin_ids, int16_t, 16)
 VEC_DEFINE_API(return_types_list, enum type, 32)
-VEC_DEFINE_API(cmd_param_types_list, struct cmd_param, 8)
-VEC_DEFINE_API(cmd_param_types_lists, struct cmd_param_types_list*, 32)
-VEC_DEFINE_API(db_param_names, struct utf8_list*, 32)
+VEC_DEFINE_API(cmd_param_list, struct cmd_param, 32)
+VEC_DEFINE_API(cmd_param_ranges, struct cmd_param_range, 32)
 
 void
 cmd_list_init(struct cmd_list* cmds)
@@ -15,25 +18,19 @@ cmd_list_init(struct cmd_list* cmds)
     utf8_list_init(&cmds->c_symbols);
     plugin_ids_init(&cmds->plugin_ids);
     return_types_list_init(&cmds->return_types);
-    cmd_param_types_lists_init(&cmds->param_types);
-    db_param_names_init(&cmds->db_param_names);
+    cmd_param_ranges_init(&cmds->param_ranges);
+    cmd_param_list_init(&cmds->params);
+    utf8_list_init(&cmds->db_param_names);
+    cmds->sorted_count = 0;
     cmds->longest_command = 0;
 }
 
 void
 cmd_list_deinit(struct cmd_list* cmds)
 {
-    struct utf8_list**            db_param_names;
-    struct cmd_param_types_list** param_types;
-
-    vec_for_each(cmds->db_param_names, db_param_names)
-        utf8_list_deinit(*db_param_names);
-    db_param_names_deinit(cmds->db_param_names);
-
-    vec_for_each(cmds->param_types, param_types)
-        cmd_param_types_list_deinit(*param_types);
-    cmd_param_types_lists_deinit(cmds->param_types);
-
+    utf8_list_deinit(cmds->db_param_names);
+    cmd_param_list_deinit(cmds->params);
+    cmd_param_ranges_deinit(cmds->param_ranges);
     return_types_list_deinit(cmds->return_types);
     plugin_ids_deinit(cmds->plugin_ids);
     utf8_list_deinit(cmds->c_symbols);
@@ -49,8 +46,7 @@ cmd_list_insert(
     struct utf8_view db_cmd_name,
     struct utf8_view c_symbol)
 {
-    struct cmd_param_types_list** param_types;
-    struct utf8_list**            db_param_names;
+    struct cmd_param_range* param_range;
 
     /* NOTE: DBPro supports command overloading, so there will be duplicates.
      * The check for whether an overload is ambiguous occurs later when the
@@ -77,25 +73,19 @@ cmd_list_insert(
         goto plugin_insert_failed;
     if (return_types_list_insert(&cmds->return_types, insert, return_type) < 0)
         goto return_type_failed;
-    param_types
-        = cmd_param_types_lists_insert_emplace(&cmds->param_types, insert);
-    if (param_types == NULL)
-        goto param_types_failed;
-    cmd_param_types_list_init(param_types);
-    db_param_names
-        = db_param_names_insert_emplace(&cmds->db_param_names, insert);
-    if (db_param_names == NULL)
-        goto param_names_failed;
-    utf8_list_init(db_param_names);
+    param_range
+        = cmd_param_ranges_insert_emplace(&cmds->param_ranges, insert);
+    if (param_range == NULL)
+        goto param_range_failed;
+    param_range->first = cmd_param_list_count(cmds->params);
+    param_range->count = 0;
 
     if (cmds->longest_command < db_cmd_name.len)
         cmds->longest_command = db_cmd_name.len;
 
     return insert;
 
-param_names_failed:
-    cmd_param_types_lists_erase(cmds->param_types, insert);
-param_types_failed:
+param_range_failed:
     return_types_list_erase(cmds->return_types, insert);
 return_type_failed:
     plugin_ids_erase(cmds->plugin_ids, insert);
@@ -116,8 +106,319 @@ cmd_list_add(
     struct utf8_view c_symbol)
 {
     utf8_idx insert = utf8_lower_bound(cmds->db_cmd_names, db_cmd_name);
-    return cmd_list_insert(
+    cmd_id   cmd = cmd_list_insert(
         cmds, insert, plugin_id, return_type, db_cmd_name, c_symbol);
+    if (cmd > -1)
+        cmds->sorted_count++;
+    return cmd;
+}
+
+cmd_id
+cmd_list_append(
+    struct cmd_list* cmds,
+    plugin_id        plugin_id,
+    enum type        return_type,
+    struct utf8_view db_cmd_name,
+    struct utf8_view c_symbol)
+{
+    return cmd_list_insert(
+        cmds,
+        cmd_list_count(cmds),
+        plugin_id,
+        return_type,
+        db_cmd_name,
+        c_symbol);
+}
+
+int
+cmd_list_append_list(struct cmd_list* cmds, const struct cmd_list* other)
+{
+    cmd_id src;
+    for (src = 0; src != cmd_list_count(other); ++src)
+    {
+        int    i;
+        cmd_id dst = cmd_list_append(
+            cmds,
+            other->plugin_ids->data[src],
+            other->return_types->data[src],
+            utf8_span_view(
+                other->db_cmd_names->data,
+                utf8_list_span(other->db_cmd_names, src)),
+            utf8_span_view(
+                other->c_symbols->data, utf8_list_span(other->c_symbols, src)));
+        if (dst < 0)
+            return -1;
+
+        for (i = 0; i != cmd_param_count(other, src); ++i)
+        {
+            const struct cmd_param* param = cmd_param(other, src, i);
+            struct utf8_span        name = utf8_list_span(
+                other->db_param_names,
+                other->param_ranges->data[src].first + i);
+            if (cmd_add_param(
+                    cmds,
+                    dst,
+                    param->type,
+                    param->direction,
+                    utf8_span_view(other->db_param_names->data, name))
+                != 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+struct sort_entry
+{
+    const char* name;
+    utf8_idx    len;
+    /* Breaks ties between commands with the same name */
+    cmd_id order;
+    cmd_id cmd;
+};
+
+/* Must order names the same way as utf8_lower_bound() */
+static int
+sort_entry_cmp(const void* a, const void* b)
+{
+    const struct sort_entry* e1 = a;
+    const struct sort_entry* e2 = b;
+    int cmp
+        = memcmp(e1->name, e2->name, e1->len < e2->len ? e1->len : e2->len);
+    if (cmp != 0)
+        return cmp;
+    if (e1->len != e2->len)
+        return e1->len < e2->len ? -1 : 1;
+    return e1->order < e2->order ? -1 : 1;
+}
+
+static void
+permute(
+    void*                    data,
+    size_t                   size,
+    const struct sort_entry* entries,
+    cmd_id                   count,
+    char*                    tmp)
+{
+    cmd_id i;
+    for (i = 0; i != count; ++i)
+        memcpy(tmp + i * size, (char*)data + entries[i].cmd * size, size);
+    memcpy(data, tmp, size * count);
+}
+
+/* Rebuilds the list so it only contains the commands in "entries", in that
+ * order. Strings are rebuilt too, because utf8_list expects the strings to be
+ * stored in the same order as their spans. Parameters are rebuilt in the same
+ * order, which also drops parameters left behind by erased commands. "tmp"
+ * must have room for "count" parameter ranges */
+static int
+rebuild(
+    struct cmd_list*         cmds,
+    const struct sort_entry* entries,
+    cmd_id                   count,
+    char*                    tmp)
+{
+    cmd_id                  cmd;
+    struct cmd_param_range* param_ranges;
+    struct utf8_list*       db_cmd_names;
+    struct utf8_list*       c_symbols;
+    struct cmd_param_list*  params;
+    struct utf8_list*       db_param_names;
+
+    utf8_list_init(&db_cmd_names);
+    utf8_list_init(&c_symbols);
+    cmd_param_list_init(&params);
+    utf8_list_init(&db_param_names);
+    param_ranges = (struct cmd_param_range*)tmp;
+    for (cmd = 0; cmd != count; ++cmd)
+    {
+        int              i;
+        struct utf8_span name
+            = utf8_list_span(cmds->db_cmd_names, entries[cmd].cmd);
+        struct utf8_span c_symbol
+            = utf8_list_span(cmds->c_symbols, entries[cmd].cmd);
+        struct cmd_param_range range
+            = cmds->param_ranges->data[entries[cmd].cmd];
+
+        if (utf8_list_add(
+                &db_cmd_names, utf8_span_view(cmds->db_cmd_names->data, name))
+            != 0)
+            goto rebuild_failed;
+        if (utf8_list_add(
+                &c_symbols, utf8_span_view(cmds->c_symbols->data, c_symbol))
+            != 0)
+            goto rebuild_failed;
+
+        param_ranges[cmd].first = cmd_param_list_count(params);
+        param_ranges[cmd].count = range.count;
+        for (i = 0; i != range.count; ++i)
+        {
+            struct utf8_span param_name
+                = utf8_list_span(cmds->db_param_names, range.first + i);
+            if (cmd_param_list_push(
+                    &params, cmds->params->data[range.first + i])
+                != 0)
+                goto rebuild_failed;
+            if (utf8_list_add(
+                    &db_param_names,
+                    utf8_span_view(cmds->db_param_names->data, param_name))
+                != 0)
+                goto rebuild_failed;
+        }
+    }
+    if (count > 0)
+        memcpy(
+            cmds->param_ranges->data,
+            param_ranges,
+            sizeof(*param_ranges) * count);
+
+    permute(cmds->plugin_ids->data, sizeof(plugin_id), entries, count, tmp);
+    permute(cmds->return_types->data, sizeof(enum type), entries, count, tmp);
+
+    /* Shrinking never fails */
+    plugin_ids_resize(&cmds->plugin_ids, count);
+    return_types_list_resize(&cmds->return_types, count);
+    cmd_param_ranges_resize(&cmds->param_ranges, count);
+
+    utf8_list_deinit(cmds->db_cmd_names);
+    utf8_list_deinit(cmds->c_symbols);
+    cmd_param_list_deinit(cmds->params);
+    utf8_list_deinit(cmds->db_param_names);
+    cmds->db_cmd_names = db_cmd_names;
+    cmds->c_symbols = c_symbols;
+    cmds->params = params;
+    cmds->db_param_names = db_param_names;
+    return 0;
+
+rebuild_failed:
+    utf8_list_deinit(db_param_names);
+    cmd_param_list_deinit(params);
+    utf8_list_deinit(c_symbols);
+    utf8_list_deinit(db_cmd_names);
+    return -1;
+}
+
+int
+cmd_list_sort(struct cmd_list* cmds)
+{
+    cmd_id             cmd;
+    cmd_id             count = cmd_list_count(cmds);
+    struct sort_entry* entries;
+    char*              tmp;
+
+    if (cmds->sorted_count == count)
+        return 0;
+
+    entries = mem_alloc(sizeof(*entries) * count);
+    if (entries == NULL)
+    {
+        log_oom(sizeof(*entries) * count, "cmd_list_sort()");
+        goto alloc_entries_failed;
+    }
+    /* No parallel array holds anything larger than a parameter range */
+    tmp = mem_alloc(sizeof(struct cmd_param_range) * count);
+    if (tmp == NULL)
+    {
+        log_oom(sizeof(struct cmd_param_range) * count, "cmd_list_sort()");
+        goto alloc_tmp_failed;
+    }
+
+    /* cmd_list_add() inserts a command in front of all commands with the same
+     * name. Sorted commands keep their relative order, and appended commands
+     * are placed in front of them in reverse order */
+    for (cmd = 0; cmd != count; ++cmd)
+    {
+        struct utf8_span span = utf8_list_span(cmds->db_cmd_names, cmd);
+        entries[cmd].name = cmds->db_cmd_names->data + span.off;
+        entries[cmd].len = span.len;
+        entries[cmd].order = cmd < cmds->sorted_count ? cmd : -cmd;
+        entries[cmd].cmd = cmd;
+    }
+    qsort(entries, (size_t)count, sizeof(*entries), sort_entry_cmp);
+
+    if (rebuild(cmds, entries, count, tmp) != 0)
+        goto rebuild_failed;
+    cmds->sorted_count = count;
+
+    mem_free(tmp);
+    mem_free(entries);
+    return 0;
+
+rebuild_failed:
+    mem_free(tmp);
+alloc_tmp_failed:
+    mem_free(entries);
+alloc_entries_failed:
+    return -1;
+}
+
+int
+cmd_list_remap_plugins(
+    struct cmd_list* cmds, const struct plugin_ids* plugin_map)
+{
+    cmd_id             cmd;
+    cmd_id             count = cmd_list_count(cmds);
+    cmd_id             kept = 0;
+    cmd_id             kept_sorted = 0;
+    char               longest_command = 0;
+    struct sort_entry* entries;
+    char*              tmp;
+
+    if (count == 0)
+        return 0;
+
+    entries = mem_alloc(sizeof(*entries) * count);
+    if (entries == NULL)
+    {
+        log_oom(sizeof(*entries) * count, "cmd_list_remap_plugins()");
+        goto alloc_entries_failed;
+    }
+    tmp = mem_alloc(sizeof(struct cmd_param_range) * count);
+    if (tmp == NULL)
+    {
+        log_oom(
+            sizeof(struct cmd_param_range) * count,
+            "cmd_list_remap_plugins()");
+        goto alloc_tmp_failed;
+    }
+
+    for (cmd = 0; cmd != count; ++cmd)
+    {
+        struct utf8_span span;
+        plugin_id        plugin = cmds->plugin_ids->data[cmd];
+        ODBUTIL_DEBUG_ASSERT(
+            plugin >= 0 && plugin < plugin_ids_count(plugin_map),
+            log_cmd_err("plugin_id: %d\n", plugin));
+        if (plugin_map->data[plugin] == -1)
+            continue;
+
+        span = utf8_list_span(cmds->db_cmd_names, cmd);
+        if (longest_command < span.len)
+            longest_command = span.len;
+        if (cmd < cmds->sorted_count)
+            kept_sorted++;
+        entries[kept++].cmd = cmd;
+    }
+
+    if (rebuild(cmds, entries, kept, tmp) != 0)
+        goto rebuild_failed;
+    for (cmd = 0; cmd != kept; ++cmd)
+        cmds->plugin_ids->data[cmd]
+            = plugin_map->data[cmds->plugin_ids->data[cmd]];
+    cmds->sorted_count = kept_sorted;
+    cmds->longest_command = longest_command;
+
+    mem_free(tmp);
+    mem_free(entries);
+    return 0;
+
+rebuild_failed:
+    mem_free(tmp);
+alloc_tmp_failed:
+    mem_free(entries);
+alloc_entries_failed:
+    return -1;
 }
 
 void
@@ -125,15 +426,27 @@ cmd_list_erase(struct cmd_list* cmds, cmd_id cmd_id)
 {
     /* The max length may have changed if we remove a command that is equal to
      * the max */
-    int              recalc_longest_command = 0;
-    struct utf8_span span = utf8_list_span(cmds->db_cmd_names, cmd_id);
+    int                    recalc_longest_command = 0;
+    struct utf8_span       span = utf8_list_span(cmds->db_cmd_names, cmd_id);
+    struct cmd_param_range range = cmds->param_ranges->data[cmd_id];
     if (span.len == cmds->longest_command)
         recalc_longest_command = 1;
+    if (cmd_id < cmds->sorted_count)
+        cmds->sorted_count--;
+
+    /* Parameters can only be removed cheaply if they are the last ones, which
+     * is the case when a loader rejects the command it just added. Otherwise
+     * they are left unused until the list is sorted again */
+    if (range.first + range.count == cmd_param_list_count(cmds->params))
+        while (range.count--)
+        {
+            cmd_param_list_pop(cmds->params);
+            utf8_list_erase(
+                cmds->db_param_names,
+                utf8_list_count(cmds->db_param_names) - 1);
+        }
 
-    utf8_list_deinit(cmds->db_param_names->data[cmd_id]);
-    db_param_names_erase(cmds->db_param_names, cmd_id);
-    cmd_param_types_list_deinit(cmds->param_types->data[cmd_id]);
-    cmd_param_types_lists_erase(cmds->param_types, cmd_id);
+    cmd_param_ranges_erase(cmds->param_ranges, cmd_id);
     return_types_list_erase(cmds->return_types, cmd_id);
     plugin_ids_erase(cmds->plugin_ids, cmd_id);
     utf8_list_erase(cmds->c_symbols, cmd_id);
@@ -152,6 +465,52 @@ cmd_list_erase(struct cmd_list* cmds, cmd_id cmd_id)
     }
 }
 
+/* Copies the parameters of a command to the end of the parameter arrays, so
+ * more parameters can be added to it */
+static int
+move_params_to_end(struct cmd_list* cmds, cmd_id cmd_id)
+{
+    int                     i;
+    struct utf8             name = empty_utf8();
+    struct cmd_param_range* range = &cmds->param_ranges->data[cmd_id];
+    int32_t                 first = cmd_param_list_count(cmds->params);
+
+    for (i = 0; i != range->count; ++i)
+    {
+        struct cmd_param param = cmds->params->data[range->first + i];
+        /* The name has to be copied, because adding to the list may move the
+         * list's memory */
+        if (utf8_set(
+                &name,
+                utf8_span_view(
+                    cmds->db_param_names->data,
+                    utf8_list_span(cmds->db_param_names, range->first + i)))
+            != 0)
+            goto move_failed;
+        if (cmd_param_list_push(&cmds->params, param) != 0)
+            goto move_failed;
+        if (utf8_list_add(&cmds->db_param_names, utf8_view(name)) != 0)
+        {
+            cmd_param_list_pop(cmds->params);
+            goto move_failed;
+        }
+    }
+
+    range->first = first;
+    utf8_deinit(name);
+    return 0;
+
+move_failed:
+    while (cmd_param_list_count(cmds->params) != first)
+    {
+        cmd_param_list_pop(cmds->params);
+        utf8_list_erase(
+            cmds->db_param_names, utf8_list_count(cmds->db_param_names) - 1);
+    }
+    utf8_deinit(name);
+    return -1;
+}
+
 int
 cmd_add_param(
     struct cmd_list*         cmds,
@@ -160,21 +519,28 @@ cmd_add_param(
     enum cmd_param_direction direction,
     struct utf8_view         db_param_name)
 {
-    struct cmd_param_types_list** params = &cmds->param_types->data[cmd_id];
-    struct utf8_list** param_names = &cmds->db_param_names->data[cmd_id];
+    struct cmd_param        param;
+    struct cmd_param_range* range = &cmds->param_ranges->data[cmd_id];
 
-    struct cmd_param* param = cmd_param_types_list_emplace(params);
-    if (param == NULL)
-        return -1;
-    param->type = type;
-    param->direction = direction;
+    /* A command's parameters must be stored next to each other. This is
+     * always the case unless another command got parameters in the meantime */
+    if (range->count == 0)
+        range->first = cmd_param_list_count(cmds->params);
+    else if (range->first + range->count != cmd_param_list_count(cmds->params))
+        if (move_params_to_end(cmds, cmd_id) != 0)
+            return -1;
 
-    if (utf8_list_add(param_names, db_param_name) != 0)
+    param.type = type;
+    param.direction = direction;
+    if (cmd_param_list_push(&cmds->params, param) != 0)
+        return -1;
+    if (utf8_list_add(&cmds->db_param_names, db_param_name) != 0)
     {
-        cmd_param_types_list_pop(*params);
+        cmd_param_list_pop(cmds->params);
         return -1;
     }
 
+    range->count++;
     return 0;
 }
 
@@ -187,3 +553,43 @@ cmd_list_find(const struct cmd_list* commands, struct utf8_view name)
         return cmd;
     return -1;
 }
+
+#if defined(ODBUTIL_MEM_DEBUGGING)
+/* Works for both vectors and utf8_list, as both end in a "data" array sized by
+ * "capacity" */
+#define CONTAINER_SIZE(c)                                                      \
+    ((mem_size)((char*)(c)->data - (char*)(c))                                 \
+     + (mem_size)sizeof(*(c)->data) * (mem_size)(c)->capacity)
+
+void
+mem_acquire_cmd_list(struct cmd_list* cmds)
+{
+    if (cmds->db_param_names)
+        mem_acquire(
+            cmds->db_param_names, CONTAINER_SIZE(cmds->db_param_names));
+    if (cmds->params)
+        mem_acquire(cmds->params, CONTAINER_SIZE(cmds->params));
+    if (cmds->param_ranges)
+        mem_acquire(cmds->param_ranges, CONTAINER_SIZE(cmds->param_ranges));
+    if (cmds->return_types)
+        mem_acquire(cmds->return_types, CONTAINER_SIZE(cmds->return_types));
+    if (cmds->plugin_ids)
+        mem_acquire(cmds->plugin_ids, CONTAINER_SIZE(cmds->plugin_ids));
+    if (cmds->c_symbols)
+        mem_acquire(cmds->c_symbols, CONTAINER_SIZE(cmds->c_symbols));
+    if (cmds->db_cmd_names)
+        mem_acquire(cmds->db_cmd_names, CONTAINER_SIZE(cmds->db_cmd_names));
+}
+
+void
+mem_release_cmd_list(struct cmd_list* cmds)
+{
+    mem_release(cmds->db_param_names);
+    mem_release(cmds->params);
+    mem_release(cmds->param_ranges);
+    mem_release(cmds->return_types);
+    mem_release(cmds->plugin_ids);
+    mem_release(cmds->c_symbols);
+    mem_release(cmds->db_cmd_names);
+}
+#endif
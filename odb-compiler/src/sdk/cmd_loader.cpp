@@ -1,33 +1,31 @@
-/* TODO: Remove this once LIEF Is gone */
-#if __GNUC__
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Woverloaded-virtual"
-#endif
-
-#include "LIEF/ELF.hpp"
-#include "LIEF/MachO.hpp"
-#include "LIEF/PE.hpp"
-#include "LIEF/PE/ParserConfig.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
 
 extern "C" {
 #include "odb-compiler/sdk/cmd_cache.h"
 #include "odb-compiler/sdk/cmd_list.h"
 #include "odb-compiler/sdk/plugin_list.h"
+#include "odb-compiler/sdk/plugin_reader.h"
+#include "odb-util/log.h"
+#include "odb-util/mem.h"
+#include "odb-util/thread.h"
+#include "odb-util/time.h"
 }
 
 int
 load_dbpro_commands(
-    struct cmd_list*        commands,
-    plugin_id               plugin_id,
-    const LIEF::PE::Binary* pe,
-    struct ospathc          filepath);
+    struct cmd_list*            commands,
+    plugin_id                   plugin_id,
+    const struct plugin_reader* plugin,
+    struct ospathc              filepath);
 
 int
 load_odb_commands(
-    struct cmd_list*    commands,
-    plugin_id           plugin_id,
-    const LIEF::Binary* binary,
-    struct ospathc      filepath);
+    struct cmd_list*            commands,
+    plugin_id                   plugin_id,
+    const struct plugin_reader* plugin,
+    struct ospathc              filepath);
 
 static int
 plugin_is_cached(const struct plugin_ids* cached_plugins, plugin_id id)
@@ -41,40 +39,202 @@ plugin_is_cached(const struct plugin_ids* cached_plugins, plugin_id id)
     return 0;
 }
 
-static LIEF::Binary*
-load_binary(const struct plugin_info* plugin, enum target_platform platform)
+static int
+open_plugin(
+    struct plugin_reader*     reader,
+    const struct plugin_info* plugin,
+    enum target_platform      platform)
 {
     switch (platform)
     {
-        case TARGET_WINDOWS: {
-            return static_cast<LIEF::Binary*>(
-                LIEF::PE::Parser::parse(
-                    ospath_cstr(plugin->filepath),
-                    LIEF::PE::ParserConfig{
-                        false, ///< Parse PE Authenticode signature
-                        true,  ///< Parse PE Exports Directory
-                        false, ///< Parse PE Import Directory
-                        true,  ///< Parse PE resources tree
-                        false, ///< Parse PE relocations
-                    })
-                    .release());
-        }
-
+        case TARGET_WINDOWS:
         case TARGET_LINUX:
-            return static_cast<LIEF::Binary*>(
-                LIEF::ELF::Parser::parse(ospath_cstr(plugin->filepath))
-                    .release());
+            if (plugin_reader_open(reader, ospathc(plugin->filepath)) != 0)
+                return -1;
+            if (reader->format
+                != (platform == TARGET_WINDOWS ? PLUGIN_FORMAT_PE
+                                               : PLUGIN_FORMAT_ELF))
+            {
+                plugin_reader_close(reader);
+                return -1;
+            }
+            return 0;
 
         case TARGET_MACOS:
             log_cmd_err("Loading MachO not implemented\n");
-            return nullptr;
-            /*
-                binary.reset(static_cast<LIEF::Binary*>(
-                    LIEF::MachO::Parser::parse(ospath_cstr(plugin->filepath))
-                        .release()));*/
+            return -1;
+    }
+
+    return -1;
+}
+
+/* Loads all commands from a single plugin. "reader" is NULL if the plugin
+ * could not be opened. Returns 0 if the plugin was loaded or ignored, and
+ * negative on a fatal error */
+static int
+load_plugin_commands(
+    struct cmd_list*            cmds,
+    plugin_id                   plugin_id,
+    const struct plugin_info*   plugin,
+    const struct plugin_reader* reader,
+    int                         plugin_count,
+    enum sdk_type               sdk_type)
+{
+    if (reader == NULL)
+    {
+        log_cmd_warn(
+            "Failed to load plugin {quote:%s}. Plugin will be ignored...\n",
+            ospath_cstr(plugin->filepath));
+        return 0;
+    }
+
+    log_cmd_progress(
+        plugin_id,
+        plugin_count,
+        "Parsing plugin %s\n",
+        utf8_cstr(plugin->name));
+
+    switch (sdk_type)
+    {
+        case SDK_DBPRO:
+            if (reader->format != PLUGIN_FORMAT_PE)
+            {
+                log_cmd_warn(
+                    "{quote:%s} is not a valid PE file. Plugin will be "
+                    "ignored...\n",
+                    ospath_cstr(plugin->filepath));
+                return 0;
+            }
+            return load_dbpro_commands(
+                cmds, plugin_id, reader, ospathc(plugin->filepath));
+
+        case SDK_ODB:
+            return load_odb_commands(
+                cmds, plugin_id, reader, ospathc(plugin->filepath));
+    }
+
+    return 0;
+}
+
+struct plugin_file
+{
+    struct plugin_reader reader;
+    hash64               hash;
+    int                  is_open;
+};
+
+struct plugin_cmds
+{
+    struct cmd_list cmds;
+    int             result;
+};
+
+struct load_ctx
+{
+    const struct plugin_list* plugins;
+    const struct plugin_ids*  cached_plugins;
+    struct plugin_file*       files;
+    struct plugin_cmds*       plugin_cmds;
+    enum sdk_type             sdk_type;
+    enum target_platform      platform;
+    std::atomic<int>          next_plugin;
+};
+
+/* Opens and hashes the command data of every plugin, so the cache can tell
+ * which plugins changed. The plugins stay mapped so they don't have to be
+ * opened again if they need to be parsed. Plugins that can't be read get a
+ * hash of 0, so they are always parsed, which reports the error */
+static void*
+hash_worker(void* arg)
+{
+    struct load_ctx* ctx = (struct load_ctx*)arg;
+    plugin_id        plugin_id;
+
+    if (mem_init() != 0)
+        return (void*)-1;
+
+    while ((plugin_id = ctx->next_plugin++) < plugin_list_count(ctx->plugins))
+    {
+        struct plugin_file* file = &ctx->files[plugin_id];
+        file->is_open = open_plugin(
+                            &file->reader,
+                            vec_get(ctx->plugins, plugin_id),
+                            ctx->platform)
+                        == 0;
+        if (!file->is_open
+            || plugin_reader_command_hash(&file->reader, &file->hash) != 0)
+        {
+            file->hash = 0;
+        }
+        /* The mapping is unmapped by the main thread */
+        if (file->is_open)
+            mem_release(file->reader.mf.address);
+    }
+
+    mem_deinit();
+    return NULL;
+}
+
+/* Each worker takes the next plugin that hasn't been parsed yet and fills in
+ * that plugin's own command list, so no locking is needed */
+static void*
+load_worker(void* arg)
+{
+    struct load_ctx* ctx = (struct load_ctx*)arg;
+    plugin_id        plugin_id;
+
+    if (mem_init() != 0)
+        return (void*)-1;
+
+    while ((plugin_id = ctx->next_plugin++) < plugin_list_count(ctx->plugins))
+    {
+        struct plugin_file* file = &ctx->files[plugin_id];
+        struct plugin_cmds* out = &ctx->plugin_cmds[plugin_id];
+        if (plugin_is_cached(ctx->cached_plugins, plugin_id))
+            continue;
+
+        out->result = load_plugin_commands(
+            &out->cmds,
+            plugin_id,
+            vec_get(ctx->plugins, plugin_id),
+            file->is_open ? &file->reader : NULL,
+            plugin_list_count(ctx->plugins),
+            ctx->sdk_type);
+        mem_release_cmd_list(&out->cmds);
     }
 
-    return nullptr;
+    mem_deinit();
+    return NULL;
+}
+
+/* Runs "worker" on up to "worker_count" threads and waits for all of them to
+ * finish */
+static int
+run_workers(void* (*worker)(void*), struct load_ctx* ctx, int worker_count)
+{
+    std::vector<struct thread*> threads;
+    int                         result = 0;
+
+    ctx->next_plugin = 0;
+    if (worker_count < 1)
+        worker_count = 1;
+    for (int i = 0; i != worker_count; ++i)
+    {
+        struct thread* thread = thread_start(worker, ctx);
+        if (thread == NULL)
+            break;
+        threads.push_back(thread);
+    }
+    if (threads.empty())
+    {
+        log_cmd_err("Failed to start plugin loader threads\n");
+        return -1;
+    }
+    for (struct thread* thread : threads)
+        if (thread_join(thread) != NULL)
+            result = -1;
+
+    return result;
 }
 
 int
@@ -85,89 +245,121 @@ cmd_list_load_from_plugins(
     enum target_arch          arch,
     enum target_platform      platform)
 {
-    struct plugin_ids*        cached_plugins;
-    const struct plugin_info* plugin;
-    plugin_id                 plugin_id;
+    struct plugin_ids*    cached_plugins;
+    struct plugin_hashes* plugin_hashes;
+    struct load_ctx       ctx;
+    plugin_id             plugin_id;
+    int                   plugin_count = plugin_list_count(plugins);
+    int                   result = 0;
+    int                   worker_count
+        = (int)std::thread::hardware_concurrency();
+    uint64_t              cache_start;
 
     plugin_ids_init(&cached_plugins);
+    plugin_hashes_init(&plugin_hashes);
+
+    std::vector<struct plugin_file> files(plugin_count);
+    for (plugin_id = 0; plugin_id != plugin_count; ++plugin_id)
+        files[plugin_id].is_open = 0;
 
-    log_cmd_progress(0, plugin_list_count(plugins), "Loading command cache");
-    if (cmd_cache_load(&cached_plugins, plugins, cmds, sdk_type, arch, platform)
+    ctx.plugins = plugins;
+    ctx.cached_plugins = cached_plugins;
+    ctx.files = files.data();
+    ctx.sdk_type = sdk_type;
+    ctx.platform = platform;
+
+    log_cmd_progress(0, plugin_count, "Loading command cache");
+    cache_start = time_get_us();
+    if (run_workers(
+            hash_worker,
+            &ctx,
+            worker_count < plugin_count ? worker_count : plugin_count)
+        != 0)
+    {
+        goto fatal_error;
+    }
+    for (plugin_id = 0; plugin_id != plugin_count; ++plugin_id)
+        if (files[plugin_id].is_open)
+            /* Mappings are tracked with a size of 1, see
+             * mem_track_allocation() */
+            mem_acquire(files[plugin_id].reader.mf.address, 1);
+    for (plugin_id = 0; plugin_id != plugin_count; ++plugin_id)
+        if (plugin_hashes_push(&plugin_hashes, files[plugin_id].hash) != 0)
+            goto fatal_error;
+    if (cmd_cache_load(
+            &cached_plugins, plugin_hashes, cmds, sdk_type, arch, platform)
         != 0)
     {
         log_cmd_warn(
             "Failed to load command cache. All plugins will be parsed.\n");
     }
-
-    vec_enumerate(plugins, plugin_id, plugin)
+    else
     {
-        if (plugin_is_cached(cached_plugins, plugin_id))
-            continue;
+        log_cmd_info(
+            "Loaded %d commands from %d cached plugins in %.3f ms\n",
+            cmd_list_count(cmds),
+            plugin_ids_count(cached_plugins),
+            (double)(time_get_us() - cache_start) / 1000.0);
+    }
 
-        std::unique_ptr<LIEF::Binary> binary(load_binary(plugin, platform));
-        if (binary.get() == nullptr)
+    {
+        /* Plugins are parsed in parallel, with each plugin writing its
+         * commands into its own list. The lists are merged in order of plugin
+         * ID afterwards, which results in the same command list as loading
+         * each plugin one after another */
+        std::vector<struct plugin_cmds> plugin_cmds(plugin_count);
+        for (plugin_id = 0; plugin_id != plugin_count; ++plugin_id)
         {
-            log_cmd_warn(
-                "Failed to load plugin {quote:%s}. Plugin will be ignored...\n",
-                ospath_cstr(plugin->filepath));
-            continue;
+            cmd_list_init(&plugin_cmds[plugin_id].cmds);
+            plugin_cmds[plugin_id].result = 0;
         }
 
-        log_cmd_progress(
-            plugin_id,
-            plugin_list_count(plugins),
-            "Parsing plugin %s\n",
-            utf8_cstr(plugin->name));
+        /* The cache may have been reallocated while loading */
+        ctx.cached_plugins = cached_plugins;
+        ctx.plugin_cmds = plugin_cmds.data();
+        if (worker_count > plugin_count - plugin_ids_count(cached_plugins))
+            worker_count = plugin_count - plugin_ids_count(cached_plugins);
+        result = run_workers(load_worker, &ctx, worker_count);
 
-        switch (sdk_type)
+        for (plugin_id = 0; plugin_id != plugin_count; ++plugin_id)
         {
-            case SDK_DBPRO:
-                if (binary->format() != LIEF::Binary::FORMATS::PE)
-                {
-                    log_cmd_warn(
-                        "{quote:%s} is not a valid PE file. Plugin will be "
-                        "ignored...\n",
-                        ospath_cstr(plugin->filepath));
-                    continue;
-                }
-                if (load_dbpro_commands(
-                        cmds,
-                        plugin_id,
-                        static_cast<const LIEF::PE::Binary*>(binary.get()),
-                        ospathc(plugin->filepath))
-                    != 0)
-                {
-                    goto fatal_error;
-                }
-                break;
-
-            case SDK_ODB:
-                if (load_odb_commands(
-                        cmds,
-                        plugin_id,
-                        binary.get(),
-                        ospathc(plugin->filepath))
-                    != 0)
-                {
-                    goto fatal_error;
-                }
-                break;
+            struct plugin_cmds* in = &plugin_cmds[plugin_id];
+            mem_acquire_cmd_list(&in->cmds);
+            if (result == 0 && cmd_list_append_list(cmds, &in->cmds) != 0)
+                result = -1;
+            /* Stop at the first plugin that failed, same as the serial
+             * loader */
+            if (result == 0 && in->result != 0)
+                result = -1;
+            cmd_list_deinit(&in->cmds);
         }
     }
 
-    if (cmd_cache_save(plugins, cmds, sdk_type, arch, platform) != 0)
+    /* Commands from the cache and from all plugins were appended unsorted */
+    if (cmd_list_sort(cmds) != 0)
+        result = -1;
+    if (result != 0)
+        goto fatal_error;
+
+    /* Nothing to update if every plugin was loaded from the cache */
+    if (plugin_ids_count(cached_plugins) != plugin_count
+        && cmd_cache_save(plugin_hashes, cmds, sdk_type, arch, platform) != 0)
         log_cmd_warn(
             "Failed to save command cache. All plugins will be parsed next "
             "time.\n");
 
+    for (plugin_id = 0; plugin_id != plugin_count; ++plugin_id)
+        if (files[plugin_id].is_open)
+            plugin_reader_close(&files[plugin_id].reader);
+    plugin_hashes_deinit(plugin_hashes);
     plugin_ids_deinit(cached_plugins);
     return 0;
 
 fatal_error:
+    for (plugin_id = 0; plugin_id != plugin_count; ++plugin_id)
+        if (files[plugin_id].is_open)
+            plugin_reader_close(&files[plugin_id].reader);
+    plugin_hashes_deinit(plugin_hashes);
     plugin_ids_deinit(cached_plugins);
     return -1;
 }
-
-#if __GNUC__
-#pragma GCC diagnostic pop
-#endif
@@ -1,14 +1,10 @@
 extern "C" {
 #include "odb-compiler/sdk/cmd_list.h"
 #include "odb-compiler/sdk/plugin_list.h"
+#include "odb-compiler/sdk/plugin_reader.h"
 #include "odb-util/log.h"
 }
 
-#include "LIEF/Abstract/Binary.hpp"
-#include "LIEF/ELF.hpp"
-#include "LIEF/PE.hpp"
-#include <iostream>
-
 static int
 parse_command_string(
     struct cmd_list* commands,
@@ -71,7 +67,7 @@ parse_command_string(
             return 0;
         }
 
-    cmd_id cmd = cmd_list_add(
+    cmd_id cmd = cmd_list_append(
         commands,
         plugin_id,
         return_type,
@@ -149,18 +145,29 @@ parse_string_section(
 
 static int
 parse_string_table(
-    const LIEF::PE::Binary* pe,
-    struct ospathc          filepath,
-    plugin_id               plugin_id,
-    struct cmd_list*        commands)
+    const struct plugin_reader* plugin,
+    struct ospathc              filepath,
+    plugin_id                   plugin_id,
+    struct cmd_list*            commands)
 {
-    struct utf8 entry_str = empty_utf8();
+    struct pe_string_iter it;
+    struct utf16_view     u16v;
+    struct utf8           entry_str = empty_utf8();
+    int                   result;
 
-    for (const auto& entry : pe->resources_manager().value().string_table())
+    switch (plugin_reader_pe_strings(plugin, &it))
+    {
+        case 0: break;
+        case 1:
+            log_cmd_warn(
+                "No resources found in plugin {emph:%s}.\n",
+                ospathc_cstr(filepath));
+            return 0;
+        default: goto malformed;
+    }
+
+    while ((result = pe_string_iter_next(&it, &u16v)) == 1)
     {
-        const std::u16string& u16 = entry.name();
-        struct utf16_view     u16v
-            = {(const uint16_t*)u16.data(), (utf16_idx)u16.length()};
         if (utf16_to_utf8(&entry_str, u16v) != 0)
             goto fatal_error;
 
@@ -176,9 +183,18 @@ parse_string_table(
         }
     }
 
+    if (result < 0)
+        goto malformed;
+
     utf8_deinit(entry_str);
     return 0;
 
+malformed:
+    utf8_deinit(entry_str);
+    return log_cmd_err(
+        "Malformed string table in plugin {emph:%s}.\n",
+        ospathc_cstr(filepath));
+
 fatal_error:
     utf8_deinit(entry_str);
     return -1;
@@ -186,52 +202,45 @@ fatal_error:
 
 int
 load_odb_commands(
-    struct cmd_list*    commands,
-    plugin_id           plugin_id,
-    const LIEF::Binary* binary,
-    struct ospathc      filepath)
+    struct cmd_list*            commands,
+    plugin_id                   plugin_id,
+    const struct plugin_reader* plugin,
+    struct ospathc              filepath)
 {
-    switch (binary->format())
+    switch (plugin->format)
     {
-        case LIEF::Binary::ELF: {
-            auto elf = static_cast<const LIEF::ELF::Binary*>(binary);
-            const LIEF::Section* odbres = elf->get_section(".odbres");
-            if (odbres == nullptr)
-                return log_cmd_err(
-                    "Missing .odbres section in plugin {emph:%s}.\n",
-                    ospathc_cstr(filepath));
-
-            auto             content = odbres->content();
-            struct utf8_span span = {0, (utf8_idx)content.size()};
+        case PLUGIN_FORMAT_ELF: {
+            struct utf8_span odbres;
+            switch (plugin_reader_elf_section(plugin, ".odbres", &odbres))
+            {
+                case 0: break;
+                case 1:
+                    return log_cmd_err(
+                        "Missing .odbres section in plugin {emph:%s}.\n",
+                        ospathc_cstr(filepath));
+                default:
+                    return log_cmd_err(
+                        "Malformed section table in plugin {emph:%s}.\n",
+                        ospathc_cstr(filepath));
+            }
+
+            /* The section is parsed directly from the mapped file */
             return parse_string_section(
-                (const char*)content.data(),
-                span,
+                plugin_reader_data(plugin),
+                odbres,
                 filepath,
                 plugin_id,
                 commands);
         }
 
-        case LIEF::Binary::PE: {
-            auto pe = static_cast<const LIEF::PE::Binary*>(binary);
-
-            if (pe->resources() == nullptr)
-            {
-                log_cmd_warn(
-                    "No resources found in pluign {emph:%s}.\n",
-                    ospathc_cstr(filepath));
-                return 0;
-            }
-
-            return parse_string_table(pe, filepath, plugin_id, commands);
-        }
+        case PLUGIN_FORMAT_PE:
+            return parse_string_table(plugin, filepath, plugin_id, commands);
 
-        case LIEF::Binary::UNKNOWN:
-        case LIEF::Binary::MACHO:
-        case LIEF::Binary::OAT:
+        case PLUGIN_FORMAT_UNKNOWN:
         default:
             log_cmd_err(
                 "Loading plugin format %d is not yet supported\n",
-                binary->format());
+                plugin->format);
             break;
     }
 
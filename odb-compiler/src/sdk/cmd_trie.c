@@ -0,0 +1,102 @@
+#include "odb-compiler/sdk/cmd_trie.h"
+#include "odb-util/log.h"
+#include "odb-util/utf8_list.h"
+
+VEC_DEFINE_API(cmd_trie, struct cmd_trie_node, 32)
+
+static int32_t
+new_node(struct cmd_trie** trie, char c)
+{
+    struct cmd_trie_node* node = cmd_trie_emplace(trie);
+    if (node == NULL)
+        return -1;
+
+    node->first_child = -1;
+    node->next_sibling = -1;
+    node->cmd = -1;
+    node->keyword = -1;
+    node->c = c;
+
+    return cmd_trie_count(*trie) - 1;
+}
+
+static int32_t
+get_or_insert_child(struct cmd_trie** trie, int32_t parent, char c)
+{
+    int32_t child, prev = -1, new_child;
+
+    /* Keep siblings sorted so lookups can exit early */
+    for (child = (*trie)->data[parent].first_child; child > -1;
+         prev = child, child = (*trie)->data[child].next_sibling)
+    {
+        if ((*trie)->data[child].c == c)
+            return child;
+        if ((unsigned char)(*trie)->data[child].c > (unsigned char)c)
+            break;
+    }
+
+    new_child = new_node(trie, c);
+    if (new_child < 0)
+        return -1;
+
+    (*trie)->data[new_child].next_sibling = child;
+    if (prev > -1)
+        (*trie)->data[prev].next_sibling = new_child;
+    else
+        (*trie)->data[parent].first_child = new_child;
+
+    return new_child;
+}
+
+int
+cmd_trie_build(struct cmd_trie** trie, const struct cmd_list* cmds)
+{
+    cmd_id cmd;
+
+    cmd_trie_clear(*trie);
+    if (new_node(trie, '\0') != CMD_TRIE_ROOT)
+        return -1;
+
+    for (cmd = 0; cmd != cmd_list_count(cmds); ++cmd)
+    {
+        int32_t          node = CMD_TRIE_ROOT;
+        struct utf8_span name = utf8_list_span(cmds->db_cmd_names, cmd);
+        const char*      data = cmds->db_cmd_names->data;
+
+        for (; name.len; name.off++, name.len--)
+        {
+            node = get_or_insert_child(trie, node, data[name.off]);
+            if (node < 0)
+                return -1;
+        }
+
+        /* Overloads share the same name. cmd_list_find() returns the first
+         * one, so do the same here */
+        if ((*trie)->data[node].cmd == -1)
+            (*trie)->data[node].cmd = cmd;
+    }
+
+    return 0;
+}
+
+int
+cmd_trie_add_keyword(struct cmd_trie** trie, const char* name, int keyword)
+{
+    int32_t node = CMD_TRIE_ROOT;
+
+    ODBUTIL_DEBUG_ASSERT(
+        keyword >= 0 && keyword <= INT16_MAX,
+        log_cmd_err("keyword: %d\n", keyword));
+
+    /* Command names are upper case, so keywords are stored the same way */
+    for (; *name; ++name)
+    {
+        node = get_or_insert_child(
+            trie, node, (char)toupper((unsigned char)*name));
+        if (node < 0)
+            return -1;
+    }
+
+    (*trie)->data[node].keyword = (int16_t)keyword;
+    return 0;
+}
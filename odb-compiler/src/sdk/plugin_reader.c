@@ -0,0 +1,426 @@
+#include "odb-compiler/sdk/plugin_reader.h"
+#include <string.h>
+
+#define ELF_SHT_NOBITS        8
+#define PE_RT_STRING          6
+#define PE_DIR_RESOURCE       2
+#define PE_RESOURCE_DIRECTORY 0x80000000
+
+/* All offsets are computed in 64-bit so malformed files can't cause them to
+ * wrap around */
+static int
+in_bounds(const struct plugin_reader* reader, uint64_t off, uint64_t len)
+{
+    return off <= (uint64_t)reader->mf.size
+           && len <= (uint64_t)reader->mf.size - off;
+}
+
+static uint16_t
+read_u16(const struct plugin_reader* reader, uint64_t off)
+{
+    uint16_t value;
+    memcpy(&value, plugin_reader_data(reader) + off, sizeof(value));
+    return value;
+}
+
+static uint32_t
+read_u32(const struct plugin_reader* reader, uint64_t off)
+{
+    uint32_t value;
+    memcpy(&value, plugin_reader_data(reader) + off, sizeof(value));
+    return value;
+}
+
+static uint64_t
+read_u64(const struct plugin_reader* reader, uint64_t off)
+{
+    uint64_t value;
+    memcpy(&value, plugin_reader_data(reader) + off, sizeof(value));
+    return value;
+}
+
+static int
+open_elf(struct plugin_reader* reader)
+{
+    const char* data = plugin_reader_data(reader);
+    if (!in_bounds(reader, 0, 64))
+        return -1;
+    /* Only little endian 32-bit and 64-bit files are supported */
+    if ((data[4] != 1 && data[4] != 2) || data[5] != 1)
+        return -1;
+
+    reader->format = PLUGIN_FORMAT_ELF;
+    return 0;
+}
+
+static int
+open_pe(struct plugin_reader* reader)
+{
+    uint32_t pe_header;
+    uint16_t optional_header_size;
+
+    if (!in_bounds(reader, 0, 64))
+        return -1;
+    pe_header = read_u32(reader, 0x3C);
+    if (!in_bounds(reader, pe_header, 24)
+        || memcmp(plugin_reader_data(reader) + pe_header, "PE\0\0", 4) != 0)
+        return -1;
+
+    reader->pe_section_count = read_u16(reader, (uint64_t)pe_header + 6);
+    optional_header_size = read_u16(reader, (uint64_t)pe_header + 20);
+    reader->pe_sections = pe_header + 24 + optional_header_size;
+    if (!in_bounds(
+            reader,
+            reader->pe_sections,
+            (uint64_t)reader->pe_section_count * 40))
+        return -1;
+
+    reader->format = PLUGIN_FORMAT_PE;
+    return 0;
+}
+
+int
+plugin_reader_open(struct plugin_reader* reader, struct ospathc filepath)
+{
+    const char* data;
+
+    if (mfile_map_read(&reader->mf, filepath, 0) != 0)
+        return -1;
+
+    reader->format = PLUGIN_FORMAT_UNKNOWN;
+    reader->pe_sections = 0;
+    reader->pe_section_count = 0;
+
+    data = plugin_reader_data(reader);
+    if (in_bounds(reader, 0, 4) && memcmp(data, "\x7f" "ELF", 4) == 0)
+    {
+        if (open_elf(reader) == 0)
+            return 0;
+    }
+    else if (in_bounds(reader, 0, 2) && data[0] == 'M' && data[1] == 'Z')
+    {
+        if (open_pe(reader) == 0)
+            return 0;
+    }
+
+    mfile_unmap(&reader->mf);
+    return -1;
+}
+
+void
+plugin_reader_close(struct plugin_reader* reader)
+{
+    mfile_unmap(&reader->mf);
+}
+
+struct elf_section
+{
+    uint32_t name;
+    uint32_t type;
+    uint64_t off;
+    uint64_t size;
+};
+
+static struct elf_section
+read_elf_section(const struct plugin_reader* reader, uint64_t header)
+{
+    struct elf_section section;
+    section.name = read_u32(reader, header);
+    section.type = read_u32(reader, header + 4);
+    if (plugin_reader_data(reader)[4] == 2)
+    {
+        section.off = read_u64(reader, header + 0x18);
+        section.size = read_u64(reader, header + 0x20);
+    }
+    else
+    {
+        section.off = read_u32(reader, header + 0x10);
+        section.size = read_u32(reader, header + 0x14);
+    }
+    return section;
+}
+
+int
+plugin_reader_elf_section(
+    const struct plugin_reader* reader,
+    const char*                 name,
+    struct utf8_span*           section)
+{
+    uint64_t           shoff;
+    uint16_t           shentsize, shnum, shstrndx, i;
+    struct elf_section strtab;
+    size_t             name_len = strlen(name) + 1;
+
+    if (plugin_reader_data(reader)[4] == 2)
+    {
+        shoff = read_u64(reader, 0x28);
+        shentsize = read_u16(reader, 0x3A);
+        shnum = read_u16(reader, 0x3C);
+        shstrndx = read_u16(reader, 0x3E);
+        if (shnum && shentsize < 64)
+            return -1;
+    }
+    else
+    {
+        shoff = read_u32(reader, 0x20);
+        shentsize = read_u16(reader, 0x2E);
+        shnum = read_u16(reader, 0x30);
+        shstrndx = read_u16(reader, 0x32);
+        if (shnum && shentsize < 40)
+            return -1;
+    }
+
+    if (shnum == 0)
+        return 1;
+    if (shstrndx >= shnum
+        || !in_bounds(reader, shoff, (uint64_t)shnum * shentsize))
+        return -1;
+
+    strtab = read_elf_section(reader, shoff + (uint64_t)shstrndx * shentsize);
+    if (!in_bounds(reader, strtab.off, strtab.size))
+        return -1;
+
+    for (i = 0; i != shnum; ++i)
+    {
+        struct elf_section sec
+            = read_elf_section(reader, shoff + (uint64_t)i * shentsize);
+        if (sec.name >= strtab.size || strtab.size - sec.name < name_len)
+            continue;
+        if (memcmp(
+                plugin_reader_data(reader) + strtab.off + sec.name,
+                name,
+                name_len)
+            != 0)
+            continue;
+
+        if (sec.type == ELF_SHT_NOBITS)
+            sec.size = 0;
+        else if (!in_bounds(reader, sec.off, sec.size))
+            return -1;
+
+        section->off = (utf8_idx)sec.off;
+        section->len = (utf8_idx)sec.size;
+        return 0;
+    }
+
+    return 1;
+}
+
+static int
+rva_to_offset(const struct plugin_reader* reader, uint32_t rva, uint64_t* off)
+{
+    int i;
+    for (i = 0; i != reader->pe_section_count; ++i)
+    {
+        uint64_t header = reader->pe_sections + (uint64_t)i * 40;
+        uint32_t raw_size = read_u32(reader, header + 16);
+        uint32_t virtual_address = read_u32(reader, header + 12);
+        uint32_t raw_data = read_u32(reader, header + 20);
+        if (rva >= virtual_address && rva - virtual_address < raw_size)
+        {
+            *off = (uint64_t)raw_data + (rva - virtual_address);
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/* Each resource directory is followed by its named entries and its ID entries,
+ * 8 bytes each */
+static int
+read_resource_dir(
+    const struct plugin_reader* reader, uint64_t dir, int* entry_count)
+{
+    if (!in_bounds(reader, dir, 16))
+        return -1;
+    *entry_count = read_u16(reader, dir + 12) + read_u16(reader, dir + 14);
+    if (!in_bounds(reader, dir + 16, (uint64_t)*entry_count * 8))
+        return -1;
+    return 0;
+}
+
+int
+plugin_reader_pe_strings(
+    const struct plugin_reader* reader, struct pe_string_iter* it)
+{
+    uint64_t pe_header = read_u32(reader, 0x3C);
+    uint64_t optional_header = pe_header + 24;
+    uint64_t data_dirs, root;
+    uint32_t data_dir_count, rsrc_rva;
+    int      i, root_count;
+
+    if (!in_bounds(reader, optional_header, 2))
+        return -1;
+    switch (read_u16(reader, optional_header))
+    {
+        case 0x10B: /* PE32 */
+            data_dir_count = read_u32(reader, optional_header + 92);
+            data_dirs = optional_header + 96;
+            break;
+        case 0x20B: /* PE32+ */
+            data_dir_count = read_u32(reader, optional_header + 108);
+            data_dirs = optional_header + 112;
+            break;
+        default: return -1;
+    }
+
+    if (data_dir_count <= PE_DIR_RESOURCE)
+        return 1;
+    if (!in_bounds(reader, data_dirs + PE_DIR_RESOURCE * 8, 8))
+        return -1;
+    rsrc_rva = read_u32(reader, data_dirs + PE_DIR_RESOURCE * 8);
+    if (rsrc_rva == 0)
+        return 1;
+    if (rva_to_offset(reader, rsrc_rva, &root) != 0)
+        return -1;
+    if (read_resource_dir(reader, root, &root_count) != 0)
+        return -1;
+
+    it->reader = reader;
+    it->rsrc = (uint32_t)root;
+    it->bundle = it->bundle_count = 0;
+    it->lang = it->lang_count = 0;
+    it->pos = it->end = 0;
+
+    /* The first level of the resource tree is the resource type */
+    for (i = 0; i != root_count; ++i)
+    {
+        uint64_t entry = root + 16 + (uint64_t)i * 8;
+        uint32_t id = read_u32(reader, entry);
+        uint32_t data = read_u32(reader, entry + 4);
+        if (id != PE_RT_STRING || !(data & PE_RESOURCE_DIRECTORY))
+            continue;
+
+        it->bundles = it->rsrc + (data & ~PE_RESOURCE_DIRECTORY);
+        if (read_resource_dir(reader, it->bundles, &it->bundle_count) != 0)
+            return -1;
+        return 0;
+    }
+
+    return 1;
+}
+
+int
+pe_string_iter_next(struct pe_string_iter* it, struct utf16_view* str)
+{
+    const struct plugin_reader* reader = it->reader;
+
+    while (1)
+    {
+        uint64_t entry;
+        uint32_t data;
+
+        /* Strings are stored in blocks of 16, each string prefixed with its
+         * length. Empty strings are padding */
+        while (it->end - it->pos >= 2)
+        {
+            uint16_t len = read_u16(reader, it->pos);
+            it->pos += 2;
+            if (len == 0)
+                continue;
+            if ((uint32_t)len * 2 > it->end - it->pos)
+            {
+                it->pos = it->end;
+                break;
+            }
+
+            str->data = (const uint16_t*)(plugin_reader_data(reader) + it->pos);
+            str->len = len;
+            it->pos += (uint32_t)len * 2;
+            return 1;
+        }
+
+        /* The third level of the tree is the language. Each language leads to
+         * a data entry that contains the next block of strings */
+        if (it->lang < it->lang_count)
+        {
+            uint64_t data_entry, block;
+            uint32_t size;
+
+            entry = it->langs + 16 + (uint64_t)it->lang++ * 8;
+            data = read_u32(reader, entry + 4);
+            if (data & PE_RESOURCE_DIRECTORY)
+                continue;
+
+            data_entry = (uint64_t)it->rsrc + data;
+            if (!in_bounds(reader, data_entry, 16))
+                return -1;
+            size = read_u32(reader, data_entry + 4);
+            if (rva_to_offset(reader, read_u32(reader, data_entry), &block)
+                    != 0
+                || !in_bounds(reader, block, size))
+                return -1;
+
+            it->pos = (uint32_t)block;
+            it->end = (uint32_t)block + size;
+            continue;
+        }
+
+        /* The second level of the tree is the string bundle ID */
+        if (it->bundle < it->bundle_count)
+        {
+            entry = it->bundles + 16 + (uint64_t)it->bundle++ * 8;
+            data = read_u32(reader, entry + 4);
+            if (!(data & PE_RESOURCE_DIRECTORY))
+                continue;
+
+            it->langs = it->rsrc + (data & ~PE_RESOURCE_DIRECTORY);
+            it->lang = 0;
+            if (read_resource_dir(reader, it->langs, &it->lang_count) != 0)
+                return -1;
+            continue;
+        }
+
+        return 0;
+    }
+}
+
+int
+plugin_reader_command_hash(const struct plugin_reader* reader, hash64* hash)
+{
+    /* Seeding with the format keeps plugins without any commands from hashing
+     * to 0 */
+    *hash = hash64_murmur64a(NULL, 0, reader->format);
+
+    switch (reader->format)
+    {
+        case PLUGIN_FORMAT_ELF: {
+            struct utf8_span odbres;
+            switch (plugin_reader_elf_section(reader, ".odbres", &odbres))
+            {
+                case 0: break;
+                case 1: return 0;
+                default: return -1;
+            }
+            *hash = hash64_murmur64a(
+                plugin_reader_data(reader) + odbres.off, odbres.len, *hash);
+            return 0;
+        }
+
+        case PLUGIN_FORMAT_PE: {
+            struct pe_string_iter it;
+            struct utf16_view     str;
+            int                   result;
+            switch (plugin_reader_pe_strings(reader, &it))
+            {
+                case 0: break;
+                case 1: return 0;
+                default: return -1;
+            }
+            while ((result = pe_string_iter_next(&it, &str)) == 1)
+            {
+                /* Without the length, moving characters from one string to
+                 * the next would not change the hash */
+                int32_t len = str.len;
+                *hash = hash64_murmur64a(&len, sizeof(len), *hash);
+                *hash = hash64_murmur64a(str.data, str.len * 2, *hash);
+            }
+            return result;
+        }
+
+        case PLUGIN_FORMAT_UNKNOWN: break;
+    }
+
+    return -1;
+}
@@ -160,7 +160,8 @@ calculate_scope_ids(
     const struct db_source*    sources,
     const struct plugin_list*  plugins,
     const struct cmd_list*     cmds,
-    const struct symbol_table* symbols)
+    const struct symbol_table* symbols,
+    struct semantic_session*   session)
 {
     struct ast* ast = tus[tu_id];
     int32_t     scope_counter = 0;
@@ -181,4 +182,4 @@ calculate_scope_ids(
 static const struct semantic_check* depends[] = {NULL};
 
 const struct semantic_check semantic_calculate_scope_ids
-    = {calculate_scope_ids, depends, "calculate_scope_ids"};
+    = {calculate_scope_ids, depends, "calculate_scope_ids", 0, NULL};
@@ -0,0 +1,699 @@
+#include "odb-compiler/semantic/func_table.h"
+#include "odb-util/hash.h"
+#include "odb-util/hm.h"
+#include "odb-util/log.h"
+#include "odb-util/mem.h"
+#include "odb-util/mutex.h"
+#include "odb-util/vec.h"
+
+struct func_entry
+{
+    enum func_state state;
+    int             owner;
+    enum type       ret_type;
+    /* Signature of checked functions. Index into func_table.params */
+    int32_t params, param_count;
+    /* Polymorphic functions only: First instantiation. Index into
+     * func_table.instances */
+    int32_t instances;
+};
+
+struct func_instance
+{
+    int32_t next;
+    ast_id  func;
+    /* Index into func_table.arg_types */
+    int32_t arg_types, arg_count;
+};
+
+/* The key packs the TU into the upper 32 bits and the AST_FUNC or
+ * AST_FUNC_POLY node into the lower 32 bits */
+HM_DECLARE_API(static, funcmap, uint64_t, struct func_entry, 32)
+HM_DEFINE_API(funcmap, uint64_t, struct func_entry, 32)
+
+VEC_DECLARE_API(static, params, struct func_param, 32)
+VEC_DEFINE_API(params, struct func_param, 32)
+
+VEC_DECLARE_API(static, types, enum type, 32)
+VEC_DEFINE_API(types, enum type, 32)
+
+VEC_DECLARE_API(static, instances, struct func_instance, 32)
+VEC_DEFINE_API(instances, struct func_instance, 32)
+
+/* The key of the function each type check is waiting on, indexed by owner */
+VEC_DECLARE_API(static, waits, uint64_t, 32)
+VEC_DEFINE_API(waits, uint64_t, 32)
+
+/* How many type checks are blocked on a TU, indexed by TU / SHARD_COUNT */
+VEC_DECLARE_API(static, counts, int32_t, 32)
+VEC_DEFINE_API(counts, int32_t, 32)
+
+#define NOT_WAITING ((uint64_t)-1)
+
+#define SHARD_BITS  4
+#define SHARD_COUNT (1 << SHARD_BITS)
+
+struct shard
+{
+    struct mutex*     mutex;
+    /* Broadcast whenever a function is published or failed, and whenever a
+     * type check got a TU it was blocked on */
+    struct cond*      changed;
+    struct funcmap*   funcs;
+    struct params*    params;
+    struct types*     arg_types;
+    struct instances* instances;
+    /* Of the TUs that map to this shard, see tu_shard() */
+    struct counts*    tus_wanted;
+};
+
+struct func_table
+{
+    struct shard shards[SHARD_COUNT];
+
+    /* Only needed when type checks wait on each other, which is rare. Must be
+     * locked before any of the shards */
+    struct mutex* wait_mutex;
+    struct waits* waits;
+};
+
+static uint64_t
+make_key(int tu_id, ast_id n)
+{
+    return ((uint64_t)(uint32_t)tu_id << 32) | (uint32_t)n;
+}
+
+/* The hashmap of each shard uses the lower bits of the same hash, so the shard
+ * is picked by the upper bits */
+static struct shard*
+key_shard(struct func_table* table, uint64_t key)
+{
+    hash32 h = hash32_jenkins_oaat(&key, sizeof(key));
+    return &table->shards[h >> (32 - SHARD_BITS)];
+}
+
+static struct shard*
+tu_shard(struct func_table* table, int tu_id)
+{
+    return &table->shards[tu_id % SHARD_COUNT];
+}
+
+/* The containers are modified by many threads. Between calls, none of them owns
+ * their memory */
+static void
+mem_acquire_shard_containers(struct shard* shard)
+{
+#if defined(ODBUTIL_MEM_DEBUGGING)
+    if (shard->funcs)
+    {
+        mem_acquire(
+            shard->funcs,
+            offsetof(struct funcmap, hashes)
+                + sizeof(shard->funcs->hashes[0]) * shard->funcs->capacity);
+        mem_acquire(
+            shard->funcs->kvs.keys,
+            sizeof(shard->funcs->kvs.keys[0]) * shard->funcs->capacity);
+        mem_acquire(
+            shard->funcs->kvs.values,
+            sizeof(shard->funcs->kvs.values[0]) * shard->funcs->capacity);
+    }
+    if (shard->params)
+        mem_acquire(
+            shard->params,
+            offsetof(struct params, data)
+                + sizeof(shard->params->data[0]) * shard->params->capacity);
+    if (shard->arg_types)
+        mem_acquire(
+            shard->arg_types,
+            offsetof(struct types, data)
+                + sizeof(shard->arg_types->data[0])
+                      * shard->arg_types->capacity);
+    if (shard->instances)
+        mem_acquire(
+            shard->instances,
+            offsetof(struct instances, data)
+                + sizeof(shard->instances->data[0])
+                      * shard->instances->capacity);
+    if (shard->tus_wanted)
+        mem_acquire(
+            shard->tus_wanted,
+            offsetof(struct counts, data)
+                + sizeof(shard->tus_wanted->data[0])
+                      * shard->tus_wanted->capacity);
+#else
+    (void)shard;
+#endif
+}
+
+static void
+mem_release_shard_containers(struct shard* shard)
+{
+#if defined(ODBUTIL_MEM_DEBUGGING)
+    if (shard->tus_wanted)
+        mem_release(shard->tus_wanted);
+    if (shard->instances)
+        mem_release(shard->instances);
+    if (shard->arg_types)
+        mem_release(shard->arg_types);
+    if (shard->params)
+        mem_release(shard->params);
+    if (shard->funcs)
+    {
+        mem_release(shard->funcs->kvs.values);
+        mem_release(shard->funcs->kvs.keys);
+        mem_release(shard->funcs);
+    }
+#else
+    (void)shard;
+#endif
+}
+
+static void
+lock_shard(struct shard* shard)
+{
+    mutex_lock(shard->mutex);
+    mem_acquire_shard_containers(shard);
+}
+
+static void
+unlock_shard(struct shard* shard)
+{
+    mem_release_shard_containers(shard);
+    mutex_unlock(shard->mutex);
+}
+
+/* Called with the shard locked. Releases the containers while blocked, because
+ * other threads may modify them in the meantime */
+static void
+wait_shard(struct shard* shard)
+{
+    mem_release_shard_containers(shard);
+    cond_wait(shard->changed, shard->mutex);
+    mem_acquire_shard_containers(shard);
+}
+
+static void
+mem_acquire_waits(struct func_table* table)
+{
+#if defined(ODBUTIL_MEM_DEBUGGING)
+    if (table->waits)
+        mem_acquire(
+            table->waits,
+            offsetof(struct waits, data)
+                + sizeof(table->waits->data[0]) * table->waits->capacity);
+#else
+    (void)table;
+#endif
+}
+
+static void
+lock_waits(struct func_table* table)
+{
+    mutex_lock(table->wait_mutex);
+    mem_acquire_waits(table);
+}
+
+static void
+unlock_waits(struct func_table* table)
+{
+#if defined(ODBUTIL_MEM_DEBUGGING)
+    if (table->waits)
+        mem_release(table->waits);
+#endif
+    mutex_unlock(table->wait_mutex);
+}
+
+static int
+shard_init(struct shard* shard)
+{
+    shard->mutex = mutex_create();
+    if (shard->mutex == NULL)
+        goto create_mutex_failed;
+    shard->changed = cond_create();
+    if (shard->changed == NULL)
+        goto create_cond_failed;
+
+    funcmap_init(&shard->funcs);
+    params_init(&shard->params);
+    types_init(&shard->arg_types);
+    instances_init(&shard->instances);
+    counts_init(&shard->tus_wanted);
+
+    return 0;
+
+create_cond_failed:
+    mutex_destroy(shard->mutex);
+create_mutex_failed:
+    return -1;
+}
+
+static void
+shard_deinit(struct shard* shard)
+{
+    mem_acquire_shard_containers(shard);
+    counts_deinit(shard->tus_wanted);
+    instances_deinit(shard->instances);
+    types_deinit(shard->arg_types);
+    params_deinit(shard->params);
+    funcmap_deinit(shard->funcs);
+    cond_destroy(shard->changed);
+    mutex_destroy(shard->mutex);
+}
+
+struct func_table*
+func_table_create(void)
+{
+    int                i;
+    struct func_table* table = mem_alloc(sizeof(*table));
+    if (table == NULL)
+        goto alloc_table_failed;
+
+    table->wait_mutex = mutex_create();
+    if (table->wait_mutex == NULL)
+        goto create_mutex_failed;
+    waits_init(&table->waits);
+
+    for (i = 0; i != SHARD_COUNT; ++i)
+        if (shard_init(&table->shards[i]) != 0)
+            goto init_shard_failed;
+
+    return table;
+
+init_shard_failed:
+    while (i--)
+        shard_deinit(&table->shards[i]);
+    mutex_destroy(table->wait_mutex);
+create_mutex_failed:
+    mem_free(table);
+alloc_table_failed:
+    log_oom(sizeof(*table), "func_table_create()");
+    return NULL;
+}
+
+void
+func_table_destroy(struct func_table* table)
+{
+    int i;
+    for (i = 0; i != SHARD_COUNT; ++i)
+        shard_deinit(&table->shards[i]);
+
+    mem_acquire_waits(table);
+    waits_deinit(table->waits);
+    mutex_destroy(table->wait_mutex);
+    mem_free(table);
+}
+
+enum func_state
+func_table_claim(struct func_table* table, int tu_id, ast_id func, int owner)
+{
+    struct func_entry* entry;
+    enum func_state    state;
+    uint64_t           key = make_key(tu_id, func);
+    struct shard*      shard = key_shard(table, key);
+
+    lock_shard(shard);
+    switch (funcmap_emplace_or_get(&shard->funcs, key, &entry))
+    {
+        case HM_OOM: state = FUNC_FAILED; break;
+        case HM_EXISTS:
+            state = entry->state == FUNC_BUSY && entry->owner == owner
+                        ? FUNC_OWNED
+                        : entry->state;
+            break;
+        case HM_NEW:
+            entry->state = FUNC_BUSY;
+            entry->owner = owner;
+            entry->ret_type = TYPE_INVALID;
+            entry->params = 0;
+            entry->param_count = 0;
+            entry->instances = -1;
+            state = FUNC_OWNED;
+            break;
+    }
+    unlock_shard(shard);
+
+    return state;
+}
+
+enum func_state
+func_table_find(
+    struct func_table* table,
+    int                tu_id,
+    ast_id             func,
+    int                owner,
+    enum type*         ret_type,
+    struct func_param* params,
+    int                max_params,
+    int*               param_count)
+{
+    const struct func_entry* entry;
+    enum func_state          state;
+    int                      i;
+    uint64_t                 key = make_key(tu_id, func);
+    struct shard*            shard = key_shard(table, key);
+
+    lock_shard(shard);
+    entry = funcmap_find(shard->funcs, key);
+    if (entry == NULL)
+        state = FUNC_UNCLAIMED;
+    else if (entry->state == FUNC_BUSY && entry->owner == owner)
+        state = FUNC_OWNED;
+    else
+        state = entry->state;
+
+    if (state == FUNC_CHECKED && ret_type != NULL)
+    {
+        *ret_type = entry->ret_type;
+        *param_count = entry->param_count;
+        for (i = 0; i != entry->param_count && i != max_params; ++i)
+            params[i] = *vec_get(shard->params, entry->params + i);
+    }
+    unlock_shard(shard);
+
+    return state;
+}
+
+int
+func_table_publish(
+    struct func_table*       table,
+    int                      tu_id,
+    ast_id                   func,
+    enum type                ret_type,
+    const struct func_param* params,
+    int                      param_count)
+{
+    struct func_entry* entry;
+    int32_t            first;
+    int                i;
+    uint64_t           key = make_key(tu_id, func);
+    struct shard*      shard = key_shard(table, key);
+
+    lock_shard(shard);
+    first = params_count(shard->params);
+    for (i = 0; i != param_count; ++i)
+    {
+        struct func_param* param = params_emplace(&shard->params);
+        if (param == NULL)
+            goto oom;
+        *param = params[i];
+    }
+
+    entry = funcmap_find(shard->funcs, key);
+    ODBUTIL_DEBUG_ASSERT(entry != NULL, log_semantic_err("func: %d\n", func));
+    entry->state = FUNC_CHECKED;
+    entry->ret_type = ret_type;
+    entry->params = first;
+    entry->param_count = param_count;
+    cond_broadcast(shard->changed);
+    unlock_shard(shard);
+
+    return 0;
+
+oom:
+    unlock_shard(shard);
+    return -1;
+}
+
+void
+func_table_fail(struct func_table* table, int owner)
+{
+    uint64_t           key;
+    struct func_entry* entry;
+    int                i;
+
+    for (i = 0; i != SHARD_COUNT; ++i)
+    {
+        struct shard* shard = &table->shards[i];
+        lock_shard(shard);
+        hm_for_each(shard->funcs, key, entry)
+        {
+            if (entry->state == FUNC_BUSY && entry->owner == owner)
+                entry->state = FUNC_FAILED;
+        }
+        cond_broadcast(shard->changed);
+        unlock_shard(shard);
+    }
+
+    lock_waits(table);
+    if (owner < waits_count(table->waits))
+        *vec_get(table->waits, owner) = NOT_WAITING;
+    unlock_waits(table);
+}
+
+/* Returns the owner of the function if it is busy, otherwise -1 */
+static int
+busy_owner(struct func_table* table, uint64_t key)
+{
+    const struct func_entry* entry;
+    struct shard*            shard = key_shard(table, key);
+    int                      owner = -1;
+
+    lock_shard(shard);
+    entry = funcmap_find(shard->funcs, key);
+    if (entry && entry->state == FUNC_BUSY)
+        owner = entry->owner;
+    unlock_shard(shard);
+
+    return owner;
+}
+
+int
+func_table_wait(struct func_table* table, int owner, int tu_id, ast_id func)
+{
+    uint64_t key = make_key(tu_id, func);
+    int      hops;
+    int      result = 0;
+
+    lock_waits(table);
+    while (waits_count(table->waits) <= owner)
+    {
+        uint64_t* wait = waits_emplace(&table->waits);
+        if (wait == NULL)
+        {
+            result = -1;
+            goto out;
+        }
+        *wait = NOT_WAITING;
+    }
+    *vec_get(table->waits, owner) = key;
+
+    /* Follow the chain of type checks that are waiting on each other. If it
+     * leads back to us, nobody can make progress. A type check can only wait
+     * on one function at a time, so the chain can't be longer than the number
+     * of type checks. Whoever closes the chain sees it, because the waits
+     * can't change while the wait mutex is held */
+    for (hops = 0; hops <= waits_count(table->waits); ++hops)
+    {
+        int busy = busy_owner(table, key);
+        if (busy < 0)
+            break;
+        if (busy == owner)
+        {
+            *vec_get(table->waits, owner) = NOT_WAITING;
+            result = -1;
+            break;
+        }
+        if (busy >= waits_count(table->waits))
+            break;
+        key = *vec_get(table->waits, busy);
+        if (key == NOT_WAITING)
+            break;
+    }
+
+out:
+    unlock_waits(table);
+    return result;
+}
+
+void
+func_table_wait_finish(struct func_table* table, int owner)
+{
+    const struct func_entry* entry;
+    struct shard*            shard;
+    uint64_t                 key = NOT_WAITING;
+
+    lock_waits(table);
+    if (owner < waits_count(table->waits))
+        key = *vec_get(table->waits, owner);
+    unlock_waits(table);
+    if (key == NOT_WAITING)
+        return;
+
+    shard = key_shard(table, key);
+    lock_shard(shard);
+    while ((entry = funcmap_find(shard->funcs, key)) != NULL
+           && entry->state == FUNC_BUSY)
+    {
+        wait_shard(shard);
+    }
+    unlock_shard(shard);
+
+    lock_waits(table);
+    *vec_get(table->waits, owner) = NOT_WAITING;
+    unlock_waits(table);
+}
+
+static int
+instance_matches(
+    const struct shard*         shard,
+    const struct func_instance* instance,
+    const enum type*            arg_types,
+    int                         arg_count)
+{
+    int i;
+    if (instance->arg_count != arg_count)
+        return 0;
+    for (i = 0; i != arg_count; ++i)
+        if (*vec_get(shard->arg_types, instance->arg_types + i)
+            != arg_types[i])
+        {
+            return 0;
+        }
+    return 1;
+}
+
+ast_id
+func_table_find_instance(
+    struct func_table* table,
+    int                tu_id,
+    ast_id             func_poly,
+    const enum type*   arg_types,
+    int                arg_count)
+{
+    const struct func_entry* entry;
+    int32_t                  i;
+    ast_id                   func = -1;
+    uint64_t                 key = make_key(tu_id, func_poly);
+    struct shard*            shard = key_shard(table, key);
+
+    lock_shard(shard);
+    entry = funcmap_find(shard->funcs, key);
+    for (i = entry ? entry->instances : -1; i > -1;
+         i = vec_get(shard->instances, i)->next)
+    {
+        const struct func_instance* instance = vec_get(shard->instances, i);
+        if (instance_matches(shard, instance, arg_types, arg_count))
+        {
+            func = instance->func;
+            break;
+        }
+    }
+    unlock_shard(shard);
+
+    return func;
+}
+
+int
+func_table_add_instance(
+    struct func_table* table,
+    int                tu_id,
+    ast_id             func_poly,
+    ast_id             func,
+    const enum type*   arg_types,
+    int                arg_count)
+{
+    struct func_entry*    entry;
+    struct func_instance* instance;
+    int32_t               first;
+    int                   i;
+    uint64_t              key = make_key(tu_id, func_poly);
+    struct shard*         shard = key_shard(table, key);
+
+    lock_shard(shard);
+    first = types_count(shard->arg_types);
+    for (i = 0; i != arg_count; ++i)
+        if (types_push(&shard->arg_types, arg_types[i]) != 0)
+            goto oom;
+
+    switch (funcmap_emplace_or_get(&shard->funcs, key, &entry))
+    {
+        case HM_OOM: goto oom;
+        case HM_EXISTS: break;
+        case HM_NEW:
+            /* Polymorphic functions themselves are never type checked */
+            entry->state = FUNC_UNCLAIMED;
+            entry->owner = -1;
+            entry->ret_type = TYPE_INVALID;
+            entry->params = 0;
+            entry->param_count = 0;
+            entry->instances = -1;
+            break;
+    }
+
+    instance = instances_emplace(&shard->instances);
+    if (instance == NULL)
+        goto oom;
+    instance->next = entry->instances;
+    instance->func = func;
+    instance->arg_types = first;
+    instance->arg_count = arg_count;
+    entry->instances = instances_count(shard->instances) - 1;
+    unlock_shard(shard);
+
+    return 0;
+
+oom:
+    unlock_shard(shard);
+    return -1;
+}
+
+int
+func_table_want_tu(struct func_table* table, int tu_id)
+{
+    struct shard* shard = tu_shard(table, tu_id);
+    int           idx = tu_id / SHARD_COUNT;
+
+    lock_shard(shard);
+    while (counts_count(shard->tus_wanted) <= idx)
+        if (counts_push(&shard->tus_wanted, 0) != 0)
+            goto oom;
+    (*vec_get(shard->tus_wanted, idx))++;
+    unlock_shard(shard);
+
+    return 0;
+
+oom:
+    unlock_shard(shard);
+    return -1;
+}
+
+void
+func_table_got_tu(struct func_table* table, int tu_id)
+{
+    struct shard* shard = tu_shard(table, tu_id);
+
+    lock_shard(shard);
+    (*vec_get(shard->tus_wanted, tu_id / SHARD_COUNT))--;
+    cond_broadcast(shard->changed);
+    unlock_shard(shard);
+}
+
+int
+func_table_tu_wanted(struct func_table* table, int tu_id)
+{
+    struct shard* shard = tu_shard(table, tu_id);
+    int           idx = tu_id / SHARD_COUNT;
+    int           wanted;
+
+    lock_shard(shard);
+    wanted = idx < counts_count(shard->tus_wanted)
+             && *vec_get(shard->tus_wanted, idx) > 0;
+    unlock_shard(shard);
+
+    return wanted;
+}
+
+void
+func_table_hand_over_tu(struct func_table* table, int tu_id)
+{
+    struct shard* shard = tu_shard(table, tu_id);
+    int           idx = tu_id / SHARD_COUNT;
+
+    lock_shard(shard);
+    while (idx < counts_count(shard->tus_wanted)
+           && *vec_get(shard->tus_wanted, idx) > 0)
+    {
+        wait_shard(shard);
+    }
+    unlock_shard(shard);
+}
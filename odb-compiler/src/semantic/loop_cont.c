@@ -37,9 +37,12 @@ create_step_block(struct ast** astp, ast_id loop, ast_id cont)
             = ast_inc_step(astp, inc_var, step_expr, ast_loc(*astp, step_expr));
         (*astp)->nodes[cont].cont.step
             = ast_block(astp, inc_stmt, ast_loc(*astp, step_expr));
+        ast_set_parent(*astp, (*astp)->nodes[cont].cont.step, cont);
     }
     else
     {
+        /* The post body is shared with the loop. It stays indexed as a child
+         * of the loop */
         ast_id loop_body = (*astp)->nodes[loop].loop.loop_body;
         ast_id post_body = (*astp)->nodes[loop_body].loop_body.post_body;
         ODBUTIL_DEBUG_ASSERT(post_body > -1, (void)0);
@@ -99,7 +102,8 @@ check_loop_cont(
     const struct db_source*    sources,
     const struct plugin_list*  plugins,
     const struct cmd_list*     cmds,
-    const struct symbol_table* symbols)
+    const struct symbol_table* symbols,
+    struct semantic_session*   session)
 {
     ast_id       n, loop;
     struct ast** astp = &tus[tu_id];
@@ -128,4 +132,4 @@ static const struct semantic_check* depends[]
        NULL};
 
 const struct semantic_check semantic_loop_cont
-    = {check_loop_cont, depends, "loop_cont"};
+    = {check_loop_cont, depends, "loop_cont", 0, NULL};
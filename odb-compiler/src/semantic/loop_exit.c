@@ -8,11 +8,10 @@
 
 static int
 check_exit(
-    const struct ast* ast,
-    ast_id            exit,
-    const char*       filename,
-    const char*       source)
+    struct ast** astp, ast_id exit, const char* filename, const char* source)
 {
+    const struct ast* ast = *astp;
+
     ODBUTIL_DEBUG_ASSERT(exit > -1, (void)0);
     ODBUTIL_DEBUG_ASSERT(
         ast_node_type(ast, exit) == AST_LOOP_EXIT,
@@ -62,26 +61,25 @@ check_loop_exit(
     const struct db_source*    sources,
     const struct plugin_list*  plugins,
     const struct cmd_list*     cmds,
-    const struct symbol_table* symbols)
+    const struct symbol_table* symbols,
+    struct semantic_session*   session)
 {
-    ast_id            n;
-    const struct ast* ast = tus[tu_id];
-    const char*       filename = utf8_cstr(filenames[tu_id]);
-    const char*       source = sources[tu_id].text.data;
-
-    for (n = 0; n != ast_count(ast); ++n)
-    {
-        if (ast_node_type(ast, n) != AST_LOOP_EXIT)
-            continue;
-
-        if (check_exit(ast, n, filename, source) != 0)
-            return -1;
-    }
-
-    return 0;
+    const struct semantic_check* check = &semantic_loop_exit;
+    return semantic_visit(
+        &check,
+        1,
+        SEMANTIC_VISIT_ANY_ORDER,
+        &tus[tu_id],
+        utf8_cstr(filenames[tu_id]),
+        sources[tu_id].text.data);
 }
 
 static const struct semantic_check* depends[] = {NULL};
 
+static const struct semantic_visitor visitor
+    = {check_exit,
+       SEMANTIC_VISIT_NODE(AST_LOOP_EXIT),
+       SEMANTIC_VISIT_ANY_ORDER};
+
 const struct semantic_check semantic_loop_exit
-    = {check_loop_exit, depends, "loop_exit"};
+    = {check_loop_exit, depends, "loop_exit", 0, &visitor};
@@ -227,6 +227,7 @@ convert_for_loop_to_primitives(
         }
 
         (*astp)->nodes[for3].loop_for3.next = -1;
+        ast_set_parent(*astp, next, -1);
         ast_delete_tree(*astp, next);
     }
 
@@ -251,6 +252,8 @@ convert_for_loop_to_primitives(
     ast_id exit_block = ast_block(astp, exit_stmt, loop_loc);
     (*astp)->nodes[exit_block].block.next = body;
     (*astp)->nodes[loop_body].loop_body.body = exit_block;
+    ast_set_parent(*astp, body, exit_block);
+    ast_set_parent(*astp, exit_block, loop_body);
 
     /* Insert post-increment into the end, and make sure to remove it as a child
      * from the loop_for nodes */
@@ -258,6 +261,7 @@ convert_for_loop_to_primitives(
         post_body == -1, log_semantic_err("post_body: %d\n", post_body));
     ast_id inc_block = ast_block(astp, inc_stmt, loop_loc);
     (*astp)->nodes[loop_body].loop_body.post_body = inc_block;
+    ast_set_parent(*astp, inc_block, loop_body);
     (*astp)->nodes[for3].loop_for3.step = -1;
 
     /* Loop variable initialization statement is inserted outside of the loop */
@@ -277,14 +281,27 @@ convert_for_loop_to_primitives(
     (*astp)->nodes[init_block].block.stmt
         = (*astp)->nodes[loop_block].block.stmt;
     (*astp)->nodes[loop_block].block.stmt = tmp;
+    ast_set_parent(*astp, (*astp)->nodes[init_block].block.stmt, init_block);
+    ast_set_parent(*astp, tmp, loop_block);
 
     /* Clean up dangling nodes */
     (*astp)->nodes[loop].loop.loop_for1 = -1;
+    ast_set_parent(*astp, for1, -1);
     ast_delete_tree((*astp), for1);
 
     return 0;
 }
 
+static int
+visit_loop(
+    struct ast** astp, ast_id loop, const char* filename, const char* source)
+{
+    if ((*astp)->nodes[loop].loop.loop_for1 == -1)
+        return 0;
+
+    return convert_for_loop_to_primitives(astp, loop, filename, source);
+}
+
 static int
 loop_for(
     struct ast**               tus,
@@ -295,35 +312,29 @@ loop_for(
     const struct db_source*    sources,
     const struct plugin_list*  plugins,
     const struct cmd_list*     cmds,
-    const struct symbol_table* symbols)
+    const struct symbol_table* symbols,
+    struct semantic_session*   session)
 {
-    ast_id       n;
-    struct ast** astp = &tus[tu_id];
-    struct ast*  ast = *astp;
-    const char*  filename = utf8_cstr(filenames[tu_id]);
-    const char*  source = sources[tu_id].text.data;
-
-    for (n = 0; n != ast_count(ast); ++n)
-    {
-        if (ast_node_type(ast, n) != AST_LOOP)
-            continue;
-        if (ast->nodes[n].loop.loop_for1 == -1)
-            continue;
-
-        if (convert_for_loop_to_primitives(astp, n, filename, source) != 0)
-            return -1;
-        ast = *astp;
-    }
-
-    ast_gc(ast);
-#if defined(ODBCOMPILER_AST_SANITY_CHECK)
-    ast_verify_connectivity(ast);
-#endif
-    return 0;
+    const struct semantic_check* check = &semantic_loop_for;
+    return semantic_visit(
+        &check,
+        1,
+        SEMANTIC_VISIT_CHILDREN_FIRST,
+        &tus[tu_id],
+        utf8_cstr(filenames[tu_id]),
+        sources[tu_id].text.data);
 }
 
 static const struct semantic_check* depends[]
     = {&semantic_unary_literal, /* Required for deducing the step direction */
        NULL};
 
-const struct semantic_check semantic_loop_for = {loop_for, depends, "loop_for"};
+/* The step expression is below the loop, so unary_literal only has to visit
+ * the children of the loop first */
+static const struct semantic_visitor visitor
+    = {visit_loop,
+       SEMANTIC_VISIT_NODE(AST_LOOP),
+       SEMANTIC_VISIT_CHILDREN_FIRST};
+
+const struct semantic_check semantic_loop_for
+    = {loop_for, depends, "loop_for", 0, &visitor};
@@ -11,7 +11,8 @@ check_loop_names(
     const struct db_source*    sources,
     const struct plugin_list*  plugins,
     const struct cmd_list*     cmds,
-    const struct symbol_table* symbols)
+    const struct symbol_table* symbols,
+    struct semantic_session*   session)
 {
     ast_id      n;
     struct ast* ast = tus[tu_id];
@@ -25,4 +26,4 @@ check_loop_names(
 static const struct semantic_check* depends[] = {NULL};
 
 const struct semantic_check semantic_loop_name
-    = {check_loop_names, depends, "loop_name"};
+    = {check_loop_names, depends, "loop_name", 0, NULL};
@@ -0,0 +1,294 @@
+#include "odb-compiler/semantic/overload_cache.h"
+#include "odb-util/hash.h"
+#include "odb-util/hm.h"
+#include "odb-util/log.h"
+#include "odb-util/mem.h"
+#include "odb-util/mutex.h"
+#include "odb-util/vec.h"
+
+struct overload_entry
+{
+    int32_t next;
+    cmd_id  overload;
+    /* Index into overload_cache.arg_types */
+    int32_t arg_types, arg_count;
+};
+
+struct overload_cmd
+{
+    /* Index into overload_cache.entries, or -1 */
+    int32_t first_entry;
+    /* 0 if the overloads were not counted yet */
+    int32_t overload_count;
+};
+
+/* Maps the first overload of a command to what is known about it */
+HM_DECLARE_API(static, cmdmap, cmd_id, struct overload_cmd, 32)
+HM_DEFINE_API(cmdmap, cmd_id, struct overload_cmd, 32)
+
+VEC_DECLARE_API(static, types, enum type, 32)
+VEC_DEFINE_API(types, enum type, 32)
+
+VEC_DECLARE_API(static, entries, struct overload_entry, 32)
+VEC_DEFINE_API(entries, struct overload_entry, 32)
+
+struct overload_cache
+{
+    struct mutex*   mutex;
+    struct cmdmap*  cmds;
+    struct types*   arg_types;
+    struct entries* entries;
+};
+
+/* The containers are modified by the overload resolution of many threads.
+ * Between calls, none of them owns their memory */
+static void
+mem_acquire_containers(struct overload_cache* cache)
+{
+#if defined(ODBUTIL_MEM_DEBUGGING)
+    if (cache->cmds)
+    {
+        mem_acquire(
+            cache->cmds,
+            offsetof(struct cmdmap, hashes)
+                + sizeof(cache->cmds->hashes[0]) * cache->cmds->capacity);
+        mem_acquire(
+            cache->cmds->kvs.keys,
+            sizeof(cache->cmds->kvs.keys[0]) * cache->cmds->capacity);
+        mem_acquire(
+            cache->cmds->kvs.values,
+            sizeof(cache->cmds->kvs.values[0]) * cache->cmds->capacity);
+    }
+    if (cache->arg_types)
+        mem_acquire(
+            cache->arg_types,
+            offsetof(struct types, data)
+                + sizeof(cache->arg_types->data[0])
+                      * cache->arg_types->capacity);
+    if (cache->entries)
+        mem_acquire(
+            cache->entries,
+            offsetof(struct entries, data)
+                + sizeof(cache->entries->data[0]) * cache->entries->capacity);
+#else
+    (void)cache;
+#endif
+}
+
+static void
+mem_release_containers(struct overload_cache* cache)
+{
+#if defined(ODBUTIL_MEM_DEBUGGING)
+    if (cache->entries)
+        mem_release(cache->entries);
+    if (cache->arg_types)
+        mem_release(cache->arg_types);
+    if (cache->cmds)
+    {
+        mem_release(cache->cmds->kvs.values);
+        mem_release(cache->cmds->kvs.keys);
+        mem_release(cache->cmds);
+    }
+#else
+    (void)cache;
+#endif
+}
+
+static void
+lock(struct overload_cache* cache)
+{
+    mutex_lock(cache->mutex);
+    mem_acquire_containers(cache);
+}
+
+static void
+unlock(struct overload_cache* cache)
+{
+    mem_release_containers(cache);
+    mutex_unlock(cache->mutex);
+}
+
+struct overload_cache*
+overload_cache_create(void)
+{
+    struct overload_cache* cache = mem_alloc(sizeof(*cache));
+    if (cache == NULL)
+        goto alloc_cache_failed;
+
+    cache->mutex = mutex_create();
+    if (cache->mutex == NULL)
+        goto create_mutex_failed;
+
+    cmdmap_init(&cache->cmds);
+    types_init(&cache->arg_types);
+    entries_init(&cache->entries);
+
+    return cache;
+
+create_mutex_failed:
+    mem_free(cache);
+alloc_cache_failed:
+    log_oom(sizeof(*cache), "overload_cache_create()");
+    return NULL;
+}
+
+void
+overload_cache_destroy(struct overload_cache* cache)
+{
+    if (cache == NULL)
+        return;
+
+    mem_acquire_containers(cache);
+    entries_deinit(cache->entries);
+    types_deinit(cache->arg_types);
+    cmdmap_deinit(cache->cmds);
+    mutex_destroy(cache->mutex);
+    mem_free(cache);
+}
+
+/* Gets the entry of a command, creating it if necessary */
+static struct overload_cmd*
+emplace_cmd(struct overload_cache* cache, cmd_id first_overload)
+{
+    struct overload_cmd* cmd;
+    switch (cmdmap_emplace_or_get(&cache->cmds, first_overload, &cmd))
+    {
+        case HM_OOM: return NULL;
+        case HM_EXISTS: break;
+        case HM_NEW:
+            cmd->first_entry = -1;
+            cmd->overload_count = 0;
+            break;
+    }
+    return cmd;
+}
+
+int
+overload_cache_overload_count(
+    struct overload_cache* cache, cmd_id first_overload)
+{
+    const struct overload_cmd* cmd;
+    int                        count;
+
+    if (cache == NULL)
+        return 0;
+
+    lock(cache);
+    cmd = cmdmap_find(cache->cmds, first_overload);
+    count = cmd ? cmd->overload_count : 0;
+    unlock(cache);
+
+    return count;
+}
+
+int
+overload_cache_set_overload_count(
+    struct overload_cache* cache, cmd_id first_overload, int overload_count)
+{
+    struct overload_cmd* cmd;
+
+    if (cache == NULL)
+        return 0;
+
+    lock(cache);
+    cmd = emplace_cmd(cache, first_overload);
+    if (cmd == NULL)
+    {
+        unlock(cache);
+        return -1;
+    }
+    cmd->overload_count = overload_count;
+    unlock(cache);
+
+    return 0;
+}
+
+static int
+entry_matches(
+    const struct overload_cache* cache,
+    const struct overload_entry* entry,
+    const enum type*             arg_types,
+    int                          arg_count)
+{
+    int i;
+    if (entry->arg_count != arg_count)
+        return 0;
+    for (i = 0; i != arg_count; ++i)
+        if (*vec_get(cache->arg_types, entry->arg_types + i) != arg_types[i])
+            return 0;
+    return 1;
+}
+
+cmd_id
+overload_cache_find(
+    struct overload_cache* cache,
+    cmd_id                 first_overload,
+    const enum type*       arg_types,
+    int                    arg_count)
+{
+    const struct overload_cmd* cmd;
+    int32_t                    i;
+    cmd_id                     overload = -1;
+
+    if (cache == NULL)
+        return -1;
+
+    lock(cache);
+    cmd = cmdmap_find(cache->cmds, first_overload);
+    for (i = cmd ? cmd->first_entry : -1; i > -1;
+         i = vec_get(cache->entries, i)->next)
+    {
+        const struct overload_entry* entry = vec_get(cache->entries, i);
+        if (entry_matches(cache, entry, arg_types, arg_count))
+        {
+            overload = entry->overload;
+            break;
+        }
+    }
+    unlock(cache);
+
+    return overload;
+}
+
+int
+overload_cache_add(
+    struct overload_cache* cache,
+    cmd_id                 first_overload,
+    const enum type*       arg_types,
+    int                    arg_count,
+    cmd_id                 overload)
+{
+    struct overload_entry* entry;
+    struct overload_cmd*   cmd;
+    int32_t                types_start;
+    int                    i;
+
+    if (cache == NULL)
+        return 0;
+
+    lock(cache);
+    types_start = types_count(cache->arg_types);
+    for (i = 0; i != arg_count; ++i)
+        if (types_push(&cache->arg_types, arg_types[i]) != 0)
+            goto oom;
+
+    entry = entries_emplace(&cache->entries);
+    if (entry == NULL)
+        goto oom;
+    entry->overload = overload;
+    entry->arg_types = types_start;
+    entry->arg_count = arg_count;
+
+    cmd = emplace_cmd(cache, first_overload);
+    if (cmd == NULL)
+        goto oom;
+    entry->next = cmd->first_entry;
+    cmd->first_entry = entries_count(cache->entries) - 1;
+    unlock(cache);
+
+    return 0;
+
+oom:
+    unlock(cache);
+    return -1;
+}
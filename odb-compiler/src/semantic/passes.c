@@ -0,0 +1,351 @@
+#include "odb-compiler/ast/ast.h"
+#include "odb-compiler/ast/ast_integrity.h"
+#include "odb-compiler/parser/db_source.h"
+#include "odb-compiler/semantic/passes.h"
+#include "odb-util/log.h"
+
+VEC_DEFINE_API(semantic_passes, struct semantic_pass, 16)
+
+VEC_DECLARE_API(static, visit_stack, ast_id, 32)
+VEC_DEFINE_API(visit_stack, ast_id, 32)
+
+/* Post-order traversals push a node twice. The second entry is encoded as
+ * negative, and means the children of the node were visited */
+#define CHILDREN_VISITED(n) (-1 - (n))
+
+static int
+depends_on(const struct semantic_check* check, const struct semantic_check* dep)
+{
+    const struct semantic_check** d;
+    for (d = check->depends_on; *d != NULL; ++d)
+        if (*d == dep || depends_on(*d, dep))
+            return 1;
+    return 0;
+}
+
+/* Adds the checks that depend on a failed check to the failed checks. Checks
+ * only depend on checks listed before them in the same pass */
+static int
+propagate_failure(
+    const struct semantic_check* const* checks, int check_count, int failed)
+{
+    int i, j;
+    for (i = 0; i != check_count; ++i)
+        if (failed & (1 << i))
+            for (j = i + 1; j != check_count; ++j)
+                if (depends_on(checks[j], checks[i]))
+                    failed |= 1 << j;
+    return failed;
+}
+
+static void
+visit_node(
+    const struct semantic_check* const* checks,
+    int                                 check_count,
+    int*                                failed,
+    struct ast**                        astp,
+    ast_id                              n,
+    const char*                         filename,
+    const char*                         source)
+{
+    int i;
+    for (i = 0; i != check_count; ++i)
+    {
+        const struct semantic_visitor* visitor = checks[i]->visitor;
+        /* A previous visitor may have changed the type of the node */
+        uint64_t type = SEMANTIC_VISIT_NODE(ast_node_type(*astp, n));
+        if ((*failed & (1 << i)) || !(visitor->node_types & type))
+            continue;
+        if (visitor->visit(astp, n, filename, source) != 0)
+            *failed = propagate_failure(
+                checks, check_count, *failed | (1 << i));
+    }
+}
+
+static int
+push_children(struct visit_stack** stack, const struct ast* ast, ast_id n)
+{
+    ast_id left = ast->nodes[n].base.left;
+    ast_id right = ast->nodes[n].base.right;
+
+    /* Pushed in reverse so the left child is visited first */
+    if (right > -1 && visit_stack_push(stack, right) != 0)
+        return -1;
+    if (left > -1 && visit_stack_push(stack, left) != 0)
+        return -1;
+
+    return 0;
+}
+
+static int
+visit_checks(
+    const struct semantic_check* const* checks,
+    int                                 check_count,
+    enum semantic_visit_order           order,
+    struct ast**                        astp,
+    const char*                         filename,
+    const char*                         source)
+{
+    struct visit_stack* stack;
+    ast_id              n;
+    int                 failed = 0;
+    int                 all_failed = (1 << check_count) - 1;
+
+    visit_stack_init(&stack);
+    if ((*astp)->root > -1 && visit_stack_push(&stack, (*astp)->root) != 0)
+        goto fail;
+
+    /* The nodes are visited by following the tree instead of sweeping over
+     * the node array, so dangling nodes are skipped. In post-order, nodes that
+     * a visitor creates below the node it is called for are not visited */
+    while (visit_stack_count(stack) > 0 && failed != all_failed)
+    {
+        n = *visit_stack_pop(stack);
+
+        if (order == SEMANTIC_VISIT_PARENTS_FIRST)
+        {
+            visit_node(
+                checks, check_count, &failed, astp, n, filename, source);
+            if (push_children(&stack, *astp, n) != 0)
+                goto fail;
+            continue;
+        }
+
+        if (n < 0)
+        {
+            visit_node(
+                checks,
+                check_count,
+                &failed,
+                astp,
+                CHILDREN_VISITED(n),
+                filename,
+                source);
+            continue;
+        }
+
+        if (visit_stack_push(&stack, CHILDREN_VISITED(n)) != 0)
+            goto fail;
+        if (push_children(&stack, *astp, n) != 0)
+            goto fail;
+    }
+
+#if defined(ODBCOMPILER_AST_SANITY_CHECK)
+    ast_verify_connectivity(*astp);
+#endif
+
+    visit_stack_deinit(stack);
+    return failed;
+
+fail:
+    visit_stack_deinit(stack);
+    return all_failed;
+}
+
+int
+semantic_visit(
+    const struct semantic_check* const* checks,
+    int                                 check_count,
+    enum semantic_visit_order           order,
+    struct ast**                        astp,
+    const char*                         filename,
+    const char*                         source)
+{
+    return visit_checks(checks, check_count, order, astp, filename, source)
+                   == 0
+               ? 0
+               : -1;
+}
+
+int
+semantic_passes_find(
+    const struct semantic_passes* passes, const struct semantic_check* check)
+{
+    int                         i, p;
+    const struct semantic_pass* pass;
+
+    vec_enumerate(passes, p, pass)
+        for (i = 0; i != pass->count; ++i)
+            if (pass->checks[i] == check)
+                return p;
+
+    return -1;
+}
+
+static int
+already_ran(
+    const struct semantic_check*  check,
+    const struct semantic_check** already_run)
+{
+    const struct semantic_check** done;
+    for (done = already_run; done && *done != NULL; ++done)
+        if (*done == check || already_ran(check, (*done)->depends_on))
+            return 1;
+    return 0;
+}
+
+static int
+is_fusable(const struct semantic_pass* pass)
+{
+    return pass->checks[0]->visitor != NULL
+           && pass->count < SEMANTIC_PASS_MAX_CHECKS;
+}
+
+static int
+place_check(
+    struct semantic_passes** passes, const struct semantic_check* check)
+{
+    const struct semantic_check** dep;
+    struct semantic_pass*         pass;
+    int                           p, first = 0, shares_dep;
+    enum semantic_visit_order     order
+        = check->visitor ? check->visitor->order : SEMANTIC_VISIT_ANY_ORDER;
+
+    /* The check can only share a pass with its dependencies if it relies on
+     * them in a traversal order the pass can provide */
+    for (dep = check->depends_on; *dep != NULL; ++dep)
+    {
+        p = semantic_passes_find(*passes, *dep);
+        if (p < 0)
+            continue;
+        if (order == SEMANTIC_VISIT_ANY_ORDER)
+            p++;
+        if (first < p)
+            first = p;
+    }
+
+    if (check->visitor)
+        for (p = first; p < semantic_passes_count(*passes); ++p)
+        {
+            pass = vec_get(*passes, p);
+            if (!is_fusable(pass))
+                continue;
+
+            shares_dep = 0;
+            for (dep = check->depends_on; *dep != NULL; ++dep)
+                if (semantic_passes_find(*passes, *dep) == p)
+                    shares_dep = 1;
+            if (shares_dep && pass->order != SEMANTIC_VISIT_ANY_ORDER
+                && pass->order != order)
+            {
+                continue;
+            }
+
+            if (shares_dep)
+                pass->order = order;
+            pass->checks[pass->count++] = check;
+            return 0;
+        }
+
+    pass = semantic_passes_emplace(passes);
+    if (pass == NULL)
+        return -1;
+    pass->checks[0] = check;
+    pass->count = 1;
+    pass->order = SEMANTIC_VISIT_ANY_ORDER;
+
+    return 0;
+}
+
+static int
+add_check(
+    struct semantic_passes**      passes,
+    const struct semantic_check*  check,
+    const struct semantic_check** already_run)
+{
+    const struct semantic_check** dep;
+
+    if (semantic_passes_find(*passes, check) > -1
+        || already_ran(check, already_run))
+    {
+        return 0;
+    }
+
+    for (dep = check->depends_on; *dep != NULL; ++dep)
+        if (add_check(passes, *dep, already_run) != 0)
+            return -1;
+
+    return place_check(passes, check);
+}
+
+int
+semantic_passes_build(
+    struct semantic_passes**      passes,
+    const struct semantic_check*  check,
+    const struct semantic_check** already_run)
+{
+    return add_check(passes, check, already_run);
+}
+
+int
+semantic_pass_run(
+    const struct semantic_pass* pass,
+    struct ast**                tus,
+    int                         tu_count,
+    int                         tu_id,
+    struct mutex**              tu_mutexes,
+    const struct utf8*          filenames,
+    const struct db_source*     sources,
+    const struct plugin_list*   plugins,
+    const struct cmd_list*      cmds,
+    const struct symbol_table*  symbols,
+    struct semantic_session*    session)
+{
+    if (pass->count > 1)
+        return visit_checks(
+            pass->checks,
+            pass->count,
+            pass->order,
+            &tus[tu_id],
+            utf8_cstr(filenames[tu_id]),
+            sources[tu_id].text.data);
+
+    return pass->checks[0]->execute(
+               tus,
+               tu_count,
+               tu_id,
+               tu_mutexes,
+               filenames,
+               sources,
+               plugins,
+               cmds,
+               symbols,
+               session)
+                   == 0
+               ? 0
+               : 1;
+}
+
+int
+semantic_log_passes(const struct semantic_check* check)
+{
+    struct semantic_passes* passes;
+    struct semantic_pass*   pass;
+    int                     p, i;
+
+    semantic_passes_init(&passes);
+    if (semantic_passes_build(&passes, check, NULL) != 0)
+    {
+        semantic_passes_deinit(passes);
+        return -1;
+    }
+
+    vec_enumerate(passes, p, pass)
+    {
+        log_semantic_info("Pass %d: {emph:%s}", p + 1, pass->checks[0]->name);
+        for (i = 1; i != pass->count; ++i)
+            log_raw(", {emph:%s}", pass->checks[i]->name);
+
+        if (pass->count == 1)
+            log_raw("\n");
+        else if (pass->order == SEMANTIC_VISIT_CHILDREN_FIRST)
+            log_raw(" (fused, children first)\n");
+        else if (pass->order == SEMANTIC_VISIT_PARENTS_FIRST)
+            log_raw(" (fused, parents first)\n");
+        else
+            log_raw(" (fused)\n");
+    }
+
+    semantic_passes_deinit(passes);
+    return 0;
+}
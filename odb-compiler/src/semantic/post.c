@@ -2,6 +2,8 @@
 #include "odb-compiler/ast/ast_export.h"
 #include "odb-compiler/ast/ast_ops.h"
 #include "odb-compiler/semantic/post.h"
+#include "odb-compiler/semantic/symbol_table.h"
+#include "odb-util/mem.h"
 
 void
 post_delete_polymorphic_functions(struct ast** tus, int tu_count)
@@ -24,11 +26,39 @@ post_delete_polymorphic_functions(struct ast** tus, int tu_count)
                 ast->nodes[parent].block.next = ast->nodes[n].block.next;
             else
                 ast->root = ast->nodes[n].block.next;
+            ast_set_parent(ast, ast->nodes[n].block.next, parent);
+            ast_set_parent(ast, n, -1);
             ast->nodes[n].block.next = -1;
 
             ast_delete_tree(ast, n);
         }
+    }
+}
+
+int
+post_gc(struct ast** tus, int tu_count, struct symbol_table* symbols)
+{
+    /* Collecting rewrites the whole AST. Below this percentage of deleted
+     * nodes, it's cheaper for later passes to skip over them */
+    static const int threshold_percent = 10;
+    int              tu_id;
 
-        ast_gc(ast);
+    for (tu_id = 0; tu_id != tu_count; ++tu_id)
+    {
+        ast_id  n, dead = 0;
+        ast_id* remap;
+        for (n = 0; n != ast_count(tus[tu_id]); ++n)
+            if (ast_node_type(tus[tu_id], n) == AST_GC)
+                dead++;
+
+        if (dead == 0 || dead * 100 < ast_count(tus[tu_id]) * threshold_percent)
+            continue;
+
+        if (ast_gc(&tus[tu_id], &remap) != 0)
+            return -1;
+        symbol_table_remap_tu(symbols, tu_id, remap);
+        mem_free(remap);
     }
+
+    return 0;
 }
@@ -1,7 +1,9 @@
 #include "odb-compiler/ast/ast.h"
 #include "odb-compiler/parser/db_source.h"
 #include "odb-compiler/sdk/cmd_list.h"
+#include "odb-compiler/semantic/overload_cache.h"
 #include "odb-compiler/semantic/semantic.h"
+#include "odb-compiler/semantic/session.h"
 #include "odb-compiler/semantic/type.h"
 #include "odb-util/log.h"
 #include "odb-util/vec.h"
@@ -12,6 +14,9 @@
 VEC_DECLARE_API(static, candidates, cmd_id, 8)
 VEC_DEFINE_API(candidates, cmd_id, 8)
 
+VEC_DECLARE_API(static, arg_types, enum type, 8)
+VEC_DEFINE_API(arg_types, enum type, 8)
+
 typedef int (*conversion_valid_func)(enum type, enum type);
 
 struct ctx
@@ -90,21 +95,19 @@ static const conversion_valid_func narrowing_rules[]
 static int
 eliminate_candidates(cmd_id* cmd_id, void* user)
 {
-    int                                i;
-    ast_id                             arglist;
-    struct ctx*                        ctx = user;
-    const struct cmd_param_types_list* params
-        = ctx->cmds->param_types->data[*cmd_id];
+    int         i;
+    ast_id      arglist;
+    struct ctx* ctx = user;
 
     /* param count mismatch */
-    if (cmd_param_types_list_count(params) != ctx->argcount)
+    if (cmd_param_count(ctx->cmds, *cmd_id) != ctx->argcount)
         return 0;
 
     for (i = 0, arglist = ctx->arglist; i != ctx->argcount;
          ++i, arglist = ctx->ast->nodes[arglist].arglist.next)
     {
         ast_id    expr = ctx->ast->nodes[arglist].arglist.expr;
-        enum type param = params->data[i].type;
+        enum type param = cmd_param(ctx->cmds, *cmd_id, i)->type;
         enum type arg = ast_type_info(ctx->ast, expr);
 
         if (!ctx->is_conversion_valid(arg, param))
@@ -148,11 +151,8 @@ report_duplicate_commands(
     vec_for_each(candidates, cmdp)
     {
         struct utf8_view name = utf8_list_view(cmds->db_cmd_names, *cmdp);
-        const struct cmd_param_types_list* param_types
-            = cmds->param_types->data[*cmdp];
-        struct utf8_list* param_names = cmds->db_param_names->data[*cmdp];
-        enum type         ret_type = cmds->return_types->data[*cmdp];
-        plugin_id         plugin_id = cmds->plugin_ids->data[*cmdp];
+        enum type        ret_type = cmds->return_types->data[*cmdp];
+        plugin_id        plugin_id = cmds->plugin_ids->data[*cmdp];
         const struct plugin_info* plugin = &plugins->data[plugin_id];
         log_raw(
             "%*s|   {emph:%.*s}%s",
@@ -161,14 +161,14 @@ report_duplicate_commands(
             name.len,
             name.data + name.off,
             ret_type == TYPE_VOID ? " " : "(");
-        for (arg_idx = 0; arg_idx != utf8_list_count(param_names); ++arg_idx)
+        for (arg_idx = 0; arg_idx != cmd_param_count(cmds, *cmdp); ++arg_idx)
         {
             if (arg_idx)
                 log_raw(", ");
             log_raw(
                 "%s AS %s",
-                utf8_list_cstr(param_names, arg_idx),
-                type_to_db_name(param_types->data[arg_idx].type));
+                cmd_param_name_cstr(cmds, *cmdp, arg_idx),
+                type_to_db_name(cmd_param(cmds, *cmdp, arg_idx)->type));
         }
         log_raw("%s  ", ret_type == TYPE_VOID ? "" : ")");
         log_raw("[%s]\n", utf8_cstr(plugin->name));
@@ -198,8 +198,7 @@ report_ambiguous_overloads(
     struct log_highlight* hl;
     int*                  arg_positions;
 
-    int param_count = cmd_param_types_list_count(
-        cmds->param_types->data[*vec_first(candidates)]);
+    int param_count = cmd_param_count(cmds, *vec_first(candidates));
 
     ODBUTIL_DEBUG_ASSERT(param_count > 0, (void)0);
     ODBUTIL_DEBUG_ASSERT(narrowing_rules[rule_idx] != NULL, (void)0);
@@ -222,8 +221,7 @@ report_ambiguous_overloads(
         enum type arg_type = ast_type_info(ast, expr);
         vec_for_each(candidates, cmdp)
         {
-            enum type param_type
-                = cmds->param_types->data[*cmdp]->data[arg_idx].type;
+            enum type param_type = cmd_param(cmds, *cmdp, arg_idx)->type;
 
             if (narrowing_rules[rule_idx](arg_type, param_type))
             {
@@ -283,11 +281,8 @@ report_ambiguous_overloads(
     vec_for_each(candidates, cmdp)
     {
         struct utf8_view name = utf8_list_view(cmds->db_cmd_names, *cmdp);
-        const struct cmd_param_types_list* param_types
-            = cmds->param_types->data[*cmdp];
-        struct utf8_list* param_names = cmds->db_param_names->data[*cmdp];
-        enum type         ret_type = cmds->return_types->data[*cmdp];
-        plugin_id         plugin_id = cmds->plugin_ids->data[*cmdp];
+        enum type        ret_type = cmds->return_types->data[*cmdp];
+        plugin_id        plugin_id = cmds->plugin_ids->data[*cmdp];
         const struct plugin_info* plugin = &plugins->data[plugin_id];
         log_raw(
             "%*s|   {emph:%.*s}%s",
@@ -296,7 +291,7 @@ report_ambiguous_overloads(
             name.len,
             name.data + name.off,
             ret_type == TYPE_VOID ? " " : "(");
-        for (arg_idx = 0; arg_idx != utf8_list_count(param_names); ++arg_idx)
+        for (arg_idx = 0; arg_idx != cmd_param_count(cmds, *cmdp); ++arg_idx)
         {
             char fmt[26];
             if (arg_idx)
@@ -307,8 +302,8 @@ report_ambiguous_overloads(
                 strcpy(fmt, "%s AS %s");
             log_raw(
                 fmt,
-                utf8_list_cstr(param_names, arg_idx),
-                type_to_db_name(param_types->data[arg_idx].type));
+                cmd_param_name_cstr(cmds, *cmdp, arg_idx),
+                type_to_db_name(cmd_param(cmds, *cmdp, arg_idx)->type));
         }
         log_raw("%s  ", ret_type == TYPE_VOID ? "" : ")");
         log_raw("[%s]\n", utf8_cstr(plugin->name));
@@ -359,11 +354,11 @@ report_available_commands(
     log_flc_err(
         filename,
         source,
-        ast->nodes[arglist].arglist.combined_location,
+        ast->locs[arglist].combined_location,
         "%s",
         msg);
     gutter = log_excerpt_1(
-        source, ast->nodes[arglist].arglist.combined_location, "", 0);
+        source, ast->locs[arglist].combined_location, "", 0);
     log_excerpt_note(gutter, "Available candidates:\n");
     cmd_name = utf8_list_view(cmds->db_cmd_names, cmd);
     for (; cmd < cmd_list_count(cmds)
@@ -374,9 +369,6 @@ report_available_commands(
         enum type                 ret_type = cmds->return_types->data[cmd];
         plugin_id                 plugin_id = cmds->plugin_ids->data[cmd];
         const struct plugin_info* plugin = &plugins->data[plugin_id];
-        const struct cmd_param_types_list* param_types
-            = cmds->param_types->data[cmd];
-        struct utf8_list* param_names = cmds->db_param_names->data[cmd];
         log_raw(
             "%*s|   {emph:%.*s}%s",
             gutter,
@@ -384,14 +376,14 @@ report_available_commands(
             cmd_name.len,
             cmd_name.data + cmd_name.off,
             ret_type == TYPE_VOID ? " " : "(");
-        for (i = 0; i != utf8_list_count(param_names); ++i)
+        for (i = 0; i != cmd_param_count(cmds, cmd); ++i)
         {
             if (i)
                 log_raw(", ");
             log_raw(
                 "%s {emph0:AS %s}",
-                utf8_list_cstr(param_names, i),
-                type_to_db_name(param_types->data[i].type));
+                cmd_param_name_cstr(cmds, cmd, i),
+                type_to_db_name(cmd_param(cmds, cmd, i)->type));
         }
         log_raw("%s  ", ret_type == TYPE_VOID ? "" : ")");
         log_raw("[%s]\n", utf8_cstr(plugin->name));
@@ -405,11 +397,8 @@ log_cmd_signature(
     const struct cmd_list*    cmds,
     int                       gutter)
 {
-    int              i;
-    struct utf8_view name = utf8_list_view(cmds->db_cmd_names, cmd_id);
-    const struct cmd_param_types_list* param_types
-        = cmds->param_types->data[cmd_id];
-    struct utf8_list*         param_names = cmds->db_param_names->data[cmd_id];
+    int                       i;
+    struct utf8_view          name = utf8_list_view(cmds->db_cmd_names, cmd_id);
     enum type                 ret_type = cmds->return_types->data[cmd_id];
     plugin_id                 plugin_id = cmds->plugin_ids->data[cmd_id];
     const struct plugin_info* plugin = &plugins->data[plugin_id];
@@ -420,14 +409,14 @@ log_cmd_signature(
         name.len,
         name.data + name.off,
         ret_type == TYPE_VOID ? " " : "(");
-    for (i = 0; i != utf8_list_count(param_names); ++i)
+    for (i = 0; i != cmd_param_count(cmds, cmd_id); ++i)
     {
         if (i)
             log_raw(", ");
         log_raw(
             "%s {emph0:AS %s}",
-            utf8_list_cstr(param_names, i),
-            type_to_db_name(param_types->data[i].type));
+            cmd_param_name_cstr(cmds, cmd_id, i),
+            type_to_db_name(cmd_param(cmds, cmd_id, i)->type));
     }
     log_raw("%s  ", ret_type == TYPE_VOID ? "" : ")");
     log_raw("[%s]\n", utf8_cstr(plugin->name));
@@ -446,13 +435,12 @@ typecheck_warnings(
     struct ast* ast = *astp;
     cmd_id      cmd_id = ast->nodes[cmd_node].cmd.id;
     ast_id      arglist = ast->nodes[cmd_node].cmd.arglist;
-    const struct cmd_param_types_list* params = cmds->param_types->data[cmd_id];
 
     ODBUTIL_DEBUG_ASSERT(
         ast_node_type(ast, cmd_node) == AST_COMMAND,
         log_semantic_err("type: %d\n", ast_node_type(ast, cmd_node)));
 
-    for (i = 0; i != cmd_param_types_list_count(params);
+    for (i = 0; i != cmd_param_count(cmds, cmd_id);
          ++i, arglist = ast->nodes[arglist].arglist.next)
     {
         ODBUTIL_DEBUG_ASSERT(
@@ -461,7 +449,7 @@ typecheck_warnings(
         int       gutter;
         ast_id    arg = ast->nodes[arglist].arglist.expr;
         enum type arg_type = ast_type_info(ast, arg);
-        enum type param_type = params->data[i].type;
+        enum type param_type = cmd_param(cmds, cmd_id, i)->type;
 
         switch (type_convert(arg_type, param_type))
         {
@@ -510,6 +498,7 @@ typecheck_warnings(
                 return -1;
             ast = *astp;
             ast->nodes[arglist].arglist.expr = cast;
+            ast_set_parent(ast, cast, arglist);
             ast->nodes[cast].info.type_info = param_type;
         }
     }
@@ -519,19 +508,42 @@ typecheck_warnings(
 
 static int
 create_candidates_list(
-    struct candidates** candidates, const struct cmd_list* cmds, cmd_id cmd_id)
+    struct candidates**    candidates,
+    const struct cmd_list* cmds,
+    struct overload_cache* overloads,
+    cmd_id                 first_overload)
 {
+    int i, count;
+
     /* All overloads will be next to each other in memory, where the ID
      * assigned to the AST node will be the first overload (because it was
-     * found using utf8_lower_bound()). */
-    struct utf8_view cmd_name = utf8_list_view(cmds->db_cmd_names, cmd_id);
-    do
+     * found using utf8_lower_bound()). Comparing the names is only necessary
+     * the first time the command is resolved in any TU */
+    count = overload_cache_overload_count(overloads, first_overload);
+    if (count == 0)
     {
-        if (candidates_push(candidates, cmd_id++) != 0)
+        struct utf8_view cmd_name
+            = utf8_list_view(cmds->db_cmd_names, first_overload);
+        do
+        {
+            count++;
+        } while (
+            first_overload + count < cmd_list_count(cmds)
+            && utf8_equal(
+                cmd_name,
+                utf8_list_view(cmds->db_cmd_names, first_overload + count)));
+
+        if (overload_cache_set_overload_count(overloads, first_overload, count)
+            != 0)
+        {
             return -1;
-    } while (
-        cmd_id < cmd_list_count(cmds)
-        && utf8_equal(cmd_name, utf8_list_view(cmds->db_cmd_names, cmd_id)));
+        }
+    }
+
+    if (candidates_resize(candidates, count) != 0)
+        return -1;
+    for (i = 0; i != count; ++i)
+        (*candidates)->data[i] = first_overload + i;
 
     return 0;
 }
@@ -546,23 +558,28 @@ resolve_cmd_overloads(
     const struct db_source*    sources,
     const struct plugin_list*  plugins,
     const struct cmd_list*     cmds,
-    const struct symbol_table* symbols)
+    const struct symbol_table* symbols,
+    struct semantic_session*   session)
 {
     ast_id             n;
     ast_id             arglist;
     int                rule_idx, param_min, param_max;
+    cmd_id             first_overload, cached;
     struct candidates* candidates;
     struct candidates* prev_candidates;
+    struct arg_types*  arg_types;
     cmd_id*            cmdp;
 
-    struct ast** astp = &tus[tu_id];
-    struct ast*  ast = *astp;
-    const char*  filename = utf8_cstr(filenames[tu_id]);
-    const char*  source = sources[tu_id].text.data;
-    struct ctx   ctx = {NULL, ast, cmds, 0, -1};
+    struct ast**           astp = &tus[tu_id];
+    struct ast*            ast = *astp;
+    const char*            filename = utf8_cstr(filenames[tu_id]);
+    const char*            source = sources[tu_id].text.data;
+    struct ctx             ctx = {NULL, ast, cmds, 0, -1};
+    struct overload_cache* overloads = semantic_session_overloads(session);
 
     candidates_init(&candidates);
     candidates_init(&prev_candidates);
+    arg_types_init(&arg_types);
 
     for (n = 0; n != ast_count(ast); ++n)
     {
@@ -573,20 +590,47 @@ resolve_cmd_overloads(
         if (ast_type_info(ast, n) == TYPE_INVALID)
             continue;
 
-        /* Collect all overloads of the command */
-        candidates_clear(candidates);
-        if (create_candidates_list(&candidates, cmds, ast->nodes[n].cmd.id)
-            != 0)
-        {
-            goto fail;
-        }
-
         /* Count number of arguments in the AST */
         ctx.arglist = ast->nodes[n].cmd.arglist;
         ctx.argcount = 0;
+        arg_types_clear(arg_types);
         for (arglist = ast->nodes[n].cmd.arglist; arglist > -1;
              arglist = ast->nodes[arglist].arglist.next)
+        {
+            ast_id expr = ast->nodes[arglist].arglist.expr;
+            if (arg_types_push(&arg_types, ast_type_info(ast, expr)) != 0)
+                goto fail;
             ctx.argcount++;
+        }
+
+        /* The same commands tend to be called with the same argument types
+         * over and over again. If the command was resolved for these types
+         * before, in any TU, the same overload is chosen again */
+        first_overload = ast->nodes[n].cmd.id;
+        cached = overload_cache_find(
+            overloads,
+            first_overload,
+            ctx.argcount ? vec_first(arg_types) : NULL,
+            ctx.argcount);
+        if (cached > -1)
+        {
+            ast->nodes[n].cmd.id = cached;
+            if (typecheck_warnings(astp, n, plugins, cmds, filename, source)
+                != 0)
+            {
+                goto fail;
+            }
+
+            ast = *astp;
+            continue;
+        }
+
+        /* Collect all overloads of the command */
+        if (create_candidates_list(&candidates, cmds, overloads, first_overload)
+            != 0)
+        {
+            goto fail;
+        }
 
         /* Determine min and max number of parameters of all overloads. This is
          * used later for error reporting */
@@ -594,9 +638,7 @@ resolve_cmd_overloads(
         param_max = 0;
         vec_for_each(candidates, cmdp)
         {
-            const struct cmd_param_types_list* params
-                = cmds->param_types->data[*cmdp];
-            int param_count = cmd_param_types_list_count(params);
+            int param_count = cmd_param_count(cmds, *cmdp);
             if (param_count < param_min)
                 param_min = param_count;
             if (param_count > param_max)
@@ -641,6 +683,16 @@ resolve_cmd_overloads(
             ast->nodes[n].cmd.id = candidates_count(candidates) == 1
                                        ? *vec_first(candidates)
                                        : *vec_first(prev_candidates);
+            if (overload_cache_add(
+                    overloads,
+                    first_overload,
+                    ctx.argcount ? vec_first(arg_types) : NULL,
+                    ctx.argcount,
+                    ast->nodes[n].cmd.id)
+                != 0)
+            {
+                goto fail;
+            }
             if (typecheck_warnings(astp, n, plugins, cmds, filename, source)
                 != 0)
             {
@@ -709,11 +761,13 @@ resolve_cmd_overloads(
         goto fail;
     }
 
+    arg_types_deinit(arg_types);
     candidates_deinit(prev_candidates);
     candidates_deinit(candidates);
     return 0;
 
 fail:
+    arg_types_deinit(arg_types);
     candidates_deinit(prev_candidates);
     candidates_deinit(candidates);
     return -1;
@@ -722,4 +776,4 @@ fail:
 static const struct semantic_check* depends[] = {&semantic_type_check, NULL};
 
 const struct semantic_check semantic_resolve_cmd_overloads
-    = {resolve_cmd_overloads, depends, "resolve_cmd_overloads"};
+    = {resolve_cmd_overloads, depends, "resolve_cmd_overloads", 0, NULL};
@@ -0,0 +1,734 @@
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "odb-compiler/ast/ast.h"
+#include "odb-compiler/semantic/passes.h"
+#include "odb-compiler/semantic/semantic.h"
+#include "odb-compiler/semantic/session.h"
+#include "odb-util/log.h"
+#include "odb-util/mem.h"
+#include "odb-util/mutex.h"
+#include "odb-util/thread.h"
+#include "odb-util/time.h"
+}
+
+/* A task that has to finish before another one can run. If "check" is not
+ * NULL, the dependent relies on that check of the task, and is skipped if it
+ * failed. Otherwise, the dependent only has to run after the task */
+struct edge
+{
+    int                          task;
+    const struct semantic_check* check;
+};
+
+/* A (pass, TU) pair. Tasks are stored in the order of the passes, with all
+ * TUs of a pass next to each other */
+struct task
+{
+    const struct semantic_pass* pass;
+    int                         tu_id;
+    /* Number of tasks that have to finish before this one can run */
+    std::atomic<int> pending;
+    /* Set if a check this one depends on failed or was skipped */
+    std::atomic<int> skip;
+    /* Bitmask of the checks of the pass that failed or were skipped. Only
+     * accessed by the worker running the task */
+    int               failed_checks;
+    std::vector<edge> dependents;
+};
+
+/* Each worker pushes and pops the tasks it made ready at the back of its own
+ * queue. Idle workers steal from the front of the other queues */
+struct task_queue
+{
+    struct mutex*   mutex;
+    std::deque<int> tasks;
+};
+
+struct semantic_sched;
+
+struct worker
+{
+    struct semantic_sched* sched;
+    struct thread*         thread;
+    struct task_queue      queue;
+    int                    id;
+};
+
+struct semantic_sched
+{
+    struct ast**               tus;
+    int                        tu_count;
+    struct mutex**             tu_mutexes;
+    const struct utf8*         filenames;
+    const struct db_source*    sources;
+    const struct plugin_list*  plugins;
+    const struct cmd_list*     cmds;
+    /* NULL if the TUs are still being parsed. The cross-TU passes then look up
+     * the declarations semantic_sched_tu_ready() adds to the session */
+    const struct symbol_table* symbols;
+    struct semantic_session*   session;
+
+    struct semantic_passes* passes;
+    std::vector<task>       tasks;
+    std::vector<worker>     workers;
+    int                     started;
+    std::atomic<int>        remaining;
+    std::atomic<int>        failed;
+    std::atomic<int>        steals;
+
+    /* Workers with nothing to do sleep on "work_available" until a task is
+     * pushed or all tasks finished. "queued" counts the tasks in all queues */
+    struct mutex*    idle_mutex;
+    struct cond*     work_available;
+    std::atomic<int> queued;
+    /* Cross-TU tasks may wait for other TUs to be prepared, so they never
+     * occupy all workers. Guarded by "idle_mutex". Tasks that would exceed
+     * "max_cross_tasks" are deferred until a running one finishes */
+    int              cross_tasks;
+    int              max_cross_tasks;
+    std::vector<int> deferred;
+
+    /* The first pass of each TU waits for the TU to be parsed. The flags make
+     * sure each gate is only opened once */
+    struct mutex*     gate_mutex;
+    std::vector<char> tu_gates_open;
+    int               tu_gates_opened;
+    /* None of the passes of a TU that failed to parse run */
+    std::vector<char> tu_failed;
+
+    uint64_t              start_us;
+    std::vector<uint64_t> tu_busy_us;
+    std::vector<uint64_t> tu_done_us;
+};
+
+static int
+has_cross_tu_check(const struct semantic_pass* pass)
+{
+    int i;
+    for (i = 0; i != pass->count; ++i)
+        if (pass->checks[i]->flags & SEMANTIC_CHECK_CROSS_TU)
+            return 1;
+    return 0;
+}
+
+static int
+is_cross_tu(
+    const struct semantic_sched* sched, const struct semantic_pass* pass)
+{
+    return sched->tu_count > 1 && has_cross_tu_check(pass);
+}
+
+static void
+add_edge(
+    struct semantic_sched*       sched,
+    int                          from,
+    int                          to,
+    const struct semantic_check* check)
+{
+    sched->tasks[from].dependents.push_back({to, check});
+    sched->tasks[to].pending++;
+}
+
+/* Tasks on the same TU can't run at the same time anyway, because most passes
+ * modify the AST. They are chained in the same order semantic_check_run()
+ * would run them, since some checks rely on running after checks they don't
+ * explicitly depend on (e.g. loop_for creates nodes after scope IDs were
+ * calculated). A failed check only skips the checks depending on it, so that
+ * an error in one TU doesn't keep the cross-TU passes of the other TUs from
+ * running.
+ *
+ * A cross-TU pass only depends on the passes of its own TU. It waits for the
+ * other TUs it looks into by itself, see semantic_session_wait_for_tu(). The
+ * passes after it depend on it for all TUs, because it may modify any TU */
+static void
+build_graph(struct semantic_sched* sched, const struct semantic_passes* passes)
+{
+    const struct semantic_check** dep;
+    const struct semantic_pass*   pass;
+    int                           p, dep_pass, i, tu_id, u;
+
+    vec_enumerate(passes, p, pass)
+        for (tu_id = 0; tu_id != sched->tu_count; ++tu_id)
+        {
+            int          id = p * sched->tu_count + tu_id;
+            struct task* task = &sched->tasks[id];
+
+            task->pass = pass;
+            task->tu_id = tu_id;
+            task->pending = 0;
+            task->skip = 0;
+            task->failed_checks = 0;
+
+            for (i = 0; i != pass->count; ++i)
+                for (dep = pass->checks[i]->depends_on; *dep != NULL; ++dep)
+                {
+                    /* Dependencies within the same pass are taken care of by
+                     * the order the pass visits the nodes in */
+                    dep_pass = semantic_passes_find(passes, *dep);
+                    if (dep_pass == p)
+                        continue;
+
+                    if (is_cross_tu(sched, vec_get(passes, dep_pass)))
+                    {
+                        for (u = 0; u != sched->tu_count; ++u)
+                            add_edge(
+                                sched, dep_pass * sched->tu_count + u, id, *dep);
+                    }
+                    else
+                        add_edge(
+                            sched, dep_pass * sched->tu_count + tu_id, id, *dep);
+                }
+
+            /* Edges that duplicate a dependency are harmless */
+            if (p > 0)
+                add_edge(sched, id - sched->tu_count, id, NULL);
+            else
+                task->pending++; /* Waits for the TU to be parsed */
+        }
+}
+
+static void
+push_task(struct semantic_sched* sched, struct task_queue* queue, int task)
+{
+    mutex_lock(queue->mutex);
+    queue->tasks.push_back(task);
+    mutex_unlock(queue->mutex);
+
+    /* Idle workers check "queued" with the idle mutex locked, so they either
+     * see the new task or are already waiting for the signal */
+    sched->queued++;
+    mutex_lock(sched->idle_mutex);
+    cond_signal(sched->work_available);
+    mutex_unlock(sched->idle_mutex);
+}
+
+static int
+pop_task(struct semantic_sched* sched, struct task_queue* queue)
+{
+    int task = -1;
+    mutex_lock(queue->mutex);
+    if (!queue->tasks.empty())
+    {
+        task = queue->tasks.back();
+        queue->tasks.pop_back();
+    }
+    mutex_unlock(queue->mutex);
+
+    if (task > -1)
+        sched->queued--;
+    return task;
+}
+
+static int
+steal_task(struct worker* thief)
+{
+    struct semantic_sched* sched = thief->sched;
+    int                    i, task = -1;
+
+    for (i = 1; i != (int)sched->workers.size() && task < 0; ++i)
+    {
+        struct task_queue* queue
+            = &sched->workers[(thief->id + i) % sched->workers.size()].queue;
+        mutex_lock(queue->mutex);
+        if (!queue->tasks.empty())
+        {
+            task = queue->tasks.front();
+            queue->tasks.pop_front();
+        }
+        mutex_unlock(queue->mutex);
+    }
+
+    if (task > -1)
+    {
+        sched->queued--;
+        sched->steals++;
+    }
+    return task;
+}
+
+static void
+wait_for_work(struct semantic_sched* sched)
+{
+    mutex_lock(sched->idle_mutex);
+    while (sched->queued == 0 && sched->remaining > 0)
+        cond_wait(sched->work_available, sched->idle_mutex);
+    mutex_unlock(sched->idle_mutex);
+}
+
+static int
+run_task(struct semantic_sched* sched, struct task* task)
+{
+    struct ast** astp = &sched->tus[task->tu_id];
+
+    /* A warning was already logged for empty TUs */
+    if (ast_count(*astp) == 0)
+        return 0;
+
+    if (is_cross_tu(sched, task->pass))
+    {
+        task->failed_checks = semantic_pass_run(
+            task->pass,
+            sched->tus,
+            sched->tu_count,
+            task->tu_id,
+            sched->tu_mutexes,
+            sched->filenames,
+            sched->sources,
+            sched->plugins,
+            sched->cmds,
+            sched->symbols,
+            sched->session);
+        return task->failed_checks == 0 ? 0 : -1;
+    }
+
+    /* Tasks on the same TU are chained, so the TU can only be held by a
+     * cross-TU check of another TU, which releases it before waiting */
+    mutex_lock(sched->tu_mutexes[task->tu_id]);
+    mem_acquire_ast(*astp);
+
+    task->failed_checks = semantic_pass_run(
+        task->pass,
+        sched->tus,
+        sched->tu_count,
+        task->tu_id,
+        sched->tu_mutexes,
+        sched->filenames,
+        sched->sources,
+        sched->plugins,
+        sched->cmds,
+        sched->symbols,
+        sched->session);
+
+    mem_release_ast(*astp);
+    mutex_unlock(sched->tu_mutexes[task->tu_id]);
+
+    return task->failed_checks == 0 ? 0 : -1;
+}
+
+static void
+release_task(
+    struct semantic_sched* sched, struct task_queue* queue, int id, int skip)
+{
+    struct task* task = &sched->tasks[id];
+    if (skip)
+        task->skip = 1;
+    if (--task->pending != 0)
+        return;
+
+    /* Everything the cross-TU checks rely on is done, so the cross-TU tasks of
+     * other TUs can look into this TU now */
+    if (is_cross_tu(sched, task->pass))
+        semantic_session_tu_prepared(
+            sched->session,
+            task->tu_id,
+            task->skip || sched->tu_failed[task->tu_id]);
+    push_task(sched, queue, id);
+}
+
+/* Returns 0 if the task was deferred */
+static int
+start_cross_task(struct semantic_sched* sched, int id)
+{
+    int started = 0;
+    mutex_lock(sched->idle_mutex);
+    if (sched->cross_tasks < sched->max_cross_tasks)
+    {
+        sched->cross_tasks++;
+        started = 1;
+    }
+    else
+        sched->deferred.push_back(id);
+    mutex_unlock(sched->idle_mutex);
+    return started;
+}
+
+static void
+finish_cross_task(struct worker* worker)
+{
+    struct semantic_sched* sched = worker->sched;
+    int                    id = -1;
+
+    mutex_lock(sched->idle_mutex);
+    sched->cross_tasks--;
+    if (!sched->deferred.empty())
+    {
+        id = sched->deferred.back();
+        sched->deferred.pop_back();
+    }
+    mutex_unlock(sched->idle_mutex);
+
+    if (id > -1)
+        push_task(sched, &worker->queue, id);
+}
+
+static int
+check_failed(const struct task* task, const struct semantic_check* check)
+{
+    int i;
+    for (i = 0; i != task->pass->count; ++i)
+        if (task->pass->checks[i] == check)
+            return task->failed_checks & (1 << i);
+    return 0;
+}
+
+static void
+finish_task(struct worker* worker, struct task* task)
+{
+    struct semantic_sched* sched = worker->sched;
+
+    for (const struct edge& edge : task->dependents)
+        release_task(
+            sched,
+            &worker->queue,
+            edge.task,
+            edge.check != NULL && check_failed(task, edge.check));
+
+    /* Wake up the idle workers so they can exit */
+    if (--sched->remaining == 0)
+    {
+        mutex_lock(sched->idle_mutex);
+        cond_broadcast(sched->work_available);
+        mutex_unlock(sched->idle_mutex);
+    }
+}
+
+static void*
+sched_worker(void* arg)
+{
+    struct worker*         worker = (struct worker*)arg;
+    struct semantic_sched* sched = worker->sched;
+
+    if (mem_init() != 0)
+        return (void*)-1;
+
+    while (sched->remaining > 0)
+    {
+        struct task* task;
+        uint64_t     start_us;
+        int          cross_tu;
+        int          id = pop_task(sched, &worker->queue);
+        if (id < 0)
+            id = steal_task(worker);
+        if (id < 0)
+        {
+            wait_for_work(sched);
+            continue;
+        }
+
+        task = &sched->tasks[id];
+        if (task->skip || sched->tu_failed[task->tu_id])
+        {
+            task->failed_checks = (1 << task->pass->count) - 1;
+            finish_task(worker, task);
+            continue;
+        }
+
+        cross_tu = is_cross_tu(sched, task->pass);
+        if (cross_tu && !start_cross_task(sched, id))
+            continue;
+
+        start_us = time_get_us();
+        if (run_task(sched, task) != 0)
+            sched->failed = 1;
+        /* Tasks on the same TU never overlap */
+        sched->tu_done_us[task->tu_id] = time_get_us();
+        sched->tu_busy_us[task->tu_id]
+            += sched->tu_done_us[task->tu_id] - start_us;
+
+        if (cross_tu)
+            finish_cross_task(worker);
+        finish_task(worker, task);
+    }
+
+    mem_deinit();
+    return NULL;
+}
+
+static void
+open_tu_gate(struct semantic_sched* sched, int tu_id, int failed)
+{
+    int all_open;
+
+    mutex_lock(sched->gate_mutex);
+    if (sched->tu_gates_open[tu_id])
+    {
+        mutex_unlock(sched->gate_mutex);
+        return;
+    }
+    sched->tu_gates_open[tu_id] = 1;
+    sched->tu_failed[tu_id] = failed;
+    all_open = ++sched->tu_gates_opened == sched->tu_count;
+    mutex_unlock(sched->gate_mutex);
+
+    if (failed)
+        sched->failed = 1;
+    /* Every TU that was parsed added its declarations before its gate was
+     * opened, so symbols that weren't found until now don't exist */
+    if (all_open)
+        semantic_session_symbols_complete(sched->session);
+
+    /* The first pass of the TU has the same ID as the TU */
+    release_task(
+        sched,
+        &sched->workers[tu_id % sched->workers.size()].queue,
+        tu_id,
+        failed);
+}
+
+static struct semantic_sched*
+start(
+    const struct semantic_check* check,
+    struct ast**                 tus,
+    int                          tu_count,
+    struct mutex**               tu_mutexes,
+    const struct utf8*           filenames,
+    const struct db_source*      sources,
+    const struct plugin_list*    plugins,
+    const struct cmd_list*       cmds,
+    const struct symbol_table*   symbols,
+    struct semantic_session*     session)
+{
+    struct semantic_sched* sched;
+    int                    id;
+    int worker_count = (int)std::thread::hardware_concurrency();
+    /* A worker is kept free for the passes the cross-TU tasks wait for */
+    int min_workers = tu_count > 1 ? 2 : 1;
+
+    if (semantic_session_begin(session, tu_count) != 0)
+        return NULL;
+
+    sched = new semantic_sched;
+    sched->tus = tus;
+    sched->tu_count = tu_count;
+    sched->tu_mutexes = tu_mutexes;
+    sched->filenames = filenames;
+    sched->sources = sources;
+    sched->plugins = plugins;
+    sched->cmds = cmds;
+    sched->symbols = symbols;
+    sched->session = session;
+    sched->failed = 0;
+    sched->steals = 0;
+    sched->queued = 0;
+    sched->cross_tasks = 0;
+    sched->tu_gates_open = std::vector<char>(tu_count, 0);
+    sched->tu_gates_opened = 0;
+    sched->tu_failed = std::vector<char>(tu_count, 0);
+    sched->tu_busy_us = std::vector<uint64_t>(tu_count, 0);
+    sched->tu_done_us = std::vector<uint64_t>(tu_count, 0);
+    sched->start_us = time_get_us();
+
+    sched->gate_mutex = mutex_create();
+    if (sched->gate_mutex == NULL)
+        goto create_gate_mutex_failed;
+    sched->idle_mutex = mutex_create();
+    if (sched->idle_mutex == NULL)
+        goto create_idle_mutex_failed;
+    sched->work_available = cond_create();
+    if (sched->work_available == NULL)
+        goto create_cond_failed;
+
+    semantic_passes_init(&sched->passes);
+    if (semantic_passes_build(&sched->passes, check, NULL) != 0)
+        goto build_passes_failed;
+
+    sched->tasks
+        = std::vector<task>(semantic_passes_count(sched->passes) * tu_count);
+    sched->remaining = (int)sched->tasks.size();
+    build_graph(sched, sched->passes);
+
+    if (worker_count > (int)sched->tasks.size())
+        worker_count = (int)sched->tasks.size();
+    if (worker_count < min_workers)
+        worker_count = min_workers;
+    sched->workers = std::vector<worker>(worker_count);
+    for (id = 0; id != worker_count; ++id)
+    {
+        struct worker* worker = &sched->workers[id];
+        worker->sched = sched;
+        worker->id = id;
+        worker->queue.mutex = mutex_create();
+        if (worker->queue.mutex == NULL)
+            goto create_queue_mutex_failed;
+    }
+
+    /* Nothing can run yet, so the workers idle until the first TU is ready */
+    for (sched->started = 0; sched->started != worker_count; ++sched->started)
+    {
+        struct worker* worker = &sched->workers[sched->started];
+        worker->thread = thread_start(sched_worker, worker);
+        if (worker->thread == NULL)
+            break;
+    }
+    /* The workers that did start steal the tasks of the ones that didn't */
+    if (sched->started < min_workers)
+    {
+        log_semantic_err("Failed to start semantic check threads\n");
+        goto start_threads_failed;
+    }
+    sched->max_cross_tasks = sched->started - (min_workers - 1);
+
+    return sched;
+
+start_threads_failed:
+create_queue_mutex_failed:
+    while (id-- > 0)
+        mutex_destroy(sched->workers[id].queue.mutex);
+build_passes_failed:
+    semantic_passes_deinit(sched->passes);
+    cond_destroy(sched->work_available);
+create_cond_failed:
+    mutex_destroy(sched->idle_mutex);
+create_idle_mutex_failed:
+    mutex_destroy(sched->gate_mutex);
+create_gate_mutex_failed:
+    delete sched;
+    return NULL;
+}
+
+struct semantic_sched*
+semantic_sched_start(
+    const struct semantic_check* check,
+    struct ast**                 tus,
+    int                          tu_count,
+    struct mutex**               tu_mutexes,
+    const struct utf8*           filenames,
+    const struct db_source*      sources,
+    const struct plugin_list*    plugins,
+    const struct cmd_list*       cmds,
+    struct semantic_session*     session)
+{
+    return start(
+        check,
+        tus,
+        tu_count,
+        tu_mutexes,
+        filenames,
+        sources,
+        plugins,
+        cmds,
+        NULL,
+        session);
+}
+
+void
+semantic_sched_tu_ready(struct semantic_sched* sched, int tu_id)
+{
+    int          result;
+    struct ast** astp = &sched->tus[tu_id];
+
+    /* Many checks look up the parent of a node */
+    mem_acquire_ast(*astp);
+    if (ast_count(*astp) == 0)
+        log_semantic_warn(
+            "AST is empty for source file {quote:%s}\n",
+            utf8_cstr(sched->filenames[tu_id]));
+    result = ast_parents_build(*astp);
+    mem_release_ast(*astp);
+
+    /* Without a symbol table, the cross-TU passes look up the declarations
+     * in the session */
+    if (sched->symbols == NULL
+        && semantic_session_add_declarations(
+               sched->session, sched->tus, tu_id, sched->sources)
+               != 0)
+        result = -1;
+
+    open_tu_gate(sched, tu_id, result != 0);
+}
+
+void
+semantic_sched_tu_failed(struct semantic_sched* sched, int tu_id)
+{
+    open_tu_gate(sched, tu_id, 1);
+}
+
+int
+semantic_sched_finish(struct semantic_sched* sched)
+{
+    int id, tu_id, result = 0;
+
+    /* Whatever was never made ready can't be checked */
+    for (tu_id = 0; tu_id != sched->tu_count; ++tu_id)
+        open_tu_gate(sched, tu_id, 1);
+
+    for (id = 0; id != sched->started; ++id)
+        if (thread_join(sched->workers[id].thread) != NULL)
+            result = -1;
+
+    if (result == 0)
+    {
+        log_semantic_info(
+            "Ran %d passes on %d source files with %d threads, %d tasks "
+            "stolen, finished after {emph:%.3f} ms\n",
+            semantic_passes_count(sched->passes),
+            sched->tu_count,
+            sched->started,
+            (int)sched->steals,
+            (double)(time_get_us() - sched->start_us) / 1000.0);
+        for (tu_id = 0; tu_id != sched->tu_count; ++tu_id)
+            if (sched->tu_done_us[tu_id] != 0)
+                log_semantic_info(
+                    "Checked {emph:%s} in %.3f ms, finished after %.3f ms\n",
+                    utf8_cstr(sched->filenames[tu_id]),
+                    (double)sched->tu_busy_us[tu_id] / 1000.0,
+                    (double)(sched->tu_done_us[tu_id] - sched->start_us)
+                        / 1000.0);
+    }
+
+    if (sched->failed)
+        result = -1;
+
+    for (id = 0; id != (int)sched->workers.size(); ++id)
+        mutex_destroy(sched->workers[id].queue.mutex);
+    semantic_passes_deinit(sched->passes);
+    cond_destroy(sched->work_available);
+    mutex_destroy(sched->idle_mutex);
+    mutex_destroy(sched->gate_mutex);
+    delete sched;
+
+    return result;
+}
+
+int
+semantic_check_run_parallel(
+    const struct semantic_check* check,
+    struct ast**                 tus,
+    int                          tu_count,
+    struct mutex**               tu_mutexes,
+    const struct utf8*           filenames,
+    const struct db_source*      sources,
+    const struct plugin_list*    plugins,
+    const struct cmd_list*       cmds,
+    const struct symbol_table*   symbols,
+    struct semantic_session*     session)
+{
+    struct semantic_sched* sched;
+    int                    tu_id;
+
+    if (tu_count == 0)
+        return 0;
+
+    sched = start(
+        check,
+        tus,
+        tu_count,
+        tu_mutexes,
+        filenames,
+        sources,
+        plugins,
+        cmds,
+        symbols,
+        session);
+    if (sched == NULL)
+        return -1;
+
+    for (tu_id = 0; tu_id != tu_count; ++tu_id)
+        semantic_sched_tu_ready(sched, tu_id);
+
+    return semantic_sched_finish(sched);
+}
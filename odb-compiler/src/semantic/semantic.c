@@ -1,89 +1,9 @@
 #include "odb-compiler/ast/ast.h"
+#include "odb-compiler/semantic/passes.h"
 #include "odb-compiler/semantic/semantic.h"
-#include "odb-util/hash.h"
-#include "odb-util/hm.h"
+#include "odb-util/mutex.h"
 #include <assert.h>
 
-struct ptr_set_kvs
-{
-    const struct semantic_check** keys;
-};
-static hash32
-ptr_kvs_hash(const struct semantic_check* key)
-{
-    return hash32_aligned_ptr((uintptr_t)key);
-}
-static int
-ptr_kvs_alloc(
-    struct ptr_set_kvs* kvs, struct ptr_set_kvs* old_kvs, int16_t capacity)
-{
-    kvs->keys = mem_alloc(sizeof(*kvs->keys) * capacity);
-    return kvs->keys == NULL ? -1 : 0;
-}
-static void
-ptr_kvs_free_old(struct ptr_set_kvs* kvs)
-{
-    mem_free(kvs->keys);
-}
-static void
-ptr_kvs_free(struct ptr_set_kvs* kvs)
-{
-    mem_free(kvs->keys);
-}
-static const struct semantic_check*
-ptr_kvs_get_key(const struct ptr_set_kvs* kvs, int16_t slot)
-{
-    return kvs->keys[slot];
-}
-static int
-ptr_kvs_set_key(
-    struct ptr_set_kvs* kvs, int16_t slot, const struct semantic_check* key)
-{
-    kvs->keys[slot] = key;
-    return 0;
-}
-static int
-ptr_kvs_keys_equal(
-    const struct semantic_check* k1, const struct semantic_check* k2)
-{
-    return k1 == k2;
-}
-static void**
-ptr_kvs_get_value(const struct ptr_set_kvs* kvs, int16_t slot)
-{
-    return (void**)1; // So insert_new() returns success
-}
-static void
-ptr_kvs_set_value(struct ptr_set_kvs* kvs, int16_t slot, void** value)
-{
-}
-
-HM_DECLARE_API_FULL(
-    static,
-    ptr_set,
-    hash32,
-    const struct semantic_check*,
-    void*,
-    16,
-    struct ptr_set_kvs)
-HM_DEFINE_API_FULL(
-    ptr_set,
-    hash32,
-    const struct semantic_check*,
-    void*,
-    16,
-    ptr_kvs_hash,
-    ptr_kvs_alloc,
-    ptr_kvs_free_old,
-    ptr_kvs_free,
-    ptr_kvs_get_key,
-    ptr_kvs_set_key,
-    ptr_kvs_keys_equal,
-    ptr_kvs_get_value,
-    ptr_kvs_set_value,
-    32,
-    70)
-
 struct ctx
 {
     struct ast**               tus;
@@ -95,26 +15,44 @@ struct ctx
     const struct plugin_list*  plugins;
     const struct cmd_list*     cmds;
     const struct symbol_table* symbols;
+    struct semantic_session*   session;
 };
 
 static int
-run_dependencies(
-    struct ctx*                   ctx,
-    const struct semantic_check** dependencies,
-    struct ptr_set**              visited);
-
-static int
-run_check(
-    struct ctx*                  ctx,
-    const struct semantic_check* check,
-    struct ptr_set**             visited)
+run_checks(
+    const struct semantic_check*  check,
+    const struct semantic_check** already_run,
+    struct ctx*                   ctx)
 {
-    if (run_dependencies(ctx, check->depends_on, visited) < 0)
+    struct semantic_passes* passes;
+    struct semantic_pass*   pass;
+    int                     result;
+    struct ast**            astp = &ctx->tus[ctx->tu_id];
+    struct utf8             filename = ctx->filenames[ctx->tu_id];
+
+    if (ast_count(*astp) == 0)
+    {
+        log_semantic_warn(
+            "AST is empty for source file {quote:%s}\n", utf8_cstr(filename));
+        return 0;
+    }
+
+    /* Many checks look up the parent of a node. Other threads may instantiate
+     * functions into this AST, which is why it has to be locked */
+    mutex_lock(ctx->tu_mutexes[ctx->tu_id]);
+    result = ast_parents_build(*astp);
+    mutex_unlock(ctx->tu_mutexes[ctx->tu_id]);
+    if (result != 0)
         return -1;
 
-    if (ptr_set_emplace_new(visited, check) != NULL)
+    semantic_passes_init(&passes);
+    if (semantic_passes_build(&passes, check, already_run) != 0)
+        goto fail;
+
+    vec_for_each(passes, pass)
     {
-        if (check->execute(
+        if (semantic_pass_run(
+                pass,
                 ctx->tus,
                 ctx->tu_count,
                 ctx->tu_id,
@@ -123,26 +61,20 @@ run_check(
                 ctx->sources,
                 ctx->plugins,
                 ctx->cmds,
-                ctx->symbols)
-            < 0)
+                ctx->symbols,
+                ctx->session)
+            != 0)
         {
-            return -1;
+            goto fail;
         }
     }
 
+    semantic_passes_deinit(passes);
     return 0;
-}
-static int
-run_dependencies(
-    struct ctx*                   ctx,
-    const struct semantic_check** dependencies,
-    struct ptr_set**              visited)
-{
-    const struct semantic_check** check;
-    for (check = dependencies; *check != NULL; ++check)
-        if (run_check(ctx, *check, visited) != 0)
-            return -1;
-    return 0;
+
+fail:
+    semantic_passes_deinit(passes);
+    return -1;
 }
 
 int
@@ -156,12 +88,10 @@ semantic_check_run(
     const struct db_source*      sources,
     const struct plugin_list*    plugins,
     const struct cmd_list*       cmds,
-    const struct symbol_table*   symbols)
+    const struct symbol_table*   symbols,
+    struct semantic_session*     session)
 {
-    struct ptr_set* check_visited;
-    struct ast**    astp = &tus[tu_id];
-    struct utf8     filename = filenames[tu_id];
-    struct ctx      ctx
+    struct ctx ctx
         = {tus,
            tu_count,
            tu_id,
@@ -170,25 +100,10 @@ semantic_check_run(
            sources,
            plugins,
            cmds,
-           symbols};
-
-    if (ast_count(*astp) == 0)
-    {
-        log_semantic_warn(
-            "AST is empty for source file {quote:%s}\n", utf8_cstr(filename));
-        return 0;
-    }
-
-    ptr_set_init(&check_visited);
+           symbols,
+           session};
 
-    if (run_check(&ctx, check, &check_visited) < 0)
-    {
-        ptr_set_deinit(check_visited);
-        return -1;
-    }
-
-    ptr_set_deinit(check_visited);
-    return 0;
+    return run_checks(check, NULL, &ctx);
 }
 
 static int
@@ -201,11 +116,126 @@ dummy_check(
     const struct db_source*    sources,
     const struct plugin_list*  plugins,
     const struct cmd_list*     cmds,
-    const struct symbol_table* symbols)
+    const struct symbol_table* symbols,
+    struct semantic_session*   session)
 {
     return 0;
 }
 
+static const struct semantic_check* essential_checks[]
+    = {&semantic_type_check,
+       &semantic_resolve_cmd_overloads,
+       &semantic_loop_exit,
+       &semantic_loop_cont,
+       &semantic_loop_for,
+       NULL};
+static const struct semantic_check essential_check
+    = {dummy_check, essential_checks, "essential_checks", 0, NULL};
+
+int
+semantic_log_essential_passes(void)
+{
+    return semantic_log_passes(&essential_check);
+}
+
+int
+semantic_run_essential_checks_parallel(
+    struct ast**               tus,
+    int                        tu_count,
+    struct mutex**             tu_mutexes,
+    const struct utf8*         filenames,
+    const struct db_source*    sources,
+    const struct plugin_list*  plugins,
+    const struct cmd_list*     cmds,
+    const struct symbol_table* symbols,
+    struct semantic_session*   session)
+{
+    return semantic_check_run_parallel(
+        &essential_check,
+        tus,
+        tu_count,
+        tu_mutexes,
+        filenames,
+        sources,
+        plugins,
+        cmds,
+        symbols,
+        session);
+}
+
+struct semantic_sched*
+semantic_sched_start_essential_checks(
+    struct ast**              tus,
+    int                       tu_count,
+    struct mutex**            tu_mutexes,
+    const struct utf8*        filenames,
+    const struct db_source*   sources,
+    const struct plugin_list* plugins,
+    const struct cmd_list*    cmds,
+    struct semantic_session*  session)
+{
+    return semantic_sched_start(
+        &essential_check,
+        tus,
+        tu_count,
+        tu_mutexes,
+        filenames,
+        sources,
+        plugins,
+        cmds,
+        session);
+}
+
+int
+semantic_run_essential_step(
+    enum semantic_step         step,
+    struct ast**               tus,
+    int                        tu_count,
+    int                        tu_id,
+    struct mutex**             tu_mutexes,
+    const struct utf8*         filenames,
+    const struct db_source*    sources,
+    const struct plugin_list*  plugins,
+    const struct cmd_list*     cmds,
+    const struct symbol_table* symbols,
+    struct semantic_session*   session)
+{
+    static const struct semantic_check* type_check_done[]
+        = {&semantic_type_check, NULL};
+
+    struct ctx ctx
+        = {tus,
+           tu_count,
+           tu_id,
+           tu_mutexes,
+           filenames,
+           sources,
+           plugins,
+           cmds,
+           symbols,
+           session};
+
+    switch (step)
+    {
+        case SEMANTIC_STEP_PREPARE: {
+            struct semantic_check prepare_check
+                = {dummy_check,
+                   semantic_type_check.depends_on,
+                   "prepare_type_check",
+                   0,
+                   NULL};
+            return run_checks(&prepare_check, NULL, &ctx);
+        }
+        case SEMANTIC_STEP_TYPE_CHECK:
+            return run_checks(
+                &semantic_type_check, semantic_type_check.depends_on, &ctx);
+        case SEMANTIC_STEP_FINISH:
+            return run_checks(&essential_check, type_check_done, &ctx);
+    }
+
+    return -1;
+}
+
 int
 semantic_run_essential_checks(
     struct ast**               tus,
@@ -216,20 +246,50 @@ semantic_run_essential_checks(
     const struct db_source*    sources,
     const struct plugin_list*  plugins,
     const struct cmd_list*     cmds,
-    const struct symbol_table* symbols)
+    const struct symbol_table* symbols,
+    struct semantic_session*   session)
 {
-    static const struct semantic_check* essential_checks[]
-        = {&semantic_type_check,
-           &semantic_resolve_cmd_overloads,
-           &semantic_loop_exit,
-           &semantic_loop_cont,
-           &semantic_loop_for,
-           NULL};
-    static const struct semantic_check essential_check
-        = {dummy_check, essential_checks, "essential_checks"};
-
-    return semantic_check_run(
-        &essential_check,
+    int result;
+
+    if (semantic_run_essential_step(
+            SEMANTIC_STEP_PREPARE,
+            tus,
+            tu_count,
+            tu_id,
+            tu_mutexes,
+            filenames,
+            sources,
+            plugins,
+            cmds,
+            symbols,
+            session)
+        != 0)
+    {
+        return -1;
+    }
+
+    /* See SEMANTIC_STEP_TYPE_CHECK */
+    if (tu_count > 1)
+        mem_release_ast(tus[tu_id]);
+    result = semantic_run_essential_step(
+        SEMANTIC_STEP_TYPE_CHECK,
+        tus,
+        tu_count,
+        tu_id,
+        tu_mutexes,
+        filenames,
+        sources,
+        plugins,
+        cmds,
+        symbols,
+        session);
+    if (tu_count > 1)
+        mem_acquire_ast(tus[tu_id]);
+    if (result != 0)
+        return -1;
+
+    return semantic_run_essential_step(
+        SEMANTIC_STEP_FINISH,
         tus,
         tu_count,
         tu_id,
@@ -238,5 +298,6 @@ semantic_run_essential_checks(
         sources,
         plugins,
         cmds,
-        symbols);
+        symbols,
+        session);
 }
@@ -0,0 +1,281 @@
+#include "odb-compiler/semantic/func_table.h"
+#include "odb-compiler/semantic/overload_cache.h"
+#include "odb-compiler/semantic/session.h"
+#include "odb-compiler/semantic/symbol_table.h"
+#include "odb-util/log.h"
+#include "odb-util/mem.h"
+#include "odb-util/mutex.h"
+#include "odb-util/vec.h"
+#include <string.h>
+
+enum tu_state
+{
+    TU_PENDING,
+    TU_PREPARED,
+    TU_FAILED
+};
+
+VEC_DECLARE_API(static, tu_states, char, 32)
+VEC_DEFINE_API(tu_states, char, 32)
+
+struct semantic_session
+{
+    struct func_table*     funcs;
+    struct overload_cache* overloads;
+
+    /* Guards everything below. "changed" is broadcast whenever a TU was
+     * prepared or declarations were added */
+    struct mutex*        mutex;
+    struct cond*         changed;
+    struct tu_states*    tu_states;
+    struct symbol_table* symbols;
+    int                  generation;
+    char                 symbols_complete;
+};
+
+/* The containers are modified by many threads. Between calls, none of them owns
+ * their memory */
+static void
+mem_acquire_containers(struct semantic_session* session)
+{
+#if defined(ODBUTIL_MEM_DEBUGGING)
+    if (session->tu_states)
+        mem_acquire(
+            session->tu_states,
+            offsetof(struct tu_states, data)
+                + sizeof(session->tu_states->data[0])
+                      * session->tu_states->capacity);
+    mem_acquire_symbol_table(session->symbols);
+#else
+    (void)session;
+#endif
+}
+
+static void
+mem_release_containers(struct semantic_session* session)
+{
+#if defined(ODBUTIL_MEM_DEBUGGING)
+    mem_release_symbol_table(session->symbols);
+    if (session->tu_states)
+        mem_release(session->tu_states);
+#else
+    (void)session;
+#endif
+}
+
+static void
+lock(struct semantic_session* session)
+{
+    mutex_lock(session->mutex);
+    mem_acquire_containers(session);
+}
+
+static void
+unlock(struct semantic_session* session)
+{
+    mem_release_containers(session);
+    mutex_unlock(session->mutex);
+}
+
+static void
+wait(struct semantic_session* session)
+{
+    mem_release_containers(session);
+    cond_wait(session->changed, session->mutex);
+    mem_acquire_containers(session);
+}
+
+struct semantic_session*
+semantic_session_create(void)
+{
+    struct semantic_session* session = mem_alloc(sizeof(*session));
+    if (session == NULL)
+        goto alloc_session_failed;
+
+    session->funcs = func_table_create();
+    if (session->funcs == NULL)
+        goto create_funcs_failed;
+
+    session->overloads = overload_cache_create();
+    if (session->overloads == NULL)
+        goto create_overloads_failed;
+
+    session->mutex = mutex_create();
+    if (session->mutex == NULL)
+        goto create_mutex_failed;
+    session->changed = cond_create();
+    if (session->changed == NULL)
+        goto create_cond_failed;
+
+    tu_states_init(&session->tu_states);
+    symbol_table_init(&session->symbols);
+    /* Until semantic_session_begin() is called, nothing is being parsed */
+    session->generation = 0;
+    session->symbols_complete = 1;
+
+    return session;
+
+create_cond_failed:
+    mutex_destroy(session->mutex);
+create_mutex_failed:
+    overload_cache_destroy(session->overloads);
+create_overloads_failed:
+    func_table_destroy(session->funcs);
+create_funcs_failed:
+    mem_free(session);
+alloc_session_failed:
+    log_oom(sizeof(*session), "semantic_session_create()");
+    return NULL;
+}
+
+void
+semantic_session_destroy(struct semantic_session* session)
+{
+    mem_acquire_containers(session);
+    symbol_table_deinit(session->symbols);
+    tu_states_deinit(session->tu_states);
+    cond_destroy(session->changed);
+    mutex_destroy(session->mutex);
+    overload_cache_destroy(session->overloads);
+    func_table_destroy(session->funcs);
+    mem_free(session);
+}
+
+struct func_table*
+semantic_session_funcs(struct semantic_session* session)
+{
+    return session->funcs;
+}
+
+struct overload_cache*
+semantic_session_overloads(struct semantic_session* session)
+{
+    return session->overloads;
+}
+
+int
+semantic_session_begin(struct semantic_session* session, int tu_count)
+{
+    lock(session);
+    symbol_table_deinit(session->symbols);
+    symbol_table_init(&session->symbols);
+    session->generation = 0;
+    session->symbols_complete = 0;
+    if (tu_states_resize(&session->tu_states, tu_count) != 0)
+    {
+        unlock(session);
+        return -1;
+    }
+    if (tu_count > 0)
+        memset(session->tu_states->data, TU_PENDING, tu_count);
+    unlock(session);
+
+    return 0;
+}
+
+void
+semantic_session_tu_prepared(
+    struct semantic_session* session, int tu_id, int failed)
+{
+    lock(session);
+    if (tu_id < tu_states_count(session->tu_states))
+        *vec_get(session->tu_states, tu_id) = failed ? TU_FAILED : TU_PREPARED;
+    cond_broadcast(session->changed);
+    unlock(session);
+}
+
+int
+semantic_session_wait_for_tu(struct semantic_session* session, int tu_id)
+{
+    enum tu_state state = TU_PREPARED;
+
+    lock(session);
+    if (tu_id < tu_states_count(session->tu_states))
+    {
+        while (*vec_get(session->tu_states, tu_id) == TU_PENDING)
+            wait(session);
+        state = *vec_get(session->tu_states, tu_id);
+    }
+    unlock(session);
+
+    return state == TU_PREPARED ? 0 : -1;
+}
+
+int
+semantic_session_add_declarations(
+    struct semantic_session* session,
+    struct ast**             tus,
+    int                      tu_id,
+    const struct db_source*  sources)
+{
+    struct symbol_table* staged;
+    int                  result;
+
+    /* The declarations are collected without holding the lock, so lookups
+     * only wait for the merge */
+    symbol_table_init(&staged);
+    if (symbol_table_add_declarations_from_ast(&staged, tus, tu_id, sources)
+        != 0)
+    {
+        symbol_table_deinit(staged);
+        return -1;
+    }
+
+    lock(session);
+    result = symbol_table_merge(&session->symbols, staged);
+    session->generation++;
+    cond_broadcast(session->changed);
+    unlock(session);
+
+    symbol_table_deinit(staged);
+    return result;
+}
+
+void
+semantic_session_symbols_complete(struct semantic_session* session)
+{
+    lock(session);
+    session->symbols_complete = 1;
+    cond_broadcast(session->changed);
+    unlock(session);
+}
+
+int
+semantic_session_find_symbol(
+    struct semantic_session*   session,
+    struct utf8_view           key,
+    struct symbol_table_entry* entry,
+    int*                       generation)
+{
+    const struct symbol_table_entry* found;
+    int                              result = -1;
+
+    lock(session);
+    if (!session->symbols_complete)
+    {
+        found = symbol_table_find(session->symbols, key);
+        if (found)
+            *entry = *found;
+        *generation = session->generation;
+        result = found ? 1 : 0;
+    }
+    unlock(session);
+
+    return result;
+}
+
+void
+semantic_session_wait_for_symbols(
+    struct semantic_session* session, int generation)
+{
+    lock(session);
+    while (!session->symbols_complete && session->generation == generation)
+        wait(session);
+    unlock(session);
+}
+
+struct symbol_table*
+semantic_session_symbols(struct semantic_session* session)
+{
+    return session->symbols;
+}
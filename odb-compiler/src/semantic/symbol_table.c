@@ -4,6 +4,7 @@
 #include "odb-compiler/semantic/symbol_table.h"
 #include "odb-util/hash.h"
 #include "odb-util/hm.h"
+#include "odb-util/log.h"
 #include "odb-util/mem.h"
 
 struct kvs_key_data
@@ -203,12 +204,63 @@ symbol_table_add_declarations_from_ast(
     return 0;
 }
 
+int
+symbol_table_merge(
+    struct symbol_table** table, const struct symbol_table* other)
+{
+    struct utf8_view           key;
+    struct symbol_table_entry* other_entry;
+    struct symbol_table_entry* entry;
+    if (other == NULL)
+        return 0;
+
+    hm_for_each_full(&other->hm, key, other_entry, kvs_get_key, kvs_get_value)
+    {
+        switch (hm_emplace_or_get((struct hm**)table, key, &entry))
+        {
+            case HM_OOM: return -1;
+            case HM_EXISTS:
+                /* Merging the same table more than once is harmless, but two
+                 * TUs declaring the same symbol is not */
+                if (entry->tu_id != other_entry->tu_id
+                    || entry->ast_node != other_entry->ast_node)
+                {
+                    log_semantic_err(
+                        "Symbol {emph:%.*s} is declared more than once\n",
+                        key.len,
+                        key.data + key.off);
+                    return -1;
+                }
+                break;
+            case HM_NEW: *entry = *other_entry; break;
+        }
+    }
+
+    return 0;
+}
+
 const struct symbol_table_entry*
 symbol_table_find(const struct symbol_table* table, struct utf8_view key)
 {
     return hm_find(&table->hm, key);
 }
 
+void
+symbol_table_remap_tu(
+    struct symbol_table* table, int tu_id, const ast_id* remap)
+{
+    struct utf8_view           key;
+    struct symbol_table_entry* entry;
+    if (table == NULL)
+        return;
+
+    hm_for_each_full(&table->hm, key, entry, kvs_get_key, kvs_get_value)
+    {
+        if (entry->tu_id == tu_id)
+            entry->ast_node = remap[entry->ast_node];
+    }
+}
+
 void
 mem_acquire_symbol_table(struct symbol_table* table)
 {
@@ -4,7 +4,9 @@
 #include "odb-compiler/ast/ast_ops.h"
 #include "odb-compiler/messages/messages.h"
 #include "odb-compiler/parser/db_source.h"
+#include "odb-compiler/semantic/func_table.h"
 #include "odb-compiler/semantic/semantic.h"
+#include "odb-compiler/semantic/session.h"
 #include "odb-compiler/semantic/symbol_table.h"
 #include "odb-compiler/semantic/type.h"
 #include "odb-util/config.h"
@@ -16,11 +18,6 @@
 #include "odb-util/vec.h"
 #include <assert.h>
 
-struct span_scope
-{
-    struct utf8_span span;
-    int16_t          scope;
-};
 struct view_scope
 {
     struct utf8_view view;
@@ -32,8 +29,8 @@ struct type_origin
     ast_id    original_declaration;
 };
 
-VEC_DECLARE_API(static, spanlist, struct span_scope, 32)
-VEC_DEFINE_API(spanlist, struct span_scope, 32)
+VEC_DECLARE_API(static, spanlist, struct utf8_span, 32)
+VEC_DEFINE_API(spanlist, struct utf8_span, 32)
 
 struct stack_entry
 {
@@ -65,6 +62,22 @@ stack_erase_node(struct stack* stack, ast_id node)
         }
 }
 
+/* Indexes the functions that were instantiated from polymorphic functions.
+ * The key packs the AST_FUNC_POLY node into the upper 32 bits, and a hash of
+ * the argument types passed to its polymorphic parameters into the lower 32
+ * bits. See lookup_func_instantiation().
+ */
+HM_DECLARE_API(static, instmap, uint64_t, ast_id, 32)
+HM_DEFINE_API(instmap, uint64_t, ast_id, 32)
+
+/* The types of the arguments passed to a function, in order */
+VEC_DECLARE_API(static, typelist, enum type, 32)
+VEC_DEFINE_API(typelist, enum type, 32)
+
+/* The parameters of the function being called */
+VEC_DECLARE_API(static, paramsig, struct func_param, 32)
+VEC_DEFINE_API(paramsig, struct func_param, 32)
+
 /* The "typemap" is used to track the types of variables. When a variable first
  * appears, it is inserted into the typemap and its type is determined based on
  * the context surrounding it. If the variable is later referenced, then the
@@ -72,22 +85,29 @@ stack_erase_node(struct stack* stack, ast_id node)
  *
  * The "text" field references the source text. The spanlist contains
  * utf8_span's that index into the source code. Because it's possible to have
- * the same variable name in a different scope, the key also contains the
- * current scope (0=global, 1, 2, 3, ... = nesting) such that the same variable
- * name hashes to a different value if it is in a different scope.
+ * the same variable name in a different scope, every scope (0=global, 1, 2,
+ * 3, ... = functions) gets its own typemap. See struct scoped_typemap.
  */
+struct typemap_stats
+{
+    int32_t lookups;
+    int32_t probes;
+    int32_t max_probes;
+};
 struct typemap_kvs
 {
     const char*         text;
     struct spanlist*    keys;
     struct type_origin* values;
+#if defined(ODBCOMPILER_TYPE_CHECK_STATS)
+    struct typemap_stats stats;
+#endif
 };
 
 static hash32
-typemap_kvs_hash(struct view_scope key)
+typemap_kvs_hash(struct utf8_view key)
 {
-    return hash32_jenkins_oaat(key.view.data + key.view.off, key.view.len)
-           + key.scope;
+    return hash32_jenkins_oaat(key.data + key.off, key.len);
 }
 static int
 typemap_kvs_alloc(
@@ -104,6 +124,12 @@ typemap_kvs_alloc(
         return log_oom(sizeof(enum type) * capacity, "typemap_kvs_alloc()");
     }
 
+#if defined(ODBCOMPILER_TYPE_CHECK_STATS)
+    kvs->stats.lookups = 0;
+    kvs->stats.probes = 0;
+    kvs->stats.max_probes = 0;
+#endif
+
     return 0;
 }
 static void
@@ -118,33 +144,27 @@ typemap_kvs_free(struct typemap_kvs* kvs)
     mem_free(kvs->values);
     spanlist_deinit(kvs->keys);
 }
-static struct view_scope
+static struct utf8_view
 typemap_kvs_get_key(const struct typemap_kvs* kvs, int32_t slot)
 {
     ODBUTIL_DEBUG_ASSERT(kvs->text != NULL, (void)0);
-    struct span_scope span_scope = kvs->keys->data[slot];
-    struct utf8_view  view = utf8_span_view(kvs->text, span_scope.span);
-    struct view_scope view_scope = {view, span_scope.scope};
-    return view_scope;
+    return utf8_span_view(kvs->text, kvs->keys->data[slot]);
 }
 static int
 typemap_kvs_set_key(
-    struct typemap_kvs* kvs, int32_t slot, struct view_scope key)
+    struct typemap_kvs* kvs, int32_t slot, struct utf8_view key)
 {
-    ODBUTIL_DEBUG_ASSERT(
-        kvs->text == NULL || kvs->text == key.view.data, (void)0);
+    ODBUTIL_DEBUG_ASSERT(kvs->text == NULL || kvs->text == key.data, (void)0);
 
-    kvs->text = key.view.data;
-    struct utf8_span  span = utf8_view_span(kvs->text, key.view);
-    struct span_scope span_scope = {span, key.scope};
-    kvs->keys->data[slot] = span_scope;
+    kvs->text = key.data;
+    kvs->keys->data[slot] = utf8_view_span(kvs->text, key);
 
     return 0;
 }
 static int
-typemap_kvs_keys_equal(struct view_scope k1, struct view_scope k2)
+typemap_kvs_keys_equal(struct utf8_view k1, struct utf8_view k2)
 {
-    return k1.scope == k2.scope && utf8_equal(k1.view, k2.view);
+    return utf8_equal(k1, k2);
 }
 static struct type_origin*
 typemap_kvs_get_value(const struct typemap_kvs* kvs, int32_t slot)
@@ -158,18 +178,33 @@ typemap_kvs_set_value(
     kvs->values[slot] = *value;
 }
 
+#if defined(ODBCOMPILER_TYPE_CHECK_STATS)
+static void
+typemap_kvs_count_lookup(const struct typemap_kvs* kvs, int32_t probes)
+{
+    /* Lookups only have const access to the hashmap */
+    struct typemap_stats* stats = (struct typemap_stats*)&kvs->stats;
+    stats->lookups++;
+    stats->probes += probes;
+    if (stats->max_probes < probes)
+        stats->max_probes = probes;
+}
+#   undef HM_ON_LOOKUP
+#   define HM_ON_LOOKUP(hm, probes) typemap_kvs_count_lookup(&(hm)->kvs, probes)
+#endif
+
 HM_DECLARE_API_FULL(
     static,
     typemap,
     hash32,
-    struct view_scope,
+    struct utf8_view,
     struct type_origin,
     32,
     struct typemap_kvs)
 HM_DEFINE_API_FULL(
     typemap,
     hash32,
-    struct view_scope,
+    struct utf8_view,
     struct type_origin,
     32,
     typemap_kvs_hash,
@@ -184,26 +219,118 @@ HM_DEFINE_API_FULL(
     32,
     70)
 
+/* The typemaps of all scopes that are currently being type checked. Scopes are
+ * entered and left in a stack-like order: When a function is called, its body
+ * is type checked before continuing with the caller. Once a function has been
+ * fully type checked its variables can no longer be referenced, and the
+ * typemap of its scope is freed. Leaving a scope therefore only costs as much
+ * as the number of variables that were declared in it, and no tombstones are
+ * left behind for other scopes to probe past.
+ */
+struct typemap_scope
+{
+    int32_t         scope;
+    struct typemap* typemap;
+};
+
+VEC_DECLARE_API(static, scopelist, struct typemap_scope, 32)
+VEC_DEFINE_API(scopelist, struct typemap_scope, 32)
+
+struct scoped_typemap
+{
+    struct scopelist* scopes;
+#if defined(ODBCOMPILER_TYPE_CHECK_STATS)
+    struct typemap_stats stats;
+    int32_t              scope_count;
+#endif
+};
+
 static void
-typemap_clear_all_with_scope(struct typemap* hm, int16_t scope)
+scoped_typemap_init(struct scoped_typemap* stm)
 {
-    int slot;
-    for (slot = 0; slot != typemap_capacity(hm); ++slot)
+    scopelist_init(&stm->scopes);
+#if defined(ODBCOMPILER_TYPE_CHECK_STATS)
+    stm->stats.lookups = 0;
+    stm->stats.probes = 0;
+    stm->stats.max_probes = 0;
+    stm->scope_count = 0;
+#endif
+}
+
+static void
+scoped_typemap_deinit(struct scoped_typemap* stm)
+{
+    struct typemap_scope* s;
+    vec_for_each(stm->scopes, s)
     {
-        if (hm->hashes[slot] == HM_SLOT_UNUSED
-            || hm->hashes[slot] == HM_SLOT_RIP)
-        {
-            continue;
-        }
+        typemap_deinit(s->typemap);
+    }
+    scopelist_deinit(stm->scopes);
+}
 
-        if (vec_get(hm->kvs.keys, slot)->scope == scope)
+static enum hm_status
+scoped_typemap_emplace_or_get(
+    struct scoped_typemap* stm,
+    struct view_scope      key,
+    struct type_origin**   value)
+{
+    struct typemap_scope* s = NULL;
+    enum hm_status        status;
+    int32_t               i = scopelist_count(stm->scopes);
+
+    /* This is almost always the scope on top of the stack */
+    while (i--)
+        if (vec_get(stm->scopes, i)->scope == key.scope)
         {
-            hm->hashes[slot] = HM_SLOT_RIP;
-            hm->count--;
+            s = vec_get(stm->scopes, i);
+            break;
         }
+
+    if (s == NULL)
+    {
+        s = scopelist_emplace(&stm->scopes);
+        if (s == NULL)
+            return HM_OOM;
+        s->scope = key.scope;
+        typemap_init(&s->typemap);
+#if defined(ODBCOMPILER_TYPE_CHECK_STATS)
+        stm->scope_count++;
+#endif
     }
+
+    status = typemap_emplace_or_get(&s->typemap, key.view, value);
+
+#if defined(ODBCOMPILER_TYPE_CHECK_STATS)
+    /* Growing the typemap resets its counters, so collect them after every
+     * lookup */
+    if (s->typemap != NULL)
+    {
+        struct typemap_stats* stats = &s->typemap->kvs.stats;
+        stm->stats.lookups += stats->lookups;
+        stm->stats.probes += stats->probes;
+        if (stm->stats.max_probes < stats->max_probes)
+            stm->stats.max_probes = stats->max_probes;
+        stats->lookups = 0;
+        stats->probes = 0;
+        stats->max_probes = 0;
+    }
+#endif
+
+    return status;
 }
 
+static void
+scoped_typemap_leave(struct scoped_typemap* stm, int32_t scope)
+{
+    int32_t i = scopelist_count(stm->scopes);
+    while (i--)
+        if (vec_get(stm->scopes, i)->scope == scope)
+        {
+            typemap_deinit(vec_get(stm->scopes, i)->typemap);
+            scopelist_erase(stm->scopes, i);
+            break;
+        }
+}
 static int
 cast_expr_to_boolean(
     struct ast** astp,
@@ -233,6 +360,7 @@ cast_expr_to_boolean(
                 ast->nodes[parent].base.left = cast;
             if (ast->nodes[parent].base.right == n)
                 ast->nodes[parent].base.right = cast;
+            ast_set_parent(ast, cast, parent);
 
             return 0;
         }
@@ -306,11 +434,144 @@ balanced_type_conversion(const struct ast* ast, ast_id lhs, ast_id rhs)
 
 enum process_result
 {
+    /* The node depends on a function that another type check is busy with, or
+     * on a symbol that wasn't declared yet because its TU is still being
+     * parsed. The node is processed again once the function is done or more
+     * declarations were added. See wait_for_func() and find_symbol() */
+    DEP_BUSY = 2,
     DEP_ADDED = 1,
     DEP_OK = 0,
     DEP_ERROR = -1,
 };
 
+/* State of a single type_check() call. It is shared with the traversals it
+ * runs in other TUs, to check the functions it calls there */
+struct check_ctx
+{
+    /* Only used if there are multiple TUs, otherwise NULL */
+    struct func_table* funcs;
+    int                owner;
+
+    /* If the type check wasn't given a symbol table, the symbols are looked up
+     * in the session while the TUs are still being parsed. Once all
+     * declarations were added, the session's table is used directly */
+    struct semantic_session*   session;
+    const struct symbol_table* symbols;
+    int                        symbols_seen;
+    /* Set if DEP_BUSY is waiting for declarations instead of a function */
+    char                       symbols_pending;
+
+    /* Scratch buffers for function calls */
+    struct typelist* arg_types;
+    struct paramsig* params;
+
+    /* Calls to functions in other TUs, and how many of those functions had to
+     * be checked first because no signature was published for them yet */
+    int extern_calls, extern_checks;
+    /* How often a function was busy in another type check, and how often a TU
+     * was locked by another thread */
+    int busy_waits, lock_waits;
+
+#if defined(ODBCOMPILER_TYPE_CHECK_STATS)
+    struct typemap_stats typemap_stats;
+    int32_t              scope_count;
+#endif
+};
+
+static void
+check_ctx_init(
+    struct check_ctx*        ctx,
+    struct func_table*       funcs,
+    int                      owner,
+    struct semantic_session* session)
+{
+    ctx->funcs = funcs;
+    ctx->owner = owner;
+    ctx->session = session;
+    ctx->symbols = NULL;
+    ctx->symbols_seen = 0;
+    ctx->symbols_pending = 0;
+    typelist_init(&ctx->arg_types);
+    paramsig_init(&ctx->params);
+    ctx->extern_calls = 0;
+    ctx->extern_checks = 0;
+    ctx->busy_waits = 0;
+    ctx->lock_waits = 0;
+#if defined(ODBCOMPILER_TYPE_CHECK_STATS)
+    ctx->typemap_stats.lookups = 0;
+    ctx->typemap_stats.probes = 0;
+    ctx->typemap_stats.max_probes = 0;
+    ctx->scope_count = 0;
+#endif
+}
+
+static void
+check_ctx_deinit(struct check_ctx* ctx)
+{
+    paramsig_deinit(ctx->params);
+    typelist_deinit(ctx->arg_types);
+}
+
+/* Locking a TU also takes over the memory of its AST, because other threads
+ * may have reallocated it in the meantime. If another type check holds the TU,
+ * it hands the TU over once it finished the function it is checking */
+static void
+lock_tu(
+    struct check_ctx* ctx, struct ast** tus, struct mutex** tu_mutexes, int tu)
+{
+    if (!mutex_trylock(tu_mutexes[tu]))
+    {
+        ctx->lock_waits++;
+        if (func_table_want_tu(ctx->funcs, tu) == 0)
+        {
+            mutex_lock(tu_mutexes[tu]);
+            func_table_got_tu(ctx->funcs, tu);
+        }
+        else
+            mutex_lock(tu_mutexes[tu]);
+    }
+    mem_acquire_ast(tus[tu]);
+}
+
+static void
+unlock_tu(struct ast** tus, struct mutex** tu_mutexes, int tu)
+{
+    mem_release_ast(tus[tu]);
+    mutex_unlock(tu_mutexes[tu]);
+}
+
+static enum process_result
+recursive_extern_call(
+    const char* filename, const char* source, struct utf8_span location)
+{
+    log_flc_err(
+        filename,
+        source,
+        location,
+        "Functions in different source files are recursively calling each "
+        "other. This is not supported yet.\n");
+    log_excerpt_1(source, location, "", 0);
+    return DEP_ERROR;
+}
+
+/* The traversal releases its TU and blocks until the function is done, see
+ * check_subtree(). The other type check may have to lock the TU to finish the
+ * function */
+static enum process_result
+wait_for_func(
+    struct check_ctx* ctx,
+    int               tu_id,
+    ast_id            func,
+    const char*       filename,
+    const char*       source,
+    struct utf8_span  location)
+{
+    if (func_table_wait(ctx->funcs, ctx->owner, tu_id, func) == 0)
+        return DEP_BUSY;
+
+    return recursive_extern_call(filename, source, location);
+}
+
 static enum process_result
 process_block(struct stack** stack, struct ast* ast, ast_id block)
 {
@@ -440,12 +701,12 @@ process_command(
 
 static enum process_result
 process_assignment(
-    struct stack**   stack,
-    struct ast**     astp,
-    ast_id           ass,
-    const char*      filename,
-    const char*      source,
-    struct typemap** typemap)
+    struct stack**         stack,
+    struct ast**           astp,
+    ast_id                 ass,
+    const char*            filename,
+    const char*            source,
+    struct scoped_typemap* typemap)
 {
     ast_id  lhs, rhs;
     int32_t top = stack_count(*stack);
@@ -474,8 +735,8 @@ process_assignment(
             = utf8_span_view(source, (*astp)->nodes[lhs].identifier.name);
         struct view_scope lhs_name_scope
             = {lhs_name, (*astp)->nodes[lhs].info.scope_id};
-        enum hm_status lhs_insertion
-            = typemap_emplace_or_get(typemap, lhs_name_scope, &lhs_type);
+        enum hm_status lhs_insertion = scoped_typemap_emplace_or_get(
+            typemap, lhs_name_scope, &lhs_type);
         switch (lhs_insertion)
         {
             case HM_OOM: return DEP_ERROR;
@@ -549,6 +810,7 @@ process_assignment(
             if (cast < -1)
                 return DEP_ERROR;
             (*astp)->nodes[ass].assignment.expr = cast;
+            ast_set_parent(*astp, cast, ass);
             (*astp)->nodes[cast].info.type_info = lhs_type->type;
         }
     }
@@ -562,18 +824,18 @@ process_assignment(
 
 static int
 process_identifier(
-    struct stack**   stack,
-    struct ast**     astp,
-    ast_id           n,
-    const char*      filename,
-    const char*      source,
-    struct typemap** typemap)
+    struct stack**         stack,
+    struct ast**           astp,
+    ast_id                 n,
+    const char*            filename,
+    const char*            source,
+    struct scoped_typemap* typemap)
 {
     struct type_origin* type_origin;
     struct utf8_view    name
         = utf8_span_view(source, (*astp)->nodes[n].identifier.name);
     struct view_scope view_scope = {name, (*astp)->nodes[n].info.scope_id};
-    switch (typemap_emplace_or_get(typemap, view_scope, &type_origin))
+    switch (scoped_typemap_emplace_or_get(typemap, view_scope, &type_origin))
     {
         case HM_NEW: {
             struct utf8_span loc;
@@ -690,6 +952,7 @@ process_identifier(
                 if (init_ass == -1)
                     return -1;
                 (*astp)->nodes[init_block].block.stmt = init_ass;
+                ast_set_parent(*astp, init_ass, init_block);
 
                 /* Fill in type info */
                 (*astp)->nodes[init_lit].info.type_info = type_origin->type;
@@ -703,6 +966,7 @@ process_identifier(
 
                 ODBUTIL_DEBUG_ASSERT(parent == -1, (void)0);
                 (*astp)->nodes[init_block].block.next = (*astp)->root;
+                ast_set_parent(*astp, (*astp)->root, init_block);
                 (*astp)->root = init_block;
 
                 /* Fill in type info */
@@ -802,6 +1066,7 @@ process_binop(
                     (*astp)->nodes[binop].binop.left = cast;
                 else
                     (*astp)->nodes[binop].binop.right = cast;
+                ast_set_parent(*astp, cast, binop);
                 (*astp)->nodes[cast].info.type_info = conv.type;
             }
 
@@ -847,6 +1112,7 @@ process_binop(
                 if (cast_lhs < 0)
                     return DEP_ERROR;
                 (*astp)->nodes[binop].binop.left = cast_lhs;
+                ast_set_parent(*astp, cast_lhs, binop);
                 (*astp)->nodes[cast_lhs].info.type_info = base_target_type;
 
                 switch (type_convert(base_type, base_target_type))
@@ -894,6 +1160,7 @@ process_binop(
                 if (cast_rhs < 0)
                     return DEP_ERROR;
                 (*astp)->nodes[binop].binop.right = cast_rhs;
+                ast_set_parent(*astp, cast_rhs, binop);
                 (*astp)->nodes[cast_rhs].info.type_info = exp_target_type;
 
                 switch (type_convert(exp_type, exp_target_type))
@@ -999,6 +1266,7 @@ process_binop(
                     (*astp)->nodes[binop].binop.left = cast;
                 else
                     (*astp)->nodes[binop].binop.right = cast;
+                ast_set_parent(*astp, cast, binop);
                 (*astp)->nodes[cast].info.type_info = conv.type;
             }
 
@@ -1231,9 +1499,15 @@ process_func_return(
             return DEP_ERROR;
 
         if (ast_node_type(*astp, func_or_exit) == AST_FUNC)
+        {
             (*astp)->nodes[def].func_def.retval = cast;
+            ast_set_parent(*astp, cast, def);
+        }
         else
+        {
             (*astp)->nodes[func_or_exit].func_exit.retval = cast;
+            ast_set_parent(*astp, cast, func_or_exit);
+        }
 
         (*astp)->nodes[cast].info.type_info = current_ret_type;
 
@@ -1265,7 +1539,7 @@ process_func_return(
         struct utf8_span ret_loc
             = ast_node_type(*astp, func_or_exit) == AST_FUNC_EXIT
                   ? ast_loc(*astp, func_or_exit)
-                  : (*astp)->nodes[func].func.endfunction_location;
+                  : (*astp)->locs[func].endfunction_location;
         err_func_missing_return_value(*astp, func, ret_loc, filename, source);
         return -1;
     }
@@ -1311,14 +1585,55 @@ process_func_exit(
     return DEP_OK;
 }
 
+static int
+collect_params(struct check_ctx* ctx, const struct ast* ast, ast_id func)
+{
+    ast_id pl_param;
+    ast_id decl = ast->nodes[func].func.decl;
+
+    paramsig_clear(ctx->params);
+    for (pl_param = ast->nodes[decl].func_decl.paramlist; pl_param > -1;
+         pl_param = ast->nodes[pl_param].paramlist.next)
+    {
+        ast_id             param = ast->nodes[pl_param].paramlist.identifier;
+        struct func_param* p = paramsig_emplace(&ctx->params);
+        if (p == NULL)
+            return -1;
+        p->type = ast_type_info(ast, param);
+        p->type_location = ast->locs[param].explicit_type_location;
+    }
+
+    return 0;
+}
+
+/* Makes the signature of a checked function available to the type checks of
+ * other TUs */
+static int
+publish_func(
+    struct check_ctx* ctx, const struct ast* ast, int tu_id, ast_id func)
+{
+    if (collect_params(ctx, ast, func) != 0)
+        return -1;
+
+    return func_table_publish(
+        ctx->funcs,
+        tu_id,
+        func,
+        ast_type_info(ast, func),
+        ctx->params ? ctx->params->data : NULL,
+        paramsig_count(ctx->params));
+}
+
 static enum process_result
 process_func(
-    struct stack**   stack,
-    struct ast*      ast,
-    ast_id           func,
-    const char*      filename,
-    const char*      source,
-    struct typemap** typemap)
+    struct stack**         stack,
+    struct ast*            ast,
+    int                    tu_id,
+    ast_id                 func,
+    const char*            filename,
+    const char*            source,
+    struct scoped_typemap* typemap,
+    struct check_ctx*      ctx)
 {
     ast_id  decl, def, identifier, paramlist, body, ret;
     int32_t top = stack_count(*stack);
@@ -1338,6 +1653,25 @@ process_func(
     body = ast->nodes[def].func_def.body;
     ret = ast->nodes[def].func_def.retval;
 
+    /* With multiple TUs, the type check of another TU may be checking this
+     * function already */
+    if (ctx->funcs)
+        switch (func_table_claim(ctx->funcs, tu_id, func, ctx->owner))
+        {
+            case FUNC_UNCLAIMED:
+            case FUNC_OWNED: break;
+            case FUNC_BUSY:
+                return wait_for_func(
+                    ctx,
+                    tu_id,
+                    func,
+                    filename,
+                    source,
+                    ast_loc(ast, identifier));
+            case FUNC_CHECKED: stack_pop(*stack); return DEP_OK;
+            case FUNC_FAILED: return DEP_ERROR;
+        }
+
     if (ret > -1 && ast_type_info(ast, ret) == TYPE_INVALID)
         stack_push_entry(stack, ret);
     if (body > -1 && ast_type_info(ast, body) == TYPE_INVALID)
@@ -1386,6 +1720,18 @@ process_func(
     ast->nodes[identifier].info.type_info = ident_type;
     */
 
+    /* The parameters, body and return value have all been type checked, so
+     * nothing can reference the function's variables anymore */
+    if (paramlist > -1)
+        scoped_typemap_leave(typemap, ast->nodes[paramlist].info.scope_id);
+    else if (body > -1)
+        scoped_typemap_leave(typemap, ast->nodes[body].info.scope_id);
+    else if (ret > -1)
+        scoped_typemap_leave(typemap, ast->nodes[ret].info.scope_id);
+
+    if (ctx->funcs && publish_func(ctx, ast, tu_id, func) != 0)
+        return DEP_ERROR;
+
     stack_pop(*stack);
     return DEP_OK;
 }
@@ -1421,16 +1767,18 @@ instantiate_func(
     const ast_id func_poly,
     const char*  func_filename,
     const char*  func_source,
-    /* TU in which the call is being made (contains the arglist) */
-    struct ast**     call_astp,
-    const ast_id     call_arglist,
+    /* Types of the arguments passed to the function */
+    const enum type* arg_types,
+    int              arg_count,
+    /* TU in which the call is being made */
     struct utf8_span call_location,
     const char*      call_filename,
     const char*      call_source)
 {
     int32_t scope;
+    int     arg;
     ast_id  func, poly_block, func_block, decl, def, ret, body, paramlist,
-        pl_param, al_arg;
+        pl_param;
 
     ODBUTIL_DEBUG_ASSERT(
         ast_node_type((*func_astp), func_poly) == AST_FUNC_POLY,
@@ -1453,46 +1801,41 @@ instantiate_func(
     (*func_astp)->nodes[func_block].block.next
         = (*func_astp)->nodes[poly_block].block.next;
     (*func_astp)->nodes[poly_block].block.next = func_block;
+    ast_set_parent(
+        *func_astp, (*func_astp)->nodes[func_block].block.next, func_block);
+    ast_set_parent(*func_astp, func_block, poly_block);
 
     /* The arguments passed to the function determine the parameter types. We
      * copy them over here. Some polymorphic functions are "partial", i.e. one
      * parameter carries type information but another does not. In these cases
      * we must insert casts to the correct type. */
     decl = (*func_astp)->nodes[func].func.decl;
-    ODBUTIL_DEBUG_ASSERT(
-        call_arglist == -1
-            || ast_node_type((*call_astp), call_arglist) == AST_ARGLIST,
-        log_semantic_err(
-            "type: %d\n", ast_node_type((*call_astp), call_arglist)));
     paramlist = (*func_astp)->nodes[decl].func_decl.paramlist;
-    for (pl_param = paramlist, al_arg = call_arglist;
-         pl_param > -1 && al_arg > -1;
-         pl_param = (*func_astp)->nodes[pl_param].paramlist.next,
-        al_arg = (*call_astp)->nodes[al_arg].arglist.next)
+    for (pl_param = paramlist, arg = 0; pl_param > -1 && arg != arg_count;
+         pl_param = (*func_astp)->nodes[pl_param].paramlist.next, arg++)
     {
-        ast_id    param = (*func_astp)->nodes[pl_param].paramlist.identifier;
-        ast_id    arg = (*call_astp)->nodes[al_arg].arglist.expr;
-        enum type arg_type = ast_type_info((*call_astp), arg);
+        ast_id param = (*func_astp)->nodes[pl_param].paramlist.identifier;
 
         if ((*func_astp)->nodes[param].identifier.explicit_type == TYPE_INVALID)
         {
             /* This parameter has not been declared with an explicit type,
              * therefore it takes the type of the argument being passed in */
-            (*func_astp)->nodes[param].identifier.explicit_type = arg_type;
+            (*func_astp)->nodes[param].identifier.explicit_type
+                = arg_types[arg];
         }
     }
-    if (al_arg > -1 || pl_param > -1)
+    if (arg != arg_count || pl_param > -1)
     {
         int gutter;
         log_flc_err(
             call_filename,
             call_source,
             call_location,
-            al_arg > -1 ? "Too many arguments to function call.\n"
-                        : "Too few arguments to function call.\n");
+            arg != arg_count ? "Too many arguments to function call.\n"
+                             : "Too few arguments to function call.\n");
         gutter = log_excerpt_1(call_source, call_location, "", 0);
         log_excerpt_note(gutter, "Function has the following signature:\n");
-        log_excerpt_1(call_source, ast_loc(*func_astp, decl), "", 0);
+        log_excerpt_1(func_source, ast_loc(*func_astp, decl), "", 0);
         return -1;
     }
 
@@ -1515,14 +1858,68 @@ instantiate_func(
     return func;
 }
 
+/*!
+ * @brief Checks if an instantiation of a polymorphic function can be called
+ * with the given arguments. Only the parameters that are polymorphic have to
+ * match. Casts are inserted for the other parameters later.
+ */
+static int
+func_instantiation_matches(
+    const struct ast* func_ast,
+    ast_id            paramlist_poly,
+    ast_id            func,
+    const enum type*  arg_types,
+    int               arg_count)
+{
+    ast_id poly_pl_param, pl_param;
+    int    arg;
+    ast_id decl = func_ast->nodes[func].func.decl;
+
+    for (poly_pl_param = paramlist_poly,
+        pl_param = func_ast->nodes[decl].func_decl.paramlist,
+        arg = 0;
+         poly_pl_param > -1;
+         poly_pl_param = func_ast->nodes[poly_pl_param].paramlist.next,
+        pl_param = func_ast->nodes[pl_param].paramlist.next,
+        arg++)
+    {
+        ast_id    poly_param, param;
+        enum type param_type;
+
+        ODBUTIL_DEBUG_ASSERT(pl_param > -1, (void)0);
+        ODBUTIL_DEBUG_ASSERT(arg < arg_count, (void)0);
+
+        poly_param = func_ast->nodes[poly_pl_param].paramlist.identifier;
+        param = func_ast->nodes[pl_param].paramlist.identifier;
+        param_type = ast_type_info(func_ast, param);
+
+        if (param_type != arg_types[arg]
+            && func_ast->nodes[poly_param].identifier.explicit_type
+                   == TYPE_INVALID)
+        {
+            return 0;
+        }
+    }
+
+    ODBUTIL_DEBUG_ASSERT(
+        arg == arg_count,
+        log_semantic_err("arg: %d, count: %d\n", arg, arg_count));
+    ODBUTIL_DEBUG_ASSERT(
+        pl_param == -1,
+        log_semantic_err(
+            "node: %d, type: %d\n",
+            pl_param,
+            ast_node_type(func_ast, pl_param)));
+
+    return 1;
+}
+
 static ast_id
 find_func_instantiation(
-    /* TU in which the polymorphic function exists */
-    struct ast* func_ast,
-    ast_id      func_block,
-    /* TU in which the call is being made (contains the arglist) */
-    const struct ast* call_ast,
-    ast_id            call_arglist)
+    struct ast*      func_ast,
+    ast_id           func_block,
+    const enum type* arg_types,
+    int              arg_count)
 
 {
     ast_id           poly_func, identifier, paramlist_poly, poly_decl;
@@ -1533,11 +1930,6 @@ find_func_instantiation(
         ast_node_type(func_ast, func_block) == AST_BLOCK,
         log_semantic_err("type: %d\n", ast_node_type(func_ast, func_block)));
 
-    ODBUTIL_DEBUG_ASSERT(
-        call_arglist == -1
-            || ast_node_type(call_ast, call_arglist) == AST_ARGLIST,
-        log_semantic_err("type: %d\n", ast_node_type(call_ast, call_arglist)));
-
     poly_func = func_ast->nodes[func_block].block.stmt;
     ODBUTIL_DEBUG_ASSERT(
         ast_node_type(func_ast, poly_func) == AST_FUNC_POLY,
@@ -1553,7 +1945,7 @@ find_func_instantiation(
 
     while (1)
     {
-        ast_id func, decl, al_arg, pl_param, poly_pl_param;
+        ast_id func, decl;
         func_block = func_ast->nodes[func_block].block.next;
         if (func_block < 0)
             return -1;
@@ -1572,74 +1964,481 @@ find_func_instantiation(
             return -1;
         }
 
-        for (poly_pl_param = paramlist_poly,
-            pl_param = func_ast->nodes[decl].func_decl.paramlist,
-            al_arg = call_arglist;
-             poly_pl_param > -1;
-             poly_pl_param = func_ast->nodes[poly_pl_param].paramlist.next,
-            pl_param = func_ast->nodes[pl_param].paramlist.next,
-            al_arg = call_ast->nodes[al_arg].arglist.next)
+        if (func_instantiation_matches(
+                func_ast, paramlist_poly, func, arg_types, arg_count))
         {
-            ast_id    poly_param, param, arg;
-            enum type param_type, arg_type;
-
-            ODBUTIL_DEBUG_ASSERT(pl_param > -1, (void)0);
-            ODBUTIL_DEBUG_ASSERT(al_arg > -1, (void)0);
-
-            poly_param = func_ast->nodes[poly_pl_param].paramlist.identifier;
-            param = func_ast->nodes[pl_param].paramlist.identifier;
-            arg = call_ast->nodes[al_arg].arglist.expr;
-            param_type = ast_type_info(func_ast, param);
-            arg_type = ast_type_info(call_ast, arg);
-
-            if (param_type != arg_type
-                /* Casts are inserted later. This function only tries to find a
-                   matching instantiation on parameters that are polymorphic. */
-                && func_ast->nodes[poly_param].identifier.explicit_type
-                       == TYPE_INVALID)
-            {
-                goto no_match;
-            }
+            return func;
         }
+    }
+}
 
-        ODBUTIL_DEBUG_ASSERT(
-            al_arg == -1,
-            log_semantic_err(
-                "node: %d, type: %d\n",
-                al_arg,
-                ast_node_type(call_ast, al_arg)));
-        ODBUTIL_DEBUG_ASSERT(
-            pl_param == -1,
-            log_semantic_err(
-                "node: %d, type: %d\n",
-                pl_param,
-                ast_node_type(func_ast, pl_param)));
+/*!
+ * @brief Builds the key under which an instantiation is stored in the
+ * instantiation index. It is made up of the polymorphic function and the types
+ * of the arguments passed to its polymorphic parameters.
+ * @return Returns 0 on success, or -1 if the number of arguments doesn't match
+ * the number of parameters. In this case the function can't be called and no
+ * key is produced.
+ */
+static int
+func_instantiation_key(
+    const struct ast* func_ast,
+    ast_id            func_poly,
+    const enum type*  arg_types,
+    int               arg_count,
+    uint64_t*         key)
+{
+    ast_id pl_param;
+    int    arg;
+    ast_id decl = func_ast->nodes[func_poly].func_poly.decl;
+    hash32 h = 0;
+
+    for (pl_param = func_ast->nodes[decl].func_decl.paramlist, arg = 0;
+         pl_param > -1 && arg != arg_count;
+         pl_param = func_ast->nodes[pl_param].paramlist.next, arg++)
+    {
+        ast_id param = func_ast->nodes[pl_param].paramlist.identifier;
+        if (func_ast->nodes[param].identifier.explicit_type == TYPE_INVALID)
+            h = hash32_combine(h, arg_types[arg]);
+    }
+    if (pl_param > -1 || arg != arg_count)
+        return -1;
+
+    *key = ((uint64_t)(uint32_t)func_poly << 32) | h;
+    return 0;
+}
+
+/*!
+ * @brief Looks up an instantiation of a polymorphic function that can be
+ * called with the given arguments. The instantiation index is consulted
+ * first. If the index has no match, all instantiations are searched, and
+ * the result is added to the index.
+ */
+static ast_id
+lookup_func_instantiation(
+    struct instmap** instmap,
+    struct ast*      func_ast,
+    ast_id           func_poly,
+    const enum type* arg_types,
+    int              arg_count)
+{
+    uint64_t key;
+    ast_id*  cached;
+    ast_id   func;
+    ast_id   poly_decl = func_ast->nodes[func_poly].func_poly.decl;
+    ast_id   paramlist_poly = func_ast->nodes[poly_decl].func_decl.paramlist;
+
+    /* Let instantiate_func() report the wrong number of arguments */
+    if (func_instantiation_key(func_ast, func_poly, arg_types, arg_count, &key)
+        != 0)
+    {
+        return -1;
+    }
 
+    /* Different argument types can hash to the same key, so the cached
+     * instantiation still has to be verified */
+    cached = instmap_find(*instmap, key);
+    if (cached != NULL
+        && func_instantiation_matches(
+            func_ast, paramlist_poly, *cached, arg_types, arg_count))
+    {
+        return *cached;
+    }
+
+    func = find_func_instantiation(
+        func_ast, ast_find_parent(func_ast, func_poly), arg_types, arg_count);
+    if (func > -1)
+        instmap_insert_always(instmap, key, func);
+
+    return func;
+}
+
+static int
+collect_arg_types(struct check_ctx* ctx, const struct ast* ast, ast_id arglist)
+{
+    typelist_clear(ctx->arg_types);
+    for (; arglist > -1; arglist = ast->nodes[arglist].arglist.next)
+    {
+        ast_id expr = ast->nodes[arglist].arglist.expr;
+        if (typelist_push(&ctx->arg_types, ast_type_info(ast, expr)) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief Turns the node into a function call, and inserts casts for the
+ * arguments that don't match the types of the parameters.
+ * @param[in] func_source Source of the TU in which the function is defined.
+ * The parameter locations refer to it.
+ */
+static int
+apply_func_signature(
+    struct ast**             astp,
+    ast_id                   n,
+    enum type                ret_type,
+    const struct func_param* params,
+    int                      param_count,
+    const char*              func_source,
+    const char*              filename,
+    const char*              source)
+{
+    int    arg;
+    ast_id al_arg;
+    ast_id identifier = (*astp)->nodes[n].func_or_container_ref.identifier;
+    ast_id arglist = (*astp)->nodes[n].func_or_container_ref.arglist;
+
+    for (arg = 0, al_arg = arglist; arg != param_count && al_arg > -1;
+         arg++, al_arg = (*astp)->nodes[al_arg].arglist.next)
+    {
+        ast_id    cast;
+        ast_id    expr = (*astp)->nodes[al_arg].arglist.expr;
+        enum type param_type = params[arg].type;
+        enum type arg_type = ast_type_info(*astp, expr);
+
+        if (param_type == arg_type)
+            continue;
+
+        switch (type_convert(arg_type, param_type))
+        {
+            case TC_ALLOW: break;
+            case TC_DISALLOW:
+                err_func_call_incompatible_types(
+                    *astp,
+                    expr,
+                    param_type,
+                    params[arg].type_location,
+                    func_source,
+                    arg + 1,
+                    filename,
+                    source);
+                return -1;
+
+            case TC_SIGN_CHANGE:
+            case TC_TRUENESS:
+            case TC_INT_TO_FLOAT:
+            case TC_BOOL_PROMOTION:
+                warn_func_call_implicit_conversion(
+                    *astp,
+                    expr,
+                    param_type,
+                    params[arg].type_location,
+                    func_source,
+                    arg + 1,
+                    filename,
+                    source);
+                break;
+
+            case TC_TRUNCATE:
+                warn_func_call_truncation(
+                    *astp,
+                    expr,
+                    param_type,
+                    params[arg].type_location,
+                    func_source,
+                    arg + 1,
+                    filename,
+                    source);
+                break;
+        }
+
+        cast = ast_cast(astp, expr, param_type, ast_loc(*astp, expr));
+        if (cast < 0)
+            return -1;
+        (*astp)->nodes[al_arg].arglist.expr = cast;
+        ast_set_parent(*astp, cast, al_arg);
+        (*astp)->nodes[cast].info.type_info = param_type;
+    }
+    if (arg != param_count || al_arg > -1)
+    {
+        log_flc_err(
+            filename,
+            source,
+            ast_loc(*astp, n),
+            al_arg > -1 ? "Too many arguments to function call.\n"
+                        : "Too few arguments to function call.\n");
+        log_excerpt_1(source, ast_loc(*astp, n), "", 0);
+        return -1;
+    }
+
+    (*astp)->nodes[n].info.node_type = AST_FUNC_CALL;
+    (*astp)->nodes[n].info.type_info = ret_type;
+    (*astp)->nodes[identifier].info.type_info = ret_type;
+
+    return 0;
+}
+
+static int
+check_subtree(
+    struct ast**               tus,
+    int                        tu_id,
+    ast_id                     root,
+    struct mutex**             tu_mutexes,
+    const struct utf8*         filenames,
+    const struct db_source*    sources,
+    const struct cmd_list*     cmds,
+    const struct symbol_table* symbols,
+    struct check_ctx*          ctx);
+
+/* Called with the TU of the polymorphic function locked */
+static ast_id
+instantiate_extern_func(
+    struct ast**      tus,
+    int               func_tu,
+    ast_id            func_poly,
+    const char*       func_filename,
+    const char*       func_source,
+    struct utf8_span  call_location,
+    const char*       call_filename,
+    const char*       call_source,
+    struct check_ctx* ctx)
+{
+    uint64_t         key;
+    const enum type* arg_types = ctx->arg_types ? ctx->arg_types->data : NULL;
+    int              arg_count = typelist_count(ctx->arg_types);
+    ast_id           func = -1;
+
+    /* Another thread may have instantiated the function while the TU was
+     * unlocked, or the TU's own type check may have */
+    func = func_table_find_instance(
+        ctx->funcs, func_tu, func_poly, arg_types, arg_count);
+    if (func > -1)
         return func;
+    if (func_instantiation_key(
+            tus[func_tu], func_poly, arg_types, arg_count, &key)
+        == 0)
+    {
+        func = find_func_instantiation(
+            tus[func_tu],
+            ast_find_parent(tus[func_tu], func_poly),
+            arg_types,
+            arg_count);
+    }
+    if (func < 0)
+    {
+        func = instantiate_func(
+            &tus[func_tu],
+            func_poly,
+            func_filename,
+            func_source,
+            arg_types,
+            arg_count,
+            call_location,
+            call_filename,
+            call_source);
+        if (func < 0)
+            return -1;
+    }
+
+    if (func_table_add_instance(
+            ctx->funcs, func_tu, func_poly, func, arg_types, arg_count)
+        != 0)
+    {
+        return -1;
+    }
+
+    return func;
+}
+
+/* The lookup doesn't block. If the symbol may still be declared by a TU that
+ * is being parsed, the traversal releases its TU and waits for more
+ * declarations, see check_subtree() */
+static enum process_result
+find_symbol(
+    struct check_ctx*          ctx,
+    const struct symbol_table* symbols,
+    struct utf8_view           key,
+    struct symbol_table_entry* entry)
+{
+    const struct symbol_table_entry* found;
+
+    if (symbols == NULL && ctx->symbols == NULL)
+    {
+        switch (semantic_session_find_symbol(
+            ctx->session, key, entry, &ctx->symbols_seen))
+        {
+            case 1: return DEP_OK;
+            case 0: ctx->symbols_pending = 1; return DEP_BUSY;
+            default: ctx->symbols = semantic_session_symbols(ctx->session);
+        }
+    }
+
+    found = symbol_table_find(symbols ? symbols : ctx->symbols, key);
+    if (found == NULL)
+        return DEP_ERROR;
+    *entry = *found;
+    return DEP_OK;
+}
+
+/*!
+ * @brief The function definition exists in another TU. If the function was
+ * checked already, its signature is taken from the function table without
+ * having to lock the other TU. Otherwise, the function is checked in the other
+ * TU first.
+ */
+static enum process_result
+process_extern_func_ref(
+    struct stack**                   stack,
+    struct ast**                     tus,
+    int                              tu_id,
+    struct mutex**                   tu_mutexes,
+    ast_id                           n,
+    const struct symbol_table_entry* entry,
+    const struct utf8*               filenames,
+    const struct db_source*          sources,
+    const struct cmd_list*           cmds,
+    const struct symbol_table*       symbols,
+    struct check_ctx*                ctx)
+{
+    enum type        ret_type;
+    enum func_state  state;
+    int              param_count, result;
+    struct ast**     astp = &tus[tu_id];
+    const char*      filename = utf8_cstr(filenames[tu_id]);
+    const char*      source = sources[tu_id].text.data;
+    const char*      func_filename = utf8_cstr(filenames[entry->tu_id]);
+    const char*      func_source = sources[entry->tu_id].text.data;
+    struct utf8_span location = ast_loc(*astp, n);
+    const enum type* arg_types = ctx->arg_types ? ctx->arg_types->data : NULL;
+    int              arg_count = typelist_count(ctx->arg_types);
+    ast_id           func = entry->ast_node;
+
+    ODBUTIL_DEBUG_ASSERT(ctx->funcs != NULL, (void)0);
+
+    if (paramsig_resize(&ctx->params, arg_count) != 0)
+        return DEP_ERROR;
+
+    /* The other TU is not locked, so it's not known whether the function is
+     * polymorphic. Only polymorphic functions have instances though */
+    state = func_table_find(
+        ctx->funcs,
+        entry->tu_id,
+        func,
+        ctx->owner,
+        &ret_type,
+        ctx->params ? ctx->params->data : NULL,
+        arg_count,
+        &param_count);
+    if (state == FUNC_UNCLAIMED)
+    {
+        ast_id instance = func_table_find_instance(
+            ctx->funcs, entry->tu_id, func, arg_types, arg_count);
+        if (instance > -1)
+        {
+            func = instance;
+            state = func_table_find(
+                ctx->funcs,
+                entry->tu_id,
+                func,
+                ctx->owner,
+                &ret_type,
+                ctx->params ? ctx->params->data : NULL,
+                arg_count,
+                &param_count);
+        }
+    }
+
+    switch (state)
+    {
+        case FUNC_CHECKED:
+            if (apply_func_signature(
+                    astp,
+                    n,
+                    ret_type,
+                    ctx->params ? ctx->params->data : NULL,
+                    param_count,
+                    func_source,
+                    filename,
+                    source)
+                != 0)
+            {
+                return DEP_ERROR;
+            }
+            ctx->extern_calls++;
+            stack_pop(*stack);
+            return DEP_OK;
 
-    no_match:;
+        case FUNC_BUSY:
+            return wait_for_func(
+                ctx, entry->tu_id, func, filename, source, location);
+
+        case FUNC_OWNED:
+            return recursive_extern_call(filename, source, location);
+
+        case FUNC_FAILED: return DEP_ERROR;
+        case FUNC_UNCLAIMED: break;
+    }
+
+    /* Nobody has checked the function yet, so check it now. Only one TU is
+     * locked at a time, so threads can't deadlock on the TU mutexes. The
+     * other TU may not have been prepared for the type check yet */
+    ctx->extern_checks++;
+    unlock_tu(tus, tu_mutexes, tu_id);
+    if (semantic_session_wait_for_tu(ctx->session, entry->tu_id) != 0)
+    {
+        lock_tu(ctx, tus, tu_mutexes, tu_id);
+        return DEP_ERROR;
     }
+    lock_tu(ctx, tus, tu_mutexes, entry->tu_id);
+
+    if (ast_node_type(tus[entry->tu_id], func) == AST_FUNC_POLY)
+        func = instantiate_extern_func(
+            tus,
+            entry->tu_id,
+            func,
+            func_filename,
+            func_source,
+            location,
+            filename,
+            source,
+            ctx);
+    result = -1;
+    if (func > -1)
+        result = check_subtree(
+            tus,
+            entry->tu_id,
+            func,
+            tu_mutexes,
+            filenames,
+            sources,
+            cmds,
+            symbols,
+            ctx);
+
+    unlock_tu(tus, tu_mutexes, entry->tu_id);
+    lock_tu(ctx, tus, tu_mutexes, tu_id);
+
+    /* The call is processed again, now that the signature is published */
+    return result == 0 ? DEP_ADDED : DEP_ERROR;
 }
 
 static enum process_result
 process_func_or_container_ref(
     struct stack**             stack,
+    struct instmap**           instmap,
     struct ast**               tus,
     int                        tu_id,
     struct mutex**             tu_mutexes,
     ast_id                     n,
     const struct utf8*         filenames,
     const struct db_source*    sources,
-    const struct symbol_table* symbols)
+    const struct cmd_list*     cmds,
+    const struct symbol_table* symbols,
+    struct check_ctx*          ctx)
 {
-    ast_id identifier, arglist;
+    ast_id           identifier, arglist, func;
+    const enum type* arg_types;
+    int              arg_count;
+    enum func_state  state = FUNC_UNCLAIMED;
 
     struct ast** astp = &tus[tu_id];
     const char*  filename = utf8_cstr(filenames[tu_id]);
     const char*  source = sources[tu_id].text.data;
 
     struct utf8_view                 key;
-    const struct symbol_table_entry* entry;
+    struct symbol_table_entry        found;
+    const struct symbol_table_entry* entry = &found;
+    enum process_result              lookup;
 
     /* NOTE: The function has an identifier, but the type of it is set when the
      * return type is known. */
@@ -1652,8 +2451,10 @@ process_func_or_container_ref(
 
     identifier = (*astp)->nodes[n].func_or_container_ref.identifier;
     key = utf8_span_view(source, (*astp)->nodes[identifier].identifier.name);
-    entry = symbol_table_find(symbols, key);
-    if (entry == NULL)
+    lookup = find_symbol(ctx, symbols, key, &found);
+    if (lookup == DEP_BUSY)
+        return DEP_BUSY;
+    if (lookup != DEP_OK)
     {
         log_flc_err(
             filename,
@@ -1664,147 +2465,145 @@ process_func_or_container_ref(
         return -1;
     }
 
-    if (entry->tu_id == tu_id)
-    {
-        /* The function definition exists in our own AST. */
+    if (collect_arg_types(ctx, *astp, arglist) != 0)
+        return DEP_ERROR;
+    arg_types = ctx->arg_types ? ctx->arg_types->data : NULL;
+    arg_count = typelist_count(ctx->arg_types);
+
+    if (entry->tu_id != tu_id)
+        return process_extern_func_ref(
+            stack,
+            tus,
+            tu_id,
+            tu_mutexes,
+            n,
+            entry,
+            filenames,
+            sources,
+            cmds,
+            symbols,
+            ctx);
+
+    /* The function definition exists in our own AST. */
 
-        ast_id func;
-        if (ast_node_type((*astp), entry->ast_node) == AST_FUNC_POLY)
+    if (ast_node_type((*astp), entry->ast_node) == AST_FUNC_POLY)
+    {
+        uint64_t inst_key;
+        func = lookup_func_instantiation(
+            instmap, *astp, entry->ast_node, arg_types, arg_count);
+        if (func < 0)
         {
-            ast_id poly_block = ast_find_parent(*astp, entry->ast_node);
-            func = find_func_instantiation(
-                *astp,
-                poly_block,
-                *astp,
-                (*astp)->nodes[n].func_or_container_ref.arglist);
+            func = instantiate_func(
+                astp,
+                entry->ast_node,
+                filename,
+                source,
+                arg_types,
+                arg_count,
+                ast_loc(*astp, n),
+                filename,
+                source);
             if (func < 0)
-            {
-                func = instantiate_func(
-                    astp,
-                    entry->ast_node,
-                    filename,
-                    source,
-                    astp,
-                    (*astp)->nodes[n].func_or_container_ref.arglist,
-                    ast_loc(*astp, n),
-                    filename,
-                    source);
-                if (func < 0)
-                    return DEP_ERROR;
+                return DEP_ERROR;
 
-                stack_push_entry(stack, func);
-                return DEP_ADDED;
+            if (func_instantiation_key(
+                    *astp, entry->ast_node, arg_types, arg_count, &inst_key)
+                    == 0
+                && instmap_insert_always(instmap, inst_key, func) != 0)
+            {
+                return DEP_ERROR;
             }
-        }
-        else
-        {
-            ODBUTIL_DEBUG_ASSERT(
-                ast_node_type(*astp, entry->ast_node) == AST_FUNC,
-                log_semantic_err(
-                    "type: %d\n", ast_node_type(*astp, entry->ast_node)));
-            func = entry->ast_node;
-        }
 
-        if (ast_type_info(*astp, func) != TYPE_INVALID)
-        {
-            (*astp)->nodes[n].info.node_type = AST_FUNC_CALL;
-            (*astp)->nodes[n].info.type_info = ast_type_info(*astp, func);
-            (*astp)->nodes[identifier].info.type_info
-                = ast_type_info(*astp, func);
-
-            /* May need to insert casts for the arguments */
-            int    arg_num;
-            ast_id pl_param, al_arg;
-            ast_id decl = (*astp)->nodes[func].func.decl;
-            ast_id paramlist = (*astp)->nodes[decl].func_decl.paramlist;
-            for (arg_num = 1, pl_param = paramlist, al_arg = arglist;
-                 pl_param > -1 && al_arg > -1;
-                 arg_num++,
-                pl_param = (*astp)->nodes[pl_param].paramlist.next,
-                al_arg = (*astp)->nodes[al_arg].arglist.next)
+            /* Calls from other TUs can use the instantiation too */
+            if (ctx->funcs
+                && func_table_add_instance(
+                       ctx->funcs,
+                       tu_id,
+                       entry->ast_node,
+                       func,
+                       arg_types,
+                       arg_count)
+                       != 0)
             {
-                ast_id cast, param, arg;
-
-                param = (*astp)->nodes[pl_param].paramlist.identifier;
-                arg = (*astp)->nodes[al_arg].arglist.expr;
-                enum type param_type = ast_type_info(*astp, param);
-                enum type arg_type = ast_type_info(*astp, arg);
-
-                if (param_type == arg_type)
-                    continue;
-
-                switch (type_convert(arg_type, param_type))
-                {
-                    case TC_ALLOW: break;
-                    case TC_DISALLOW:
-                        err_func_call_incompatible_types(
-                            *astp, arg, param, arg_num, filename, source);
-                        return DEP_ERROR;
-
-                    case TC_SIGN_CHANGE:
-                    case TC_TRUENESS:
-                    case TC_INT_TO_FLOAT:
-                    case TC_BOOL_PROMOTION:
-                        warn_func_call_implicit_conversion(
-                            *astp, arg, param, arg_num, filename, source);
-                        break;
-
-                    case TC_TRUNCATE:
-                        warn_func_call_truncation(
-                            *astp, arg, param, arg_num, filename, source);
-                        break;
-                }
-
-                cast = ast_cast(astp, arg, param_type, ast_loc(*astp, arg));
-                if (cast < -1)
-                    return DEP_ERROR;
-                (*astp)->nodes[al_arg].arglist.expr = cast;
-                (*astp)->nodes[cast].info.type_info = param_type;
+                return DEP_ERROR;
             }
 
-            stack_pop(*stack);
-            return DEP_OK;
+            stack_push_entry(stack, func);
+            return DEP_ADDED;
         }
+    }
+    else
+    {
+        ODBUTIL_DEBUG_ASSERT(
+            ast_node_type(*astp, entry->ast_node) == AST_FUNC,
+            log_semantic_err(
+                "type: %d\n", ast_node_type(*astp, entry->ast_node)));
+        func = entry->ast_node;
+    }
 
-        /* If the function is recursive, it will already be on the stack. We
-         * want to pop all direct nodes from the stack up until this function.
-         * Sibling nodes are preserved, because we want to explore the breadth
-         * of the tree more in this situation to see if there are any other
-         * exitfunction/return statements that might help define the return type
-         * of the function. */
-        struct stack_entry* entry;
-        vec_for_each(*stack, entry)
+    /* The function may be half way through being checked by another TU's type
+     * check, in which case its type can't be trusted yet */
+    if (ctx->funcs)
+        switch (state = func_table_find(
+                    ctx->funcs, tu_id, func, ctx->owner, NULL, NULL, 0, NULL))
         {
-            if (entry->node == func)
-            {
-                for (; n > -1 && n != func; n = ast_find_parent(*astp, n))
-                    stack_erase_node(*stack, n);
-                return DEP_ADDED;
-            }
+            case FUNC_UNCLAIMED:
+            case FUNC_OWNED:
+            case FUNC_CHECKED: break;
+            case FUNC_BUSY:
+                return wait_for_func(
+                    ctx, tu_id, func, filename, source, ast_loc(*astp, n));
+            case FUNC_FAILED: return DEP_ERROR;
         }
 
-        /* Otherwise add it to be processed now */
-        stack_push_entry(stack, func);
-        return DEP_ADDED;
-    }
-    else
+    if (ast_type_info(*astp, func) != TYPE_INVALID)
     {
-        /* The function definition exists in another AST. Since semantic
-         * checks are run in parallel, the ASTs are protected by a mutex
-         */
-        struct mutex* their_mutex = tu_mutexes[entry->tu_id];
-        struct mutex* our_mutex = tu_mutexes[tu_id];
-
-        mutex_unlock(our_mutex);
-        mutex_lock(their_mutex);
+        /* May need to insert casts for the arguments */
+        if (collect_params(ctx, *astp, func) != 0)
+            return DEP_ERROR;
+        if (apply_func_signature(
+                astp,
+                n,
+                ast_type_info(*astp, func),
+                ctx->params ? ctx->params->data : NULL,
+                paramsig_count(ctx->params),
+                source,
+                filename,
+                source)
+            != 0)
+        {
+            return DEP_ERROR;
+        }
 
-        /* TODO */
+        stack_pop(*stack);
+        return DEP_OK;
+    }
 
-        mutex_unlock(their_mutex);
-        mutex_lock(our_mutex);
+    /* If the function is recursive, it will already be on the stack. We
+     * want to pop all direct nodes from the stack up until this function.
+     * Sibling nodes are preserved, because we want to explore the breadth
+     * of the tree more in this situation to see if there are any other
+     * exitfunction/return statements that might help define the return type
+     * of the function. */
+    struct stack_entry* stack_entry;
+    vec_for_each(*stack, stack_entry)
+    {
+        if (stack_entry->node == func)
+        {
+            for (; n > -1 && n != func; n = ast_find_parent(*astp, n))
+                stack_erase_node(*stack, n);
+            return DEP_ADDED;
+        }
     }
 
-    return DEP_ERROR;
+    /* The function is being checked further up, by a traversal that called
+     * into another TU which then called back into this TU */
+    if (state == FUNC_OWNED)
+        return recursive_extern_call(filename, source, ast_loc(*astp, n));
+
+    /* Otherwise add it to be processed now */
+    stack_push_entry(stack, func);
+    return DEP_ADDED;
 }
 
 static enum process_result
@@ -1885,14 +2684,16 @@ process_scope(struct stack** stack, struct ast* ast, ast_id scope)
 static enum process_result
 process_node(
     struct stack**             stack,
-    struct typemap**           typemap,
+    struct scoped_typemap*     typemap,
+    struct instmap**           instmap,
     struct ast**               tus,
     int                        tu_id,
     struct mutex**             tu_mutexes,
     const struct utf8*         filenames,
     const struct db_source*    sources,
     const struct cmd_list*     cmds,
-    const struct symbol_table* symbols)
+    const struct symbol_table* symbols,
+    struct check_ctx*          ctx)
 {
     struct ast**        astp = &tus[tu_id];
     const char*         filename = utf8_cstr(filenames[tu_id]);
@@ -1937,10 +2738,21 @@ process_node(
         case AST_FUNC_EXIT:
             return process_func_exit(stack, astp, n, filename, source);
         case AST_FUNC:
-            return process_func(stack, *astp, n, filename, source, typemap);
+            return process_func(
+                stack, *astp, tu_id, n, filename, source, typemap, ctx);
         case AST_FUNC_OR_CONTAINER_REF:
             return process_func_or_container_ref(
-                stack, tus, tu_id, tu_mutexes, n, filenames, sources, symbols);
+                stack,
+                instmap,
+                tus,
+                tu_id,
+                tu_mutexes,
+                n,
+                filenames,
+                sources,
+                cmds,
+                symbols,
+                ctx);
 
         case AST_FUNC_POLY: ODBUTIL_DEBUG_ASSERT(0, (void)0); return DEP_ERROR;
         case AST_FUNC_CALL:
@@ -1999,13 +2811,22 @@ process_node(
 
 #if defined(ODBCOMPILER_AST_SANITY_CHECK)
 static void
-sanity_check(struct ast* ast, const char* filename, const char* source)
+sanity_check(
+    struct ast*        ast,
+    int                tu_id,
+    const char*        filename,
+    const char*        source,
+    struct func_table* funcs)
 {
     ast_id n;
     int    error = 0;
     int    gutter;
     for (n = 0; n != ast_count(ast); ++n)
     {
+        /* Deleted nodes are removed after all semantic checks have run */
+        if (ast_node_type(ast, n) == AST_GC)
+            continue;
+
         if (ast_type_info(ast, n) == TYPE_INVALID)
         {
             ast_id parent;
@@ -2022,6 +2843,19 @@ sanity_check(struct ast* ast, const char* filename, const char* source)
             if (parent > -1)
                 continue;
 
+            /* The same goes for functions that the type check of another TU
+             * is still busy with */
+            for (parent = n; parent > -1; parent = ast_find_parent(ast, parent))
+                if (funcs && ast_node_type(ast, parent) == AST_FUNC
+                    && func_table_find(
+                           funcs, tu_id, parent, tu_id, NULL, NULL, 0, NULL)
+                           == FUNC_BUSY)
+                {
+                    break;
+                }
+            if (parent > -1)
+                continue;
+
             log_flc_err(
                 filename,
                 source,
@@ -2032,12 +2866,6 @@ sanity_check(struct ast* ast, const char* filename, const char* source)
             gutter = log_excerpt_1(source, ast_loc(ast, n), "", 0);
             error = -1;
         }
-
-        if (ast_node_type(ast, n) == AST_GC)
-        {
-            log_semantic_err("AST_GC nodes still exist in tree.\n");
-            error = -1;
-        }
     }
 
     ODBUTIL_DEBUG_ASSERT(
@@ -2049,75 +2877,193 @@ sanity_check(struct ast* ast, const char* filename, const char* source)
 }
 #endif
 
+/* Called with the TU locked */
 static int
-type_check(
+check_subtree(
     struct ast**               tus,
-    int                        tu_count,
     int                        tu_id,
+    ast_id                     root,
     struct mutex**             tu_mutexes,
     const struct utf8*         filenames,
     const struct db_source*    sources,
-    const struct plugin_list*  plugins,
     const struct cmd_list*     cmds,
-    const struct symbol_table* symbols)
+    const struct symbol_table* symbols,
+    struct check_ctx*          ctx)
 {
-    struct typemap* typemap;
-    struct stack*   stack;
-    int             return_code;
-    struct ast**    astp = &tus[tu_id];
+    struct scoped_typemap typemap;
+    struct instmap*       instmap;
+    struct stack*         stack;
+    int                   return_code = 0;
 
-    typemap_init(&typemap);
+    scoped_typemap_init(&typemap);
+    instmap_init(&instmap);
     stack_init(&stack);
 
-    ODBUTIL_DEBUG_ASSERT(
-        ast_node_type((*astp), (*astp)->root) == AST_BLOCK,
-        log_semantic_err("type: %d\n", ast_node_type((*astp), (*astp)->root)));
-
-    /*
-     * It's necessary to traverse the AST in a way where statements are
-     * evaluated in the order they appear in the source code, and in a way
-     * where the scope of each block is visited depth-first.
-     *
-     * This will make it a lot easier to propagate the type information of
-     * variables, because they will be processed in the same order the data
-     * flows.
-     */
-
-    return_code = 0;
-    mutex_lock(tu_mutexes[tu_id]);
-    stack_push_entry(&stack, (*astp)->root);
+    stack_push_entry(&stack, root);
     while (stack_count(stack) > 0)
     {
-        switch (process_node(
+        ast_id              n = vec_last(stack)->node;
+        enum process_result result = process_node(
             &stack,
             &typemap,
+            &instmap,
             tus,
             tu_id,
             tu_mutexes,
             filenames,
             sources,
             cmds,
-            symbols))
+            symbols,
+            ctx);
+
+        switch (result)
         {
             case DEP_ADDED: break;
-            case DEP_OK: break;
+            case DEP_OK:
+                /* Other type checks may be blocked on this TU, because they
+                 * have to check or instantiate a function in it. Let them in
+                 * whenever a function is done */
+                if (ctx->funcs && ast_node_type(tus[tu_id], n) == AST_FUNC
+                    && func_table_tu_wanted(ctx->funcs, tu_id))
+                {
+                    unlock_tu(tus, tu_mutexes, tu_id);
+                    func_table_hand_over_tu(ctx->funcs, tu_id);
+                    lock_tu(ctx, tus, tu_mutexes, tu_id);
+                }
+                break;
+            case DEP_BUSY:
+                unlock_tu(tus, tu_mutexes, tu_id);
+                if (ctx->symbols_pending)
+                {
+                    ctx->symbols_pending = 0;
+                    semantic_session_wait_for_symbols(
+                        ctx->session, ctx->symbols_seen);
+                }
+                else
+                {
+                    ctx->busy_waits++;
+                    func_table_wait_finish(ctx->funcs, ctx->owner);
+                }
+                lock_tu(ctx, tus, tu_mutexes, tu_id);
+                break;
             case DEP_ERROR:
                 return_code = -1;
                 stack_clear(stack);
                 break;
         }
     }
-    mutex_unlock(tu_mutexes[tu_id]);
 
-    ast_gc(*astp);
     stack_deinit(stack);
-    typemap_deinit(typemap);
+#if defined(ODBCOMPILER_TYPE_CHECK_STATS)
+    ctx->scope_count += typemap.scope_count;
+    ctx->typemap_stats.lookups += typemap.stats.lookups;
+    ctx->typemap_stats.probes += typemap.stats.probes;
+    if (ctx->typemap_stats.max_probes < typemap.stats.max_probes)
+        ctx->typemap_stats.max_probes = typemap.stats.max_probes;
+#endif
+    instmap_deinit(instmap);
+    scoped_typemap_deinit(&typemap);
+
+    return return_code;
+}
+
+static int
+type_check(
+    struct ast**               tus,
+    int                        tu_count,
+    int                        tu_id,
+    struct mutex**             tu_mutexes,
+    const struct utf8*         filenames,
+    const struct db_source*    sources,
+    const struct plugin_list*  plugins,
+    const struct cmd_list*     cmds,
+    const struct symbol_table* symbols,
+    struct semantic_session*   session)
+{
+    struct check_ctx ctx;
+    int              return_code;
+    struct ast**     astp = &tus[tu_id];
+
+    /* The function table is only needed to call functions in other TUs */
+    check_ctx_init(
+        &ctx,
+        tu_count > 1 ? semantic_session_funcs(session) : NULL,
+        tu_id,
+        session);
+
+    /* With multiple TUs, the ASTs are handed between threads. See
+     * SEMANTIC_CHECK_CROSS_TU. With a single TU, the caller has exclusive
+     * access to it */
+    if (tu_count > 1)
+        lock_tu(&ctx, tus, tu_mutexes, tu_id);
+
+    ODBUTIL_DEBUG_ASSERT(
+        ast_node_type((*astp), (*astp)->root) == AST_BLOCK,
+        log_semantic_err("type: %d\n", ast_node_type((*astp), (*astp)->root)));
+
+    /*
+     * It's necessary to traverse the AST in a way where statements are
+     * evaluated in the order they appear in the source code, and in a way
+     * where the scope of each block is visited depth-first.
+     *
+     * This will make it a lot easier to propagate the type information of
+     * variables, because they will be processed in the same order the data
+     * flows.
+     */
+    return_code = check_subtree(
+        tus,
+        tu_id,
+        (*astp)->root,
+        tu_mutexes,
+        filenames,
+        sources,
+        cmds,
+        symbols,
+        &ctx);
+
+    /* Functions claimed by this type check must not keep other type checks
+     * waiting */
+    if (return_code != 0 && ctx.funcs)
+        func_table_fail(ctx.funcs, tu_id);
 
 #if defined(ODBCOMPILER_AST_SANITY_CHECK)
     if (return_code == 0)
         sanity_check(
-            *astp, utf8_cstr(filenames[tu_id]), sources[tu_id].text.data);
+            *astp,
+            tu_id,
+            utf8_cstr(filenames[tu_id]),
+            sources[tu_id].text.data,
+            ctx.funcs);
+#endif
+
+    if (tu_count > 1)
+        unlock_tu(tus, tu_mutexes, tu_id);
+
+#if defined(ODBCOMPILER_TYPE_CHECK_STATS)
+    log_semantic_info(
+        "Type checked {emph:%s}: %d scopes, %d typemap lookups, %d probes "
+        "({emph:%.2f} per lookup, %d max)\n",
+        utf8_cstr(filenames[tu_id]),
+        ctx.scope_count,
+        ctx.typemap_stats.lookups,
+        ctx.typemap_stats.probes,
+        ctx.typemap_stats.lookups
+            ? (double)ctx.typemap_stats.probes / ctx.typemap_stats.lookups
+            : 0.0,
+        ctx.typemap_stats.max_probes);
 #endif
+    if (ctx.extern_calls || ctx.busy_waits || ctx.lock_waits)
+        log_semantic_info(
+            "Type checked {emph:%s}: %d calls to other source files (%d "
+            "checked here first), %d waits on busy functions, %d contended "
+            "locks\n",
+            utf8_cstr(filenames[tu_id]),
+            ctx.extern_calls,
+            ctx.extern_checks,
+            ctx.busy_waits,
+            ctx.lock_waits);
+
+    check_ctx_deinit(&ctx);
 
     return return_code;
 }
@@ -2128,4 +3074,4 @@ static const struct semantic_check* depends[]
        &semantic_loop_cont,
        NULL};
 const struct semantic_check semantic_type_check
-    = {type_check, depends, "loop_for"};
+    = {type_check, depends, "type_check", SEMANTIC_CHECK_CROSS_TU, NULL};
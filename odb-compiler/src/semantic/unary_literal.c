@@ -1,6 +1,8 @@
 #include "odb-compiler/ast/ast.h"
 #include "odb-compiler/ast/ast_ops.h"
+#include "odb-compiler/parser/db_source.h"
 #include "odb-compiler/semantic/semantic.h"
+#include "odb-util/utf8.h"
 
 static int
 process_unop(struct ast* ast, ast_id n)
@@ -193,13 +195,22 @@ child_changed:
         case AST_SCOPE: return -1;
     }
 
-    ast->nodes[expr].info.location
+    ast->locs[n].location
         = utf8_span_union(ast_loc(ast, n), ast_loc(ast, expr));
     memcpy(&ast->nodes[n], &ast->nodes[expr], sizeof(ast->nodes[expr]));
+    ast_set_parent(ast, expr, -1);
     ast_delete_node(ast, expr);
     return 0;
 }
 
+static int
+visit_unop(
+    struct ast** astp, ast_id n, const char* filename, const char* source)
+{
+    process_unop(*astp, n);
+    return 0;
+}
+
 static int
 unary_literal(
     struct ast**               tus,
@@ -210,23 +221,23 @@ unary_literal(
     const struct db_source*    sources,
     const struct plugin_list*  plugins,
     const struct cmd_list*     cmds,
-    const struct symbol_table* symbols)
+    const struct symbol_table* symbols,
+    struct semantic_session*   session)
 {
-    ast_id      n;
-    struct ast* ast = tus[tu_id];
-
-    for (n = 0; n != ast_count(ast); ++n)
-    {
-        if (ast_node_type(ast, n) != AST_UNOP)
-            continue;
-
-        process_unop(ast, n);
-    }
-
-    return 0;
+    const struct semantic_check* check = &semantic_unary_literal;
+    return semantic_visit(
+        &check,
+        1,
+        SEMANTIC_VISIT_ANY_ORDER,
+        &tus[tu_id],
+        utf8_cstr(filenames[tu_id]),
+        sources[tu_id].text.data);
 }
 
 static const struct semantic_check* depends[] = {NULL};
 
+static const struct semantic_visitor visitor
+    = {visit_unop, SEMANTIC_VISIT_NODE(AST_UNOP), SEMANTIC_VISIT_ANY_ORDER};
+
 const struct semantic_check semantic_unary_literal
-    = {unary_literal, depends, "unary_literal"};
+    = {unary_literal, depends, "unary_literal", 0, &visitor};
@@ -10,6 +10,7 @@ extern "C" {
 struct ast;
 struct mutex;
 struct symbol_table;
+struct semantic_session;
 struct plugin_list;
 }
 
@@ -27,11 +28,12 @@ struct DBParserHelper
         const char*                 name,
         std::initializer_list<type> param_types);
 
-    struct plugin_list*  plugins;
-    struct cmd_list      cmds;
-    struct symbol_table* symbols;
-    struct db_parser     p;
-    struct db_source     src;
-    struct ast*          ast;
-    struct mutex*        ast_mutex;
+    struct plugin_list*      plugins;
+    struct cmd_list          cmds;
+    struct symbol_table*     symbols;
+    struct semantic_session* session;
+    struct db_parser         p;
+    struct db_source         src;
+    struct ast*              ast;
+    struct mutex*            ast_mutex;
 };
@@ -7,6 +7,7 @@ extern "C" {
 #include "odb-compiler/ast/ast_export.h"
 #include "odb-compiler/sdk/cmd_list.h"
 #include "odb-compiler/semantic/semantic.h"
+#include "odb-compiler/semantic/session.h"
 #include "odb-compiler/semantic/symbol_table.h"
 #include "odb-compiler/semantic/type.h"
 #include "odb-util/mutex.h"
@@ -18,7 +19,8 @@ DBParserHelper::DBParserHelper()
     plugin_list_init(&plugins);
     cmd_list_init(&cmds);
     symbol_table_init(&symbols);
-    db_parser_init(&p);
+    session = semantic_session_create();
+    db_parser_init(&p, DB_LEXER_FLEX);
     memset(&src, 0, sizeof(src));
     ast_init(&ast);
     ast_mutex = mutex_create();
@@ -48,6 +50,7 @@ DBParserHelper::~DBParserHelper()
     db_parser_deinit(&p);
     if (src.text.data)
         db_source_close(&src);
+    semantic_session_destroy(session);
     symbol_table_deinit(symbols);
     cmd_list_deinit(&cmds);
     plugin_list_deinit(plugins);
@@ -91,7 +94,8 @@ DBParserHelper::semantic(const struct semantic_check* check)
         &src,
         plugins,
         &cmds,
-        symbols);
+        symbols,
+        session);
     utf8_deinit(filename);
 #if defined(ODBCOMPILER_DOT_EXPORT)
     const testing::TestInfo* info
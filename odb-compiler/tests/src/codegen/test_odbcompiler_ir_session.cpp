@@ -0,0 +1,61 @@
+#include "gmock/gmock.h"
+#include <cstring>
+
+extern "C" {
+#include "odb-compiler/codegen/ir.h"
+#include "odb-util/mstream.h"
+}
+
+#define NAME odbcompiler_ir_session
+
+using namespace testing;
+
+struct NAME : public Test
+{
+    void
+    TearDown() override
+    {
+        mstream_free_writable(&ms);
+    }
+
+    struct mstream ms = mstream_init_writable();
+};
+
+TEST_F(NAME, compile_to_memory_writes_object)
+{
+    struct ir_session* session
+        = ir_session_create(TARGET_x86_64, TARGET_LINUX, IR_O0);
+    ASSERT_THAT(session, NotNull());
+    struct ir_module* ir = ir_alloc("test");
+    ASSERT_THAT(ir, NotNull());
+
+    EXPECT_THAT(ir_compile_to_memory(ir, session, &ms), Eq(0));
+    ASSERT_THAT(ms.ptr, Gt(4));
+    EXPECT_THAT(memcmp(ms.data, "\x7f" "ELF", 4), Eq(0));
+
+    ir_free(ir);
+    ir_session_destroy(session);
+}
+
+TEST_F(NAME, i386_and_x86_64_share_backend)
+{
+    struct ir_session* s32
+        = ir_session_create(TARGET_i386, TARGET_LINUX, IR_O0);
+    struct ir_session* s64
+        = ir_session_create(TARGET_x86_64, TARGET_LINUX, IR_O0);
+    ASSERT_THAT(s32, NotNull());
+    ASSERT_THAT(s64, NotNull());
+    struct ir_module* ir32 = ir_alloc("test32");
+    struct ir_module* ir64 = ir_alloc("test64");
+
+    EXPECT_THAT(ir_compile_to_memory(ir32, s32, &ms), Eq(0));
+    int size32 = ms.ptr;
+    EXPECT_THAT(size32, Gt(0));
+    EXPECT_THAT(ir_compile_to_memory(ir64, s64, &ms), Eq(0));
+    EXPECT_THAT(ms.ptr, Gt(size32));
+
+    ir_free(ir64);
+    ir_free(ir32);
+    ir_session_destroy(s64);
+    ir_session_destroy(s32);
+}
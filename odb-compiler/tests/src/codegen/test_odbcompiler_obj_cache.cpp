@@ -0,0 +1,165 @@
+#include "gmock/gmock.h"
+#include <cstdio>
+#include <filesystem>
+
+extern "C" {
+#include "odb-compiler/codegen/obj_cache.h"
+#include "odb-util/fs.h"
+}
+
+#define NAME odbcompiler_obj_cache
+
+using namespace testing;
+
+struct NAME : public Test
+{
+    void
+    SetUp() override
+    {
+        std::filesystem::remove_all(cache_dir);
+        ASSERT_THAT(fs_make_dir(cstr_ospathc(cache_dir)), Eq(0));
+    }
+
+    void
+    TearDown() override
+    {
+        std::filesystem::remove_all(cache_dir);
+        remove(objfile);
+    }
+
+    void
+    writeObject(const char* contents)
+    {
+        FILE* fp = fopen(objfile, "wb");
+        ASSERT_THAT(fp, NotNull());
+        fputs(contents, fp);
+        fclose(fp);
+    }
+
+    std::string
+    readObject()
+    {
+        std::string contents;
+        FILE*       fp = fopen(objfile, "rb");
+        int         c;
+        if (fp == nullptr)
+            return contents;
+        while ((c = fgetc(fp)) != EOF)
+            contents += (char)c;
+        fclose(fp);
+        return contents;
+    }
+
+    int
+    countObjects()
+    {
+        int count = 0;
+        for (const auto& entry :
+             std::filesystem::directory_iterator(cache_dir))
+        {
+            (void)entry;
+            count++;
+        }
+        return count;
+    }
+
+    const char* cache_dir = "odbcompiler_obj_cache_test";
+    const char* objfile = "odbcompiler_obj_cache_test.o";
+};
+
+TEST_F(NAME, unknown_key_misses)
+{
+    EXPECT_THAT(
+        obj_cache_load(
+            cstr_ospathc(cache_dir), 0x1234, cstr_ospathc(objfile)),
+        Eq(0));
+}
+
+TEST_F(NAME, stored_object_is_loaded)
+{
+    writeObject("first");
+    ASSERT_THAT(
+        obj_cache_store(cstr_ospathc(cache_dir), 1, cstr_ospathc(objfile)),
+        Eq(0));
+    writeObject("second");
+    ASSERT_THAT(
+        obj_cache_store(cstr_ospathc(cache_dir), 2, cstr_ospathc(objfile)),
+        Eq(0));
+
+    ASSERT_THAT(
+        obj_cache_load(cstr_ospathc(cache_dir), 1, cstr_ospathc(objfile)),
+        Eq(1));
+    EXPECT_THAT(readObject(), StrEq("first"));
+    ASSERT_THAT(
+        obj_cache_load(cstr_ospathc(cache_dir), 2, cstr_ospathc(objfile)),
+        Eq(1));
+    EXPECT_THAT(readObject(), StrEq("second"));
+}
+
+TEST_F(NAME, store_leaves_no_temporary_files)
+{
+    writeObject("first");
+    ASSERT_THAT(
+        obj_cache_store(cstr_ospathc(cache_dir), 1, cstr_ospathc(objfile)),
+        Eq(0));
+    writeObject("second");
+    ASSERT_THAT(
+        obj_cache_store(cstr_ospathc(cache_dir), 1, cstr_ospathc(objfile)),
+        Eq(0));
+
+    EXPECT_THAT(countObjects(), Eq(1));
+    for (const auto& entry : std::filesystem::directory_iterator(cache_dir))
+        EXPECT_THAT(entry.path().extension().string(), StrEq(".o"));
+    ASSERT_THAT(
+        obj_cache_load(cstr_ospathc(cache_dir), 1, cstr_ospathc(objfile)),
+        Eq(1));
+    EXPECT_THAT(readObject(), StrEq("second"));
+}
+
+TEST_F(NAME, evict_keeps_recently_used_objects)
+{
+    writeObject("object");
+    for (hash64 key = 1; key <= 3; ++key)
+        ASSERT_THAT(
+            obj_cache_store(
+                cstr_ospathc(cache_dir), key, cstr_ospathc(objfile)),
+            Eq(0));
+
+    /* Make all objects look old, then use one of them */
+    auto old_time = std::filesystem::file_time_type::clock::now()
+                    - std::chrono::hours(1);
+    for (const auto& entry : std::filesystem::directory_iterator(cache_dir))
+        std::filesystem::last_write_time(entry.path(), old_time);
+    ASSERT_THAT(
+        obj_cache_load(cstr_ospathc(cache_dir), 2, cstr_ospathc(objfile)),
+        Eq(1));
+
+    EXPECT_THAT(obj_cache_evict(cstr_ospathc(cache_dir), 1), Eq(2));
+    EXPECT_THAT(countObjects(), Eq(1));
+    EXPECT_THAT(
+        obj_cache_load(cstr_ospathc(cache_dir), 2, cstr_ospathc(objfile)),
+        Eq(1));
+    EXPECT_THAT(
+        obj_cache_load(cstr_ospathc(cache_dir), 1, cstr_ospathc(objfile)),
+        Eq(0));
+    EXPECT_THAT(
+        obj_cache_load(cstr_ospathc(cache_dir), 3, cstr_ospathc(objfile)),
+        Eq(0));
+}
+
+TEST_F(NAME, evict_leaves_other_files_alone)
+{
+    std::string other = std::string(cache_dir) + "/other.txt";
+    FILE*       fp = fopen(other.c_str(), "wb");
+    ASSERT_THAT(fp, NotNull());
+    fclose(fp);
+
+    writeObject("object");
+    ASSERT_THAT(
+        obj_cache_store(cstr_ospathc(cache_dir), 1, cstr_ospathc(objfile)),
+        Eq(0));
+
+    EXPECT_THAT(obj_cache_evict(cstr_ospathc(cache_dir), 0), Eq(1));
+    EXPECT_THAT(countObjects(), Eq(1));
+    EXPECT_TRUE(std::filesystem::exists(other));
+}
@@ -0,0 +1,105 @@
+#include <filesystem>
+
+#include "gmock/gmock.h"
+
+extern "C" {
+#include "odb-compiler/parser/db_lexer.h"
+#include "odb-util/ospath.h"
+}
+
+#define NAME odbcompiler_db_lexer_differential
+
+using namespace testing;
+
+struct NAME : Test
+{
+    /* Runs both lexers over the string, once with FLEX scanning the buffer
+     * in-place and once with the source being streamed into FLEX */
+    void
+    diffString(const char* code)
+    {
+        struct db_source src;
+        ASSERT_THAT(db_source_open_string(&src, cstr_utf8_view(code)), Eq(0));
+        EXPECT_THAT(db_lexer_diff(src, "<string>"), Eq(0)) << code;
+        src.has_eob = 0;
+        EXPECT_THAT(db_lexer_diff(src, "<string>"), Eq(0)) << code;
+        src.has_eob = 1;
+        db_source_close(&src);
+    }
+
+    /* Runs both lexers over every file in a directory of the source tree */
+    int
+    diffDirectory(const char* dir)
+    {
+        int files = 0;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(
+                 std::filesystem::path(ODBCOMPILER_SOURCE_ROOT) / dir))
+        {
+            struct db_source src;
+            std::string      filename = entry.path().string();
+            if (!entry.is_regular_file())
+                continue;
+
+            if (db_source_open_file(&src, cstr_ospathc(filename.c_str())) != 0)
+                continue;
+            EXPECT_THAT(db_lexer_diff(src, filename.c_str()), Eq(0))
+                << filename;
+            db_source_close(&src);
+            files++;
+        }
+        return files;
+    }
+};
+
+TEST_F(NAME, identifiers_and_keywords)
+{
+    diffString("a = b\nfoo_bar1 = x# + y! + z& + w% + s$ + t?\n");
+    diffString("if a then b else c : endif\n");
+    diffString("true TRUE False falsey remark Rem$ remstart# x");
+}
+
+TEST_F(NAME, numbers)
+{
+    diffString("1 23 0x1F 0XaB 0x %1010 %2 % 1.5 .5 5. 1e5 1E+5 1e-5 1e 1e+");
+    diffString("1.5f 2F .5e3f 1.f 9223372036854775807 99999999999999999999");
+    diffString("0x7FFFFFFFFFFFFFFFF %11111111111111111111111111111111111111111111"
+               "111111111111111111111111");
+    diffString("1.00000000000000000000000000000000000000000000000000000000000"
+               "000000000000000000001");
+}
+
+TEST_F(NAME, operators)
+{
+    diffString("a <> b <= c >= d << e >> f || g && h ~~ i .. j");
+    diffString("a < b > c | d & e ~ f . g ^ h * i / j - k + l = m ( n ) , o");
+    diffString("#constant X 5\n#constan\n# $ % & . : ;");
+}
+
+TEST_F(NAME, strings)
+{
+    diffString("print \"hello world\"\nprint \"\"\nprint \"unterminated\n");
+}
+
+TEST_F(NAME, remarks)
+{
+    diffString("rem comment\nprint 5\n` another\n// and another\n");
+    diffString("remstart\nfoo bar\n REMEND print 5");
+    diffString("/* comment \n * more */ print 5 /* unterminated");
+    diffString("remstart never ends");
+    diffString("rem no newline at end");
+}
+
+TEST_F(NAME, unusual_bytes)
+{
+    diffString("print \"\xc3\xa4\" \xc3\xa4 @ [ ] { } \\ '\t\r\n");
+}
+
+TEST_F(NAME, dba_sources)
+{
+    EXPECT_THAT(diffDirectory("dba-sources"), Gt(0));
+}
+
+TEST_F(NAME, afl_testcases)
+{
+    EXPECT_THAT(diffDirectory("afl/testcases"), Gt(0));
+}
@@ -87,3 +87,18 @@ TEST_F(NAME, match_longer_string_to_shorter_command)
     int ident = ast->nodes[ast->nodes[cmd].cmd.arglist].arglist.expr;
     ASSERT_THAT(ast_node_type(ast, ident), Eq(AST_IDENTIFIER));
 }
+
+TEST_F(NAME, match_commands_added_between_parses)
+{
+    addCommand("RANDOMIZE");
+    ASSERT_THAT(parse("randomize matrix"), Eq(0));
+    int cmd = ast->nodes[ast->root].block.stmt;
+    ASSERT_THAT(ast->nodes[cmd].cmd.id, Eq(0));
+
+    ast_deinit(ast);
+    ast_init(&ast);
+    addCommand("RANDOMIZE MATRIX");
+    ASSERT_THAT(parse("randomize matrix"), Eq(0));
+    cmd = ast->nodes[ast->root].block.stmt;
+    ASSERT_THAT(ast->nodes[cmd].cmd.id, Eq(1));
+}
@@ -0,0 +1,209 @@
+#include "odb-compiler/tests/DBParserHelper.hpp"
+#include "odb-util/tests/LogHelper.hpp"
+
+#include "gmock/gmock.h"
+
+#include <vector>
+
+extern "C" {
+#include "odb-compiler/ast/ast.h"
+#include "odb-compiler/semantic/passes.h"
+#include "odb-compiler/semantic/semantic.h"
+}
+
+#define NAME odbcompiler_semantic_passes
+
+using namespace testing;
+
+struct NAME : DBParserHelper, LogHelper, Test
+{
+    void
+    SetUp() override
+    {
+        semantic_passes_init(&passes);
+        visited.clear();
+    }
+
+    void
+    TearDown() override
+    {
+        semantic_passes_deinit(passes);
+    }
+
+    struct semantic_passes*    passes;
+    static std::vector<ast_id> visited;
+};
+
+std::vector<ast_id> NAME::visited;
+
+static int
+record_node(
+    struct ast** astp, ast_id n, const char* filename, const char* source)
+{
+    NAME::visited.push_back(n);
+    return 0;
+}
+
+static int
+fail_node(
+    struct ast** astp, ast_id n, const char* filename, const char* source)
+{
+    return -1;
+}
+
+static int
+dummy_check(
+    struct ast**               tus,
+    int                        tu_count,
+    int                        tu_id,
+    struct mutex**             tu_mutexes,
+    const struct utf8*         filenames,
+    const struct db_source*    sources,
+    const struct plugin_list*  plugins,
+    const struct cmd_list*     cmds,
+    const struct symbol_table* symbols,
+    struct semantic_session*   session)
+{
+    return 0;
+}
+
+static const struct semantic_check* no_depends[] = {NULL};
+
+static const struct semantic_visitor record_assignments
+    = {record_node,
+       SEMANTIC_VISIT_NODE(AST_ASSIGNMENT),
+       SEMANTIC_VISIT_ANY_ORDER};
+static const struct semantic_visitor record_blocks
+    = {record_node, SEMANTIC_VISIT_NODE(AST_BLOCK), SEMANTIC_VISIT_ANY_ORDER};
+
+static const struct semantic_check record_assignments_check
+    = {dummy_check, no_depends, "assignments", 0, &record_assignments};
+static const struct semantic_check record_blocks_check
+    = {dummy_check, no_depends, "blocks", 0, &record_blocks};
+
+static const struct semantic_visitor fail_blocks
+    = {fail_node, SEMANTIC_VISIT_NODE(AST_BLOCK), SEMANTIC_VISIT_ANY_ORDER};
+static const struct semantic_check fail_blocks_check
+    = {dummy_check, no_depends, "fail_blocks", 0, &fail_blocks};
+
+static const struct semantic_check* depends_on_fail[]
+    = {&fail_blocks_check, NULL};
+static const struct semantic_visitor record_assignments_after_fail
+    = {record_node,
+       SEMANTIC_VISIT_NODE(AST_ASSIGNMENT),
+       SEMANTIC_VISIT_PARENTS_FIRST};
+static const struct semantic_check record_assignments_after_fail_check
+    = {dummy_check,
+       depends_on_fail,
+       "assignments_after_fail",
+       0,
+       &record_assignments_after_fail};
+
+TEST_F(NAME, loop_for_shares_a_pass_with_unary_literal)
+{
+    ASSERT_THAT(
+        semantic_passes_build(&passes, &semantic_type_check, NULL), Eq(0));
+
+    ASSERT_THAT(semantic_passes_count(passes), Eq(4));
+    EXPECT_THAT(
+        semantic_passes_find(passes, &semantic_calculate_scope_ids), Eq(0));
+    EXPECT_THAT(semantic_passes_find(passes, &semantic_unary_literal), Eq(1));
+    EXPECT_THAT(semantic_passes_find(passes, &semantic_loop_for), Eq(1));
+    EXPECT_THAT(semantic_passes_find(passes, &semantic_loop_cont), Eq(2));
+    EXPECT_THAT(semantic_passes_find(passes, &semantic_type_check), Eq(3));
+    EXPECT_THAT(vec_get(passes, 1)->order, Eq(SEMANTIC_VISIT_CHILDREN_FIRST));
+}
+
+TEST_F(NAME, independent_visitor_joins_earliest_pass)
+{
+    static const struct semantic_check* depends[]
+        = {&semantic_loop_for, &semantic_loop_exit, NULL};
+    static const struct semantic_check check
+        = {dummy_check, depends, "check", 0, NULL};
+
+    ASSERT_THAT(semantic_passes_build(&passes, &check, NULL), Eq(0));
+
+    ASSERT_THAT(semantic_passes_count(passes), Eq(2));
+    EXPECT_THAT(vec_get(passes, 0)->count, Eq(3));
+    EXPECT_THAT(semantic_passes_find(passes, &semantic_loop_exit), Eq(0));
+}
+
+TEST_F(NAME, checks_that_already_ran_are_left_out)
+{
+    static const struct semantic_check* already_run[]
+        = {&semantic_loop_for, NULL};
+
+    ASSERT_THAT(
+        semantic_passes_build(&passes, &semantic_loop_cont, already_run),
+        Eq(0));
+
+    ASSERT_THAT(semantic_passes_count(passes), Eq(1));
+    EXPECT_THAT(semantic_passes_find(passes, &semantic_unary_literal), Eq(-1));
+    EXPECT_THAT(semantic_passes_find(passes, &semantic_loop_for), Eq(-1));
+    EXPECT_THAT(semantic_passes_find(passes, &semantic_loop_cont), Eq(0));
+}
+
+TEST_F(NAME, visit_parents_first)
+{
+    const struct semantic_check* checks[]
+        = {&record_blocks_check, &record_assignments_check};
+    ASSERT_THAT(parse("x = 1\n"), Eq(0)) << log().text;
+
+    ASSERT_THAT(
+        semantic_visit(
+            checks,
+            2,
+            SEMANTIC_VISIT_PARENTS_FIRST,
+            &ast,
+            "test",
+            src.text.data),
+        Eq(0));
+
+    ast_id block = ast->root;
+    ast_id ass = ast->nodes[block].block.stmt;
+    EXPECT_THAT(visited, ElementsAre(block, ass));
+}
+
+TEST_F(NAME, visit_children_first)
+{
+    const struct semantic_check* checks[]
+        = {&record_blocks_check, &record_assignments_check};
+    ASSERT_THAT(parse("x = 1\n"), Eq(0)) << log().text;
+
+    ASSERT_THAT(
+        semantic_visit(
+            checks,
+            2,
+            SEMANTIC_VISIT_CHILDREN_FIRST,
+            &ast,
+            "test",
+            src.text.data),
+        Eq(0));
+
+    ast_id block = ast->root;
+    ast_id ass = ast->nodes[block].block.stmt;
+    EXPECT_THAT(visited, ElementsAre(ass, block));
+}
+
+TEST_F(NAME, failed_visitor_only_stops_checks_depending_on_it)
+{
+    const struct semantic_check* checks[]
+        = {&fail_blocks_check,
+           &record_assignments_after_fail_check,
+           &record_assignments_check};
+    ASSERT_THAT(parse("x = 1\n"), Eq(0)) << log().text;
+
+    EXPECT_THAT(
+        semantic_visit(
+            checks,
+            3,
+            SEMANTIC_VISIT_PARENTS_FIRST,
+            &ast,
+            "test",
+            src.text.data),
+        Eq(-1));
+
+    ast_id block = ast->root;
+    ast_id ass = ast->nodes[block].block.stmt;
+    EXPECT_THAT(visited, ElementsAre(ass));
+}
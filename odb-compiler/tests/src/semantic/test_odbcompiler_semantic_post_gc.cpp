@@ -0,0 +1,108 @@
+#include "odb-compiler/tests/DBParserHelper.hpp"
+#include "odb-util/tests/LogHelper.hpp"
+#include "odb-util/tests/Utf8Helper.hpp"
+
+#include "gmock/gmock.h"
+
+extern "C" {
+#include "odb-compiler/ast/ast.h"
+#include "odb-compiler/ast/ast_integrity.h"
+#include "odb-compiler/ast/ast_ops.h"
+#include "odb-compiler/semantic/post.h"
+#include "odb-compiler/semantic/semantic.h"
+#include "odb-compiler/semantic/symbol_table.h"
+#include "odb-util/mem.h"
+}
+
+#define NAME odbcompiler_semantic_post_gc
+
+using namespace testing;
+
+struct NAME : DBParserHelper, LogHelper, Test
+{
+    int
+    countDeletedNodes()
+    {
+        int count = 0;
+        for (ast_id n = 0; n != ast_count(ast); ++n)
+            if (ast_node_type(ast, n) == AST_GC)
+                count++;
+        return count;
+    }
+};
+
+TEST_F(NAME, deleted_nodes_are_kept_until_gc)
+{
+    addCommand(TYPE_VOID, "PRINT", {TYPE_I32});
+    ASSERT_THAT(
+        parse("for n=1 to 5\n"
+              "    print n\n"
+              "next n\n"),
+        Eq(0))
+        << log().text;
+    ASSERT_THAT(semantic(&semantic_loop_for), Eq(0)) << log().text;
+    ASSERT_THAT(ast_verify_connectivity(ast), Eq(0));
+    EXPECT_THAT(countDeletedNodes(), Gt(0));
+}
+
+TEST_F(NAME, gc_renumbers_nodes_in_depth_first_order)
+{
+    addCommand(TYPE_VOID, "PRINT", {TYPE_I32});
+    ASSERT_THAT(
+        parse("for n=1 to 5\n"
+              "    print n\n"
+              "next n\n"),
+        Eq(0))
+        << log().text;
+    ASSERT_THAT(semantic(&semantic_loop_for), Eq(0)) << log().text;
+
+    ast_id  old_count = ast_count(ast);
+    int     deleted = countDeletedNodes();
+    ast_id  old_root = ast->root;
+    ast_id  old_loop = ast->nodes[ast->nodes[old_root].block.next].block.stmt;
+    ast_id* remap;
+    ASSERT_THAT(ast_gc(&ast, &remap), Eq(0));
+
+    EXPECT_THAT(ast_count(ast), Eq(old_count - deleted));
+    EXPECT_THAT(countDeletedNodes(), Eq(0));
+    EXPECT_THAT(ast_verify_connectivity(ast), Eq(0));
+    EXPECT_THAT(ast->root, Eq(0));
+    EXPECT_THAT(remap[old_root], Eq(0));
+
+    ast_id loop = ast->nodes[ast->nodes[ast->root].block.next].block.stmt;
+    EXPECT_THAT(ast_node_type(ast, loop), Eq(AST_LOOP));
+    EXPECT_THAT(remap[old_loop], Eq(loop));
+
+    /* The left child always directly follows its parent */
+    for (ast_id n = 0; n != ast_count(ast); ++n)
+        if (ast->nodes[n].base.left > -1)
+            EXPECT_THAT(ast->nodes[n].base.left, Eq(n + 1));
+
+    mem_free(remap);
+}
+
+TEST_F(NAME, post_gc_updates_symbol_table)
+{
+    addCommand(TYPE_VOID, "PRINT", {TYPE_I32});
+    ASSERT_THAT(
+        parse("for n=1 to 5\n"
+              "    print n\n"
+              "next n\n"
+              "FUNCTION test()\n"
+              "ENDFUNCTION\n"),
+        Eq(0))
+        << log().text;
+    ASSERT_THAT(
+        symbol_table_add_declarations_from_ast(&symbols, &ast, 0, &src), Eq(0))
+        << log().text;
+    ASSERT_THAT(semantic(&semantic_loop_for), Eq(0)) << log().text;
+    ASSERT_THAT(countDeletedNodes(), Gt(0));
+
+    ASSERT_THAT(post_gc(&ast, 1, symbols), Eq(0));
+    EXPECT_THAT(countDeletedNodes(), Eq(0));
+
+    const struct symbol_table_entry* entry
+        = symbol_table_find(symbols, cstr_utf8_view("test"));
+    ASSERT_THAT(entry, NotNull());
+    EXPECT_THAT(ast_node_type(ast, entry->ast_node), Eq(AST_FUNC));
+}
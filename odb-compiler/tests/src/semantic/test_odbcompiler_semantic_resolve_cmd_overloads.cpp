@@ -6,7 +6,9 @@
 extern "C" {
 #include "odb-compiler/ast/ast.h"
 #include "odb-compiler/ast/ast_integrity.h"
+#include "odb-compiler/semantic/overload_cache.h"
 #include "odb-compiler/semantic/semantic.h"
+#include "odb-compiler/semantic/session.h"
 #include "odb-compiler/semantic/symbol_table.h"
 }
 
@@ -28,8 +30,7 @@ TEST_F(NAME, prefer_exact_overload)
 
     int cmd = ast->nodes[ast->root].block.stmt;
     int expected_cmd_id = 1;
-    ASSERT_THAT(
-        cmds.param_types->data[expected_cmd_id]->data[0].type, Eq(TYPE_F32));
+    ASSERT_THAT(cmd_param(&cmds, expected_cmd_id, 0)->type, Eq(TYPE_F32));
     ASSERT_THAT(ast->nodes[cmd].cmd.id, Eq(expected_cmd_id));
 }
 
@@ -43,8 +44,7 @@ TEST_F(NAME, prefer_closer_matching_overload)
 
     int cmd = ast->nodes[ast->root].block.stmt;
     int expected_cmd_id = 1;
-    ASSERT_THAT(
-        cmds.param_types->data[expected_cmd_id]->data[0].type, Eq(TYPE_F64));
+    ASSERT_THAT(cmd_param(&cmds, expected_cmd_id, 0)->type, Eq(TYPE_F64));
     ASSERT_THAT(ast->nodes[cmd].cmd.id, Eq(expected_cmd_id));
 }
 
@@ -59,8 +59,7 @@ TEST_F(NAME, command_expr_passed_as_argument)
 
     int cmd = ast->nodes[ast->root].block.stmt;
     int expected_cmd_id = 2;
-    ASSERT_THAT(
-        cmds.param_types->data[expected_cmd_id]->data[0].type, Eq(TYPE_F32));
+    ASSERT_THAT(cmd_param(&cmds, expected_cmd_id, 0)->type, Eq(TYPE_F32));
     ASSERT_THAT(ast->nodes[cmd].cmd.id, Eq(expected_cmd_id));
 }
 
@@ -74,8 +73,7 @@ TEST_F(NAME, bool_is_promoted_to_integer_overload)
 
     int cmd = ast->nodes[ast->root].block.stmt;
     int expected_cmd_id = 2;
-    ASSERT_THAT(
-        cmds.param_types->data[expected_cmd_id]->data[0].type, Eq(TYPE_I64));
+    ASSERT_THAT(cmd_param(&cmds, expected_cmd_id, 0)->type, Eq(TYPE_I64));
     ASSERT_THAT(ast->nodes[cmd].cmd.id, Eq(expected_cmd_id));
 }
 
@@ -94,3 +92,44 @@ TEST_F(NAME, command_call_inside_func)
     ASSERT_THAT(semantic(&semantic_resolve_cmd_overloads), Eq(0)) << log().text;
     ASSERT_THAT(ast_verify_connectivity(ast), Eq(0));
 }
+
+TEST_F(NAME, repeated_calls_choose_same_overload)
+{
+    addCommand(TYPE_VOID, "PRINT", {TYPE_I32});
+    addCommand(TYPE_VOID, "PRINT", {TYPE_F32});
+    addCommand(TYPE_VOID, "PRINT", {TYPE_STRING});
+    ASSERT_THAT(
+        parse("print 5.5f\n"
+              "print 1\n"
+              "print 2.5f\n"),
+        Eq(0));
+    ASSERT_THAT(semantic(&semantic_resolve_cmd_overloads), Eq(0)) << log().text;
+
+    ast_id block = ast->root;
+    ast_id cmd1 = ast->nodes[block].block.stmt;
+    block = ast->nodes[block].block.next;
+    ast_id cmd2 = ast->nodes[block].block.stmt;
+    block = ast->nodes[block].block.next;
+    ast_id cmd3 = ast->nodes[block].block.stmt;
+    EXPECT_THAT(
+        cmd_param(&cmds, ast->nodes[cmd1].cmd.id, 0)->type, Eq(TYPE_F32));
+    EXPECT_THAT(
+        cmd_param(&cmds, ast->nodes[cmd2].cmd.id, 0)->type, Eq(TYPE_I32));
+    EXPECT_THAT(ast->nodes[cmd3].cmd.id, Eq(ast->nodes[cmd1].cmd.id));
+}
+
+TEST_F(NAME, chosen_overloads_are_remembered_by_the_session)
+{
+    enum type arg_types[] = {TYPE_F32};
+    addCommand(TYPE_VOID, "PRINT", {TYPE_I32});
+    addCommand(TYPE_VOID, "PRINT", {TYPE_F32});
+    ASSERT_THAT(parse("print 5.5f\n"), Eq(0));
+    ASSERT_THAT(semantic(&semantic_resolve_cmd_overloads), Eq(0)) << log().text;
+
+    int                    cmd = ast->nodes[ast->root].block.stmt;
+    struct overload_cache* overloads = semantic_session_overloads(session);
+    EXPECT_THAT(
+        overload_cache_find(overloads, 0, arg_types, 1),
+        Eq(ast->nodes[cmd].cmd.id));
+    EXPECT_THAT(overload_cache_overload_count(overloads, 0), Eq(2));
+}
@@ -44,6 +44,25 @@ TEST_F(NAME, float_accepts_byte_2)
               "BYTE AS BYTE  [test]\n"));
 }
 
+TEST_F(NAME, repeated_call_warns_every_time)
+{
+    addCommand(TYPE_VOID, "PRINT", {TYPE_F32});
+    ASSERT_THAT(parse("print 5\nprint 6\n"), Eq(0));
+    EXPECT_THAT(semantic(&semantic_resolve_cmd_overloads), Eq(0));
+    EXPECT_THAT(
+        log(),
+        LogEq("test:1:7: warning: Implicit conversion of argument 1 from BYTE "
+              "to FLOAT in command call.\n"
+              " 1 | print 5\n"
+              "   |       ^ BYTE\n"
+              "   = note: Calling command: PRINT FLOAT AS FLOAT  [test]\n"
+              "test:2:7: warning: Implicit conversion of argument 1 from BYTE "
+              "to FLOAT in command call.\n"
+              " 2 | print 6\n"
+              "   |       ^ BYTE\n"
+              "   = note: Calling command: PRINT FLOAT AS FLOAT  [test]\n"));
+}
+
 TEST_F(NAME, integer_accepts_float_with_warning)
 {
     addCommand(TYPE_VOID, "PRINT", {TYPE_I32});
@@ -0,0 +1,581 @@
+#include "odb-compiler/tests/DBParserHelper.hpp"
+
+#include <chrono>
+#include <functional>
+#include <gmock/gmock.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "odb-compiler/ast/ast.h"
+#include "odb-compiler/ast/ast_integrity.h"
+#include "odb-compiler/semantic/semantic.h"
+#include "odb-compiler/semantic/symbol_table.h"
+#include "odb-util/log.h"
+#include "odb-util/mem.h"
+#include "odb-util/mutex.h"
+#include "odb-util/utf8.h"
+}
+
+#define NAME odbcompiler_semantic_type_check_func_cross_tu
+
+using namespace testing;
+
+/* The TUs are checked in parallel, so the log output has to be collected under
+ * a lock */
+static std::mutex  log_mutex;
+static std::string log_text;
+static void
+write_log(const char* fmt, va_list ap)
+{
+    char                        buf[1024];
+    std::lock_guard<std::mutex> guard(log_mutex);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    log_text += buf;
+}
+
+struct NAME : DBParserHelper, Test
+{
+    void
+    SetUp() override
+    {
+        struct log_interface i = {write_log, 0};
+        old_log_interface = log_configure(i);
+    }
+
+    void
+    TearDown() override
+    {
+        for (int i = 0; i != (int)tus.size(); ++i)
+        {
+            ast_deinit(tus[i]);
+            db_source_close(&sources[i]);
+            mutex_destroy(mutexes[i]);
+            utf8_deinit(filenames[i]);
+        }
+        log_configure(old_log_interface);
+        log_text.clear();
+    }
+
+    int
+    addTU(const char* code)
+    {
+        int          tu_id = (int)tus.size();
+        std::string  name = "test" + std::to_string(tu_id);
+        struct utf8  filename = empty_utf8();
+        struct ast*  tu;
+        db_source    source;
+
+        if (db_source_open_string(&source, cstr_utf8_view(code)) != 0)
+            return -1;
+        ast_init(&tu);
+        utf8_set_cstr(&filename, name.c_str());
+        tus.push_back(tu);
+        sources.push_back(source);
+        filenames.push_back(filename);
+        mutexes.push_back(mutex_create());
+
+        if (db_parse(&p, &tus[tu_id], name.c_str(), sources[tu_id], &cmds)
+            != 0)
+            return -1;
+        return symbol_table_add_declarations_from_ast(
+            &symbols, tus.data(), tu_id, sources.data());
+    }
+
+    /* Runs a step on all TUs in parallel, like odb-cli does */
+    int
+    runStep(enum semantic_step step)
+    {
+        std::vector<std::thread> threads;
+        std::vector<int>         results(tus.size());
+
+        for (struct ast* tu : tus)
+            mem_release_ast(tu);
+        for (int i = 0; i != (int)tus.size(); ++i)
+            threads.emplace_back(
+                [this, step, i, &results]
+                {
+                    /* See SEMANTIC_STEP_TYPE_CHECK */
+                    bool owns_ast = step != SEMANTIC_STEP_TYPE_CHECK;
+                    if (mem_init() != 0)
+                    {
+                        results[i] = -1;
+                        return;
+                    }
+                    if (owns_ast)
+                        mem_acquire_ast(tus[i]);
+                    results[i] = semantic_run_essential_step(
+                        step,
+                        tus.data(),
+                        (int)tus.size(),
+                        i,
+                        mutexes.data(),
+                        filenames.data(),
+                        sources.data(),
+                        plugins,
+                        &cmds,
+                        symbols,
+                        session);
+                    if (owns_ast)
+                        mem_release_ast(tus[i]);
+                    mem_deinit();
+                });
+        for (std::thread& thread : threads)
+            thread.join();
+        for (struct ast* tu : tus)
+            mem_acquire_ast(tu);
+
+        for (int result : results)
+            if (result != 0)
+                return -1;
+        return 0;
+    }
+
+    int
+    semanticAll()
+    {
+        if (runStep(SEMANTIC_STEP_PREPARE) != 0)
+            return -1;
+        if (runStep(SEMANTIC_STEP_TYPE_CHECK) != 0)
+            return -1;
+        return runStep(SEMANTIC_STEP_FINISH);
+    }
+
+    /* Runs all checks on all TUs on the scheduler's thread pool */
+    int
+    semanticParallel()
+    {
+        int result;
+
+        for (struct ast* tu : tus)
+            mem_release_ast(tu);
+        result = semantic_run_essential_checks_parallel(
+            tus.data(),
+            (int)tus.size(),
+            mutexes.data(),
+            filenames.data(),
+            sources.data(),
+            plugins,
+            &cmds,
+            symbols,
+            session);
+        for (struct ast* tu : tus)
+            mem_acquire_ast(tu);
+
+        return result;
+    }
+
+    /* Starts the checks before any TU is ready, like odb-cli does while it's
+     * still parsing. The TUs were parsed already, but only become visible to
+     * the scheduler when feed() says so */
+    int
+    semanticPipelined(std::function<void(struct semantic_sched*)> feed)
+    {
+        struct semantic_sched* sched;
+        int                    result = -1;
+
+        for (struct ast* tu : tus)
+            mem_release_ast(tu);
+        sched = semantic_sched_start_essential_checks(
+            tus.data(),
+            (int)tus.size(),
+            mutexes.data(),
+            filenames.data(),
+            sources.data(),
+            plugins,
+            &cmds,
+            session);
+        if (sched != NULL)
+        {
+            feed(sched);
+            result = semantic_sched_finish(sched);
+        }
+        for (struct ast* tu : tus)
+            mem_acquire_ast(tu);
+
+        return result;
+    }
+
+    std::vector<ast_id>
+    findNodes(int tu_id, enum ast_type type)
+    {
+        std::vector<ast_id> nodes;
+        for (ast_id n = 0; n != ast_count(tus[tu_id]); ++n)
+            if (ast_node_type(tus[tu_id], n) == type)
+                nodes.push_back(n);
+        return nodes;
+    }
+
+    std::vector<struct ast*>       tus;
+    std::vector<struct db_source>  sources;
+    std::vector<struct utf8>       filenames;
+    std::vector<struct mutex*>     mutexes;
+    struct log_interface           old_log_interface;
+};
+
+TEST_F(NAME, call_takes_return_type_from_other_tu)
+{
+    ASSERT_THAT(addTU("x# = half(5.0f)\n"), Eq(0)) << log_text;
+    ASSERT_THAT(
+        addTU("FUNCTION half(a AS FLOAT)\n"
+              "ENDFUNCTION a / 2.0f\n"),
+        Eq(0))
+        << log_text;
+    ASSERT_THAT(semanticAll(), Eq(0)) << log_text;
+    ASSERT_THAT(ast_verify_connectivity(tus[0]), Eq(0));
+
+    std::vector<ast_id> calls = findNodes(0, AST_FUNC_CALL);
+    ASSERT_THAT(calls.size(), Eq(1u));
+    EXPECT_THAT(ast_type_info(tus[0], calls[0]), Eq(TYPE_F32));
+}
+
+TEST_F(NAME, argument_is_cast_to_parameter_type_of_other_tu)
+{
+    ASSERT_THAT(addTU("x# = half(5)\n"), Eq(0)) << log_text;
+    ASSERT_THAT(
+        addTU("FUNCTION half(a AS FLOAT)\n"
+              "ENDFUNCTION a / 2.0f\n"),
+        Eq(0))
+        << log_text;
+    ASSERT_THAT(semanticAll(), Eq(0)) << log_text;
+    ASSERT_THAT(ast_verify_connectivity(tus[0]), Eq(0));
+
+    std::vector<ast_id> calls = findNodes(0, AST_FUNC_CALL);
+    ASSERT_THAT(calls.size(), Eq(1u));
+    ast_id arglist = tus[0]->nodes[calls[0]].func_call.arglist;
+    ast_id arg = tus[0]->nodes[arglist].arglist.expr;
+    EXPECT_THAT(ast_node_type(tus[0], arg), Eq(AST_CAST));
+    EXPECT_THAT(ast_type_info(tus[0], arg), Eq(TYPE_F32));
+}
+
+TEST_F(NAME, polymorphic_function_is_instantiated_in_its_own_tu)
+{
+    ASSERT_THAT(
+        addTU("x# = twice(2.5f)\n"
+              "y = twice(2)\n"),
+        Eq(0))
+        << log_text;
+    ASSERT_THAT(
+        addTU("FUNCTION twice(a)\n"
+              "ENDFUNCTION a + a\n"),
+        Eq(0))
+        << log_text;
+    ASSERT_THAT(semanticAll(), Eq(0)) << log_text;
+    ASSERT_THAT(ast_verify_connectivity(tus[0]), Eq(0));
+    ASSERT_THAT(ast_verify_connectivity(tus[1]), Eq(0));
+
+    EXPECT_THAT(findNodes(0, AST_FUNC).size(), Eq(0u));
+    EXPECT_THAT(findNodes(1, AST_FUNC).size(), Eq(2u));
+
+    std::vector<ast_id> calls = findNodes(0, AST_FUNC_CALL);
+    ASSERT_THAT(calls.size(), Eq(2u));
+    EXPECT_THAT(ast_type_info(tus[0], calls[0]), Eq(TYPE_F32));
+    EXPECT_THAT(ast_type_info(tus[0], calls[1]), Eq(TYPE_U8));
+}
+
+TEST_F(NAME, many_tus_share_instantiations)
+{
+    for (int i = 0; i != 8; ++i)
+        ASSERT_THAT(
+            addTU("x# = twice(2.5f)\n"
+                  "y = add(1, 2)\n"),
+            Eq(0))
+            << log_text;
+    ASSERT_THAT(
+        addTU("FUNCTION twice(a)\n"
+              "ENDFUNCTION a + a\n"
+              "FUNCTION add(a AS INTEGER, b AS INTEGER)\n"
+              "ENDFUNCTION a + b\n"),
+        Eq(0))
+        << log_text;
+    ASSERT_THAT(semanticAll(), Eq(0)) << log_text;
+
+    /* A single instantiation of twice() and add() itself */
+    EXPECT_THAT(findNodes(8, AST_FUNC).size(), Eq(2u));
+    for (int i = 0; i != 8; ++i)
+    {
+        std::vector<ast_id> calls = findNodes(i, AST_FUNC_CALL);
+        ASSERT_THAT(calls.size(), Eq(2u));
+        EXPECT_THAT(ast_type_info(tus[i], calls[0]), Eq(TYPE_F32));
+        EXPECT_THAT(ast_type_info(tus[i], calls[1]), Eq(TYPE_I32));
+    }
+}
+
+TEST_F(NAME, recursion_across_tus_is_an_error)
+{
+    ASSERT_THAT(
+        addTU("FUNCTION ping(n AS INTEGER)\n"
+              "ENDFUNCTION pong(n)\n"),
+        Eq(0))
+        << log_text;
+    ASSERT_THAT(
+        addTU("FUNCTION pong(n AS INTEGER)\n"
+              "ENDFUNCTION ping(n)\n"),
+        Eq(0))
+        << log_text;
+    EXPECT_THAT(semanticAll(), Ne(0));
+    EXPECT_THAT(
+        log_text,
+        HasSubstr("Functions in different source files are recursively "
+                  "calling each other"));
+}
+
+TEST_F(NAME, parallel_call_takes_return_type_from_other_tu)
+{
+    ASSERT_THAT(addTU("x# = half(5)\n"), Eq(0)) << log_text;
+    ASSERT_THAT(
+        addTU("FUNCTION half(a AS FLOAT)\n"
+              "ENDFUNCTION a / 2.0f\n"),
+        Eq(0))
+        << log_text;
+    ASSERT_THAT(semanticParallel(), Eq(0)) << log_text;
+    ASSERT_THAT(ast_verify_connectivity(tus[0]), Eq(0));
+
+    std::vector<ast_id> calls = findNodes(0, AST_FUNC_CALL);
+    ASSERT_THAT(calls.size(), Eq(1u));
+    EXPECT_THAT(ast_type_info(tus[0], calls[0]), Eq(TYPE_F32));
+    ast_id arglist = tus[0]->nodes[calls[0]].func_call.arglist;
+    ast_id arg = tus[0]->nodes[arglist].arglist.expr;
+    EXPECT_THAT(ast_node_type(tus[0], arg), Eq(AST_CAST));
+}
+
+TEST_F(NAME, parallel_many_tus_share_instantiations)
+{
+    for (int i = 0; i != 16; ++i)
+        ASSERT_THAT(
+            addTU("x# = twice(2.5f)\n"
+                  "y = add(1, 2)\n"
+                  "for n = 1 to 10\n"
+                  "next n\n"),
+            Eq(0))
+            << log_text;
+    ASSERT_THAT(
+        addTU("FUNCTION twice(a)\n"
+              "ENDFUNCTION a + a\n"
+              "FUNCTION add(a AS INTEGER, b AS INTEGER)\n"
+              "ENDFUNCTION a + b\n"),
+        Eq(0))
+        << log_text;
+    ASSERT_THAT(semanticParallel(), Eq(0)) << log_text;
+
+    EXPECT_THAT(findNodes(16, AST_FUNC).size(), Eq(2u));
+    for (int i = 0; i != 16; ++i)
+    {
+        std::vector<ast_id> calls = findNodes(i, AST_FUNC_CALL);
+        ASSERT_THAT(calls.size(), Eq(2u));
+        EXPECT_THAT(ast_type_info(tus[i], calls[0]), Eq(TYPE_F32));
+        EXPECT_THAT(ast_type_info(tus[i], calls[1]), Eq(TYPE_I32));
+    }
+}
+
+TEST_F(NAME, parallel_error_in_one_tu_does_not_stop_other_tus)
+{
+    ASSERT_THAT(
+        addTU("do\n"
+              "loop\n"
+              "exit\n"),
+        Eq(0))
+        << log_text;
+    ASSERT_THAT(addTU("x# = 2.5 * 2\n"), Eq(0)) << log_text;
+    EXPECT_THAT(semanticParallel(), Ne(0));
+    EXPECT_THAT(log_text, HasSubstr("EXIT statement must be inside a loop."));
+
+    std::vector<ast_id> assignments = findNodes(1, AST_ASSIGNMENT);
+    ASSERT_THAT(assignments.size(), Eq(1u));
+    ast_id lhs = tus[1]->nodes[assignments[0]].assignment.lvalue;
+    EXPECT_THAT(ast_type_info(tus[1], lhs), Eq(TYPE_F32));
+}
+
+TEST_F(NAME, pipelined_tus_can_become_ready_in_any_order)
+{
+    ASSERT_THAT(addTU("x# = half(5)\n"), Eq(0)) << log_text;
+    ASSERT_THAT(
+        addTU("FUNCTION half(a AS FLOAT)\n"
+              "ENDFUNCTION a / 2.0f\n"),
+        Eq(0))
+        << log_text;
+    ASSERT_THAT(
+        semanticPipelined(
+            [](struct semantic_sched* sched)
+            {
+                semantic_sched_tu_ready(sched, 1);
+                semantic_sched_tu_ready(sched, 0);
+            }),
+        Eq(0))
+        << log_text;
+    ASSERT_THAT(ast_verify_connectivity(tus[0]), Eq(0));
+
+    std::vector<ast_id> calls = findNodes(0, AST_FUNC_CALL);
+    ASSERT_THAT(calls.size(), Eq(1u));
+    EXPECT_THAT(ast_type_info(tus[0], calls[0]), Eq(TYPE_F32));
+}
+
+TEST_F(NAME, pipelined_tu_that_failed_to_parse_fails_the_checks)
+{
+    ASSERT_THAT(addTU("x# = 2.5 * 2\n"), Eq(0)) << log_text;
+    ASSERT_THAT(addTU("y# = 2.5 * 2\n"), Eq(0)) << log_text;
+    EXPECT_THAT(
+        semanticPipelined(
+            [](struct semantic_sched* sched)
+            {
+                semantic_sched_tu_failed(sched, 0);
+                semantic_sched_tu_ready(sched, 1);
+            }),
+        Ne(0));
+}
+
+TEST_F(NAME, pipelined_call_waits_for_tu_that_is_still_being_parsed)
+{
+    ASSERT_THAT(addTU("x# = half(5)\n"), Eq(0)) << log_text;
+    ASSERT_THAT(
+        addTU("FUNCTION half(a AS FLOAT)\n"
+              "ENDFUNCTION a / 2.0f\n"),
+        Eq(0))
+        << log_text;
+    ASSERT_THAT(
+        semanticPipelined(
+            [](struct semantic_sched* sched)
+            {
+                /* The caller's type check starts before the function is
+                 * declared */
+                semantic_sched_tu_ready(sched, 0);
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                semantic_sched_tu_ready(sched, 1);
+            }),
+        Eq(0))
+        << log_text;
+    ASSERT_THAT(ast_verify_connectivity(tus[0]), Eq(0));
+
+    std::vector<ast_id> calls = findNodes(0, AST_FUNC_CALL);
+    ASSERT_THAT(calls.size(), Eq(1u));
+    EXPECT_THAT(ast_type_info(tus[0], calls[0]), Eq(TYPE_F32));
+}
+
+TEST_F(NAME, pipelined_call_into_tu_that_failed_to_parse_fails)
+{
+    ASSERT_THAT(addTU("x# = half(5)\n"), Eq(0)) << log_text;
+    ASSERT_THAT(
+        addTU("FUNCTION half(a AS FLOAT)\n"
+              "ENDFUNCTION a / 2.0f\n"),
+        Eq(0))
+        << log_text;
+    EXPECT_THAT(
+        semanticPipelined(
+            [](struct semantic_sched* sched)
+            {
+                semantic_sched_tu_ready(sched, 0);
+                semantic_sched_tu_failed(sched, 1);
+            }),
+        Ne(0));
+    EXPECT_THAT(log_text, HasSubstr("Command or function not found."));
+}
+
+TEST_F(NAME, pipelined_unknown_function_is_reported_once_all_tus_are_ready)
+{
+    ASSERT_THAT(addTU("x# = quarter(5)\n"), Eq(0)) << log_text;
+    ASSERT_THAT(
+        addTU("FUNCTION half(a AS FLOAT)\n"
+              "ENDFUNCTION a / 2.0f\n"),
+        Eq(0))
+        << log_text;
+    EXPECT_THAT(
+        semanticPipelined(
+            [](struct semantic_sched* sched)
+            {
+                semantic_sched_tu_ready(sched, 0);
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                semantic_sched_tu_ready(sched, 1);
+            }),
+        Ne(0));
+    EXPECT_THAT(log_text, HasSubstr("Command or function not found."));
+}
+
+TEST_F(NAME, pipelined_tus_that_never_become_ready_fail_the_checks)
+{
+    ASSERT_THAT(addTU("x# = 2.5 * 2\n"), Eq(0)) << log_text;
+    ASSERT_THAT(addTU("y# = 2.5 * 2\n"), Eq(0)) << log_text;
+    EXPECT_THAT(
+        semanticPipelined(
+            [](struct semantic_sched* sched)
+            { semantic_sched_tu_ready(sched, 1); }),
+        Ne(0));
+}
+
+TEST_F(NAME, merged_symbol_tables_resolve_calls_across_tus)
+{
+    struct symbol_table* staged[2];
+
+    ASSERT_THAT(addTU("x# = half(5.0f)\n"), Eq(0)) << log_text;
+    ASSERT_THAT(
+        addTU("FUNCTION half(a AS FLOAT)\n"
+              "ENDFUNCTION a / 2.0f\n"
+              "FUNCTION half2(a AS FLOAT)\n"
+              "ENDFUNCTION a / 2.0f\n"),
+        Eq(0))
+        << log_text;
+
+    /* Register each TU in a table of its own, like the parser threads of
+     * odb-cli do, and merge them twice to check that merging the same
+     * declarations again is accepted */
+    symbol_table_deinit(symbols);
+    symbol_table_init(&symbols);
+    for (int i = 0; i != 2; ++i)
+    {
+        symbol_table_init(&staged[i]);
+        ASSERT_THAT(
+            symbol_table_add_declarations_from_ast(
+                &staged[i], tus.data(), i, sources.data()),
+            Eq(0));
+    }
+    for (int i = 0; i != 4; ++i)
+        ASSERT_THAT(symbol_table_merge(&symbols, staged[i % 2]), Eq(0));
+    for (int i = 0; i != 2; ++i)
+        symbol_table_deinit(staged[i]);
+
+    const struct symbol_table_entry* entry
+        = symbol_table_find(symbols, cstr_utf8_view("half2"));
+    ASSERT_THAT(entry, NotNull());
+    EXPECT_THAT(entry->tu_id, Eq(1));
+
+    ASSERT_THAT(semanticParallel(), Eq(0)) << log_text;
+    std::vector<ast_id> calls = findNodes(0, AST_FUNC_CALL);
+    ASSERT_THAT(calls.size(), Eq(1u));
+    EXPECT_THAT(ast_type_info(tus[0], calls[0]), Eq(TYPE_F32));
+}
+
+TEST_F(NAME, merging_symbol_tables_with_the_same_function_fails)
+{
+    struct symbol_table* staged[2];
+
+    ASSERT_THAT(
+        addTU("FUNCTION half(a AS FLOAT)\n"
+              "ENDFUNCTION a / 2.0f\n"),
+        Eq(0))
+        << log_text;
+    /* addTU() also registers the function in the shared table, where it
+     * clashes with the one of TU 0 */
+    ASSERT_THAT(
+        addTU("FUNCTION half(a AS FLOAT)\n"
+              "ENDFUNCTION a / 2.0f\n"),
+        Ne(0))
+        << log_text;
+
+    symbol_table_deinit(symbols);
+    symbol_table_init(&symbols);
+    for (int i = 0; i != 2; ++i)
+    {
+        symbol_table_init(&staged[i]);
+        ASSERT_THAT(
+            symbol_table_add_declarations_from_ast(
+                &staged[i], tus.data(), i, sources.data()),
+            Eq(0));
+    }
+    EXPECT_THAT(symbol_table_merge(&symbols, staged[0]), Eq(0));
+    EXPECT_THAT(symbol_table_merge(&symbols, staged[1]), Ne(0));
+    for (int i = 0; i != 2; ++i)
+        symbol_table_deinit(staged[i]);
+
+    EXPECT_THAT(log_text, HasSubstr("is declared more than once"));
+}
@@ -277,6 +277,52 @@ TEST_F(NAME, call_same_function_multiple_times_only_instantiates_function_once)
     ASSERT_THAT(ast_node_type(ast, func), Eq(AST_FUNC));
 }
 
+TEST_F(NAME, alternating_argument_types_reuse_existing_instantiations)
+{
+    addCommand(TYPE_VOID, "PRINT", {TYPE_F32});
+    const char* source
+        = "PRINT sum(2, 3)\n"
+          "PRINT sum(2.2f, 3.3f)\n"
+          "PRINT sum(4, 5)\n"
+          "PRINT sum(4.4f, 5.5f)\n"
+          "FUNCTION sum(a, b)\n"
+          "ENDFUNCTION a + b\n";
+    ASSERT_THAT(parse(source), Eq(0)) << log().text;
+    ASSERT_THAT(
+        symbol_table_add_declarations_from_ast(&symbols, &ast, 0, &src), Eq(0))
+        << log().text;
+    ASSERT_THAT(semantic(&semantic_type_check), Eq(0)) << log().text;
+    ASSERT_THAT(ast_verify_connectivity(ast), Eq(0));
+
+    int func_count = 0;
+    for (ast_id n = 0; n != ast_count(ast); ++n)
+        if (ast_node_type(ast, n) == AST_FUNC)
+            func_count++;
+    ASSERT_THAT(func_count, Eq(2));
+}
+
+TEST_F(NAME, explicitly_typed_parameters_dont_cause_new_instantiations)
+{
+    addCommand(TYPE_VOID, "PRINT", {TYPE_F32});
+    const char* source
+        = "PRINT scale(2, 3)\n"
+          "PRINT scale(2, 3.3f)\n"
+          "FUNCTION scale(a, b AS FLOAT)\n"
+          "ENDFUNCTION a * b\n";
+    ASSERT_THAT(parse(source), Eq(0)) << log().text;
+    ASSERT_THAT(
+        symbol_table_add_declarations_from_ast(&symbols, &ast, 0, &src), Eq(0))
+        << log().text;
+    ASSERT_THAT(semantic(&semantic_type_check), Eq(0)) << log().text;
+    ASSERT_THAT(ast_verify_connectivity(ast), Eq(0));
+
+    int func_count = 0;
+    for (ast_id n = 0; n != ast_count(ast); ++n)
+        if (ast_node_type(ast, n) == AST_FUNC)
+            func_count++;
+    ASSERT_THAT(func_count, Eq(1));
+}
+
 TEST_F(NAME, func_returns_result_of_another_func)
 {
     addCommand(TYPE_VOID, "PRINT", {TYPE_U8});
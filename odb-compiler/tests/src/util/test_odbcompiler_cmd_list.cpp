@@ -33,3 +33,203 @@ TEST_F(NAME, added_commands_are_lexicographically_sorted)
     EXPECT_THAT(addCommand("READ"), Eq(4));
 }
 
+
+static void
+expectSameCommands(const struct cmd_list* a, const struct cmd_list* b)
+{
+    ASSERT_THAT(cmd_list_count(a), Eq(cmd_list_count(b)));
+    for (cmd_id cmd = 0; cmd != cmd_list_count(a); ++cmd)
+    {
+        struct utf8_span name_a = utf8_list_span(a->db_cmd_names, cmd);
+        struct utf8_span name_b = utf8_list_span(b->db_cmd_names, cmd);
+        struct utf8_span sym_a = utf8_list_span(a->c_symbols, cmd);
+        struct utf8_span sym_b = utf8_list_span(b->c_symbols, cmd);
+        EXPECT_THAT(
+            std::string(a->db_cmd_names->data + name_a.off, name_a.len),
+            StrEq(std::string(b->db_cmd_names->data + name_b.off, name_b.len)));
+        EXPECT_THAT(
+            std::string(a->c_symbols->data + sym_a.off, sym_a.len),
+            StrEq(std::string(b->c_symbols->data + sym_b.off, sym_b.len)));
+        EXPECT_THAT(a->plugin_ids->data[cmd], Eq(b->plugin_ids->data[cmd]));
+        ASSERT_THAT(cmd_param_count(a, cmd), Eq(cmd_param_count(b, cmd)));
+        for (int i = 0; i != cmd_param_count(a, cmd); ++i)
+        {
+            EXPECT_THAT(
+                cmd_param(a, cmd, i)->type, Eq(cmd_param(b, cmd, i)->type));
+            EXPECT_THAT(
+                cmd_param(a, cmd, i)->direction,
+                Eq(cmd_param(b, cmd, i)->direction));
+            EXPECT_THAT(
+                cmd_param_name_cstr(a, cmd, i),
+                StrEq(cmd_param_name_cstr(b, cmd, i)));
+        }
+    }
+}
+
+TEST_F(NAME, appended_commands_sort_the_same_as_added_commands)
+{
+    struct cmd_list added, appended;
+    const char*     names[]
+        = {"RANDOMIZE", "PRINT", "RANDOMIZE", "MAKE OBJECT", "PRINT", "PRINT"};
+    const char* symbols[] = {"r1", "p1", "r2", "m1", "p2", "p3"};
+
+    cmd_list_init(&added);
+    cmd_list_init(&appended);
+
+    /* Both lists start with the same sorted command */
+    cmd_list_add(
+        &added, 0, TYPE_VOID, cstr_utf8_view("PRINT"), cstr_utf8_view("p0"));
+    cmd_list_add(
+        &appended, 0, TYPE_VOID, cstr_utf8_view("PRINT"), cstr_utf8_view("p0"));
+
+    for (int i = 0; i != 6; ++i)
+    {
+        struct utf8_view name = cstr_utf8_view(names[i]);
+        struct utf8_view symbol = cstr_utf8_view(symbols[i]);
+        cmd_id           a = cmd_list_add(&added, 1, TYPE_VOID, name, symbol);
+        cmd_id b = cmd_list_append(&appended, 1, TYPE_VOID, name, symbol);
+        ASSERT_THAT(a, Ge(0));
+        ASSERT_THAT(b, Eq(i + 1));
+
+        /* Parameters are added using the returned ID before sorting, and the
+         * parameter count tells the overloads apart */
+        for (int p = 0; p != i; ++p)
+        {
+            struct utf8_view param = cstr_utf8_view("x");
+            cmd_add_param(&added, a, TYPE_I32, CMD_PARAM_IN, param);
+            cmd_add_param(&appended, b, TYPE_I32, CMD_PARAM_IN, param);
+        }
+    }
+
+    ASSERT_THAT(cmd_list_sort(&appended), Eq(0));
+    expectSameCommands(&added, &appended);
+    EXPECT_THAT(appended.longest_command, Eq(added.longest_command));
+    EXPECT_THAT(cmd_list_find(&appended, cstr_utf8_view("PRINT")), Eq(1));
+
+    cmd_list_deinit(&appended);
+    cmd_list_deinit(&added);
+}
+
+TEST_F(NAME, append_list_keeps_order_and_params)
+{
+    struct cmd_list plugin, merged, expected;
+    struct utf8_view param = cstr_utf8_view("x");
+
+    cmd_list_init(&plugin);
+    cmd_list_init(&merged);
+    cmd_list_init(&expected);
+
+    cmd_list_append(
+        &plugin, 3, TYPE_VOID, cstr_utf8_view("PRINT"), cstr_utf8_view("p1"));
+    cmd_list_append(
+        &plugin, 3, TYPE_I32, cstr_utf8_view("ABS"), cstr_utf8_view("a1"));
+    cmd_add_param(&plugin, 1, TYPE_I32, CMD_PARAM_IN, param);
+    cmd_list_append(
+        &plugin, 3, TYPE_VOID, cstr_utf8_view("PRINT"), cstr_utf8_view("p2"));
+    cmd_add_param(&plugin, 2, TYPE_F32, CMD_PARAM_OUT, param);
+
+    cmd_list_add(
+        &expected, 3, TYPE_VOID, cstr_utf8_view("PRINT"), cstr_utf8_view("p1"));
+    cmd_id abs = cmd_list_add(
+        &expected, 3, TYPE_I32, cstr_utf8_view("ABS"), cstr_utf8_view("a1"));
+    cmd_add_param(&expected, abs, TYPE_I32, CMD_PARAM_IN, param);
+    cmd_id print = cmd_list_add(
+        &expected, 3, TYPE_VOID, cstr_utf8_view("PRINT"), cstr_utf8_view("p2"));
+    cmd_add_param(&expected, print, TYPE_F32, CMD_PARAM_OUT, param);
+
+    ASSERT_THAT(cmd_list_append_list(&merged, &plugin), Eq(0));
+    ASSERT_THAT(cmd_list_sort(&merged), Eq(0));
+    expectSameCommands(&expected, &merged);
+    EXPECT_THAT(cmd_param(&merged, print, 0)->type, Eq(TYPE_F32));
+    EXPECT_THAT(cmd_param(&merged, print, 0)->direction, Eq(CMD_PARAM_OUT));
+
+    cmd_list_deinit(&expected);
+    cmd_list_deinit(&merged);
+    cmd_list_deinit(&plugin);
+}
+
+TEST_F(NAME, params_can_be_added_in_any_order)
+{
+    struct cmd_list cmds;
+    cmd_list_init(&cmds);
+
+    cmd_id a = cmd_list_add(
+        &cmds, 0, TYPE_VOID, cstr_utf8_view("A"), cstr_utf8_view("a"));
+    cmd_add_param(&cmds, a, TYPE_I32, CMD_PARAM_IN, cstr_utf8_view("a1"));
+    cmd_id b = cmd_list_add(
+        &cmds, 0, TYPE_VOID, cstr_utf8_view("B"), cstr_utf8_view("b"));
+    cmd_add_param(&cmds, b, TYPE_F32, CMD_PARAM_IN, cstr_utf8_view("b1"));
+    ASSERT_THAT(
+        cmd_add_param(
+            &cmds, a, TYPE_STRING, CMD_PARAM_OUT, cstr_utf8_view("a2")),
+        Eq(0));
+
+    ASSERT_THAT(cmd_param_count(&cmds, a), Eq(2));
+    EXPECT_THAT(cmd_param(&cmds, a, 0)->type, Eq(TYPE_I32));
+    EXPECT_THAT(cmd_param_name_cstr(&cmds, a, 0), StrEq("a1"));
+    EXPECT_THAT(cmd_param(&cmds, a, 1)->type, Eq(TYPE_STRING));
+    EXPECT_THAT(cmd_param(&cmds, a, 1)->direction, Eq(CMD_PARAM_OUT));
+    EXPECT_THAT(cmd_param_name_cstr(&cmds, a, 1), StrEq("a2"));
+    ASSERT_THAT(cmd_param_count(&cmds, b), Eq(1));
+    EXPECT_THAT(cmd_param_name_cstr(&cmds, b, 0), StrEq("b1"));
+
+    /* Erasing the command that owns the last parameters frees them */
+    cmd_list_erase(&cmds, a);
+    EXPECT_THAT(cmd_param_list_count(cmds.params), Eq(2));
+    ASSERT_THAT(cmd_param_count(&cmds, 0), Eq(1));
+    EXPECT_THAT(cmd_param_name_cstr(&cmds, 0, 0), StrEq("b1"));
+
+    cmd_list_deinit(&cmds);
+}
+
+TEST_F(NAME, remap_plugins_removes_and_renumbers_commands)
+{
+    struct cmd_list    cmds, expected;
+    struct plugin_ids* plugin_map;
+    struct utf8_view   param = cstr_utf8_view("x");
+
+    cmd_list_init(&cmds);
+    cmd_list_init(&expected);
+    plugin_ids_init(&plugin_map);
+
+    cmd_list_add(
+        &cmds, 0, TYPE_VOID, cstr_utf8_view("PRINT"), cstr_utf8_view("p0"));
+    cmd_id abs = cmd_list_add(
+        &cmds, 1, TYPE_I32, cstr_utf8_view("ABS"), cstr_utf8_view("a1"));
+    cmd_add_param(&cmds, abs, TYPE_I32, CMD_PARAM_IN, param);
+    cmd_id make = cmd_list_add(
+        &cmds,
+        1,
+        TYPE_VOID,
+        cstr_utf8_view("MAKE OBJECT"),
+        cstr_utf8_view("m1"));
+    cmd_add_param(&cmds, make, TYPE_F32, CMD_PARAM_IN, param);
+    cmd_list_append(
+        &cmds, 2, TYPE_VOID, cstr_utf8_view("PRINT"), cstr_utf8_view("p2"));
+    cmd_add_param(&cmds, 3, TYPE_F32, CMD_PARAM_OUT, param);
+
+    /* Plugin 1 is dropped, plugins 0 and 2 swap places */
+    plugin_ids_push(&plugin_map, 2);
+    plugin_ids_push(&plugin_map, -1);
+    plugin_ids_push(&plugin_map, 0);
+
+    cmd_list_add(
+        &expected, 2, TYPE_VOID, cstr_utf8_view("PRINT"), cstr_utf8_view("p0"));
+    cmd_list_append(
+        &expected, 0, TYPE_VOID, cstr_utf8_view("PRINT"), cstr_utf8_view("p2"));
+    cmd_add_param(&expected, 1, TYPE_F32, CMD_PARAM_OUT, param);
+
+    ASSERT_THAT(cmd_list_remap_plugins(&cmds, plugin_map), Eq(0));
+    EXPECT_THAT(cmds.sorted_count, Eq(1));
+    EXPECT_THAT(cmds.longest_command, Eq(5));
+    EXPECT_THAT(cmd_param_list_count(cmds.params), Eq(1));
+    expectSameCommands(&expected, &cmds);
+
+    ASSERT_THAT(cmd_list_sort(&cmds), Eq(0));
+    ASSERT_THAT(cmd_list_sort(&expected), Eq(0));
+    expectSameCommands(&expected, &cmds);
+
+    plugin_ids_deinit(plugin_map);
+    cmd_list_deinit(&expected);
+    cmd_list_deinit(&cmds);
+}
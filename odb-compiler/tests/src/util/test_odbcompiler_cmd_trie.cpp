@@ -0,0 +1,119 @@
+#include "odb-compiler/tests/DBParserHelper.hpp"
+#include "gmock/gmock.h"
+
+extern "C" {
+#include "odb-compiler/sdk/cmd_trie.h"
+}
+
+#define NAME odbcompiler_cmd_trie
+
+using namespace testing;
+
+struct NAME : DBParserHelper, Test
+{
+    void
+    SetUp() override
+    {
+        cmd_trie_init(&trie);
+    }
+    void
+    TearDown() override
+    {
+        cmd_trie_deinit(trie);
+    }
+
+    cmd_id
+    lookup(const char* str)
+    {
+        struct utf8_span span = {0, (utf8_idx)strlen(str)};
+        int32_t          node = cmd_trie_walk(trie, CMD_TRIE_ROOT, str, span);
+        return node > -1 ? cmd_trie_cmd(trie, node) : -1;
+    }
+
+    struct cmd_trie* trie;
+};
+
+TEST_F(NAME, empty_list)
+{
+    ASSERT_THAT(cmd_trie_build(&trie, &cmds), Eq(0));
+    EXPECT_THAT(lookup("RANDOMIZE"), Eq(-1));
+}
+
+TEST_F(NAME, finds_all_commands)
+{
+    addCommand("PROJECTION MATRIX4");
+    addCommand("RANDOMIZE");
+    addCommand("RANDOMIZE MATRIX");
+    addCommand("RANDOMIZE MESH");
+    addCommand("READ");
+    ASSERT_THAT(cmd_trie_build(&trie, &cmds), Eq(0));
+
+    EXPECT_THAT(lookup("PROJECTION MATRIX4"), Eq(0));
+    EXPECT_THAT(lookup("RANDOMIZE"), Eq(1));
+    EXPECT_THAT(lookup("RANDOMIZE MATRIX"), Eq(2));
+    EXPECT_THAT(lookup("RANDOMIZE MESH"), Eq(3));
+    EXPECT_THAT(lookup("READ"), Eq(4));
+}
+
+TEST_F(NAME, lookup_is_case_insensitive)
+{
+    addCommand("RANDOMIZE");
+    addCommand("RANDOMIZE MATRIX");
+    ASSERT_THAT(cmd_trie_build(&trie, &cmds), Eq(0));
+
+    EXPECT_THAT(lookup("randomize"), Eq(0));
+    EXPECT_THAT(lookup("Randomize Matrix"), Eq(1));
+}
+
+TEST_F(NAME, prefixes_are_not_commands)
+{
+    addCommand("RANDOMIZE MATRIX");
+    ASSERT_THAT(cmd_trie_build(&trie, &cmds), Eq(0));
+
+    EXPECT_THAT(lookup("RANDOMIZE"), Eq(-1));
+    EXPECT_THAT(lookup("RANDOMIZE MATRIXX"), Eq(-1));
+}
+
+TEST_F(NAME, walk_stops_when_nothing_can_match)
+{
+    addCommand("RANDOMIZE");
+    ASSERT_THAT(cmd_trie_build(&trie, &cmds), Eq(0));
+
+    EXPECT_THAT(cmd_trie_next(trie, CMD_TRIE_ROOT, 'x'), Eq(-1));
+    int32_t node = cmd_trie_next(trie, CMD_TRIE_ROOT, 'r');
+    ASSERT_THAT(node, Gt(-1));
+    EXPECT_THAT(cmd_trie_has_children(trie, node), IsTrue());
+}
+
+TEST_F(NAME, overloads_resolve_to_first_command)
+{
+    addCommand(TYPE_VOID, "PRINT", {TYPE_I32});
+    addCommand(TYPE_VOID, "PRINT", {TYPE_F32});
+    ASSERT_THAT(cmd_trie_build(&trie, &cmds), Eq(0));
+
+    cmd_id first = cmd_list_find(&cmds, cstr_utf8_view("PRINT"));
+    EXPECT_THAT(lookup("print"), Eq(first));
+}
+
+TEST_F(NAME, keywords_share_nodes_with_commands)
+{
+    addCommand("LOOP OBJECT");
+    ASSERT_THAT(cmd_trie_build(&trie, &cmds), Eq(0));
+    ASSERT_THAT(cmd_trie_add_keyword(&trie, "loop", 42), Eq(0));
+    ASSERT_THAT(cmd_trie_add_keyword(&trie, "exit function", 43), Eq(0));
+
+    const char*      str = "Loop Object";
+    struct utf8_span loop = {0, 4};
+    int32_t          node = cmd_trie_walk(trie, CMD_TRIE_ROOT, str, loop);
+    ASSERT_THAT(node, Gt(-1));
+    EXPECT_THAT(cmd_trie_keyword(trie, node), Eq(42));
+    EXPECT_THAT(cmd_trie_cmd(trie, node), Eq(-1));
+    EXPECT_THAT(cmd_trie_has_children(trie, node), IsTrue());
+    EXPECT_THAT(lookup("LOOP OBJECT"), Eq(0));
+
+    str = "EXIT FUNCTION";
+    node = cmd_trie_walk(
+        trie, CMD_TRIE_ROOT, str, {0, (utf8_idx)strlen(str)});
+    ASSERT_THAT(node, Gt(-1));
+    EXPECT_THAT(cmd_trie_keyword(trie, node), Eq(43));
+}
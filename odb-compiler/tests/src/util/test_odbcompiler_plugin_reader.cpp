@@ -0,0 +1,210 @@
+#include "gmock/gmock.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "odb-compiler/sdk/plugin_reader.h"
+}
+
+#define NAME odbcompiler_plugin_reader
+
+using namespace testing;
+
+struct NAME : Test
+{
+    void
+    TearDown() override
+    {
+        if (!filename.empty())
+            std::filesystem::remove(filename);
+    }
+
+    void
+    put16(size_t off, uint16_t value)
+    {
+        memcpy(file.data() + off, &value, sizeof(value));
+    }
+    void
+    put32(size_t off, uint32_t value)
+    {
+        memcpy(file.data() + off, &value, sizeof(value));
+    }
+
+    /* Builds a PE32 file with a single .rsrc section containing one string
+     * table block */
+    void
+    buildPE(const std::vector<std::u16string>& strings)
+    {
+        const size_t rsrc = 0x200;
+        const size_t block = rsrc + 0x58;
+        size_t       end = block;
+        for (const auto& str : strings)
+            end += 2 + str.size() * 2;
+
+        file.assign(end, 0);
+        memcpy(file.data(), "MZ", 2);
+        put32(0x3C, 64);
+        memcpy(file.data() + 64, "PE\0\0", 4);
+        put16(64 + 4, 0x14C);     /* Machine */
+        put16(64 + 6, 1);         /* NumberOfSections */
+        put16(64 + 20, 224);      /* SizeOfOptionalHeader */
+        put16(88, 0x10B);         /* PE32 */
+        put32(88 + 92, 16);       /* NumberOfRvaAndSizes */
+        put32(88 + 96 + 16, 0x1000);
+        put32(88 + 96 + 20, (uint32_t)(end - rsrc));
+
+        memcpy(file.data() + 312, ".rsrc", 5);
+        put32(312 + 8, (uint32_t)(end - rsrc));  /* VirtualSize */
+        put32(312 + 12, 0x1000);                 /* VirtualAddress */
+        put32(312 + 16, (uint32_t)(end - rsrc)); /* SizeOfRawData */
+        put32(312 + 20, (uint32_t)rsrc);         /* PointerToRawData */
+
+        /* Type -> bundle -> language -> data entry */
+        put16(rsrc + 0x00 + 14, 1);
+        put32(rsrc + 0x10, 6);
+        put32(rsrc + 0x14, 0x80000000 | 0x18);
+        put16(rsrc + 0x18 + 14, 1);
+        put32(rsrc + 0x28, 1);
+        put32(rsrc + 0x2C, 0x80000000 | 0x30);
+        put16(rsrc + 0x30 + 14, 1);
+        put32(rsrc + 0x40, 0x409);
+        put32(rsrc + 0x44, 0x48);
+        put32(rsrc + 0x48, (uint32_t)(0x1000 + block - rsrc));
+        put32(rsrc + 0x4C, (uint32_t)(end - block));
+
+        size_t off = block;
+        for (const auto& str : strings)
+        {
+            put16(off, (uint16_t)str.size());
+            memcpy(file.data() + off + 2, str.data(), str.size() * 2);
+            off += 2 + str.size() * 2;
+        }
+    }
+
+    int
+    open(struct plugin_reader* reader)
+    {
+        filename = (std::filesystem::temp_directory_path()
+                    / ("odb-plugin-reader-test-"
+                       + std::string(UnitTest::GetInstance()
+                                         ->current_test_info()
+                                         ->name())
+                       + ".dll"))
+                       .string();
+        std::ofstream(filename, std::ios::binary)
+            .write((const char*)file.data(), file.size());
+        return plugin_reader_open(reader, cstr_ospathc(filename.c_str()));
+    }
+
+    std::vector<std::u16string>
+    readStrings(struct plugin_reader* reader, int* result)
+    {
+        std::vector<std::u16string> strings;
+        struct pe_string_iter       it;
+        struct utf16_view           str;
+        *result = plugin_reader_pe_strings(reader, &it);
+        if (*result != 0)
+            return strings;
+        while ((*result = pe_string_iter_next(&it, &str)) == 1)
+            strings.emplace_back((const char16_t*)str.data, str.len);
+        return strings;
+    }
+
+    std::vector<uint8_t> file;
+    std::string          filename;
+};
+
+TEST_F(NAME, rejects_unknown_format)
+{
+    struct plugin_reader reader;
+    file.assign(128, 'x');
+    EXPECT_THAT(open(&reader), Lt(0));
+}
+
+TEST_F(NAME, reads_pe_string_table)
+{
+    struct plugin_reader reader;
+    int                  result;
+    buildPE({u"print%S%Print", u"", u"", u"cls%0%Cls"});
+    ASSERT_THAT(open(&reader), Eq(0));
+    EXPECT_THAT(reader.format, Eq(PLUGIN_FORMAT_PE));
+
+    auto strings = readStrings(&reader, &result);
+    EXPECT_THAT(result, Eq(0));
+    EXPECT_THAT(strings, ElementsAre(u"print%S%Print", u"cls%0%Cls"));
+    plugin_reader_close(&reader);
+}
+
+TEST_F(NAME, truncated_string_table_is_malformed)
+{
+    struct plugin_reader reader;
+    int                  result;
+    buildPE({u"print%S%Print", u"cls%0%Cls"});
+    file.resize(file.size() - 4);
+    ASSERT_THAT(open(&reader), Eq(0));
+
+    readStrings(&reader, &result);
+    EXPECT_THAT(result, Lt(0));
+    plugin_reader_close(&reader);
+}
+
+TEST_F(NAME, string_overrunning_block_ends_iteration)
+{
+    struct plugin_reader reader;
+    int                  result;
+    buildPE({u"print%S%Print", u"cls%0%Cls"});
+    put16(file.size() - 2 - 9 * 2, 100);
+    ASSERT_THAT(open(&reader), Eq(0));
+
+    auto strings = readStrings(&reader, &result);
+    EXPECT_THAT(result, Eq(0));
+    EXPECT_THAT(strings, ElementsAre(u"print%S%Print"));
+    plugin_reader_close(&reader);
+}
+
+TEST_F(NAME, command_hash_only_depends_on_strings)
+{
+    struct plugin_reader reader;
+    hash64               a, b, c;
+
+    buildPE({u"print%S%Print", u"cls%0%Cls"});
+    ASSERT_THAT(open(&reader), Eq(0));
+    ASSERT_THAT(plugin_reader_command_hash(&reader, &a), Eq(0));
+    plugin_reader_close(&reader);
+
+    /* Same strings in a different place of the file */
+    buildPE({u"print%S%Print", u"", u"cls%0%Cls"});
+    ASSERT_THAT(open(&reader), Eq(0));
+    ASSERT_THAT(plugin_reader_command_hash(&reader, &b), Eq(0));
+    plugin_reader_close(&reader);
+
+    buildPE({u"print%S%Print", u"cls%0%CLS"});
+    ASSERT_THAT(open(&reader), Eq(0));
+    ASSERT_THAT(plugin_reader_command_hash(&reader, &c), Eq(0));
+    plugin_reader_close(&reader);
+
+    EXPECT_THAT(a, Eq(b));
+    EXPECT_THAT(a, Ne(c));
+}
+
+TEST_F(NAME, command_hash_depends_on_string_boundaries)
+{
+    struct plugin_reader reader;
+    hash64               a, b;
+
+    buildPE({u"print%S%Print", u"cls%0%Cls"});
+    ASSERT_THAT(open(&reader), Eq(0));
+    ASSERT_THAT(plugin_reader_command_hash(&reader, &a), Eq(0));
+    plugin_reader_close(&reader);
+
+    /* Same characters, split differently */
+    buildPE({u"print%S%Printcls", u"%0%Cls"});
+    ASSERT_THAT(open(&reader), Eq(0));
+    ASSERT_THAT(plugin_reader_command_hash(&reader, &b), Eq(0));
+    plugin_reader_close(&reader);
+
+    EXPECT_THAT(a, Ne(b));
+}
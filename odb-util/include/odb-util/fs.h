@@ -46,8 +46,24 @@ fs_copy_file_if_newer(struct ospathc src, struct ospathc dst);
 ODBUTIL_PUBLIC_API int
 fs_remove_file(struct ospathc path);
 
+/*!
+ * @brief Moves a file to a new path on the same file system, replacing the
+ * destination if it exists. Other processes see either the old or the new
+ * file at the destination, never a partially written one.
+ * @return Returns 0 on success, negative on error.
+ */
+ODBUTIL_PUBLIC_API int
+fs_rename_file(struct ospathc src, struct ospathc dst);
+
 ODBUTIL_PUBLIC_API int
 fs_get_appdata_dir(struct ospath* path);
 
 ODBUTIL_PUBLIC_API uint64_t
 fs_mtime_ms(struct ospathc path);
+
+/*!
+ * @brief Sets the modification time of an existing file to the current time.
+ * @return Returns 0 on success, negative on error.
+ */
+ODBUTIL_PUBLIC_API int
+fs_touch(struct ospathc path);
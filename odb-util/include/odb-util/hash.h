@@ -6,6 +6,7 @@
 
 typedef uint32_t hash32;
 typedef hash32   (*hash32_func)(const void*, int);
+typedef uint64_t hash64;
 
 /*!
  * @brief Calculate a hash from generic data, using Jenkin's "One At A Time".
@@ -14,6 +15,15 @@ typedef hash32   (*hash32_func)(const void*, int);
 ODBUTIL_PUBLIC_API hash32
 hash32_jenkins_oaat(const void* key, int len);
 
+/*!
+ * @brief Calculate a 64-bit hash from generic data, using Austin Appleby's
+ * MurmurHash64A. It processes 8 bytes at a time, so it is better suited for
+ * hashing larger blocks of data, e.g. file contents. Pass the result of a
+ * previous call as the seed to hash data that is split into several blocks.
+ */
+ODBUTIL_PUBLIC_API hash64
+hash64_murmur64a(const void* key, int len, hash64 seed);
+
 uint32_t hash32_jenkins_hashword(const uint32_t* k, uintptr_t length, uint32_t initval);
 uint32_t hash32_jenkins_hashlittle(const uint32_t* k, uintptr_t length, uint32_t initval);
 void hash32_jenkins_hashlittle2(const void* k, uintptr_t length, uint32_t* pc, uint32_t* pb);
@@ -10,6 +10,11 @@
 #define HM_SLOT_UNUSED 0 /* SLOT_UNUSED must be 0 for memset() to work */
 #define HM_SLOT_RIP    1
 
+/* Invoked after every probe sequence, including the ones done while rehashing,
+ * with the hashmap and the number of slots that were visited. A file can #undef
+ * and redefine this before HM_DEFINE_API*() to collect statistics */
+#define HM_ON_LOOKUP(hm, probes) ((void)(hm), (void)(probes))
+
 enum hm_status
 {
     HM_OOM = -1,
@@ -309,7 +314,10 @@ enum hm_status
         int##bits##_t last_rip = -1;                                           \
                                                                                \
         slot = (int##bits##_t)(h & (H)(hm->capacity - 1));                     \
-        while (hm->hashes[slot] != HM_SLOT_UNUSED)                             \
+        /* Erasing leaves tombstones behind, which don't count towards the     \
+         * rehash threshold. If enough keys are inserted and erased, there may \
+         * be no unused slots left, so stop after every slot was visited */    \
+        while (hm->hashes[slot] != HM_SLOT_UNUSED && i != hm->capacity)        \
         {                                                                      \
             /* If the same hash already exists in this slot, and this isn't    \
              * the result of a hash collision (which we can verify by          \
@@ -317,7 +325,10 @@ enum hm_status
              * already inserted */                                             \
             if (hm->hashes[slot] == h)                                         \
                 if (keys_equal_func(get_key_func(&hm->kvs, slot), key))        \
+                {                                                              \
+                    HM_ON_LOOKUP(hm, i + 1);                                   \
                     return -(1 + slot);                                        \
+                }                                                              \
             /* Keep track of visited tombstones, as it's possible to insert    \
              * into them */                                                    \
             if (hm->hashes[slot] == HM_SLOT_RIP)                               \
@@ -335,6 +346,7 @@ enum hm_status
         if (last_rip != -1)                                                    \
             slot = last_rip;                                                   \
                                                                                \
+        HM_ON_LOOKUP(hm, i + 1);                                               \
         return slot;                                                           \
     }                                                                          \
     V* prefix##_emplace_new(struct prefix** hm, K key)                         \
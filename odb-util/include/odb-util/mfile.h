@@ -20,6 +20,23 @@ struct mfile
 ODBUTIL_PUBLIC_API int
 mfile_map_read(struct mfile* mf, struct ospathc filepath, int log_error);
 
+/*!
+ * \brief Memory-maps a file with copy-on-write access and tries to make room
+ * for "padding" zero bytes directly after the end of the file. This only
+ * works if the padding fits into the unused remainder of the file's last page,
+ * which the OS fills with zeros.
+ * \param[out] mf Pointer to mfile structure. Struct can be uninitialized.
+ * The size is set to the size of the file, excluding any padding.
+ * \param[in] file Utf8 encoded file path.
+ * \param[in] padding Number of zero bytes required after the end of the file.
+ * \param[in] log_error If set to 0, no log messages are written.
+ * \return Returns 0 if the file was mapped with padding, 1 if the file was
+ * mapped without padding, and negative on failure.
+ */
+ODBUTIL_PUBLIC_API int
+mfile_map_cow_padded(
+    struct mfile* mf, struct ospathc filepath, int padding, int log_error);
+
 /*!
  * \brief Memory-maps a file for writing. The existing file is overwritten.
  * \param[out] mf Pointer to mfile structure. Struct can be uninitialized.
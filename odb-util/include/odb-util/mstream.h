@@ -151,7 +151,7 @@ mstream_read_ospath(struct mstream* ms)
 {
     struct ospathc path;
     path.len = mstream_read_li16(ms);
-    path.str.data = mstream_read(ms, path.len + 1);
+    path.str.data = (const char*)mstream_read(ms, path.len + 1);
     return path;
 }
 
@@ -161,7 +161,7 @@ mstream_read_utf8(struct mstream* ms)
     struct utf8_view str;
     str.len = mstream_read_li16(ms);
     str.off = 0;
-    str.data = mstream_read(ms, str.len + 1);
+    str.data = (const char*)mstream_read(ms, str.len + 1);
     return str;
 }
 
@@ -3,6 +3,7 @@
 #include "odb-util/config.h"
 
 struct mutex;
+struct cond;
 
 ODBUTIL_PUBLIC_API struct mutex*
 mutex_create(void);
@@ -27,3 +28,43 @@ mutex_trylock(struct mutex* m);
 
 ODBUTIL_PUBLIC_API void
 mutex_unlock(struct mutex* m);
+
+ODBUTIL_PUBLIC_API struct cond*
+cond_create(void);
+
+ODBUTIL_PUBLIC_API void
+cond_destroy(struct cond* c);
+
+/*!
+ * \brief Unlocks the mutex and blocks until the condition is signalled, then
+ * locks the mutex again. The wait may also end without the condition being
+ * signalled, so always check what is waited for in a loop.
+ * \param[in] c Condition
+ * \param[in] m Mutex locked by the calling thread
+ */
+ODBUTIL_PUBLIC_API void
+cond_wait(struct cond* c, struct mutex* m);
+
+/*! \brief Wakes up at least one thread waiting on the condition. */
+ODBUTIL_PUBLIC_API void
+cond_signal(struct cond* c);
+
+/*! \brief Wakes up all threads waiting on the condition. */
+ODBUTIL_PUBLIC_API void
+cond_broadcast(struct cond* c);
+
+#if defined(ODBUTIL_MEM_DEBUGGING)
+ODBUTIL_PUBLIC_API void
+mem_acquire_mutex(struct mutex* m);
+ODBUTIL_PUBLIC_API void
+mem_release_mutex(struct mutex* m);
+ODBUTIL_PUBLIC_API void
+mem_acquire_cond(struct cond* c);
+ODBUTIL_PUBLIC_API void
+mem_release_cond(struct cond* c);
+#else
+#   define mem_acquire_mutex(m)
+#   define mem_release_mutex(m)
+#   define mem_acquire_cond(c)
+#   define mem_release_cond(c)
+#endif
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "odb-util/config.h"
+#include <stdint.h>
+
+/*!
+ * @brief Returns the current value of a monotonic clock in microseconds. The
+ * value itself has no meaning, it is only useful for measuring durations.
+ */
+ODBUTIL_PUBLIC_API uint64_t
+time_get_us(void);
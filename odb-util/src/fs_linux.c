@@ -7,8 +7,10 @@
 #include <dirent.h>
 #include <errno.h>
 #include <pwd.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -185,6 +187,37 @@ fs_copy_file_if_newer(struct ospathc src, struct ospathc dst)
     return fs_copy_file(src, dst);
 }
 
+int
+fs_remove_file(struct ospathc path)
+{
+    if (unlink(ospathc_cstr(path)) != 0)
+    {
+        log_util_err(
+            "Failed to remove file {quote:%s}: %s\n",
+            ospathc_cstr(path),
+            strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+fs_rename_file(struct ospathc src, struct ospathc dst)
+{
+    if (rename(ospathc_cstr(src), ospathc_cstr(dst)) != 0)
+    {
+        log_util_err(
+            "Failed to rename file {quote:%s} to {quote:%s}: %s\n",
+            ospathc_cstr(src),
+            ospathc_cstr(dst),
+            strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
 int
 fs_get_appdata_dir(struct ospath* path)
 {
@@ -207,3 +240,18 @@ fs_mtime_ms(struct ospathc path)
     return ((uint64_t)st.st_mtim.tv_sec * 1000)
            + ((uint64_t)st.st_mtim.tv_nsec / 1000000);
 }
+
+int
+fs_touch(struct ospathc path)
+{
+    if (utimes(ospathc_cstr(path), NULL) != 0)
+    {
+        log_util_err(
+            "Failed to update modification time of {quote:%s}: %s\n",
+            ospathc_cstr(path),
+            strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
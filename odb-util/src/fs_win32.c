@@ -201,6 +201,23 @@ fs_remove_file(struct ospathc path)
     return 0;
 }
 
+int
+fs_rename_file(struct ospathc src, struct ospathc dst)
+{
+    if (MoveFileExA(
+            ospathc_cstr(src), ospathc_cstr(dst), MOVEFILE_REPLACE_EXISTING)
+        == 0)
+    {
+        log_util_err(
+            "Failed to rename file {quote:%s} to {quote:%s}: {win32error}\n",
+            ospathc_cstr(src),
+            ospathc_cstr(dst));
+        return -1;
+    }
+
+    return 0;
+}
+
 int
 fs_get_appdata_dir(struct ospath* path)
 {
@@ -263,3 +280,41 @@ stat_file_failed:
 open_file_failed:
     return 0;
 }
+
+int
+fs_touch(struct ospathc path)
+{
+    FILETIME now;
+    HANDLE   hFile = CreateFile(
+        ospathc_cstr(path),
+        FILE_WRITE_ATTRIBUTES,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        log_util_err(
+            "Failed to open file {quote:%s}: {win32error}\n",
+            ospathc_cstr(path));
+        goto open_file_failed;
+    }
+
+    GetSystemTimeAsFileTime(&now);
+    if (SetFileTime(hFile, NULL, NULL, &now) == 0)
+    {
+        log_util_err(
+            "Failed to update modification time of {quote:%s}: {win32error}\n",
+            ospathc_cstr(path));
+        goto set_time_failed;
+    }
+
+    CloseHandle(hFile);
+    return 0;
+
+set_time_failed:
+    CloseHandle(hFile);
+open_file_failed:
+    return -1;
+}
@@ -2,6 +2,7 @@
 #include "odb-util/hash.h"
 #include "odb-util/log.h"
 #include <assert.h>
+#include <string.h>
 
 /* ------------------------------------------------------------------------- */
 hash32
@@ -20,6 +21,46 @@ hash32_jenkins_oaat(const void* key, int len)
     return hash;
 }
 
+/* ------------------------------------------------------------------------- */
+hash64
+hash64_murmur64a(const void* key, int len, hash64 seed)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int      r = 47;
+    const uint8_t* data = (const uint8_t*)key;
+    const uint8_t* end = data + (len & ~7);
+    hash64         hash = seed ^ ((uint64_t)len * m);
+
+    for (; data != end; data += 8)
+    {
+        uint64_t k;
+        memcpy(&k, data, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        hash ^= k;
+        hash *= m;
+    }
+
+    switch (len & 7)
+    {
+        case 7: hash ^= (uint64_t)data[6] << 48; /* fallthrough */
+        case 6: hash ^= (uint64_t)data[5] << 40; /* fallthrough */
+        case 5: hash ^= (uint64_t)data[4] << 32; /* fallthrough */
+        case 4: hash ^= (uint64_t)data[3] << 24; /* fallthrough */
+        case 3: hash ^= (uint64_t)data[2] << 16; /* fallthrough */
+        case 2: hash ^= (uint64_t)data[1] << 8;  /* fallthrough */
+        case 1:
+            hash ^= (uint64_t)data[0];
+            hash *= m;
+    }
+
+    hash ^= hash >> r;
+    hash *= m;
+    hash ^= hash >> r;
+    return hash;
+}
+
 /* ------------------------------------------------------------------------- */
 #if ODBUTIL_SIZEOF_VOID_P == 8
 hash32
@@ -82,6 +82,83 @@ open_failed:
     return -1;
 }
 
+int
+mfile_map_cow_padded(
+    struct mfile* mf, struct ospathc filepath, int padding, int log_error)
+{
+    struct stat stbuf;
+    int         fd, fits;
+    long        page_size;
+    const char* c_file_name = ospathc_cstr(filepath);
+
+    fd = open(c_file_name, O_RDONLY | O_LARGEFILE);
+    if (fd < 0)
+    {
+        if (log_error)
+            log_util_err(
+                "Failed to open() file {quote:%s}: %s\n",
+                c_file_name,
+                strerror(errno));
+        goto open_failed;
+    }
+
+    if (fstat(fd, &stbuf) != 0)
+    {
+        if (log_error)
+            log_util_err(
+                "Failed to fstat() file {quote:%s}: %s\n",
+                c_file_name,
+                strerror(errno));
+        goto fstat_failed;
+    }
+
+    if (!S_ISREG(stbuf.st_mode))
+    {
+        if (log_error)
+            log_util_err(
+                "Cannot map file {quote:%s}: File is not a regular file\n",
+                c_file_name);
+        goto fstat_failed;
+    }
+
+    /* The kernel zero-fills the remainder of the last page of a mapping that
+     * extends past EOF. Accessing any page that lies entirely past EOF causes
+     * SIGBUS, so the padding must fit into the last page of the file. */
+    page_size = sysconf(_SC_PAGESIZE);
+    fits = stbuf.st_size % page_size != 0
+           && stbuf.st_size % page_size + padding <= page_size;
+
+    mf->address = mmap(
+        NULL,
+        (size_t)(stbuf.st_size + (fits ? padding : 0)),
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_NORESERVE,
+        fd,
+        0);
+    if (mf->address == MAP_FAILED)
+    {
+        if (log_error)
+            log_util_err(
+                "Failed to mmap() file {quote:%s}: %s\n",
+                c_file_name,
+                strerror(errno));
+        goto mmap_failed;
+    }
+
+    /* file descriptor no longer required */
+    close(fd);
+
+    mem_track_allocation(mf->address);
+    mf->size = (int)stbuf.st_size;
+    return fits ? 0 : 1;
+
+mmap_failed:
+fstat_failed:
+    close(fd);
+open_failed:
+    return -1;
+}
+
 int
 mfile_map_overwrite(struct mfile* mf, int size, struct ospathc filepath)
 {
@@ -90,6 +90,98 @@ mfile_map_read(struct mfile* mf, struct ospathc filepath, int log_error)
     utf16_conv_failed          : return -1;
 }
 
+int
+mfile_map_cow_padded(struct mfile* mf, struct ospathc filepath, int padding, int log_error)
+{
+    HANDLE hFile;
+    LARGE_INTEGER liFileSize;
+    HANDLE hMapping;
+    SYSTEM_INFO sysInfo;
+    int fits;
+    struct utf16 utf16_filename = empty_utf16();
+
+    if (utf8_to_utf16(&utf16_filename, ospathc_view(filepath)) != 0)
+        goto utf16_conv_failed;
+
+    /* Try to open the file */
+    hFile = CreateFileW(
+        utf16_cstr(utf16_filename), /* File name */
+        GENERIC_READ,               /* Read only */
+        FILE_SHARE_READ,
+        NULL,                       /* Default security */
+        OPEN_EXISTING,              /* File must exist */
+        FILE_ATTRIBUTE_NORMAL,      /* Default attributes */
+            NULL);                      /* No attribute template */
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        if (log_error)
+            log_util_err(
+                "Failed to open file {quote:%s}: {win32error}\n",
+                ospathc_cstr(filepath));
+        goto open_failed;
+    }
+
+    /* Determine file size in bytes */
+    if (!GetFileSizeEx(hFile, &liFileSize))
+        goto get_file_size_failed;
+    if (liFileSize.QuadPart > (1ULL << 31) - 1)  /* mf->size is an int */
+    {
+        log_util_err(
+            "Failed to map file {quote:%s}: Mapping files >4GiB is not implemented\n",
+            ospathc_cstr(filepath));
+        goto get_file_size_failed;
+    }
+    mf->size = (int)liFileSize.LowPart;
+
+    /* The view of the file is rounded up to a whole page, and the remainder of
+     * the last page is filled with zeros. The padding must fit in there. */
+    GetSystemInfo(&sysInfo);
+    fits = mf->size % sysInfo.dwPageSize != 0
+        && mf->size % sysInfo.dwPageSize + padding <= sysInfo.dwPageSize;
+
+    hMapping = CreateFileMappingW(
+        hFile,                 /* File handle */
+        NULL,                  /* Default security attributes */
+        PAGE_WRITECOPY,        /* Copy-on-write */
+        0, mf->size,           /* High/Low size of mapping. Zero means entire file */
+        NULL);                 /* Don't name the mapping */
+    if (hMapping == NULL)
+    {
+        log_util_err(
+            "Failed to create file mapping for file {quote:%s}: {win32error}\n",
+            ospathc_cstr(filepath));
+        goto create_file_mapping_failed;
+    }
+
+    mf->address = MapViewOfFile(
+        hMapping,               /* File mapping handle */
+        FILE_MAP_COPY,          /* Copy-on-write */
+        0, 0,                   /* High/Low offset of where the mapping should begin in the file */
+        0);                     /* Length of mapping. Zero means entire file */
+    if (mf->address == NULL)
+    {
+        log_util_err(
+            "Failed to map view of file {quote:%s}: {win32error}\n",
+            ospathc_cstr(filepath));
+        goto map_view_failed;
+    }
+
+    mem_track_allocation(mf->address);
+
+    /* Don't need these anymore */
+    CloseHandle(hMapping);
+    CloseHandle(hFile);
+    utf16_deinit(utf16_filename);
+
+    return fits ? 0 : 1;
+
+    map_view_failed            :
+    create_file_mapping_failed : CloseHandle(hMapping);
+    get_file_size_failed       : CloseHandle(hFile);
+    open_failed                : utf16_deinit(utf16_filename);
+    utf16_conv_failed          : return -1;
+}
+
 int
 mfile_map_overwrite(struct mfile* mf, int size, struct ospathc filepath)
 {
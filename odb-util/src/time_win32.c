@@ -0,0 +1,15 @@
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include "odb-util/time.h"
+
+uint64_t
+time_get_us(void)
+{
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000
+           + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000
+                 / frequency.QuadPart;
+}
@@ -154,6 +154,20 @@ TEST_F(NAME, rehash_test)
     }
 }
 
+TEST_F(NAME, insert_and_erase_different_keys_fills_slots_with_tombstones)
+{
+    for (int i = 0; i != MIN_CAPACITY * 4; ++i)
+    {
+        uintptr_t key = i;
+        ASSERT_THAT(hm_test_insert_new(&hm, key, 1.5f), Eq(0));
+        ASSERT_THAT(hm_test_erase(hm, key), Pointee(1.5f)) << i;
+    }
+
+    EXPECT_THAT(hm_test_count(hm), Eq(0));
+    EXPECT_THAT(hm_test_capacity(hm), Eq(MIN_CAPACITY));
+    EXPECT_THAT(hm_test_find(hm, KEY1), IsNull());
+}
+
 TEST_F(NAME, foreach_empty)
 {
     uintptr_t key;
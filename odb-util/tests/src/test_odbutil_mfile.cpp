@@ -0,0 +1,65 @@
+extern "C" {
+#include "odb-util/mfile.h"
+}
+
+#include "gmock/gmock.h"
+#include <cstdio>
+
+#define NAME odbutil_mfile
+
+using namespace testing;
+
+struct NAME : public Test
+{
+    void
+    writeFile(int size)
+    {
+        FILE* fp = fopen(filename, "wb");
+        ASSERT_THAT(fp, NotNull());
+        for (int i = 0; i != size; ++i)
+            fputc('a', fp);
+        fclose(fp);
+    }
+
+    void
+    TearDown() override
+    {
+        remove(filename);
+    }
+
+    const char* filename = "odbutil_mfile_test.txt";
+};
+
+TEST_F(NAME, cow_padded_fits_into_last_page)
+{
+    writeFile(5);
+    struct mfile mf;
+    ASSERT_THAT(mfile_map_cow_padded(&mf, cstr_ospathc(filename), 2, 1), Eq(0));
+    EXPECT_THAT(mf.size, Eq(5));
+    EXPECT_THAT(((char*)mf.address)[5], Eq('\0'));
+    EXPECT_THAT(((char*)mf.address)[6], Eq('\0'));
+    mfile_unmap(&mf);
+}
+
+TEST_F(NAME, cow_padded_doesnt_fit_page_aligned_file)
+{
+    writeFile(65536); /* Multiple of all common page sizes */
+    struct mfile mf;
+    ASSERT_THAT(mfile_map_cow_padded(&mf, cstr_ospathc(filename), 2, 1), Eq(1));
+    EXPECT_THAT(mf.size, Eq(65536));
+    mfile_unmap(&mf);
+}
+
+TEST_F(NAME, cow_padded_writes_are_private)
+{
+    writeFile(5);
+    struct mfile mf;
+    ASSERT_THAT(
+        mfile_map_cow_padded(&mf, cstr_ospathc(filename), 2, 1), Ge(0));
+    ((char*)mf.address)[0] = 'b';
+    mfile_unmap(&mf);
+
+    ASSERT_THAT(mfile_map_read(&mf, cstr_ospathc(filename), 1), Eq(0));
+    EXPECT_THAT(((char*)mf.address)[0], Eq('a'));
+    mfile_unmap(&mf);
+}